@@ -0,0 +1,131 @@
+/**
+ * @file as-path-regex.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief matching AS_PATH with BgpAsPathRegex, and a throughput benchmark
+ * @version 0.1
+ * @date 2019-08-07
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-filter.h>
+#include <libbgp/bgp-as-path-regex.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <regex>
+#include <string>
+
+// This example demos how you can filter routes with AS_PATH regular
+// expressions, and compares the speed of BgpAsPathRegex with a character
+// based std::regex on the same paths.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const uint32_t tier1[] = { 174, 701, 1299, 2914, 3257, 3356, 6453, 6762 };
+
+// build a path that looks like one from a full table: a transit provider,
+// some more networks, and the origin, sometimes prepended, sometimes with an
+// AS_SET from aggregation.
+static std::vector<libbgp::BgpAsPathSegment> randomPath() {
+    std::vector<libbgp::BgpAsPathSegment> path;
+    libbgp::BgpAsPathSegment seq(true, libbgp::AS_SEQUENCE);
+
+    seq.value.push_back(tier1[rand() % 8]);
+    int middle = rand() % 4;
+    for (int i = 0; i < middle; i++) {
+        seq.value.push_back(rand() % 10 == 0 ? tier1[rand() % 8] : 1000 + rand() % 60000);
+    }
+
+    uint32_t origin = rand() % 20 == 0 ? 64512 + rand() % 1000 : 1000 + rand() % 400000;
+    int prepend = rand() % 10 == 0 ? 1 + rand() % 3 : 1;
+    for (int i = 0; i < prepend; i++) seq.value.push_back(origin);
+    path.push_back(seq);
+
+    if (rand() % 100 == 0) {
+        libbgp::BgpAsPathSegment set(true, libbgp::AS_SET);
+        set.value.push_back(1000 + rand() % 60000);
+        set.value.push_back(1000 + rand() % 60000);
+        path.push_back(set);
+    }
+
+    return path;
+}
+
+// the character based representation, for std::regex.
+static std::string pathToString(const std::vector<libbgp::BgpAsPathSegment> &path) {
+    std::string str;
+    for (const libbgp::BgpAsPathSegment &seg : path) {
+        if (seg.type == libbgp::AS_SET) {
+            str += "{} ";
+            continue;
+        }
+        for (uint32_t asn : seg.value) str += std::to_string(asn) + " ";
+    }
+    return str;
+}
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+
+    // each expression, and the character based expression doing the same.
+    const char *patterns[][2] = {
+        { "^174_", "^174 " },
+        { "_3356_", "(^| )3356 " },
+        { "^[0-9]+_[0-9]+$", "^[0-9]+ [0-9]+ $" },
+        { "[64512-65534]$", "(^| )(6451[2-9]|645[2-9][0-9]|64[6-9][0-9][0-9]|65[0-4][0-9][0-9]|655[0-2][0-9]|6553[0-4]) $" },
+        { "(174|701|1299|2914|3257|3356|6453|6762) . (174|701|1299|2914|3257|3356|6453|6762)",
+          "(^| )(174|701|1299|2914|3257|3356|6453|6762) [0-9]+ (174|701|1299|2914|3257|3356|6453|6762) " }
+    };
+
+    const size_t n_paths = 200000;
+    std::vector<std::vector<libbgp::BgpAsPathSegment>> paths;
+    for (size_t i = 0; i < n_paths; i++) paths.push_back(randomPath());
+
+    for (size_t p = 0; p < sizeof(patterns) / sizeof(patterns[0]); p++) {
+        libbgp::BgpAsPathRegex regex(&logger);
+        if (!regex.compile(patterns[p][0])) return 1;
+
+        size_t matched = 0;
+        double start = now();
+        for (const std::vector<libbgp::BgpAsPathSegment> &path : paths) matched += regex.match(path);
+        double dfa_time = now() - start;
+
+        // std::regex is much slower, only run it on part of the paths.
+        std::regex std_regex(patterns[p][1], std::regex::optimize);
+        size_t std_matched = 0, n_std = n_paths / 20;
+        start = now();
+        for (size_t i = 0; i < n_std; i++) std_matched += std::regex_search(pathToString(paths[i]), std_regex);
+        double std_time = (now() - start) * 20;
+
+        size_t dfa_matched_part = 0;
+        for (size_t i = 0; i < n_std; i++) dfa_matched_part += regex.match(paths[i]);
+
+        printf("%-24s %6zu matched, %3zu DFA states, %7.2f M paths/s, std::regex %5.2f M paths/s (%s)\n",
+            patterns[p][0], matched, regex.getStateCount(), n_paths / dfa_time / 1e6, n_paths / std_time / 1e6,
+            dfa_matched_part == std_matched ? "same result" : "different result");
+    }
+
+    // use the expression in a filter: reject routes with a private origin.
+    libbgp::BgpAsPathRegex private_origin(&logger);
+    if (!private_origin.compile("[64512-65534]$")) return 1;
+
+    libbgp::BgpFilterRules filter;
+    filter.append<libbgp::BgpFilterRuleAsPathRegex>(libbgp::BgpFilterRuleAsPathRegex(libbgp::REJECT, libbgp::M_REGEX_MATCH, private_origin));
+
+    libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(&logger, true);
+    as_path->prepend(64600);
+    as_path->prepend(174);
+
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attribs;
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(as_path));
+
+    libbgp::Prefix4 route ("192.0.2.0", 24);
+    printf("192.0.2.0/24 via 174 64600: %s\n", filter.apply(route, attribs) == libbgp::ACCEPT ? "accept" : "reject");
+
+    return 0;
+}
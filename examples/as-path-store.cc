@@ -0,0 +1,98 @@
+/**
+ * @file as-path-store.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief sharing AS paths of routes from many peers with the AS path store
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-as-path-store.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <set>
+
+// This example demos how you can share the AS paths of routes received from
+// many peers with BgpAsPathStore. A full table is received from two sessions
+// to each of a number of peer ASes, and the routes of each origin AS come in a
+// few updates (say, with different communities), each update with its own
+// AS_PATH attribute. The heap memory used to keep the AS_PATH attributes is
+// compared with and without the store. To have BgpFsm do this for received
+// routes, set BgpConfig::as_path_store.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static size_t heapUsed() {
+    return mallinfo2().uordblks;
+}
+
+static const uint32_t tier1[] = { 174, 701, 1299, 2914, 3257, 3356, 6453, 6762 };
+
+// the AS_PATH of the routes of an origin AS, as received from a peer: the peer,
+// a tier 1 picked by the peer, the upstream of the origin, and the origin.
+static libbgp::BgpPathAttribAsPath *makePath(libbgp::BgpLogHandler *logger, uint32_t peer, uint32_t origin) {
+    libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(logger, true);
+    as_path->prepend(origin);
+    as_path->prepend(10000 + origin % 2000);
+    as_path->prepend(tier1[(origin + peer) % 8]);
+    as_path->prepend(64512 + peer);
+    return as_path;
+}
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+
+    const uint32_t n_peers = 20, n_sessions = 2, n_origins = 10000, n_updates = 3;
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> table;
+    table.reserve(n_peers * n_sessions * n_origins * n_updates);
+
+    // without the store: every update comes with its own AS_PATH attribute.
+    size_t heap_start = heapUsed();
+    double start = now();
+    for (uint32_t peer = 0; peer < n_peers; peer++) {
+        for (uint32_t session = 0; session < n_sessions; session++) {
+            for (uint32_t origin = 0; origin < n_origins; origin++) {
+                for (uint32_t update = 0; update < n_updates; update++) {
+                    table.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(makePath(&logger, peer, 1000000 + origin)));
+                }
+            }
+        }
+    }
+    double plain_time = now() - start;
+    size_t plain_heap = heapUsed() - heap_start;
+    table.clear();
+
+    // with the store: the attributes are replaced with the interned ones.
+    libbgp::BgpAsPathStore store(&logger);
+
+    heap_start = heapUsed();
+    start = now();
+    for (uint32_t peer = 0; peer < n_peers; peer++) {
+        for (uint32_t session = 0; session < n_sessions; session++) {
+            for (uint32_t origin = 0; origin < n_origins; origin++) {
+                for (uint32_t update = 0; update < n_updates; update++) {
+                    std::shared_ptr<libbgp::BgpPathAttrib> received(makePath(&logger, peer, 1000000 + origin));
+                    table.push_back(store.internAttrib(received));
+                }
+            }
+        }
+    }
+    double store_time = now() - start;
+    size_t store_heap = heapUsed() - heap_start;
+
+    std::set<const libbgp::BgpPathAttrib *> distinct;
+    for (const std::shared_ptr<libbgp::BgpPathAttrib> &attrib : table) distinct.insert(attrib.get());
+
+    printf("%zu AS_PATH attributes from %u sessions.\n", table.size(), n_peers * n_sessions);
+    printf("without store: %zu KiB, %.3f s.\n", plain_heap / 1024, plain_time);
+    printf("with store: %zu KiB, %.3f s, %zu attribute objects.\n", store_heap / 1024, store_time, distinct.size());
+
+    return 0;
+}
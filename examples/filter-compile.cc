@@ -0,0 +1,218 @@
+/**
+ * @file filter-compile.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief checking and timing compiled filter rules sets
+ * @version 0.1
+ * @date 2019-08-02
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-filter.h>
+#include <libbgp/bgp-path-attrib.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// This example demos BgpFilterRules::compile(). A compiled rules set matches
+// routes with a BgpFilterMatcher instead of applying the rules one by one, and
+// must give the same results as the rules set it is compiled from. We check
+// that on random rules sets, routes and attributes, then time a large prefix
+// list with and without compiling.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// random IPv4 prefix. the values are picked from a small space so rules and
+// routes overlap often. some prefixes have host bits set.
+static libbgp::Prefix4 randomPrefix4() {
+    uint8_t length = rand() % 33;
+    uint32_t prefix = (rand() & 3) << 30 | (rand() & 3) << 22 | (rand() & 7) << 8 | (rand() & 3);
+    if (rand() % 8 != 0 && length < 32) prefix &= length == 0 ? 0 : ~0u << (32 - length);
+    return libbgp::Prefix4(htonl(prefix), length);
+}
+
+static libbgp::Prefix6 randomPrefix6() {
+    uint8_t length = rand() % 129;
+    uint8_t prefix[16];
+    memset(prefix, 0, 16);
+    prefix[0] = 0x20;
+    prefix[1] = rand() & 3;
+    prefix[5] = rand() & 3;
+    prefix[15] = rand() & 1;
+
+    if (rand() % 8 != 0) {
+        uint8_t masked[16];
+        libbgp::mask_ipv6(prefix, length, masked);
+        return libbgp::Prefix6(masked, length);
+    }
+
+    return libbgp::Prefix6(prefix, length);
+}
+
+static libbgp::BgpFilterOP randomOp() {
+    return rand() % 2 ? libbgp::ACCEPT : libbgp::REJECT;
+}
+
+static void randomRules(libbgp::BgpFilterRules &rules) {
+    int n_rules = rand() % 40;
+
+    for (int i = 0; i < n_rules; i++) {
+        switch (rand() % 6) {
+            case 0: rules.append<libbgp::BgpFilterRuleRoute4>(libbgp::BgpFilterRuleRoute4(randomOp(), (libbgp::BgpFilterRuleRouteMatchType) (rand() % 6), randomPrefix4())); break;
+            case 1: rules.append<libbgp::BgpFilterRuleRoute6>(libbgp::BgpFilterRuleRoute6(randomOp(), (libbgp::BgpFilterRuleRouteMatchType) (rand() % 6), randomPrefix6())); break;
+            case 2: rules.append<libbgp::BgpFilterRuleAsPath>(libbgp::BgpFilterRuleAsPath(randomOp(), (libbgp::BgpFilterRuleAsPathMatchType) (rand() % 4), rand() % 6)); break;
+            case 3: rules.append<libbgp::BgpFilterRuleCommunity>(libbgp::BgpFilterRuleCommunity(randomOp(), (libbgp::BgpFilterRuleCommunityMatchType) (rand() % 2), (uint32_t) (rand() % 5))); break;
+            case 4: rules.append<libbgp::BgpFilterRuleLargeCommunity>(libbgp::BgpFilterRuleLargeCommunity(randomOp(), (libbgp::BgpFilterRuleCommunityMatchType) (rand() % 2), rand() % 2, rand() % 2, rand() % 3)); break;
+            case 5: rules.append<libbgp::BgpFilterRuleExtCommunity>(libbgp::BgpFilterRuleExtCommunity(randomOp(), (libbgp::BgpFilterRuleCommunityMatchType) (rand() % 2), (uint64_t) (rand() % 3) << 48 | rand() % 3)); break;
+        }
+    }
+}
+
+static void randomAttribs(libbgp::BgpLogHandler *logger, std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> &attribs) {
+    if (rand() % 4 != 0) {
+        libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(logger, true);
+        int n_segs = rand() % 3;
+
+        for (int i = 0; i < n_segs; i++) {
+            libbgp::BgpAsPathSegment seg (true, rand() % 3 ? libbgp::AS_SEQUENCE : libbgp::AS_SET);
+            int length = 1 + rand() % 4;
+            for (int j = 0; j < length; j++) seg.value.push_back(rand() % 6);
+            as_path->as_paths.push_back(seg);
+        }
+
+        attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(as_path));
+    }
+
+    if (rand() % 2) {
+        libbgp::BgpPathAttribCommunity *community = new libbgp::BgpPathAttribCommunity(logger);
+        int n = rand() % 4;
+        for (int i = 0; i < n; i++) community->communites.push_back(htonl(rand() % 5));
+        attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(community));
+    }
+
+    if (rand() % 2) {
+        libbgp::BgpPathAttribLargeCommunity *community = new libbgp::BgpPathAttribLargeCommunity(logger);
+        int n = rand() % 4;
+
+        for (int i = 0; i < n; i++) {
+            libbgp::BgpLargeCommunity large;
+            large.global = rand() % 2;
+            large.local1 = rand() % 2;
+            large.local2 = rand() % 3;
+            community->large_communities.push_back(large);
+        }
+
+        attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(community));
+    }
+
+    if (rand() % 2) {
+        libbgp::BgpPathAttribExtCommunity *community = new libbgp::BgpPathAttribExtCommunity(logger);
+        int n = rand() % 4;
+        for (int i = 0; i < n; i++) community->ext_communities.push_back((uint64_t) (rand() % 3) << 48 | rand() % 3);
+        attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(community));
+    }
+}
+
+int main(int argc, char **argv) {
+    libbgp::BgpLogHandler logger;
+    logger.setLogLevel(libbgp::FATAL);
+
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+
+    // compare compiled and interpreted results, for single routes and for
+    // batches of routes sharing the same attributes.
+    size_t n_checks = 0;
+    size_t n_mismatches = 0;
+
+    for (int round = 0; round < 100; round++) {
+        libbgp::BgpFilterRules interpreted (randomOp());
+        randomRules(interpreted);
+
+        libbgp::BgpFilterRules compiled = interpreted;
+        compiled.compile();
+
+        for (int i = 0; i < 200; i++) {
+            std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attribs;
+            randomAttribs(&logger, attribs);
+
+            std::vector<libbgp::Prefix4> routes4;
+            std::vector<libbgp::Prefix6> routes6;
+            for (int j = 0; j < 8; j++) {
+                routes4.push_back(randomPrefix4());
+                routes6.push_back(randomPrefix6());
+            }
+
+            std::vector<bool> accepted4;
+            std::vector<bool> accepted6;
+            compiled.apply(routes4, attribs, accepted4);
+            compiled.apply(routes6, attribs, accepted6);
+
+            for (int j = 0; j < 8; j++) {
+                n_checks += 2;
+                bool expected4 = interpreted.apply(routes4[j], attribs) == libbgp::ACCEPT;
+                bool expected6 = interpreted.apply(routes6[j], attribs) == libbgp::ACCEPT;
+
+                if (accepted4[j] != expected4 || (compiled.apply(routes4[j], attribs) == libbgp::ACCEPT) != expected4) {
+                    n_mismatches++;
+                    char ip_str[INET_ADDRSTRLEN];
+                    uint32_t prefix = routes4[j].getPrefix();
+                    inet_ntop(AF_INET, &prefix, ip_str, INET_ADDRSTRLEN);
+                    printf("mismatch: %s/%d (round %d)\n", ip_str, routes4[j].getLength(), round);
+                }
+
+                if (accepted6[j] != expected6 || (compiled.apply(routes6[j], attribs) == libbgp::ACCEPT) != expected6) {
+                    n_mismatches++;
+                    char ip_str[INET6_ADDRSTRLEN];
+                    uint8_t prefix[16];
+                    routes6[j].getPrefix(prefix);
+                    inet_ntop(AF_INET6, prefix, ip_str, INET6_ADDRSTRLEN);
+                    printf("mismatch: %s/%d (round %d)\n", ip_str, routes6[j].getLength(), round);
+                }
+            }
+        }
+    }
+
+    printf("%zu routes checked, %zu mismatches.\n", n_checks, n_mismatches);
+
+    // time a prefix list of 50k entries, like the ones generated from IRR
+    // data. half of the routes are in the list.
+    libbgp::BgpFilterRules prefix_list (libbgp::REJECT);
+    std::vector<libbgp::Prefix4> routes;
+
+    for (int i = 0; i < 50000; i++) {
+        libbgp::Prefix4 prefix (htonl((uint32_t) (rand() % 200 + 1) << 24 | (rand() & 0xffff) << 8), 24);
+        prefix_list.append<libbgp::BgpFilterRuleRoute4>(libbgp::BgpFilterRuleRoute4(libbgp::ACCEPT, rand() % 2 ? libbgp::M_EQ : libbgp::M_LE, prefix));
+        routes.push_back(prefix);
+    }
+
+    for (int i = 0; i < 50000; i++) {
+        routes.push_back(libbgp::Prefix4(htonl((uint32_t) (rand() % 200 + 1) << 24 | (rand() & 0xffff) << 8), 24));
+    }
+
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> no_attribs;
+    libbgp::BgpFilterRules compiled_list = prefix_list;
+
+    double start = now();
+    compiled_list.compile();
+    double compile_time = now() - start;
+
+    start = now();
+    for (const libbgp::Prefix4 &route : routes) compiled_list.apply(route, no_attribs);
+    double compiled_time = now() - start;
+
+    // the interpreted list is slow: time one in every 50 routes and scale.
+    start = now();
+    for (size_t i = 0; i < routes.size(); i += 50) prefix_list.apply(routes[i], no_attribs);
+    double interpreted_time = (now() - start) * 50;
+
+    printf("50000 rules: compiled in %.1f ms.\n", compile_time * 1e3);
+    printf("%zu routes: %.1f ms compiled, about %.0f ms interpreted.\n", routes.size(), compiled_time * 1e3, interpreted_time * 1e3);
+
+    return n_mismatches == 0 ? 0 : 1;
+}
@@ -0,0 +1,102 @@
+/**
+ * @file nexthop-tracking.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief re-evaluating routes when a nexthop becomes unreachable
+ * @version 0.1
+ * @date 2019-08-11
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include <libbgp/bgp-rib4.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <time.h>
+
+// This example demos how routes are re-evaluated when the IGP reports a nexthop
+// as unreachable. Two peers send the same full-table-like set of routes: the
+// first one with a single nexthop, the second one, with shorter AS paths, with
+// routes spread over a number of nexthops. When one nexthop of the second peer
+// goes down, only the routes using it fall back to the first peer; when it comes
+// back, they are selected again. With a RouteEventBus, setNexthopReachable()
+// also publishes the changes, so the FSMs send them to their peers.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> makeAttribs(libbgp::BgpLogHandler *logger, uint32_t nexthop, uint32_t peer_asn, size_t path_len) {
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attribs;
+
+    libbgp::BgpPathAttribOrigin *origin = new libbgp::BgpPathAttribOrigin(logger);
+    origin->origin = libbgp::IGP;
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(origin));
+
+    libbgp::BgpPathAttribNexthop *nh = new libbgp::BgpPathAttribNexthop(logger);
+    nh->next_hop = nexthop;
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(nh));
+
+    libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(logger, true);
+    for (size_t i = 0; i < path_len; i++) as_path->prepend(64512 + i);
+    as_path->prepend(peer_asn);
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(as_path));
+
+    return attribs;
+}
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+    logger.setLogLevel(libbgp::WARN);
+
+    const size_t n_routes = 500000, n_nexthops = 16;
+    libbgp::BgpRib4 rib(&logger);
+
+    // the routes come in updates of 1000 routes each, the second peer uses a
+    // different nexthop for each update.
+    for (size_t i = 0; i < n_routes; i += 1000) {
+        std::vector<libbgp::Prefix4> update;
+        for (size_t j = i; j < i + 1000; j++) update.push_back(libbgp::Prefix4(htonl(0x01000000 + (j << 8)), 24));
+
+        uint32_t nexthop = htonl(0xc0000210 + (i / 1000) % n_nexthops);
+        rib.insert(inet_addr("10.0.0.1"), update, makeAttribs(&logger, inet_addr("192.0.2.1"), 65001, 4), 0, 0);
+        rib.insert(inet_addr("10.0.0.2"), update, makeAttribs(&logger, nexthop, 65002, 2), 0, 0);
+    }
+
+    uint32_t down = inet_addr("192.0.2.16");
+    std::vector<libbgp::Prefix4> unreach;
+    std::vector<const libbgp::BgpRib4Entry*> updated;
+
+    // the first unreachable nexthop builds the index of the nexthops.
+    double start = now();
+    rib.setNexthopReachable(down, false, unreach, updated);
+    double first_time = now() - start;
+
+    printf("192.0.2.16 down: %zu routes updated, %zu unreachable in %.3f s. (index built)\n", updated.size(), unreach.size(), first_time);
+    printf("1.0.0.0/24 is now from %s.\n", rib.lookup(htonl(0x01000001))->src_router_id == inet_addr("10.0.0.1") ? "10.0.0.1" : "10.0.0.2");
+
+    unreach.clear();
+    updated.clear();
+    start = now();
+    rib.setNexthopReachable(down, true, unreach, updated);
+    double up_time = now() - start;
+
+    printf("192.0.2.16 up: %zu routes updated, %zu unreachable in %.3f s.\n", updated.size(), unreach.size(), up_time);
+
+    // all nexthops of the first peer down: its routes have no other route.
+    unreach.clear();
+    updated.clear();
+    rib.setNexthopReachable(inet_addr("192.0.2.1"), false, unreach, updated);
+    printf("192.0.2.1 down: %zu routes updated, %zu unreachable.\n", updated.size(), unreach.size());
+
+    unreach.clear();
+    updated.clear();
+    start = now();
+    rib.setNexthopReachable(down, false, unreach, updated);
+    double down_time = now() - start;
+
+    printf("192.0.2.16 down again: %zu routes updated, %zu unreachable in %.3f s.\n", updated.size(), unreach.size(), down_time);
+
+    return 0;
+}
@@ -0,0 +1,121 @@
+/**
+ * @file opaque-attrib.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief passing unknow attributes through without copying them
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-update-message.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <time.h>
+
+// This example demos how attributes not known to libbgp are passed through.
+// The value of such an attribute is kept in a refcounted BgpByteSlice: it is
+// copied once when the message is parsed, and then shared by clones of the
+// attribute, like the ones in the RIB and in the messages sent to other peers.
+// Passing the attributes of a received update to many peers is timed with
+// cloning, which shares the values, and with creating new attributes from the
+// values, which copies them.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+
+    // a received update with two unknow optional transitive attributes: a
+    // small one, and a large one with extended length.
+    uint8_t small_value[4] = { 0x00, 0x00, 0xfd, 0xe8 };
+    uint8_t large_value[600];
+    for (size_t i = 0; i < sizeof(large_value); i++) large_value[i] = i;
+
+    libbgp::BgpPathAttrib small(&logger, small_value, sizeof(small_value));
+    small.optional = small.transitive = true;
+    small.type_code = 35;
+
+    libbgp::BgpPathAttrib large(&logger, large_value, sizeof(large_value));
+    large.optional = large.transitive = large.extended = true;
+    large.type_code = 99;
+
+    libbgp::BgpPathAttribOrigin origin(&logger);
+    origin.origin = libbgp::IGP;
+
+    libbgp::BgpPathAttribAsPath as_path(&logger, true);
+    as_path.prepend(65000);
+
+    libbgp::BgpUpdateMessage built(&logger, true);
+    built.addAttrib(origin);
+    built.addAttrib(as_path);
+    built.setNextHop(inet_addr("192.0.2.1"));
+    built.addAttrib(small);
+    built.addAttrib(large);
+    built.nlri.push_back(libbgp::Prefix4("198.51.100.0", 24));
+
+    uint8_t buffer[4096];
+    ssize_t len = built.write(buffer, sizeof(buffer));
+
+    libbgp::BgpUpdateMessage received(&logger, true);
+    if (len < 0 || received.parse(buffer, len) < 0) {
+        fprintf(stderr, "failed to build and parse the update.\n");
+        return 1;
+    }
+
+    // send the attributes to a number of peers, like a route server does.
+    const size_t n_peers = 200000;
+    uint8_t out[4096];
+    size_t written = 0;
+
+    double start = now();
+    for (size_t i = 0; i < n_peers; i++) {
+        libbgp::BgpUpdateMessage update(&logger, true);
+        update.setAttribs(received.path_attribute);
+        update.nlri = received.nlri;
+        written += update.write(out, sizeof(out));
+    }
+    double shared_time = now() - start;
+
+    start = now();
+    for (size_t i = 0; i < n_peers; i++) {
+        libbgp::BgpUpdateMessage update(&logger, true);
+        for (const std::shared_ptr<libbgp::BgpPathAttrib> &attrib : received.path_attribute) {
+            const libbgp::BgpByteSlice &value = attrib->getOpaqueValue();
+            if (value.empty()) {
+                update.addAttrib(*attrib);
+                continue;
+            }
+
+            libbgp::BgpPathAttrib copied(&logger, value.getData(), value.getLength());
+            copied.optional = attrib->optional;
+            copied.transitive = attrib->transitive;
+            copied.partial = attrib->partial;
+            copied.extended = attrib->extended;
+            copied.type_code = attrib->type_code;
+            update.addAttrib(copied);
+        }
+        update.nlri = received.nlri;
+        written += update.write(out, sizeof(out));
+    }
+    double copied_time = now() - start;
+
+    printf("passed %zu bytes of updates to %zu peers twice.\n", written, n_peers);
+    printf("sharing the values: %.3f s, copying the values: %.3f s.\n", shared_time, copied_time);
+
+    // the value is the same buffer in the parsed message and in the clones.
+    libbgp::BgpUpdateMessage passed(&logger, true);
+    passed.setAttribs(received.path_attribute);
+    const libbgp::BgpPathAttrib &received_large = received.getAttrib(99);
+    const libbgp::BgpPathAttrib &passed_large = passed.getAttrib(99);
+
+    printf("type 99: %zu bytes, %s, %s.\n", passed_large.getOpaqueValue().getLength(),
+        passed_large.getOpaqueValue() == libbgp::BgpByteSlice(large_value, sizeof(large_value)) ? "value intact" : "value changed",
+        passed_large.getOpaqueValue().sharesBuffer(received_large.getOpaqueValue()) ? "shared with the received message" : "copied");
+
+    return 0;
+}
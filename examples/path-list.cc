@@ -0,0 +1,111 @@
+/**
+ * @file path-list.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief switching routes of a failed peer to backup paths with path lists
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-rib4.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <time.h>
+#include <set>
+
+// This example demos prefix independent convergence with shared path lists.
+// Two peers send the same full-table-like set of routes, and the peer with
+// shorter AS paths goes down. The forwarding table here keeps the path list of
+// every prefix, like a router programming its hardware with shared nexthop
+// groups. failover() switches all the path lists using the peer to their
+// backup paths at once; discard() then selects the best routes again, which
+// takes time linear to the number of routes.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> makeAttribs(libbgp::BgpLogHandler *logger, uint32_t nexthop, uint32_t peer_asn, size_t path_len) {
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attribs;
+
+    libbgp::BgpPathAttribOrigin *origin = new libbgp::BgpPathAttribOrigin(logger);
+    origin->origin = libbgp::IGP;
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(origin));
+
+    libbgp::BgpPathAttribNexthop *nh = new libbgp::BgpPathAttribNexthop(logger);
+    nh->next_hop = nexthop;
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(nh));
+
+    libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(logger, true);
+    for (size_t i = 0; i < path_len; i++) as_path->prepend(64512 + i);
+    as_path->prepend(peer_asn);
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(as_path));
+
+    return attribs;
+}
+
+// count prefixes forwarded to the given nexthop, and prefixes with no path up.
+static void countForwarding(const std::vector<std::shared_ptr<const libbgp::BgpPathList4>> &fib, uint32_t nexthop, size_t &to_nexthop, size_t &dropped) {
+    to_nexthop = dropped = 0;
+    for (const std::shared_ptr<const libbgp::BgpPathList4> &path_list : fib) {
+        const libbgp::BgpPath4 *path = path_list->getActive();
+        if (path == NULL) dropped++;
+        else if (path->nexthop == nexthop) to_nexthop++;
+    }
+}
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+    logger.setLogLevel(libbgp::WARN);
+
+    const size_t n_routes = 500000;
+    libbgp::BgpRib4 rib(&logger);
+    rib.setPathLists(true);
+
+    std::vector<libbgp::Prefix4> routes;
+    for (size_t i = 0; i < n_routes; i++) routes.push_back(libbgp::Prefix4(htonl(0x01000000 + (i << 8)), 24));
+
+    // the routes come in updates of 1000 routes each.
+    for (size_t i = 0; i < n_routes; i += 1000) {
+        std::vector<libbgp::Prefix4> update(routes.begin() + i, routes.begin() + i + 1000);
+        rib.insert(inet_addr("10.0.0.1"), update, makeAttribs(&logger, inet_addr("192.0.2.1"), 65001, 4), 0, 0);
+        rib.insert(inet_addr("10.0.0.2"), update, makeAttribs(&logger, inet_addr("192.0.2.2"), 65002, 2), 0, 0);
+    }
+
+    // the forwarding table: path list of every prefix.
+    std::vector<std::shared_ptr<const libbgp::BgpPathList4>> fib;
+    std::set<const libbgp::BgpPathList4*> distinct;
+    fib.reserve(n_routes);
+    for (const std::pair<const libbgp::BgpRib4EntryKey, libbgp::BgpRib4Entry> &kv : rib.get()) {
+        if (kv.second.status != libbgp::RS_ACTIVE) continue;
+        fib.push_back(kv.second.path_list);
+        distinct.insert(kv.second.path_list.get());
+    }
+
+    size_t to_backup, dropped;
+    countForwarding(fib, inet_addr("192.0.2.1"), to_backup, dropped);
+    printf("%zu prefixes share %zu path lists, %zu forwarded to backup 192.0.2.1.\n", fib.size(), distinct.size(), to_backup);
+
+    // peer 10.0.0.2 goes down.
+    double start = now();
+    rib.failover(inet_addr("10.0.0.2"));
+    double failover_time = now() - start;
+
+    countForwarding(fib, inet_addr("192.0.2.1"), to_backup, dropped);
+    printf("failover: %zu forwarded to backup 192.0.2.1, %zu dropped in %.6f s.\n", to_backup, dropped, failover_time);
+
+    // the routes are then selected again.
+    std::vector<libbgp::Prefix4> unreach;
+    std::vector<const libbgp::BgpRib4Entry*> replacements;
+    start = now();
+    rib.discard(inet_addr("10.0.0.2"), unreach, replacements);
+    double discard_time = now() - start;
+
+    printf("discard: %zu routes replaced, %zu unreachable in %.3f s.\n", replacements.size(), unreach.size(), discard_time);
+    printf("1.0.0.0/24 now has %zu path(s).\n", rib.lookup(inet_addr("10.0.0.1"), htonl(0x01000001))->path_list->getPaths().size());
+
+    return 0;
+}
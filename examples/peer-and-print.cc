@@ -146,10 +146,10 @@ int main(void) {
     running = true;
     std::thread ticker_thread(ticker, std::ref(fsm));
 
-    uint8_t *read_buffer = (uint8_t *) malloc(65536);
-
     while (true) {
-        ssize_t read_ret = read(fd_conn, read_buffer, 65536);
+        // read directly into the input buffer of the FSM. (you may also read 
+        // into your own buffer and pass it to fsm.run())
+        ssize_t read_ret = read(fd_conn, fsm.acquireInput(65536), 65536);
 
         if (read_ret < 0) {
             fprintf(stderr, "read(): %s.\n", strerror(errno));
@@ -161,8 +161,8 @@ int main(void) {
             break;
         }
 
-        // pass the message to fsm
-        int fsm_ret = fsm.run(read_buffer, (size_t) read_ret); 
+        // let the fsm process what we have read
+        int fsm_ret = fsm.commitInput((size_t) read_ret); 
 
         // ret 0: fatal error/reset by peer.
         // ret 2: notification sent to peer
@@ -179,7 +179,6 @@ int main(void) {
     
     fsm.stop();
     fprintf(stderr, "closing socket & clean up...\n");
-    free(read_buffer);
     close(fd_conn);
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,96 @@
+/**
+ * @file peer-drop.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief re-evaluating routes of a dropped peer with multiple threads
+ * @version 0.1
+ * @date 2019-08-11
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include <libbgp/bgp-rib4.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <time.h>
+#include <thread>
+
+// This example demos how the routes of a peer are dropped when the session goes
+// down. Two peers send the same full-table-like set of routes, and the peer
+// with shorter AS paths goes down. Every dropped route needs a new best route,
+// which is looked up by discard(). The lookups can be done by multiple threads
+// with setDiscardWorkers(). The drop is timed with one worker and with one
+// worker per CPU, and the results are compared.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> makeAttribs(libbgp::BgpLogHandler *logger, uint32_t nexthop, uint32_t peer_asn, size_t path_len) {
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attribs;
+
+    libbgp::BgpPathAttribOrigin *origin = new libbgp::BgpPathAttribOrigin(logger);
+    origin->origin = libbgp::IGP;
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(origin));
+
+    libbgp::BgpPathAttribNexthop *nh = new libbgp::BgpPathAttribNexthop(logger);
+    nh->next_hop = nexthop;
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(nh));
+
+    libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(logger, true);
+    for (size_t i = 0; i < path_len; i++) as_path->prepend(64512 + i);
+    as_path->prepend(peer_asn);
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(as_path));
+
+    return attribs;
+}
+
+static void loadRoutes(libbgp::BgpLogHandler *logger, libbgp::BgpRib4 &rib, const std::vector<libbgp::Prefix4> &routes) {
+    // the routes come in updates of 1000 routes each.
+    for (size_t i = 0; i < routes.size(); i += 1000) {
+        std::vector<libbgp::Prefix4> update(routes.begin() + i, routes.begin() + std::min(routes.size(), i + 1000));
+        rib.insert(inet_addr("10.0.0.1"), update, makeAttribs(logger, inet_addr("192.0.2.1"), 65001, 4), 0, 0);
+        rib.insert(inet_addr("10.0.0.2"), update, makeAttribs(logger, inet_addr("192.0.2.2"), 65002, 2), 0, 0);
+    }
+}
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+    logger.setLogLevel(libbgp::WARN);
+
+    const size_t n_routes = 500000;
+    std::vector<libbgp::Prefix4> routes;
+    for (size_t i = 0; i < n_routes; i++) {
+        routes.push_back(libbgp::Prefix4(htonl(0x01000000 + (i << 8)), 24));
+    }
+
+    libbgp::BgpRib4 serial(&logger);
+    libbgp::BgpRib4 parallel(&logger);
+    loadRoutes(&logger, serial, routes);
+    loadRoutes(&logger, parallel, routes);
+
+    // 0: one worker per CPU.
+    parallel.setDiscardWorkers(0);
+
+    std::vector<libbgp::Prefix4> serial_dropped, parallel_dropped;
+    std::vector<const libbgp::BgpRib4Entry*> serial_replaced, parallel_replaced;
+
+    double start = now();
+    serial.discard(inet_addr("10.0.0.2"), serial_dropped, serial_replaced);
+    double serial_time = now() - start;
+
+    start = now();
+    parallel.discard(inet_addr("10.0.0.2"), parallel_dropped, parallel_replaced);
+    double parallel_time = now() - start;
+
+    bool same = serial_dropped.size() == parallel_dropped.size() && serial_replaced.size() == parallel_replaced.size();
+    for (size_t i = 0; same && i < serial_replaced.size(); i++) {
+        same = serial_replaced[i]->route == parallel_replaced[i]->route && serial_replaced[i]->src_router_id == parallel_replaced[i]->src_router_id;
+    }
+
+    printf("dropped peer with %zu routes: %zu replaced, %zu unreachable.\n", n_routes, serial_replaced.size(), serial_dropped.size());
+    printf("1 worker: %.3f s, %u workers: %.3f s, results %s.\n", serial_time, std::thread::hardware_concurrency(), parallel_time, same ? "identical" : "different");
+
+    return 0;
+}
@@ -0,0 +1,73 @@
+/**
+ * @file prefix-set.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief filtering routes with large, shared prefix sets
+ * @version 0.1
+ * @date 2019-08-06
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-filter.h>
+#include <libbgp/prefix-set.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+
+// This example demos how you can use PrefixSet4 to filter routes with large
+// prefix lists (e.g., ones generated from IRR data). A prefix set holds the
+// whole list in a compact trie, and is shared by all filters using it.
+
+static const char* result(libbgp::BgpFilterOP op) {
+    return op == libbgp::ACCEPT ? "accept" : "reject";
+}
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+
+    // write a prefix list file. One entry per line, in the form of
+    // "prefix/length [ge n] [le n]".
+    const char *filename = "/tmp/prefix-set-example.txt";
+    FILE *file = fopen(filename, "w");
+    if (file == NULL) {
+        fprintf(stderr, "failed to create %s.\n", filename);
+        return 1;
+    }
+    fprintf(file, "# AS-EXAMPLE\n");
+    fprintf(file, "192.0.2.0/24\n");
+    fprintf(file, "198.51.100.0/22 le 24\n");
+    fclose(file);
+
+    libbgp::PrefixSet4 customer_routes(&logger);
+    if (!customer_routes.load(filename)) return 1;
+
+    // the same set can be used by the filters of many sessions. Only one copy
+    // of the set is kept in memory.
+    libbgp::BgpFilterRules session_a_filter(libbgp::REJECT);
+    libbgp::BgpFilterRules session_b_filter(libbgp::REJECT);
+    session_a_filter.append<libbgp::BgpFilterRulePrefixSet4>(libbgp::BgpFilterRulePrefixSet4(libbgp::ACCEPT, libbgp::M_IN_SET, customer_routes));
+    session_b_filter.append<libbgp::BgpFilterRulePrefixSet4>(libbgp::BgpFilterRulePrefixSet4(libbgp::ACCEPT, libbgp::M_IN_SET, customer_routes));
+
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attribs;
+    libbgp::Prefix4 route_a ("198.51.101.0", 24);
+    libbgp::Prefix4 route_b ("203.0.113.0", 24);
+
+    printf("%zu entries loaded.\n", customer_routes.size());
+    printf("session A: 198.51.101.0/24: %s, 203.0.113.0/24: %s\n", result(session_a_filter.apply(route_a, attribs)), result(session_a_filter.apply(route_b, attribs)));
+
+    // when the IRR data refreshes, load the new entries. The new set is built
+    // aside and swapped in for all filters at once.
+    std::vector<libbgp::PrefixSetEntry4> entries;
+    libbgp::PrefixSetEntry4 entry;
+    inet_pton(AF_INET, "203.0.113.0", &entry.prefix);
+    entry.length = 24;
+    entry.ge = 24;
+    entry.le = 24;
+    entries.push_back(entry);
+
+    if (!customer_routes.load(entries)) return 1;
+
+    printf("%zu entries loaded.\n", customer_routes.size());
+    printf("session B: 198.51.101.0/24: %s, 203.0.113.0/24: %s\n", result(session_b_filter.apply(route_a, attribs)), result(session_b_filter.apply(route_b, attribs)));
+
+    return 0;
+}
@@ -0,0 +1,83 @@
+/**
+ * @file prefix-value.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief storing large number of prefixes as plain prefix values
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/prefix4.h>
+#include <libbgp/prefix6.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <time.h>
+
+// This example demos how you can store prefixes as Prefix4Value and
+// Prefix6Value, the plain value versions of Prefix4 and Prefix6. A million
+// prefixes are parsed from NLRI into both types, and the memory used and the
+// time spent are compared.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// prefix values can be built at compile time.
+static constexpr libbgp::Prefix6Value documentation6 (0x20010db800000000ULL, 0, 32);
+
+int main(void) {
+    const size_t n_routes = 1000000;
+
+    // a million /24s, and a million /48s (one in 16 in 2001:db8::/32), as NLRI.
+    std::vector<libbgp::Prefix4Value> routes4;
+    std::vector<libbgp::Prefix6Value> routes6;
+    for (size_t i = 0; i < n_routes; i++) {
+        routes4.push_back(libbgp::Prefix4Value(htonl((uint32_t) i << 8), 24));
+        uint64_t high = i % 16 == 0 ? 0x20010db800000000ULL | ((uint64_t) (i / 16) << 16) : 0x2a00000000000000ULL | ((uint64_t) i << 16);
+        routes6.push_back(libbgp::Prefix6Value(high, 0, 48));
+    }
+
+    std::vector<uint8_t> nlri4(n_routes * 4), nlri6(n_routes * 7);
+    libbgp::Prefix4::WriteList(routes4, nlri4.data(), nlri4.size());
+    libbgp::Prefix6::WriteList(routes6, nlri6.data(), nlri6.size());
+
+    // parse into prefix objects and into prefix values.
+    std::vector<libbgp::Prefix4> objects4;
+    std::vector<libbgp::Prefix6> objects6;
+    std::vector<libbgp::Prefix4Value> values4;
+    std::vector<libbgp::Prefix6Value> values6;
+
+    double start = now();
+    libbgp::Prefix4::ParseList(nlri4.data(), nlri4.size(), objects4);
+    libbgp::Prefix6::ParseList(nlri6.data(), nlri6.size(), objects6);
+    double object_time = now() - start;
+
+    start = now();
+    libbgp::Prefix4::ParseList(nlri4.data(), nlri4.size(), values4);
+    libbgp::Prefix6::ParseList(nlri6.data(), nlri6.size(), values6);
+    double value_time = now() - start;
+
+    printf("%zu IPv4 prefixes: %zu KiB as Prefix4, %zu KiB as Prefix4Value.\n", values4.size(),
+        objects4.size() * sizeof(libbgp::Prefix4) / 1024, values4.size() * sizeof(libbgp::Prefix4Value) / 1024);
+    printf("%zu IPv6 prefixes: %zu KiB as Prefix6, %zu KiB as Prefix6Value.\n", values6.size(),
+        objects6.size() * sizeof(libbgp::Prefix6) / 1024, values6.size() * sizeof(libbgp::Prefix6Value) / 1024);
+    printf("parsed in %.3f s as objects, %.3f s as values.\n", object_time, value_time);
+
+    // values convert back to objects when an API wants one.
+    size_t n_documentation = 0;
+    libbgp::Prefix6 documentation (documentation6);
+    for (const libbgp::Prefix6Value &value : values6) {
+        if (documentation6.includes(value)) n_documentation++;
+    }
+
+    uint8_t prefix[16];
+    char prefix_str[INET6_ADDRSTRLEN];
+    documentation.getPrefix(prefix);
+    inet_ntop(AF_INET6, prefix, prefix_str, INET6_ADDRSTRLEN);
+    printf("%zu prefixes in %s/%d.\n", n_documentation, prefix_str, documentation.getLength());
+
+    return 0;
+}
@@ -0,0 +1,104 @@
+/**
+ * @file prefix6-includes.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief testing IPv6 addresses against prefixes with 64 bits words and batch include tests
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/prefix6.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// This example demos the different ways to test if IPv6 addresses are in a
+// prefix: Prefix6::Includes, Prefix6Words::includes, and
+// Prefix6::IncludesBatch. They are benchmarked against a byte-by-byte include
+// test, which is how Prefix6::Includes used to work.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// byte-by-byte include test: mask the address one byte at a time, then
+// compare with memcmp.
+static bool includesBytewise(const uint8_t prefix[16], uint8_t length, const uint8_t address[16]) {
+    uint8_t mask[16], masked_address[16];
+    if (!libbgp::cidr_to_mask6(length, mask)) return false;
+    for (int i = 0; i < 16; i++) masked_address[i] = address[i] & mask[i];
+    return memcmp(prefix, masked_address, 16) == 0;
+}
+
+int main(void) {
+    const size_t n_addresses = 1000000;
+    const size_t n_rounds = 20;
+
+    // a million addresses, a quarter of them in 2001:db8::/32, spread over
+    // the /48s of it.
+    uint8_t (*addresses)[16] = new uint8_t[n_addresses][16];
+    for (size_t i = 0; i < n_addresses; i++) {
+        for (int j = 0; j < 16; j++) addresses[i][j] = rand() & 0xff;
+        if (i % 4 == 0) inet_pton(AF_INET6, "2001:db8::", addresses[i]);
+    }
+
+    // test against 2001:db8::/32, 2001:db8:0:0::/64 and 2001:db8::/127.
+    const char *prefixes[] = { "2001:db8::", "2001:db8::", "2001:db8::" };
+    const uint8_t lengths[] = { 32, 64, 127 };
+    bool *results = new bool[n_addresses];
+
+    for (size_t p = 0; p < 3; p++) {
+        libbgp::Prefix6 prefix(prefixes[p], lengths[p]);
+        uint8_t prefix_arr[16];
+        prefix.getPrefix(prefix_arr);
+        libbgp::Prefix6Words prefix_words = prefix.toWords();
+
+        size_t n_bytewise = 0, n_includes = 0, n_words = 0, n_batch = 0;
+
+        double start = now();
+        for (size_t r = 0; r < n_rounds; r++) {
+            for (size_t i = 0; i < n_addresses; i++) n_bytewise += includesBytewise(prefix_arr, lengths[p], addresses[i]);
+        }
+        double bytewise_time = now() - start;
+
+        start = now();
+        for (size_t r = 0; r < n_rounds; r++) {
+            for (size_t i = 0; i < n_addresses; i++) n_includes += libbgp::Prefix6::Includes(prefix_arr, lengths[p], addresses[i]);
+        }
+        double includes_time = now() - start;
+
+        // Prefix6Words: addresses are loaded as words once, then tested.
+        libbgp::Prefix6Words *words = new libbgp::Prefix6Words[n_addresses];
+        for (size_t i = 0; i < n_addresses; i++) words[i] = libbgp::Prefix6Words(addresses[i], 128);
+
+        start = now();
+        for (size_t r = 0; r < n_rounds; r++) {
+            for (size_t i = 0; i < n_addresses; i++) n_words += prefix_words.includes(words[i].high, words[i].low);
+        }
+        double words_time = now() - start;
+        delete[] words;
+
+        start = now();
+        for (size_t r = 0; r < n_rounds; r++) {
+            n_batch += libbgp::Prefix6::IncludesBatch(prefix_arr, lengths[p], addresses, n_addresses, results);
+        }
+        double batch_time = now() - start;
+
+        double n_tests = n_rounds * n_addresses / 1e6;
+        printf("%s/%d: %zu/%zu/%zu/%zu included.\n", prefixes[p], lengths[p], n_bytewise / n_rounds, n_includes / n_rounds, n_words / n_rounds, n_batch / n_rounds);
+        printf("    byte-by-byte:  %.2f M tests/s\n", n_tests / bytewise_time);
+        printf("    Includes:      %.2f M tests/s\n", n_tests / includes_time);
+        printf("    Prefix6Words:  %.2f M tests/s\n", n_tests / words_time);
+        printf("    IncludesBatch: %.2f M tests/s\n", n_tests / batch_time);
+    }
+
+    delete[] results;
+    delete[] addresses;
+
+    return 0;
+}
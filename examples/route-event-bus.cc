@@ -39,8 +39,8 @@ protected:
             if (add_ev.new_routes) printRoutes("add", *(add_ev.new_routes));
             if (add_ev.replaced_entries) {
                 std::vector<libbgp::Prefix4> altered;
-                for (const libbgp::BgpRib4Entry &e : *(add_ev.replaced_entries)) {
-                    altered.push_back(e.route);
+                for (const libbgp::BgpRib4Entry *e : *(add_ev.replaced_entries)) {
+                    altered.push_back(e->route);
                 }
                 printRoutes("changed", *(add_ev.new_routes));
             }
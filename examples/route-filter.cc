@@ -84,6 +84,13 @@ int main(void) {
         libbgp::BgpFilterRuleRoute4(libbgp::REJECT, libbgp::M_NE, libbgp::Prefix4("172.17.0.0", 24))
     );
 
+    // optional: compile the rules sets once all rules are appended. Compiled
+    // rules sets give the same results, but look up the matching rule with a
+    // prefix trie and hash tables instead of trying every rule. This matters
+    // for large rules sets, like prefix lists generated from IRR.
+    egress_rules.compile();
+    ingress_rules.compile();
+
     /* configure our "local" BgpFsm */
     libbgp::BgpConfig local_bgp_config;
     PipedOutHandler pipe_local;
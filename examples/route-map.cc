@@ -0,0 +1,142 @@
+/**
+ * @file route-map.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief modifying routes with route-map actions, and counting the attribute objects created
+ * @version 0.1
+ * @date 2019-08-09
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-filter.h>
+#include <libbgp/bgp-filter-action.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <set>
+
+// This example demos how you can modify the path attributes of routes with
+// route-map actions attached to filter rules. A full table of routes is put
+// through a policy, and the number of attribute objects created by the policy
+// is compared with the number of routes.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static const uint32_t tier1[] = { 174, 701, 1299, 2914, 3257, 3356, 6453, 6762 };
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+
+    // the policy: prefer routes from 3356 and tag them, prepend routes from
+    // 174 twice, and drop the "blackhole" community. other routes get the
+    // default LOCAL_PREF.
+    libbgp::BgpFilterRules policy;
+
+    libbgp::BgpFilterRuleAsPath all(libbgp::ACCEPT, libbgp::M_NOT_HAS_ASN, 0);
+    all.actions = libbgp::BgpFilterActions(&logger);
+    all.actions.setLocalPref(100);
+    all.actions.removeCommunity(65535, 666);
+    policy.append<libbgp::BgpFilterRuleAsPath>(all);
+
+    libbgp::BgpFilterRuleAsPath from_174(libbgp::ACCEPT, libbgp::M_HAS_ASN, 174);
+    from_174.actions = libbgp::BgpFilterActions(&logger);
+    from_174.actions.setLocalPref(100);
+    from_174.actions.prepend(65000, 2);
+    policy.append<libbgp::BgpFilterRuleAsPath>(from_174);
+
+    libbgp::BgpFilterRuleAsPath from_3356(libbgp::ACCEPT, libbgp::M_HAS_ASN, 3356);
+    from_3356.actions = libbgp::BgpFilterActions(&logger);
+    from_3356.actions.setLocalPref(200);
+    from_3356.actions.addCommunity(65000, 100);
+    from_3356.actions.setWeight(10);
+    policy.append<libbgp::BgpFilterRuleAsPath>(from_3356);
+
+    policy.compile();
+
+    // a full table: 800k routes in 80k updates, each update with its own path
+    // attribute objects, like the ones received from a peer.
+    const size_t n_updates = 80000, n_per_update = 10;
+    std::vector<std::vector<std::shared_ptr<libbgp::BgpPathAttrib>>> attribs;
+    std::vector<std::vector<libbgp::Prefix4>> routes;
+
+    for (size_t i = 0; i < n_updates; i++) {
+        libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(&logger, true);
+        as_path->prepend(1000 + rand() % 60000);
+        as_path->prepend(tier1[rand() % 8]);
+
+        libbgp::BgpPathAttribCommunity *community = new libbgp::BgpPathAttribCommunity(&logger);
+        community->communites.push_back(htonl(0x00ae0000 | (rand() % 4)));
+        if (rand() % 50 == 0) community->communites.push_back(htonl(0xffff029a));
+
+        std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attrib;
+        attrib.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(as_path));
+        attrib.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(community));
+        attribs.push_back(attrib);
+
+        std::vector<libbgp::Prefix4> update;
+        for (size_t j = 0; j < n_per_update; j++) {
+            update.push_back(libbgp::Prefix4(htonl((uint32_t) (i * n_per_update + j) << 8), 24));
+        }
+        routes.push_back(update);
+    }
+
+    // run the policy, keep the results like a RIB would.
+    std::vector<std::shared_ptr<const libbgp::BgpFilterActionResult>> rib;
+    rib.reserve(n_updates * n_per_update);
+    size_t n_accepted = 0;
+
+    double start = now();
+    for (size_t i = 0; i < n_updates; i++) {
+        std::vector<bool> accepted;
+        std::vector<std::shared_ptr<const libbgp::BgpFilterActionResult>> results;
+        n_accepted += policy.apply(routes[i], attribs[i], accepted, results);
+        for (size_t j = 0; j < results.size(); j++) rib.push_back(results[j]);
+    }
+    double apply_time = now() - start;
+
+    // count the distinct attribute objects made by the policy.
+    std::set<const libbgp::BgpPathAttrib *> created, original;
+    for (const std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> &attrib : attribs) {
+        for (const std::shared_ptr<libbgp::BgpPathAttrib> &attr : attrib) original.insert(attr.get());
+    }
+
+    for (const std::shared_ptr<const libbgp::BgpFilterActionResult> &result : rib) {
+        if (!result) continue;
+        for (const std::shared_ptr<libbgp::BgpPathAttrib> &attr : result->attribs) {
+            if (original.count(attr.get()) == 0) created.insert(attr.get());
+        }
+    }
+
+    printf("applied the policy on %zu routes in %.3f s, %zu accepted.\n", n_updates * n_per_update, apply_time, n_accepted);
+    printf("%zu attribute objects created: %zu by the default rule, %zu by the 174 rule, %zu by the 3356 rule.\n", created.size(),
+        all.actions.getAttribCount(), from_174.actions.getAttribCount(), from_3356.actions.getAttribCount());
+
+    // what happened to a route from 3356.
+    libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(&logger, true);
+    as_path->prepend(64496);
+    as_path->prepend(3356);
+
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attrib;
+    attrib.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(as_path));
+
+    const libbgp::BgpFilterActions *actions;
+    libbgp::BgpFilterPrepared prepared = policy.prepare(attrib);
+    libbgp::Prefix4 route ("192.0.2.0", 24);
+
+    if (policy.apply(route, prepared, actions) == libbgp::ACCEPT && actions != NULL) {
+        std::shared_ptr<const libbgp::BgpFilterActionResult> result = actions->apply(attrib);
+        printf("192.0.2.0/24 via 3356 64496, weight %d:\n", result->weight);
+        for (const std::shared_ptr<libbgp::BgpPathAttrib> &attr : result->attribs) {
+            uint8_t buffer[4096];
+            attr->print(buffer, sizeof(buffer));
+            printf("%s", buffer);
+        }
+    }
+
+    return 0;
+}
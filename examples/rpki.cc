@@ -0,0 +1,142 @@
+/**
+ * @file rpki.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief RPKI route origin validation with BgpRoaTable, and a full table benchmark
+ * @version 0.1
+ * @date 2019-08-08
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-filter.h>
+#include <libbgp/bgp-roa-table.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// This example demos how you can validate routes with BgpRoaTable, reject
+// RPKI-invalid routes with BgpFilterRuleRpki, and find out the routes affected
+// by a VRP update. It also validates a full-table-sized set of routes against
+// a full-sized set of VRPs to show the speed.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static libbgp::BgpVrp makeVrp4(const char *prefix, uint8_t length, uint8_t max_length, uint32_t asn) {
+    libbgp::BgpVrp vrp;
+    memset(&vrp, 0, sizeof(vrp));
+    vrp.afi = libbgp::IPV4;
+    inet_pton(AF_INET, prefix, vrp.prefix);
+    vrp.length = length;
+    vrp.max_length = max_length;
+    vrp.asn = asn;
+    return vrp;
+}
+
+static const char *state_str[] = { "not found", "valid", "invalid" };
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+    logger.setLogLevel(libbgp::WARN);
+
+    // part 1: a full-sized table. VRPs are made on random /16 to /24, and the
+    // routes are made on random prefixes, most of them inside a VRP.
+    const size_t n_vrps = 400000, n_routes = 1000000;
+    std::vector<libbgp::BgpVrp> vrps;
+    vrps.reserve(n_vrps);
+
+    for (size_t i = 0; i < n_vrps; i++) {
+        libbgp::BgpVrp vrp;
+        memset(&vrp, 0, sizeof(vrp));
+        vrp.afi = libbgp::IPV4;
+        vrp.length = 16 + rand() % 9;
+        vrp.max_length = vrp.length + rand() % (25 - vrp.length);
+        vrp.asn = 1000 + rand() % 60000;
+        uint32_t prefix = htonl(((uint32_t) rand() << 1) & (0xffffffff << (32 - vrp.length)));
+        memcpy(vrp.prefix, &prefix, 4);
+        vrps.push_back(vrp);
+    }
+
+    std::vector<libbgp::Prefix4> routes;
+    std::vector<uint32_t> origins;
+    routes.reserve(n_routes);
+    origins.reserve(n_routes);
+
+    for (size_t i = 0; i < n_routes; i++) {
+        const libbgp::BgpVrp &vrp = vrps[rand() % n_vrps];
+        uint8_t length = vrp.length + rand() % (25 - vrp.length);
+        uint32_t prefix;
+        memcpy(&prefix, vrp.prefix, 4);
+        if (rand() % 5 == 0) prefix = (uint32_t) rand() << 1;
+        prefix = htonl(ntohl(prefix) & (0xffffffff << (32 - length)));
+        routes.push_back(libbgp::Prefix4(prefix, length));
+        origins.push_back(rand() % 4 == 0 ? 1000 + rand() % 60000 : vrp.asn);
+    }
+
+    libbgp::BgpRoaTable table(&logger);
+
+    double start = now();
+    if (!table.load(vrps)) return 1;
+    double load_time = now() - start;
+
+    size_t count[3] = { 0, 0, 0 };
+    start = now();
+    for (size_t i = 0; i < n_routes; i++) count[table.validate(routes[i], origins[i])]++;
+    double validate_time = now() - start;
+
+    printf("loaded %zu VRPs in %.3f s.\n", table.size(), load_time);
+    printf("validated %zu routes in %.3f s: %zu valid, %zu invalid, %zu not found.\n",
+        n_routes, validate_time, count[libbgp::RPKI_VALID], count[libbgp::RPKI_INVALID], count[libbgp::RPKI_NOT_FOUND]);
+
+    // part 2: filtering. reject RPKI-invalid routes.
+    libbgp::BgpRoaTable roas(&logger);
+    std::vector<libbgp::BgpVrp> small;
+    small.push_back(makeVrp4("192.0.2.0", 24, 24, 65001));
+    small.push_back(makeVrp4("198.51.100.0", 22, 24, 65002));
+    roas.load(small);
+
+    // routes with an empty AS_PATH are validated with the local ASN as the
+    // origin.
+    const uint32_t local_asn = 65000;
+    libbgp::BgpFilterRules filter;
+    filter.append<libbgp::BgpFilterRuleRpki>(libbgp::BgpFilterRuleRpki(libbgp::REJECT, libbgp::M_RPKI_INVALID, roas, local_asn));
+
+    libbgp::BgpPathAttribAsPath *as_path = new libbgp::BgpPathAttribAsPath(&logger, true);
+    as_path->prepend(65002);
+    as_path->prepend(174);
+
+    std::vector<std::shared_ptr<libbgp::BgpPathAttrib>> attribs;
+    attribs.push_back(std::shared_ptr<libbgp::BgpPathAttrib>(as_path));
+
+    const char *prefixes[] = { "198.51.100.0", "198.51.101.0", "198.51.102.0", "192.0.2.0", "203.0.113.0" };
+    for (const char *prefix : prefixes) {
+        libbgp::Prefix4 route (prefix, 24);
+        printf("%s/24 via 174 65002: %s, %s\n", prefix, state_str[roas.validate(route, attribs, local_asn)],
+            filter.apply(route, attribs) == libbgp::ACCEPT ? "accept" : "reject");
+    }
+
+    // part 3: a VRP update. the filter shares the VRPs with the table, and the
+    // changed prefixes tell which routes need to be validated again (e.g., with
+    // BgpFsm::revalidate).
+    std::vector<libbgp::BgpVrp> announced, withdrawn;
+    announced.push_back(makeVrp4("192.0.2.0", 24, 24, 65002));
+    withdrawn.push_back(makeVrp4("198.51.100.0", 22, 24, 65002));
+
+    libbgp::PrefixSet4 changed(&logger);
+    roas.update(announced, withdrawn, &changed);
+
+    printf("after update (%zu prefixes changed):\n", changed.size());
+    for (const char *prefix : prefixes) {
+        libbgp::Prefix4 route (prefix, 24);
+        printf("%s/24 via 174 65002: %s, %s, %s\n", prefix, state_str[roas.validate(route, attribs, local_asn)],
+            filter.apply(route, attribs) == libbgp::ACCEPT ? "accept" : "reject",
+            changed.includes(route) ? "changed" : "not changed");
+    }
+
+    return 0;
+}
@@ -0,0 +1,93 @@
+/**
+ * @file static-routes.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief loading a large set of static routes into RIB
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-rib4.h>
+#include <libbgp/bgp-rib6.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <time.h>
+
+// This example demos how you can load a large set of static routes into RIB as
+// local routes. The routes are inserted one by one, and with the bulk insert,
+// which takes a nexthop for each route. Local routes are indexed by prefix and
+// by nexthop, so both take time linear to the number of routes. Local routes
+// with the same nexthop share their path attributes.
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(void) {
+    libbgp::BgpLogHandler logger;
+    logger.setLogLevel(libbgp::WARN);
+
+    const size_t n_routes = 200000, n_nexthops = 16;
+
+    // static routes: /24s in 10.0.0.0/8 and 100.64.0.0/10, sorted, each to one
+    // of the nexthops.
+    std::vector<libbgp::Prefix4> routes;
+    std::vector<uint32_t> nexthops;
+    for (size_t i = 0; i < n_routes; i++) {
+        uint32_t prefix = i < 65536 ? 0x0a000000 + (i << 8) : 0x64400000 + ((i - 65536) << 8);
+        routes.push_back(libbgp::Prefix4(htonl(prefix), 24));
+        nexthops.push_back(htonl(0xc0000201 + (i * 7 % n_nexthops)));
+    }
+
+    libbgp::BgpRib4 one_by_one(&logger);
+    double start = now();
+    for (size_t i = 0; i < n_routes; i++) one_by_one.insert(&logger, routes[i], nexthops[i]);
+    double one_by_one_time = now() - start;
+
+    libbgp::BgpRib4 bulk(&logger);
+    start = now();
+    std::vector<libbgp::BgpRib4Entry> inserted = bulk.insert(&logger, routes, nexthops);
+    double bulk_time = now() - start;
+
+    printf("IPv4: %zu routes one by one in %.3f s, %zu routes in bulk in %.3f s.\n", one_by_one.get().size(), one_by_one_time, inserted.size(), bulk_time);
+
+    // routes already in RIB are skipped.
+    inserted = bulk.insert(&logger, routes, nexthops);
+    printf("IPv4: inserting again: %zu routes inserted.\n", inserted.size());
+
+    // the routes to a nexthop share one update ID and one set of attributes.
+    const libbgp::BgpRib4Entry *a = bulk.lookup(htonl(0x0a000001));
+    const libbgp::BgpRib4Entry *b = bulk.lookup(htonl(0x0a001001));
+    printf("IPv4: 10.0.0.0/24 and 10.0.16.0/24: update ID %lu and %lu, %s attributes.\n", a->update_id, b->update_id,
+        a->attribs[0] == b->attribs[0] ? "shared" : "different");
+
+    // the same for IPv6: /48s in 2001:db8::/32, with global and link local
+    // nexthops.
+    const size_t n_routes6 = 50000;
+    std::vector<libbgp::Prefix6> routes6;
+    uint8_t (*nexthops_global)[16] = new uint8_t[n_routes6][16];
+    uint8_t (*nexthops_linklocal)[16] = new uint8_t[n_routes6][16];
+    for (size_t i = 0; i < n_routes6; i++) {
+        uint8_t prefix[16] = { 0x20, 0x01, 0x0d, 0xb8, (uint8_t) (i >> 8), (uint8_t) i };
+        routes6.push_back(libbgp::Prefix6(prefix, 48));
+        inet_pton(AF_INET6, "2001:db8:ffff::1", nexthops_global[i]);
+        inet_pton(AF_INET6, "fe80::1", nexthops_linklocal[i]);
+        nexthops_global[i][15] += i % n_nexthops;
+        nexthops_linklocal[i][15] += i % n_nexthops;
+    }
+
+    libbgp::BgpRib6 rib6(&logger);
+    start = now();
+    std::vector<libbgp::BgpRib6Entry> inserted6 = rib6.insert(&logger, routes6, nexthops_global, nexthops_linklocal);
+    double bulk6_time = now() - start;
+
+    printf("IPv6: %zu routes in bulk in %.3f s.\n", inserted6.size(), bulk6_time);
+
+    delete[] nexthops_global;
+    delete[] nexthops_linklocal;
+
+    return 0;
+}
@@ -0,0 +1,129 @@
+/**
+ * @file update-scanner.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief scanning update messages with BgpUpdateScanner
+ * @version 0.1
+ * @date 2019-08-04
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <libbgp/bgp-packet.h>
+#include <libbgp/bgp-update-message.h>
+#include <libbgp/bgp-update-scanner.h>
+#include <arpa/inet.h>
+#include <stdio.h>
+#include <time.h>
+#include <vector>
+
+// a visitor that counts routes. override the handlers you are interested in.
+class Counter : public libbgp::BgpUpdateVisitor {
+public:
+    Counter() { nlri4 = withdrawn4 = nlri6 = updates = 0; }
+
+    void onNlri4(__attribute__((unused)) uint32_t prefix, __attribute__((unused)) uint8_t length) { nlri4++; }
+    void onWithdraw4(__attribute__((unused)) uint32_t prefix, __attribute__((unused)) uint8_t length) { withdrawn4++; }
+    void onNlri6(__attribute__((unused)) const uint8_t prefix[16], __attribute__((unused)) uint8_t length) { nlri6++; }
+    void onUpdateEnd() { updates++; }
+
+    size_t nlri4, withdrawn4, nlri6, updates;
+};
+
+static double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main (void) {
+    libbgp::BgpLogHandler logger;
+
+    // build a stream of update messages, like the ones in a MRT dump.
+    std::vector<uint8_t> stream;
+    uint8_t pkt_buffer[4096];
+
+    for (int i = 0; i < 2000; i++) {
+        libbgp::BgpUpdateMessage update(&logger, true);
+        update.setNextHop(htonl(0x0a000001));
+        update.prepend(65000 + i % 100);
+        update.addAttrib(libbgp::BgpPathAttribOrigin(&logger));
+
+        for (int j = 0; j < 500; j++) update.addNlri4(htonl((i << 16 | j) << 8), 24);
+
+        if (i % 2 == 0) {
+            std::vector<libbgp::Prefix6> routes;
+            uint8_t nexthop[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+            uint8_t prefix[16] = { 0x20, 0x01, 0x0d, 0xb8 };
+            for (int j = 0; j < 30; j++) {
+                prefix[4] = i >> 8; prefix[5] = i; prefix[6] = j;
+                routes.push_back(libbgp::Prefix6(prefix, 48));
+            }
+            update.setNlri6(routes, nexthop, NULL);
+        }
+
+        libbgp::BgpPacket pkt(&logger, true, &update);
+        ssize_t len = pkt.write(pkt_buffer, sizeof(pkt_buffer));
+        if (len < 0) {
+            fprintf(stderr, "failed to serialize.\n");
+            return 1;
+        }
+
+        stream.insert(stream.end(), pkt_buffer, pkt_buffer + len);
+    }
+
+    // scan the stream with BgpUpdateScanner.
+    Counter counter;
+    libbgp::BgpUpdateScanner scanner(&logger, true, &counter);
+
+    double start = now();
+    size_t offset = 0;
+
+    while (offset < stream.size()) {
+        ssize_t scanned = scanner.scanPacket(stream.data() + offset, stream.size() - offset);
+        if (scanned <= 0) {
+            fprintf(stderr, "failed to scan (error %d/%d).\n", scanner.getErrorCode(), scanner.getErrorSubCode());
+            return 1;
+        }
+        offset += scanned;
+    }
+
+    double scan_time = now() - start;
+    size_t routes = counter.nlri4 + counter.nlri6;
+
+    printf("BgpUpdateScanner: %zu updates, %zu IPv4 routes, %zu IPv6 routes, %.3f ms (%.2f M routes/s)\n",
+        counter.updates, counter.nlri4, counter.nlri6, scan_time * 1e3, routes / scan_time / 1e6);
+
+    // parse the same stream with BgpPacket, for comparison.
+    start = now();
+    offset = 0;
+
+    while (offset < stream.size()) {
+        uint16_t len = ntohs(*(uint16_t *) (stream.data() + offset + 16));
+        libbgp::BgpPacket pkt(&logger, true);
+        if (pkt.parse(stream.data() + offset, len) < 0) {
+            fprintf(stderr, "failed to parse.\n");
+            return 1;
+        }
+        offset += len;
+    }
+
+    double parse_time = now() - start;
+
+    printf("BgpPacket: %.3f ms (%.2f M routes/s)\n", parse_time * 1e3, routes / parse_time / 1e6);
+
+    // malformed updates are reported with the same error codes as BgpPacket.
+    // here, ORIGIN has a bad value (3).
+    const uint8_t *bad_update = (const uint8_t *) "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\x00\x1b\x02\x00\x00\x00\x04\x40\x01\x01\x03";
+
+    libbgp::BgpUpdateScanner validator(&logger, true, NULL);
+    libbgp::BgpPacket parser(&logger, true);
+
+    validator.scanPacket(bad_update, 27);
+    parser.parse(bad_update, 27);
+
+    printf("bad update: BgpUpdateScanner error %d/%d, BgpPacket error %d/%d\n",
+        validator.getErrorCode(), validator.getErrorSubCode(),
+        parser.getErrorCode(), parser.getErrorSubCode());
+
+    return 0;
+}
@@ -0,0 +1,120 @@
+/**
+ * @file bgp-adj-rib-in.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Routes received from a peer, before ingress filtering.
+ * @version 0.1
+ * @date 2019-08-10
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include "bgp-adj-rib-in.h"
+#include <string.h>
+
+namespace libbgp {
+
+/**
+ * @brief Add routes to the Adj-RIB-In. Routes already in the Adj-RIB-In are
+ * replaced.
+ * 
+ * @param routes The routes.
+ * @param attribs Path attributes of the routes.
+ */
+void BgpAdjRibIn4::update(const std::vector<Prefix4> &routes, const std::shared_ptr<const std::vector<std::shared_ptr<BgpPathAttrib>>> &attribs) {
+    for (const Prefix4 &route : routes) {
+        BgpAdjIn4Entry &entry = this->routes[BgpRib4EntryKey(route)];
+        entry.route = route.toValue();
+        entry.attribs = attribs;
+    }
+}
+
+/**
+ * @brief Remove routes from the Adj-RIB-In.
+ * 
+ * @param routes The routes.
+ */
+void BgpAdjRibIn4::withdraw(const std::vector<Prefix4> &routes) {
+    for (const Prefix4 &route : routes) this->routes.erase(BgpRib4EntryKey(route));
+}
+
+/**
+ * @brief Remove all routes from the Adj-RIB-In.
+ * 
+ */
+void BgpAdjRibIn4::clear() {
+    routes.clear();
+}
+
+/**
+ * @brief Get number of routes in the Adj-RIB-In.
+ * 
+ * @return size_t Number of routes.
+ */
+size_t BgpAdjRibIn4::size() const {
+    return routes.size();
+}
+
+/**
+ * @brief Get the routes in the Adj-RIB-In.
+ * 
+ * @return const adj_in4_t& The routes.
+ */
+const adj_in4_t &BgpAdjRibIn4::get() const {
+    return routes;
+}
+
+/**
+ * @brief Add routes to the Adj-RIB-In. Routes already in the Adj-RIB-In are
+ * replaced.
+ * 
+ * @param routes The routes.
+ * @param nexthop_global The global nexthop.
+ * @param nexthop_linklocal The link-local nexthop.
+ * @param attribs Path attributes of the routes.
+ */
+void BgpAdjRibIn6::update(const std::vector<Prefix6> &routes, const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], const std::shared_ptr<const std::vector<std::shared_ptr<BgpPathAttrib>>> &attribs) {
+    for (const Prefix6 &route : routes) {
+        BgpAdjIn6Entry &entry = this->routes[BgpRib6EntryKey(route)];
+        entry.route = route.toValue();
+        memcpy(entry.nexthop_global, nexthop_global, 16);
+        memcpy(entry.nexthop_linklocal, nexthop_linklocal, 16);
+        entry.attribs = attribs;
+    }
+}
+
+/**
+ * @brief Remove routes from the Adj-RIB-In.
+ * 
+ * @param routes The routes.
+ */
+void BgpAdjRibIn6::withdraw(const std::vector<Prefix6> &routes) {
+    for (const Prefix6 &route : routes) this->routes.erase(BgpRib6EntryKey(route));
+}
+
+/**
+ * @brief Remove all routes from the Adj-RIB-In.
+ * 
+ */
+void BgpAdjRibIn6::clear() {
+    routes.clear();
+}
+
+/**
+ * @brief Get number of routes in the Adj-RIB-In.
+ * 
+ * @return size_t Number of routes.
+ */
+size_t BgpAdjRibIn6::size() const {
+    return routes.size();
+}
+
+/**
+ * @brief Get the routes in the Adj-RIB-In.
+ * 
+ * @return const adj_in6_t& The routes.
+ */
+const adj_in6_t &BgpAdjRibIn6::get() const {
+    return routes;
+}
+
+}
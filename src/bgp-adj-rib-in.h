@@ -0,0 +1,133 @@
+/**
+ * @file bgp-adj-rib-in.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Routes received from a peer, before ingress filtering.
+ * @version 0.1
+ * @date 2019-08-10
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_ADJ_RIB_IN_H_
+#define BGP_ADJ_RIB_IN_H_
+#include <stdint.h>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+#include "bgp-rib4.h"
+#include "bgp-rib6.h"
+
+namespace libbgp {
+
+/**
+ * @brief An IPv4 route received from the peer.
+ * 
+ */
+struct BgpAdjIn4Entry {
+    /**
+     * @brief The route.
+     * 
+     */
+    Prefix4Value route;
+
+    /**
+     * @brief Path attributes, as received. Shared by the routes received in
+     * the same update.
+     * 
+     */
+    std::shared_ptr<const std::vector<std::shared_ptr<BgpPathAttrib>>> attribs;
+};
+
+/**
+ * @brief An IPv6 route received from the peer.
+ * 
+ */
+struct BgpAdjIn6Entry {
+    /**
+     * @brief The route.
+     * 
+     */
+    Prefix6Value route;
+
+    /**
+     * @brief The global nexthop.
+     * 
+     */
+    uint8_t nexthop_global[16];
+
+    /**
+     * @brief The link-local nexthop. (all-zero if none)
+     * 
+     */
+    uint8_t nexthop_linklocal[16];
+
+    /**
+     * @brief Path attributes, as received, without MP_REACH_NLRI,
+     * MP_UNREACH_NLRI and NEXT_HOP. Shared by the routes received in the same
+     * update.
+     * 
+     */
+    std::shared_ptr<const std::vector<std::shared_ptr<BgpPathAttrib>>> attribs;
+};
+
+typedef std::unordered_map<BgpRib4EntryKey, BgpAdjIn4Entry, BgpRib4EntryHash> adj_in4_t;
+typedef std::unordered_map<BgpRib6EntryKey, BgpAdjIn6Entry, BgpRib6EntryHash> adj_in6_t;
+
+/**
+ * @brief The IPv4 Adj-RIB-In.
+ * 
+ * BgpAdjRibIn4 keeps the latest IPv4 routes received from one peer with their
+ * path attributes, before ingress filters are applied. BgpFsm keeps one if
+ * BgpConfig::keep_adj_rib_in is set, so a new set of ingress filters can be
+ * applied on the routes without asking the peer to send them again.
+ */
+class BgpAdjRibIn4 {
+public:
+    // add or replace routes with the same path attributes.
+    void update(const std::vector<Prefix4> &routes, const std::shared_ptr<const std::vector<std::shared_ptr<BgpPathAttrib>>> &attribs);
+
+    // remove routes.
+    void withdraw(const std::vector<Prefix4> &routes);
+
+    // remove all routes.
+    void clear();
+
+    // get number of routes.
+    size_t size() const;
+
+    // get the routes.
+    const adj_in4_t &get() const;
+
+private:
+    adj_in4_t routes;
+};
+
+/**
+ * @brief The IPv6 Adj-RIB-In.
+ * 
+ * See BgpAdjRibIn4.
+ */
+class BgpAdjRibIn6 {
+public:
+    // add or replace routes with the same nexthop and path attributes.
+    void update(const std::vector<Prefix6> &routes, const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], const std::shared_ptr<const std::vector<std::shared_ptr<BgpPathAttrib>>> &attribs);
+
+    // remove routes.
+    void withdraw(const std::vector<Prefix6> &routes);
+
+    // remove all routes.
+    void clear();
+
+    // get number of routes.
+    size_t size() const;
+
+    // get the routes.
+    const adj_in6_t &get() const;
+
+private:
+    adj_in6_t routes;
+};
+
+}
+
+#endif // BGP_ADJ_RIB_IN_H_
@@ -0,0 +1,115 @@
+/**
+ * @file bgp-arena.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Monotonic arena allocator for per-message objects.
+ * @version 0.1
+ * @date 2019-08-02
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#include "bgp-arena.h"
+#include <stdlib.h>
+
+namespace libbgp {
+
+/**
+ * @brief Construct a new BgpArena object with default block size.
+ *
+ */
+BgpArena::BgpArena() : BgpArena(BGP_ARENA_DEFAULT_BLKSZ) {}
+
+/**
+ * @brief Construct a new BgpArena object.
+ *
+ * @param block_size Size of the blocks to allocate from the heap. Allocations
+ * larger than the block size get a block of their own.
+ */
+BgpArena::BgpArena(size_t block_size) {
+    this->block_size = block_size;
+    cur_block = 0;
+    cur_offset = 0;
+    allocated = 0;
+}
+
+/**
+ * @brief Destroy the BgpArena object and release all blocks.
+ *
+ */
+BgpArena::~BgpArena() {
+    for (const Block &block : blocks) free(block.data);
+}
+
+/**
+ * @brief Allocate memory from the arena.
+ *
+ * @param size Size in bytes.
+ * @param align Alignment, must be power of two.
+ * @return void* Pointer to the memory.
+ * @throws "alloc_failed" Failed to allocate new block.
+ */
+void* BgpArena::alloc(size_t size, size_t align) {
+    while (cur_block < blocks.size()) {
+        Block &block = blocks[cur_block];
+        size_t offset = (cur_offset + align - 1) & ~(align - 1);
+
+        if (offset + size <= block.size) {
+            cur_offset = offset + size;
+            allocated += size;
+            return block.data + offset;
+        }
+
+        cur_block++;
+        cur_offset = 0;
+    }
+
+    grow(size + align);
+    return alloc(size, align);
+}
+
+/**
+ * @brief Release all allocations.
+ *
+ * Blocks are retained and reused by subsequent allocations. Objects in the
+ * arena are not destructed.
+ *
+ */
+void BgpArena::reset() {
+    cur_block = 0;
+    cur_offset = 0;
+    allocated = 0;
+}
+
+/**
+ * @brief Get number of bytes allocated since last reset.
+ *
+ * @return size_t Bytes allocated.
+ */
+size_t BgpArena::getBytesAllocated() const {
+    return allocated;
+}
+
+/**
+ * @brief Get total size of the blocks owned by the arena.
+ *
+ * @return size_t Size in bytes.
+ */
+size_t BgpArena::getCapacity() const {
+    size_t capacity = 0;
+    for (const Block &block : blocks) capacity += block.size;
+    return capacity;
+}
+
+void BgpArena::grow(size_t size) {
+    Block block;
+    block.size = size > block_size ? size : block_size;
+    block.data = (uint8_t *) malloc(block.size);
+
+    if (block.data == NULL) throw "alloc_failed";
+
+    blocks.push_back(block);
+    cur_block = blocks.size() - 1;
+    cur_offset = 0;
+}
+
+}
@@ -0,0 +1,189 @@
+/**
+ * @file bgp-arena.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Monotonic arena allocator for per-message objects.
+ * @version 0.1
+ * @date 2019-08-02
+ *
+ * @copyright Copyright (c) 2019
+ *
+ */
+#ifndef BGP_ARENA_H_
+#define BGP_ARENA_H_
+#include <stdint.h>
+#include <unistd.h>
+#include <new>
+#include <memory>
+#include <vector>
+#include <utility>
+#define BGP_ARENA_DEFAULT_BLKSZ 16384
+#define BGP_ARENA_ALIGN 16
+
+namespace libbgp {
+
+/**
+ * @brief The BgpArena class.
+ *
+ * BgpArena is a monotonic (bump-pointer) allocator. Memory allocated from the
+ * arena is never freed individually; instead, all allocations are released at
+ * once with reset(). Blocks are kept across reset() so a arena that has been
+ * warmed up serves all allocations of a message without touching the heap.
+ *
+ * BgpFsm uses one arena per session to hold the BgpPacket, BgpMessage and
+ * path attribute objects of the message currently being processed. The arena
+ * is reset after each message is processed.
+ *
+ * BgpArena is not thread-safe.
+ */
+class BgpArena {
+public:
+    BgpArena();
+    BgpArena(size_t block_size);
+    ~BgpArena();
+
+    // allocate size bytes aligned to align from the arena
+    void* alloc(size_t size, size_t align = BGP_ARENA_ALIGN);
+
+    // release all allocations, keep the blocks for reuse
+    void reset();
+
+    // get number of bytes allocated since last reset
+    size_t getBytesAllocated() const;
+
+    // get total number of bytes owned by the arena
+    size_t getCapacity() const;
+
+#ifndef SWIG
+    /**
+     * @brief Construct an object in the arena.
+     *
+     * Objects created with create() must be destroyed with destroy() (not
+     * delete) before the arena is reset.
+     *
+     * @tparam T Type of the object.
+     * @tparam Args Types of constructor arguments.
+     * @param args Constructor arguments.
+     * @return T* Pointer to the new object.
+     */
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+        void *mem = alloc(sizeof(T), alignof(T));
+        return new (mem) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Destroy an object created with create().
+     *
+     * @tparam T Type of the object.
+     * @param obj Pointer to the object. Can be NULL.
+     */
+    template <typename T>
+    static void destroy(T *obj) {
+        if (obj != NULL) obj->~T();
+    }
+
+    /**
+     * @brief Create an object managed by std::shared_ptr in the arena.
+     *
+     * The object and the shared_ptr control block are allocated from the arena
+     * in one go. All references to the object must be gone before the arena
+     * is reset.
+     *
+     * @tparam T Type of the object.
+     * @tparam Args Types of constructor arguments.
+     * @param args Constructor arguments.
+     * @return std::shared_ptr<T> The shared pointer.
+     */
+    template <typename T, typename... Args>
+    std::shared_ptr<T> makeShared(Args&&... args);
+#endif
+
+private:
+    BgpArena(const BgpArena &);
+    BgpArena& operator=(const BgpArena &);
+
+    // add a new block that can hold at least size bytes
+    void grow(size_t size);
+
+    typedef struct Block {
+        uint8_t *data;
+        size_t size;
+    } Block;
+
+    std::vector<Block> blocks;
+    size_t block_size;
+    size_t cur_block;
+    size_t cur_offset;
+    size_t allocated;
+};
+
+/**
+ * @brief Mark on objects created in an arena.
+ *
+ * Objects created in an arena are only valid until the arena is reset, so
+ * they must not be remembered by identity (for example, as cache keys). The
+ * mark is not copied: copies are made to outlive the arena, and are not in
+ * the arena.
+ */
+class BgpArenaMark {
+public:
+    BgpArenaMark() : marked(false) {}
+    BgpArenaMark(__attribute__((unused)) const BgpArenaMark &other) : marked(false) {}
+    BgpArenaMark& operator=(__attribute__((unused)) const BgpArenaMark &other) { return *this; }
+
+    // mark the object as created in an arena
+    void set() { marked = true; }
+
+    // test if the object was created in an arena
+    bool isSet() const { return marked; }
+
+private:
+    bool marked;
+};
+
+#ifndef SWIG
+/**
+ * @brief STL allocator adapter for BgpArena.
+ *
+ * deallocate() is a no-op; memory is reclaimed when the arena is reset.
+ *
+ * @tparam T Type of value.
+ */
+template <typename T>
+class BgpArenaAllocator {
+public:
+    typedef T value_type;
+
+    BgpArenaAllocator(BgpArena *arena) : arena(arena) {}
+
+    template <typename U>
+    BgpArenaAllocator(const BgpArenaAllocator<U> &other) : arena(other.arena) {}
+
+    T* allocate(size_t n) {
+        return (T *) arena->alloc(n * sizeof(T), alignof(T));
+    }
+
+    void deallocate(__attribute__((unused)) T *ptr, __attribute__((unused)) size_t n) {}
+
+    template <typename U>
+    bool operator== (const BgpArenaAllocator<U> &other) const {
+        return arena == other.arena;
+    }
+
+    template <typename U>
+    bool operator!= (const BgpArenaAllocator<U> &other) const {
+        return arena != other.arena;
+    }
+
+    BgpArena *arena;
+};
+
+template <typename T, typename... Args>
+std::shared_ptr<T> BgpArena::makeShared(Args&&... args) {
+    return std::allocate_shared<T>(BgpArenaAllocator<T>(this), std::forward<Args>(args)...);
+}
+#endif
+
+}
+
+#endif // BGP_ARENA_H_
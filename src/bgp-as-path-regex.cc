@@ -0,0 +1,447 @@
+/**
+ * @file bgp-as-path-regex.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief AS_PATH regular expressions.
+ * @version 0.1
+ * @date 2019-08-07
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <algorithm>
+#include <map>
+#include "bgp-as-path-regex.h"
+
+namespace libbgp {
+
+/**
+ * @brief The compiled AS_PATH regular expression.
+ * 
+ * ASNs are mapped to classes first (ASNs in the same class are matched the
+ * same way by every part of the expression), so the transition table only
+ * needs one column per class.
+ */
+struct BgpAsPathDfa {
+    std::vector<uint32_t> bounds; // first ASN of each ASN class.
+    uint32_t set_class; // class of AS_SET segments.
+    uint32_t n_classes;
+    std::vector<int32_t> table; // next state, by state * n_classes + class. -1: no match.
+    std::vector<uint8_t> accept;
+    int32_t start;
+    bool anchored_end;
+
+    uint32_t classOf(uint32_t asn) const {
+        return std::upper_bound(bounds.begin(), bounds.end(), asn) - bounds.begin() - 1;
+    }
+};
+
+enum NfaEdgeType {
+    E_EPSILON,
+    E_RANGE,
+    E_ANY
+};
+
+struct NfaEdge {
+    uint8_t type;
+    int32_t to;
+    uint32_t lo;
+    uint32_t hi;
+};
+
+struct NfaFragment {
+    int32_t start;
+    int32_t end;
+};
+
+/**
+ * @brief Parser that builds a Thompson NFA from the expression.
+ * 
+ */
+class AsPathRegexParser {
+public:
+    AsPathRegexParser(BgpLogHandler *logger, const char *pattern) {
+        this->logger = logger;
+        this->pattern = pattern;
+        pos = 0;
+        anchored_start = false;
+        anchored_end = false;
+    }
+
+    bool parse() {
+        NfaFragment regex;
+
+        if (peek() == '^') {
+            anchored_start = true;
+            pos++;
+        }
+
+        if (!parseAlt(regex)) return false;
+
+        if (peek() == '$') {
+            anchored_end = true;
+            pos++;
+        }
+
+        if (peek() != '\0') return error("unexpected character");
+
+        start = regex.start;
+        end = regex.end;
+
+        if (!anchored_start) {
+            // ".*" in front of the expression.
+            int32_t loop = newState();
+            addEdge(loop, E_ANY, loop, 0, 0);
+            addEdge(loop, E_EPSILON, start, 0, 0);
+            start = loop;
+        }
+
+        return true;
+    }
+
+    std::vector<std::vector<NfaEdge>> states;
+    int32_t start;
+    int32_t end;
+    bool anchored_start;
+    bool anchored_end;
+
+private:
+    char peek() {
+        while (pattern[pos] == '_' || pattern[pos] == ' ' || pattern[pos] == '\t') pos++;
+        return pattern[pos];
+    }
+
+    bool error(const char *what) {
+        logger->log(ERROR, "BgpAsPathRegex::compile: %s at position %zu in \"%s\".\n", what, pos, pattern);
+        return false;
+    }
+
+    int32_t newState() {
+        states.push_back(std::vector<NfaEdge>());
+        return states.size() - 1;
+    }
+
+    void addEdge(int32_t from, uint8_t type, int32_t to, uint32_t lo, uint32_t hi) {
+        NfaEdge edge;
+        edge.type = type;
+        edge.to = to;
+        edge.lo = lo;
+        edge.hi = hi;
+        states[from].push_back(edge);
+    }
+
+    NfaFragment newAtom(uint8_t type, uint32_t lo, uint32_t hi) {
+        NfaFragment frag;
+        frag.start = newState();
+        frag.end = newState();
+        addEdge(frag.start, type, frag.end, lo, hi);
+        return frag;
+    }
+
+    bool parseNumber(uint32_t &number) {
+        if (peek() < '0' || peek() > '9') return error("ASN expected");
+
+        uint64_t value = 0;
+        while (pattern[pos] >= '0' && pattern[pos] <= '9') {
+            value = value * 10 + (pattern[pos] - '0');
+            if (value > 0xffffffff) return error("ASN too large");
+            pos++;
+        }
+
+        number = value;
+        return true;
+    }
+
+    bool parseAtom(NfaFragment &frag) {
+        char c = peek();
+
+        if (c >= '0' && c <= '9') {
+            uint32_t asn;
+            if (!parseNumber(asn)) return false;
+            frag = newAtom(E_RANGE, asn, asn);
+            return true;
+        }
+
+        if (c == '.') {
+            pos++;
+            frag = newAtom(E_ANY, 0, 0);
+            return true;
+        }
+
+        if (c == '[') {
+            pos++;
+
+            // "[0-9]+" is "any ASN", like in the character based expressions.
+            if (std::string(pattern + pos).compare(0, 5, "0-9]+") == 0) {
+                pos += 5;
+                frag = newAtom(E_ANY, 0, 0);
+                return true;
+            }
+
+            uint32_t lo, hi;
+            if (!parseNumber(lo)) return false;
+            if (peek() != '-') return error("'-' expected");
+            pos++;
+            if (!parseNumber(hi)) return false;
+            if (peek() != ']') return error("']' expected");
+            pos++;
+            if (lo > hi) return error("invalid range");
+
+            frag = newAtom(E_RANGE, lo, hi);
+            return true;
+        }
+
+        if (c == '(') {
+            pos++;
+            if (!parseAlt(frag)) return false;
+            if (peek() != ')') return error("')' expected");
+            pos++;
+            return true;
+        }
+
+        return error("unexpected character");
+    }
+
+    bool parseRepeat(NfaFragment &frag) {
+        if (!parseAtom(frag)) return false;
+
+        for (char c = peek(); c == '*' || c == '+' || c == '?'; c = peek()) {
+            pos++;
+            NfaFragment rep;
+            rep.start = newState();
+            rep.end = newState();
+
+            addEdge(rep.start, E_EPSILON, frag.start, 0, 0);
+            addEdge(frag.end, E_EPSILON, rep.end, 0, 0);
+            if (c != '+') addEdge(rep.start, E_EPSILON, rep.end, 0, 0);
+            if (c != '?') addEdge(frag.end, E_EPSILON, frag.start, 0, 0);
+
+            frag = rep;
+        }
+
+        return true;
+    }
+
+    bool parseConcat(NfaFragment &frag) {
+        frag.start = frag.end = newState();
+
+        for (char c = peek(); c != '\0' && c != '|' && c != ')' && c != '$'; c = peek()) {
+            NfaFragment next;
+            if (!parseRepeat(next)) return false;
+            addEdge(frag.end, E_EPSILON, next.start, 0, 0);
+            frag.end = next.end;
+        }
+
+        return true;
+    }
+
+    bool parseAlt(NfaFragment &frag) {
+        if (!parseConcat(frag)) return false;
+
+        while (peek() == '|') {
+            pos++;
+            NfaFragment other;
+            if (!parseConcat(other)) return false;
+
+            NfaFragment alt;
+            alt.start = newState();
+            alt.end = newState();
+            addEdge(alt.start, E_EPSILON, frag.start, 0, 0);
+            addEdge(alt.start, E_EPSILON, other.start, 0, 0);
+            addEdge(frag.end, E_EPSILON, alt.end, 0, 0);
+            addEdge(other.end, E_EPSILON, alt.end, 0, 0);
+            frag = alt;
+        }
+
+        return true;
+    }
+
+    BgpLogHandler *logger;
+    const char *pattern;
+    size_t pos;
+};
+
+// add epsilon-reachable states to the set.
+static void Closure(const std::vector<std::vector<NfaEdge>> &states, std::vector<int32_t> &set) {
+    std::vector<bool> in_set(states.size(), false);
+    std::vector<int32_t> stack = set;
+
+    for (int32_t state : set) in_set[state] = true;
+
+    while (stack.size() > 0) {
+        int32_t state = stack.back();
+        stack.pop_back();
+
+        for (const NfaEdge &edge : states[state]) {
+            if (edge.type != E_EPSILON || in_set[edge.to]) continue;
+            in_set[edge.to] = true;
+            set.push_back(edge.to);
+            stack.push_back(edge.to);
+        }
+    }
+
+    std::sort(set.begin(), set.end());
+}
+
+/**
+ * @brief Construct a new BgpAsPathRegex object.
+ * 
+ * @param logger Log handler.
+ */
+BgpAsPathRegex::BgpAsPathRegex(BgpLogHandler *logger) {
+    this->logger = logger;
+}
+
+/**
+ * @brief Compile the expression.
+ * 
+ * @param pattern The expression.
+ * @retval true Expression compiled.
+ * @retval false Invalid expression, or expression too complex.
+ */
+bool BgpAsPathRegex::compile(const char *pattern) {
+    AsPathRegexParser parser(logger, pattern);
+    if (!parser.parse()) return false;
+
+    const std::vector<std::vector<NfaEdge>> &states = parser.states;
+    std::shared_ptr<BgpAsPathDfa> new_dfa = std::make_shared<BgpAsPathDfa>();
+
+    // split ASNs into classes at the bounds of every range.
+    new_dfa->bounds.push_back(0);
+    for (const std::vector<NfaEdge> &edges : states) {
+        for (const NfaEdge &edge : edges) {
+            if (edge.type != E_RANGE) continue;
+            new_dfa->bounds.push_back(edge.lo);
+            if (edge.hi != 0xffffffff) new_dfa->bounds.push_back(edge.hi + 1);
+        }
+    }
+    std::sort(new_dfa->bounds.begin(), new_dfa->bounds.end());
+    new_dfa->bounds.erase(std::unique(new_dfa->bounds.begin(), new_dfa->bounds.end()), new_dfa->bounds.end());
+
+    uint32_t n_classes = new_dfa->bounds.size() + 1;
+    new_dfa->set_class = new_dfa->bounds.size();
+    new_dfa->n_classes = n_classes;
+    new_dfa->anchored_end = parser.anchored_end;
+
+    // subset construction.
+    std::map<std::vector<int32_t>, int32_t> dfa_states;
+    std::vector<std::vector<int32_t>> pending;
+
+    std::vector<int32_t> start_set(1, parser.start);
+    Closure(states, start_set);
+    dfa_states[start_set] = 0;
+    pending.push_back(start_set);
+    new_dfa->start = 0;
+
+    for (size_t i = 0; i < pending.size(); i++) {
+        std::vector<int32_t> set = pending[i];
+        new_dfa->accept.push_back(std::binary_search(set.begin(), set.end(), parser.end));
+        new_dfa->table.resize((i + 1) * n_classes, -1);
+
+        for (uint32_t c = 0; c < n_classes; c++) {
+            std::vector<int32_t> next;
+
+            for (int32_t state : set) {
+                for (const NfaEdge &edge : states[state]) {
+                    if (edge.type == E_EPSILON) continue;
+                    if (edge.type == E_RANGE && (c == new_dfa->set_class || new_dfa->bounds[c] < edge.lo || new_dfa->bounds[c] > edge.hi)) continue;
+                    next.push_back(edge.to);
+                }
+            }
+
+            if (next.size() == 0) continue;
+
+            std::sort(next.begin(), next.end());
+            next.erase(std::unique(next.begin(), next.end()), next.end());
+            Closure(states, next);
+
+            std::map<std::vector<int32_t>, int32_t>::iterator it = dfa_states.find(next);
+            if (it == dfa_states.end()) {
+                if (pending.size() >= BGP_AS_PATH_REGEX_MAX_STATES) {
+                    logger->log(ERROR, "BgpAsPathRegex::compile: expression \"%s\" is too complex.\n", pattern);
+                    return false;
+                }
+
+                it = dfa_states.insert(std::make_pair(next, (int32_t) pending.size())).first;
+                pending.push_back(next);
+            }
+
+            new_dfa->table[i * n_classes + c] = it->second;
+        }
+    }
+
+    this->pattern = pattern;
+    dfa = new_dfa;
+
+    return true;
+}
+
+/**
+ * @brief Test if a path matches the expression.
+ * 
+ * @param as_paths The AS_PATH segments.
+ * @retval true The path matches.
+ * @retval false The path does not match, or the expression is not compiled.
+ */
+bool BgpAsPathRegex::match(const std::vector<BgpAsPathSegment> &as_paths) const {
+    if (!dfa) return false;
+
+    const BgpAsPathDfa &d = *dfa;
+    int32_t state = d.start;
+
+    if (!d.anchored_end && d.accept[state]) return true;
+
+    for (const BgpAsPathSegment &seg : as_paths) {
+        if (seg.type == AS_SET) {
+            state = d.table[state * d.n_classes + d.set_class];
+            if (state < 0) return false;
+            if (!d.anchored_end && d.accept[state]) return true;
+            continue;
+        }
+
+        for (uint32_t asn : seg.value) {
+            state = d.table[state * d.n_classes + d.classOf(asn)];
+            if (state < 0) return false;
+            if (!d.anchored_end && d.accept[state]) return true;
+        }
+    }
+
+    return d.accept[state];
+}
+
+/**
+ * @brief Test if the AS_PATH in the path attributes matches the expression.
+ * 
+ * Path attributes without AS_PATH are matched as an empty path.
+ * 
+ * @param attribs The path attributes.
+ * @retval true The path matches.
+ * @retval false The path does not match, or the expression is not compiled.
+ */
+bool BgpAsPathRegex::match(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) const {
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attribs) {
+        if (attr->type_code != AS_PATH) continue;
+        return match(dynamic_cast<const BgpPathAttribAsPath &>(*attr).as_paths);
+    }
+
+    return match(std::vector<BgpAsPathSegment>());
+}
+
+/**
+ * @brief Get the expression.
+ * 
+ * @return const char* The expression, empty if not compiled.
+ */
+const char* BgpAsPathRegex::getPattern() const {
+    return pattern.c_str();
+}
+
+/**
+ * @brief Get number of DFA states.
+ * 
+ * @return size_t Number of states, 0 if not compiled.
+ */
+size_t BgpAsPathRegex::getStateCount() const {
+    return dfa ? dfa->accept.size() : 0;
+}
+
+}
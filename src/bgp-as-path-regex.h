@@ -0,0 +1,80 @@
+/**
+ * @file bgp-as-path-regex.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief AS_PATH regular expressions.
+ * @version 0.1
+ * @date 2019-08-07
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_AS_PATH_REGEX_H_
+#define BGP_AS_PATH_REGEX_H_
+#define BGP_AS_PATH_REGEX_MAX_STATES 4096
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <string>
+#include "bgp-path-attrib.h"
+#include "bgp-log-handler.h"
+
+namespace libbgp {
+
+struct BgpAsPathDfa;
+
+/**
+ * @brief The AS_PATH regular expression.
+ * 
+ * The expression is written over ASNs, not characters. It is compiled to a
+ * DFA once, and evaluated directly on the AS_PATH segments, one step per ASN.
+ * The following syntax is supported:
+ * 
+ * - `65000`: the ASN 65000.
+ * - `.` or `[0-9]+`: any ASN.
+ * - `[64512-65534]`: any ASN in the range.
+ * - `(a b)`, `a|b`, `a*`, `a+`, `a?`: grouping, alternation and repetition.
+ * - `^` and `$`: match from the first / to the last ASN of the path. Without
+ * them, the expression may match any part of the path.
+ * - `_` or whitespace: separates ASNs.
+ * 
+ * For example, `^65000_[0-9]+$` matches paths of two ASNs starting with
+ * 65000, and `^$` matches empty paths (locally originated routes). An AS_SET
+ * segment counts as one ASN that is only matched by `.` (or `[0-9]+`).
+ * 
+ * Copies of a BgpAsPathRegex share the compiled DFA.
+ */
+class BgpAsPathRegex {
+public:
+    BgpAsPathRegex(BgpLogHandler *logger);
+
+    // compile the expression
+    bool compile(const char *pattern);
+
+    // test if a path matches the expression
+    bool match(const std::vector<BgpAsPathSegment> &as_paths) const;
+
+    // test if the AS_PATH in the path attributes matches the expression (no
+    // AS_PATH is matched as an empty path)
+    bool match(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) const;
+
+    // get the expression
+    const char* getPattern() const;
+
+    // get number of DFA states, 0 if not compiled
+    size_t getStateCount() const;
+
+private:
+    BgpLogHandler *logger;
+    std::string pattern;
+    std::shared_ptr<const BgpAsPathDfa> dfa;
+};
+
+/**
+ * @example as-path-regex.cc
+ * Example of filtering routes with AS_PATH regular expressions. This example
+ * also compares the speed of BgpAsPathRegex with std::regex.
+ */
+
+}
+
+#endif // BGP_AS_PATH_REGEX_H_
@@ -0,0 +1,148 @@
+/**
+ * @file bgp-as-path-store.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Interned AS_PATH attributes.
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include "bgp-as-path-store.h"
+
+namespace libbgp {
+
+/**
+ * @brief Construct a new BgpAsPathStore object.
+ * 
+ * @param logger Pointer to logger object for error logging. Also used as the
+ * logger of the shared AS_PATH attributes.
+ */
+BgpAsPathStore::BgpAsPathStore(BgpLogHandler *logger) {
+    this->logger = logger;
+    attribs_purge_at = 1024;
+}
+
+/**
+ * @brief Hash the segments of an AS_PATH attribute.
+ * 
+ * @param as_path The attribute.
+ * @return size_t The hash.
+ */
+static size_t HashAsPath(const BgpPathAttribAsPath &as_path) {
+    uint64_t hash = as_path.is_4b ? 0x84222325cbf29ce4ULL : 0xcbf29ce484222325ULL;
+
+    for (const BgpAsPathSegment &seg : as_path.as_paths) {
+        hash = (hash ^ (seg.type | (seg.value.size() << 8))) * 0x100000001b3ULL;
+        for (uint32_t asn : seg.value) hash = (hash ^ asn) * 0x100000001b3ULL;
+    }
+
+    return hash;
+}
+
+/**
+ * @brief Test if two AS_PATH attributes have the same path.
+ * 
+ * @param a An attribute.
+ * @param b The other attribute.
+ * @return true The paths are the same.
+ * @return false The paths are different.
+ */
+static bool SameAsPath(const BgpPathAttribAsPath &a, const BgpPathAttribAsPath &b) {
+    if (a.is_4b != b.is_4b || a.as_paths.size() != b.as_paths.size()) return false;
+
+    for (size_t i = 0; i < a.as_paths.size(); i++) {
+        const BgpAsPathSegment &seg_a = a.as_paths[i];
+        const BgpAsPathSegment &seg_b = b.as_paths[i];
+        if (seg_a.type != seg_b.type || seg_a.is_4b != seg_b.is_4b || seg_a.value != seg_b.value) return false;
+    }
+
+    return true;
+}
+
+/**
+ * @brief Intern an AS_PATH attribute.
+ * 
+ * If an attribute with the same path is already interned, it is returned.
+ * Otherwise, the attribute becomes the interned attribute of the path. (or a
+ * copy of it, if the attribute is in a BgpArena) An interned attribute MUST
+ * NOT be modified: clone it first.
+ * 
+ * @param attrib The attribute.
+ * @return std::shared_ptr<BgpPathAttrib> The interned attribute. If the
+ * attribute is not an AS_PATH attribute, the attribute itself is returned.
+ */
+std::shared_ptr<BgpPathAttrib> BgpAsPathStore::internAttrib(const std::shared_ptr<BgpPathAttrib> &attrib) {
+    if (attrib->type_code != AS_PATH || attrib->hasError()) return attrib;
+
+    const BgpPathAttribAsPath *as_path = dynamic_cast<const BgpPathAttribAsPath *>(attrib.get());
+    if (as_path == NULL) return attrib;
+
+    size_t hash = HashAsPath(*as_path);
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    auto range = attribs.equal_range(hash);
+    for (auto it = range.first; it != range.second; it++) {
+        std::shared_ptr<BgpPathAttrib> interned = it->second.lock();
+        if (interned == NULL) continue;
+        if (SameAsPath(*as_path, dynamic_cast<const BgpPathAttribAsPath &>(*interned))) return interned;
+    }
+
+    // the arena is reset after the message, keep a copy.
+    std::shared_ptr<BgpPathAttrib> kept = attrib->in_arena.isSet() ? std::shared_ptr<BgpPathAttrib>(attrib->clone()) : attrib;
+
+    attribs.insert(std::make_pair(hash, std::weak_ptr<BgpPathAttrib>(kept)));
+    if (attribs.size() >= attribs_purge_at) purgeAttribs();
+
+    return kept;
+}
+
+/**
+ * @brief Replace the AS_PATH attribute in a list of attributes with the 
+ * interned attribute of the same path.
+ * 
+ * @param attribs The attributes.
+ * @return true The AS_PATH attribute is replaced.
+ * @return false No AS_PATH attribute replaced.
+ */
+bool BgpAsPathStore::internAttribs(std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    for (std::shared_ptr<BgpPathAttrib> &attrib : attribs) {
+        if (attrib->type_code != AS_PATH) continue;
+
+        std::shared_ptr<BgpPathAttrib> interned = internAttrib(attrib);
+        if (interned == attrib) return false;
+
+        attrib = interned;
+        return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Get number of interned AS_PATH attributes.
+ * 
+ * @return size_t Number of attributes.
+ */
+size_t BgpAsPathStore::getAttribCount() {
+    std::lock_guard<std::mutex> lock(mutex);
+    purgeAttribs();
+    return attribs.size();
+}
+
+/**
+ * @brief Remove attributes no longer used from the store. The store mutex must
+ * be held.
+ * 
+ */
+void BgpAsPathStore::purgeAttribs() {
+    for (auto it = attribs.begin(); it != attribs.end();) {
+        if (it->second.expired()) it = attribs.erase(it);
+        else it++;
+    }
+
+    attribs_purge_at = attribs.size() * 2 > 1024 ? attribs.size() * 2 : 1024;
+}
+
+}
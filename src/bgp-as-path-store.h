@@ -0,0 +1,66 @@
+/**
+ * @file bgp-as-path-store.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Interned AS_PATH attributes.
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_AS_PATH_STORE_H_
+#define BGP_AS_PATH_STORE_H_
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "bgp-path-attrib.h"
+#include "bgp-log-handler.h"
+
+namespace libbgp {
+
+/**
+ * @brief The interned AS path store.
+ * 
+ * BgpAsPathStore interns AS_PATH attribute objects: routes with the same path
+ * share one attribute object instead of owning a copy of it, and two interned
+ * attributes are equal if and only if they are the same object. Set 
+ * BgpConfig::as_path_store to have BgpFsm do this for received routes. A store
+ * can be shared by FSMs in different threads.
+ * 
+ * Attributes no longer used are removed from the store lazily, as new ones are
+ * interned.
+ */
+class BgpAsPathStore {
+public:
+    BgpAsPathStore(BgpLogHandler *logger);
+
+    // intern an AS_PATH attribute. other attributes are returned as is.
+    std::shared_ptr<BgpPathAttrib> internAttrib(const std::shared_ptr<BgpPathAttrib> &attrib);
+
+    // replace the AS_PATH attribute in a list with the interned one.
+    bool internAttribs(std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+
+    // get number of interned AS_PATH attributes.
+    size_t getAttribCount();
+
+private:
+    void purgeAttribs();
+
+    BgpLogHandler *logger;
+    std::mutex mutex;
+    std::unordered_multimap<size_t, std::weak_ptr<BgpPathAttrib>> attribs;
+    size_t attribs_purge_at;
+};
+
+/**
+ * @example as-path-store.cc
+ * Example of sharing AS paths of a full table from many peers with
+ * BgpAsPathStore. This example also compares the memory used by the AS_PATH
+ * attributes with and without the store.
+ */
+
+}
+
+#endif // BGP_AS_PATH_STORE_H_
@@ -0,0 +1,199 @@
+/**
+ * @file bgp-byte-slice.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Refcounted immutable byte slices.
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include "bgp-byte-slice.h"
+#include <stdlib.h>
+#include <string.h>
+#include <new>
+
+namespace libbgp {
+
+/**
+ * @brief Construct an empty BgpByteSlice object.
+ * 
+ */
+BgpByteSlice::BgpByteSlice() {
+    buffer = NULL;
+    data = NULL;
+    length = 0;
+}
+
+/**
+ * @brief Construct a new BgpByteSlice object with a copy of the bytes.
+ * 
+ * The refcount and the bytes are kept in one allocation.
+ * 
+ * @param data Pointer to the bytes.
+ * @param length Number of bytes.
+ * @throws "bad_value_buffer" length != 0 but data is NULL.
+ * @throws "alloc_failed" Failed to allocate the buffer.
+ */
+BgpByteSlice::BgpByteSlice(const uint8_t *data, size_t length) : BgpByteSlice() {
+    if (length == 0) return;
+    if (data == NULL) throw "bad_value_buffer";
+
+    void *mem = malloc(sizeof(Buffer) + length);
+    if (mem == NULL) throw "alloc_failed";
+
+    buffer = new (mem) Buffer;
+    buffer->refs.store(1, std::memory_order_relaxed);
+
+    uint8_t *bytes = (uint8_t *) (buffer + 1);
+    memcpy(bytes, data, length);
+
+    this->data = bytes;
+    this->length = length;
+}
+
+/**
+ * @brief Construct a new BgpByteSlice object sharing the buffer of another
+ * slice.
+ * 
+ * @param other The other slice.
+ */
+BgpByteSlice::BgpByteSlice(const BgpByteSlice &other) {
+    buffer = other.buffer;
+    data = other.data;
+    length = other.length;
+    if (buffer != NULL) buffer->refs.fetch_add(1, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Construct a new BgpByteSlice object taking the buffer of another
+ * slice. The other slice becomes empty.
+ * 
+ * @param other The other slice.
+ */
+BgpByteSlice::BgpByteSlice(BgpByteSlice &&other) {
+    buffer = other.buffer;
+    data = other.data;
+    length = other.length;
+    other.buffer = NULL;
+    other.data = NULL;
+    other.length = 0;
+}
+
+/**
+ * @brief Destroy the BgpByteSlice object. The buffer is freed if this is the
+ * last slice of it.
+ * 
+ */
+BgpByteSlice::~BgpByteSlice() {
+    release();
+}
+
+BgpByteSlice& BgpByteSlice::operator= (const BgpByteSlice &other) {
+    if (other.buffer != NULL) other.buffer->refs.fetch_add(1, std::memory_order_relaxed);
+    release();
+    buffer = other.buffer;
+    data = other.data;
+    length = other.length;
+    return *this;
+}
+
+BgpByteSlice& BgpByteSlice::operator= (BgpByteSlice &&other) {
+    if (this == &other) return *this;
+    release();
+    buffer = other.buffer;
+    data = other.data;
+    length = other.length;
+    other.buffer = NULL;
+    other.data = NULL;
+    other.length = 0;
+    return *this;
+}
+
+/**
+ * @brief Get a sub-slice of the slice. The sub-slice shares the buffer.
+ * 
+ * @param offset Offset of the sub-slice in this slice.
+ * @param length Number of bytes in the sub-slice.
+ * @return BgpByteSlice The sub-slice.
+ * @throws "bad_slice" The sub-slice is out of range.
+ */
+BgpByteSlice BgpByteSlice::slice(size_t offset, size_t length) const {
+    if (offset > this->length || length > this->length - offset) throw "bad_slice";
+
+    BgpByteSlice sub;
+    if (length == 0) return sub;
+
+    sub.buffer = buffer;
+    sub.data = data + offset;
+    sub.length = length;
+    buffer->refs.fetch_add(1, std::memory_order_relaxed);
+
+    return sub;
+}
+
+/**
+ * @brief Get pointer to the bytes.
+ * 
+ * @return const uint8_t* Pointer to the bytes. (NULL if the slice is empty)
+ */
+const uint8_t* BgpByteSlice::getData() const {
+    return data;
+}
+
+/**
+ * @brief Get number of bytes in the slice.
+ * 
+ * @return size_t Number of bytes.
+ */
+size_t BgpByteSlice::getLength() const {
+    return length;
+}
+
+/**
+ * @brief Test if the slice has no bytes.
+ * 
+ * @return true The slice is empty.
+ * @return false The slice is not empty.
+ */
+bool BgpByteSlice::empty() const {
+    return length == 0;
+}
+
+/**
+ * @brief Test if two slices are views of the same buffer.
+ * 
+ * @param other The other slice.
+ * @return true The slices share the buffer.
+ * @return false The slices have different buffers, or any of them is empty.
+ */
+bool BgpByteSlice::sharesBuffer(const BgpByteSlice &other) const {
+    return buffer != NULL && buffer == other.buffer;
+}
+
+bool BgpByteSlice::operator== (const BgpByteSlice &other) const {
+    if (length != other.length) return false;
+    if (data == other.data) return true;
+    return memcmp(data, other.data, length) == 0;
+}
+
+bool BgpByteSlice::operator!= (const BgpByteSlice &other) const {
+    return !(*this == other);
+}
+
+/**
+ * @brief Drop the reference to the buffer, free it if this was the last one.
+ * 
+ */
+void BgpByteSlice::release() {
+    if (buffer != NULL && buffer->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+        buffer->~Buffer();
+        free(buffer);
+    }
+
+    buffer = NULL;
+    data = NULL;
+    length = 0;
+}
+
+}
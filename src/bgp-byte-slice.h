@@ -0,0 +1,89 @@
+/**
+ * @file bgp-byte-slice.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Refcounted immutable byte slices.
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_BYTE_SLICE_H_
+#define BGP_BYTE_SLICE_H_
+#include <stdint.h>
+#include <unistd.h>
+#include <atomic>
+
+namespace libbgp {
+
+/**
+ * @brief An immutable, refcounted byte slice.
+ * 
+ * BgpByteSlice is a view of (part of) a refcounted buffer. The buffer is
+ * allocated and filled once when a slice is created from bytes; copying a
+ * slice or taking a sub-slice of it only takes a reference to the buffer. The
+ * buffer is freed when the last slice referencing it is destroyed.
+ * 
+ * The buffer is never modified after it is filled, so slices can be shared by
+ * different threads. (A single slice object is not thread-safe, as with
+ * std::shared_ptr.)
+ * 
+ * BgpPathAttrib keeps the value of attributes not known to libbgp in a
+ * BgpByteSlice, so the value is shared by the parsed message, the RIB and the
+ * outgoing messages instead of being copied by clone().
+ */
+class BgpByteSlice {
+public:
+    BgpByteSlice();
+    BgpByteSlice(const uint8_t *data, size_t length);
+    BgpByteSlice(const BgpByteSlice &other);
+    ~BgpByteSlice();
+
+    BgpByteSlice& operator= (const BgpByteSlice &other);
+
+#ifndef SWIG
+    BgpByteSlice(BgpByteSlice &&other);
+    BgpByteSlice& operator= (BgpByteSlice &&other);
+#endif
+
+    // get a sub-slice sharing the same buffer.
+    BgpByteSlice slice(size_t offset, size_t length) const;
+
+    // get pointer to the bytes. (NULL if the slice is empty)
+    const uint8_t* getData() const;
+
+    // get number of bytes in the slice.
+    size_t getLength() const;
+
+    // test if the slice has no bytes.
+    bool empty() const;
+
+    // test if two slices are views of the same buffer.
+    bool sharesBuffer(const BgpByteSlice &other) const;
+
+    // compare bytes in two slices.
+    bool operator== (const BgpByteSlice &other) const;
+    bool operator!= (const BgpByteSlice &other) const;
+
+private:
+    struct Buffer {
+        std::atomic<uint32_t> refs;
+    };
+
+    void release();
+
+    Buffer *buffer;
+    const uint8_t *data;
+    size_t length;
+};
+
+/**
+ * @example opaque-attrib.cc
+ * Example of passing attributes not known to libbgp through without copying
+ * their values. This example also compares the time spent passing the 
+ * attributes to many peers with shared and with copied values.
+ */
+
+}
+
+#endif // BGP_BYTE_SLICE_H_
@@ -18,6 +18,8 @@
 #include "bgp-out-handler.h"
 #include "bgp-log-handler.h"
 #include "route-event-bus.h"
+#include "bgp-update-visitor.h"
+#include "bgp-as-path-store.h"
 
 namespace libbgp {
 
@@ -42,6 +44,11 @@ typedef struct BgpConfig {
         weight = 0;
         no_autotick = false;
         ibgp_alter_nexthop = false;
+        use_message_arena = false;
+        no_sink_lock = false;
+        update_visitor = NULL;
+        keep_adj_rib_in = false;
+        as_path_store = NULL;
     }
 
     /**
@@ -337,6 +344,81 @@ typedef struct BgpConfig {
      * (default: false)
      */
     bool ibgp_alter_nexthop;
+
+    /**
+     * @brief Allocate received messages from a per-session arena.
+     * 
+     * If true, the BgpPacket, BgpMessage and path attribute objects of 
+     * received messages are allocated from an arena owned by the FSM, and the
+     * arena is reset after each message is processed. The ingress filters run
+     * on the attributes in the arena, without copying them. Path attributes 
+     * are copied to the heap only when routes are accepted and inserted to the
+     * RIB (or kept in the Adj-RIB-In, see keep_adj_rib_in), so the 
+     * shared_attribs in route events published by the FSM are never in the
+     * arena.
+     * 
+     * Filter results are not cached for attributes in the arena, and the 
+     * results of route-map actions are copied to the heap (see 
+     * BgpFilterActions).
+     * 
+     * (default: false)
+     */
+    bool use_message_arena;
+
+    /**
+     * @brief Do not lock the input sink.
+     * 
+     * The input sink of the FSM is locked on every fill and pour by default.
+     * If the FSM is only ever run() from one thread (e.g., the thread reading 
+     * the session socket), set this to true to skip the locking.
+     * 
+     * (default: false)
+     */
+    bool no_sink_lock;
+
+    /**
+     * @brief Pointer to the update visitor.
+     * 
+     * If set, update messages received in ESTABLISHED state are scanned with
+     * BgpUpdateScanner and passed to the visitor directly from the input 
+     * buffer, without creating BgpUpdateMessage objects. The routes are NOT 
+     * processed by the FSM: ingress filters are not applied, nothing is 
+     * inserted to the RIBs and no route event is published. This is meant for
+     * route collectors. Malformed updates are still answered with a 
+     * NOTIFICATION message, like in the default mode. Other messages are 
+     * handled as usual.
+     * 
+     * (default: NULL)
+     */
+    BgpUpdateVisitor *update_visitor;
+
+    /**
+     * @brief Keep the routes received from the peer before ingress filtering.
+     * 
+     * If true, the FSM keeps the routes received from the peer, with their
+     * path attributes as received, in an Adj-RIB-In. When the ingress filters 
+     * are replaced with BgpFsm::setInFilters4 / setInFilters6, routes rejected
+     * by the old filters can then be accepted by the new filters without 
+     * resetting the session. This costs a hash table entry per received route;
+     * the path attributes are shared with the RIB.
+     * 
+     * (default: false)
+     */
+    bool keep_adj_rib_in;
+
+    /**
+     * @brief Pointer to the interned AS path store.
+     * 
+     * If set, the AS_PATH attribute of received routes is replaced with the 
+     * attribute shared by all routes with the same path in the store, before
+     * ingress filters are applied. Routes from different updates, and from
+     * different peers if the store is shared by their FSMs, then share one 
+     * AS_PATH attribute object, and their paths share common tails in the 
+     * store. 
+     * 
+     * (default: NULL)
+     */
+    BgpAsPathStore *as_path_store;
 } BgpConfig;
 
 /**
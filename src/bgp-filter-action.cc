@@ -0,0 +1,505 @@
+/**
+ * @file bgp-filter-action.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Route-map actions of filter rules.
+ * @version 0.1
+ * @date 2019-08-09
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <arpa/inet.h>
+#include "bgp-filter-action.h"
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+
+namespace libbgp {
+
+/**
+ * @brief Hasher for path attribute identities.
+ * 
+ */
+struct BgpAttribsIdHash {
+    std::size_t operator()(const std::vector<const BgpPathAttrib *> &key) const {
+        std::hash<const void *> hash;
+        std::size_t h = key.size();
+        for (const BgpPathAttrib *attr : key) h = h * 31 + hash(attr);
+        return h;
+    }
+};
+
+/**
+ * @brief Cached result of the actions on a set of path attributes.
+ * 
+ * The original attributes are kept as weak references, like
+ * BgpFilterAttribsVerdict: an entry whose attributes are gone is stale.
+ */
+struct BgpFilterActionCacheEntry {
+    std::vector<std::weak_ptr<BgpPathAttrib>> attribs;
+    std::shared_ptr<const BgpFilterActionResult> result;
+};
+
+/**
+ * @brief Shared state of BgpFilterActions.
+ * 
+ */
+struct BgpFilterActionState {
+    BgpLogHandler *logger;
+    std::vector<BgpFilterAction> actions;
+
+    std::mutex mutex;
+
+    // results, by identity of the original attributes.
+    std::unordered_map<std::vector<const BgpPathAttrib *>, BgpFilterActionCacheEntry, BgpAttribsIdHash> cache;
+
+    // attributes created by the actions, by serialized content.
+    std::unordered_map<std::string, std::weak_ptr<BgpPathAttrib>> interned;
+    size_t interned_limit;
+
+    std::atomic<uint64_t> cache_hits;
+    std::atomic<uint64_t> cache_misses;
+};
+
+// find the attribute with the type in the working set, -1 if none.
+static ssize_t FindAttrib(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, uint8_t type) {
+    for (size_t i = 0; i < attribs.size(); i++) {
+        if (attribs[i]->type_code == type) return i;
+    }
+
+    return -1;
+}
+
+// get a copy of the attribute at index that is safe to modify.
+template <typename T>
+static T& Modify(std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &owned, size_t index) {
+    if (!owned[index]) {
+        attribs[index] = std::shared_ptr<BgpPathAttrib>(attribs[index]->clone());
+        owned[index] = true;
+    }
+
+    return dynamic_cast<T &>(*attribs[index]);
+}
+
+// add a new attribute to the working set, keep attributes ordered by type.
+static void Insert(std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &owned, BgpPathAttrib *attrib) {
+    size_t pos = 0;
+    while (pos < attribs.size() && attribs[pos]->type_code < attrib->type_code) pos++;
+    attribs.insert(attribs.begin() + pos, std::shared_ptr<BgpPathAttrib>(attrib));
+    owned.insert(owned.begin() + pos, true);
+}
+
+/**
+ * @brief Construct a new BgpFilterActions object with no actions.
+ * 
+ * Actions can't be added to it, use BgpFilterActions(BgpLogHandler*) instead.
+ */
+BgpFilterActions::BgpFilterActions() {}
+
+/**
+ * @brief Construct a new BgpFilterActions object
+ * 
+ * @param logger Pointer to logger object for error logging, also used by the
+ * attributes created by the actions.
+ */
+BgpFilterActions::BgpFilterActions(BgpLogHandler *logger) {
+    state = std::shared_ptr<BgpFilterActionState>(new BgpFilterActionState);
+    state->logger = logger;
+    state->interned_limit = 1024;
+    state->cache_hits = 0;
+    state->cache_misses = 0;
+}
+
+/**
+ * @brief Set LOCAL_PREF.
+ * 
+ * @param local_pref The LOCAL_PREF.
+ * @return true Action added.
+ * @return false Failed to add action.
+ */
+bool BgpFilterActions::setLocalPref(uint32_t local_pref) {
+    return add(A_SET_LOCAL_PREF, local_pref, 1);
+}
+
+/**
+ * @brief Set MULTI_EXIT_DISC.
+ * 
+ * @param med The MED.
+ * @return true Action added.
+ * @return false Failed to add action.
+ */
+bool BgpFilterActions::setMed(uint32_t med) {
+    return add(A_SET_MED, med, 1);
+}
+
+/**
+ * @brief Prepend an ASN to AS_PATH.
+ * 
+ * Routes without AS_PATH get a new AS_PATH. On a 2-byte AS_PATH, AS_TRANS is
+ * prepended instead of a 4-byte ASN, and the ASN is prepended to AS4_PATH if
+ * there is one.
+ * 
+ * @param asn The ASN.
+ * @param count Number of times to prepend.
+ * @return true Action added.
+ * @return false Failed to add action.
+ */
+bool BgpFilterActions::prepend(uint32_t asn, uint8_t count) {
+    if (count == 0) {
+        if (state) state->logger->log(ERROR, "BgpFilterActions::prepend: count must be greater than 0.\n");
+        return false;
+    }
+
+    return add(A_PREPEND, asn, count);
+}
+
+/**
+ * @brief Add a community to COMMUNITY.
+ * 
+ * @param asn The ASN part of the community.
+ * @param keyword The keyword part of the community.
+ * @return true Action added.
+ * @return false Failed to add action.
+ */
+bool BgpFilterActions::addCommunity(uint16_t asn, uint16_t keyword) {
+    return addCommunity(((uint32_t) asn << 16) | keyword);
+}
+
+/**
+ * @brief Add a community to COMMUNITY.
+ * 
+ * @param community The community, in host byte order.
+ * @return true Action added.
+ * @return false Failed to add action.
+ */
+bool BgpFilterActions::addCommunity(uint32_t community) {
+    return add(A_ADD_COMMUNITY, htonl(community), 1);
+}
+
+/**
+ * @brief Remove a community from COMMUNITY. COMMUNITY is dropped if no
+ * community is left.
+ * 
+ * @param asn The ASN part of the community.
+ * @param keyword The keyword part of the community.
+ * @return true Action added.
+ * @return false Failed to add action.
+ */
+bool BgpFilterActions::removeCommunity(uint16_t asn, uint16_t keyword) {
+    return removeCommunity(((uint32_t) asn << 16) | keyword);
+}
+
+/**
+ * @brief Remove a community from COMMUNITY. COMMUNITY is dropped if no
+ * community is left.
+ * 
+ * @param community The community, in host byte order.
+ * @return true Action added.
+ * @return false Failed to add action.
+ */
+bool BgpFilterActions::removeCommunity(uint32_t community) {
+    return add(A_REMOVE_COMMUNITY, htonl(community), 1);
+}
+
+/**
+ * @brief Set the weight of the route. Only used by the in_filters of BgpFsm,
+ * overrides BgpConfig::weight.
+ * 
+ * @param weight The weight.
+ * @return true Action added.
+ * @return false Failed to add action.
+ */
+bool BgpFilterActions::setWeight(int32_t weight) {
+    return add(A_SET_WEIGHT, (uint32_t) weight, 1);
+}
+
+/**
+ * @brief Get the actions.
+ * 
+ * @return std::vector<BgpFilterAction> The actions, in order.
+ */
+std::vector<BgpFilterAction> BgpFilterActions::getActions() const {
+    if (!state) return std::vector<BgpFilterAction>();
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->actions;
+}
+
+/**
+ * @brief Test if there are no actions.
+ * 
+ * @return true No actions.
+ * @return false Has actions.
+ */
+bool BgpFilterActions::empty() const {
+    if (!state) return true;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    return state->actions.size() == 0;
+}
+
+/**
+ * @brief Run the actions on path attributes.
+ * 
+ * @param attribs The path attributes. Not modified.
+ * @return std::shared_ptr<const BgpFilterActionResult> The result. NULL if
+ * the actions change nothing. Calls with the same path attributes get the
+ * same result object.
+ */
+std::shared_ptr<const BgpFilterActionResult> BgpFilterActions::apply(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) const {
+    if (!state) return NULL;
+
+    std::vector<const BgpPathAttrib *> key;
+    key.reserve(attribs.size());
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attribs) key.push_back(attr.get());
+
+    // attributes in an arena: their address is reused once the arena is reset,
+    // don't cache.
+    bool in_arena = false;
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attribs) {
+        if (attr->in_arena.isSet()) {
+            in_arena = true;
+            break;
+        }
+    }
+
+    std::vector<BgpFilterAction> actions;
+
+    {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (state->actions.size() == 0) return NULL;
+
+        auto it = in_arena ? state->cache.end() : state->cache.find(key);
+        if (it != state->cache.end()) {
+            bool stale = false;
+            for (const std::weak_ptr<BgpPathAttrib> &attr : it->second.attribs) {
+                if (attr.expired()) {
+                    stale = true;
+                    break;
+                }
+            }
+
+            if (!stale) {
+                state->cache_hits++;
+                return it->second.result;
+            }
+        }
+
+        actions = state->actions;
+    }
+
+    state->cache_misses++;
+
+    BgpFilterActionResult *result = new BgpFilterActionResult;
+    result->attribs = attribs;
+    result->weight = 0;
+    result->has_weight = false;
+    result->has_med = false;
+
+    // owned[i]: result->attribs[i] is a new object, made by the actions.
+    std::vector<bool> owned (attribs.size(), false);
+    bool changed = false;
+
+    for (const BgpFilterAction &action : actions) {
+        ssize_t index;
+
+        switch (action.type) {
+            case A_SET_LOCAL_PREF: {
+                index = FindAttrib(result->attribs, LOCAL_PREF);
+                if (index < 0) {
+                    BgpPathAttribLocalPref *local_pref = new BgpPathAttribLocalPref(state->logger);
+                    local_pref->transitive = true;
+                    local_pref->local_pref = action.value;
+                    Insert(result->attribs, owned, local_pref);
+                    changed = true;
+                    break;
+                }
+
+                if (dynamic_cast<const BgpPathAttribLocalPref &>(*result->attribs[index]).local_pref == action.value) break;
+                Modify<BgpPathAttribLocalPref>(result->attribs, owned, index).local_pref = action.value;
+                changed = true;
+                break;
+            }
+            case A_SET_MED: {
+                result->has_med = true;
+                index = FindAttrib(result->attribs, MULTI_EXIT_DISC);
+                if (index < 0) {
+                    BgpPathAttribMed *med = new BgpPathAttribMed(state->logger);
+                    med->med = action.value;
+                    Insert(result->attribs, owned, med);
+                    changed = true;
+                    break;
+                }
+
+                if (dynamic_cast<const BgpPathAttribMed &>(*result->attribs[index]).med == action.value) break;
+                Modify<BgpPathAttribMed>(result->attribs, owned, index).med = action.value;
+                changed = true;
+                break;
+            }
+            case A_PREPEND: {
+                index = FindAttrib(result->attribs, AS_PATH);
+                if (index < 0) {
+                    Insert(result->attribs, owned, new BgpPathAttribAsPath(state->logger, true));
+                    index = FindAttrib(result->attribs, AS_PATH);
+                }
+
+                BgpPathAttribAsPath &path = Modify<BgpPathAttribAsPath>(result->attribs, owned, index);
+                for (uint8_t i = 0; i < action.count; i++) path.prepend(action.value);
+
+                if (!path.is_4b) {
+                    index = FindAttrib(result->attribs, AS4_PATH);
+                    if (index >= 0) {
+                        BgpPathAttribAs4Path &path4 = Modify<BgpPathAttribAs4Path>(result->attribs, owned, index);
+                        for (uint8_t i = 0; i < action.count; i++) path4.prepend(action.value);
+                    }
+                }
+
+                changed = true;
+                break;
+            }
+            case A_ADD_COMMUNITY: {
+                index = FindAttrib(result->attribs, COMMUNITY);
+                if (index < 0) {
+                    BgpPathAttribCommunity *community = new BgpPathAttribCommunity(state->logger);
+                    community->communites.push_back(action.value);
+                    Insert(result->attribs, owned, community);
+                    changed = true;
+                    break;
+                }
+
+                const std::vector<uint32_t> &communites = dynamic_cast<const BgpPathAttribCommunity &>(*result->attribs[index]).communites;
+                if (std::find(communites.begin(), communites.end(), action.value) != communites.end()) break;
+                Modify<BgpPathAttribCommunity>(result->attribs, owned, index).communites.push_back(action.value);
+                changed = true;
+                break;
+            }
+            case A_REMOVE_COMMUNITY: {
+                index = FindAttrib(result->attribs, COMMUNITY);
+                if (index < 0) break;
+
+                const std::vector<uint32_t> &communites = dynamic_cast<const BgpPathAttribCommunity &>(*result->attribs[index]).communites;
+                if (std::find(communites.begin(), communites.end(), action.value) == communites.end()) break;
+
+                std::vector<uint32_t> &modified = Modify<BgpPathAttribCommunity>(result->attribs, owned, index).communites;
+                modified.erase(std::remove(modified.begin(), modified.end(), action.value), modified.end());
+                if (modified.size() == 0) {
+                    result->attribs.erase(result->attribs.begin() + index);
+                    owned.erase(owned.begin() + index);
+                }
+                changed = true;
+                break;
+            }
+            case A_SET_WEIGHT: {
+                result->weight = (int32_t) action.value;
+                result->has_weight = true;
+                changed = true;
+                break;
+            }
+        }
+    }
+
+    // the result outlives the arena: copy the arena attributes it shares with
+    // the original path attributes.
+    if (changed && in_arena) {
+        for (size_t i = 0; i < owned.size(); i++) {
+            if (owned[i] || !result->attribs[i]->in_arena.isSet()) continue;
+            result->attribs[i] = std::shared_ptr<BgpPathAttrib>(result->attribs[i]->clone());
+        }
+    }
+
+    std::shared_ptr<const BgpFilterActionResult> shared_result;
+    if (changed) shared_result = std::shared_ptr<const BgpFilterActionResult>(result);
+    else delete result;
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+
+    // share new attributes with the same content.
+    if (changed) {
+        uint8_t buffer[4096];
+        for (size_t i = 0; i < owned.size(); i++) {
+            if (!owned[i]) continue;
+            ssize_t len = result->attribs[i]->write(buffer, sizeof(buffer));
+            if (len < 0) continue;
+
+            std::weak_ptr<BgpPathAttrib> &slot = state->interned[std::string((const char *) buffer, len)];
+            std::shared_ptr<BgpPathAttrib> existing = slot.lock();
+            if (existing) result->attribs[i] = existing;
+            else slot = result->attribs[i];
+        }
+
+        if (state->interned.size() >= state->interned_limit) {
+            for (auto it = state->interned.begin(); it != state->interned.end();) {
+                if (it->second.expired()) it = state->interned.erase(it);
+                else it++;
+            }
+            state->interned_limit = std::max((size_t) 1024, state->interned.size() * 2);
+        }
+    }
+
+    if (in_arena) return shared_result;
+
+    BgpFilterActionCacheEntry entry;
+    entry.attribs.assign(attribs.begin(), attribs.end());
+    entry.result = shared_result;
+
+    if (state->cache.size() >= BGP_FILTER_ACTION_CACHE_SIZE) state->cache.clear();
+    state->cache[key] = entry;
+
+    return shared_result;
+}
+
+/**
+ * @brief Get the number of apply() calls answered by the cache.
+ * 
+ * @return uint64_t Number of cache hits.
+ */
+uint64_t BgpFilterActions::getCacheHits() const {
+    return state ? state->cache_hits.load() : 0;
+}
+
+/**
+ * @brief Get the number of apply() calls not answered by the cache.
+ * 
+ * @return uint64_t Number of cache misses.
+ */
+uint64_t BgpFilterActions::getCacheMisses() const {
+    return state ? state->cache_misses.load() : 0;
+}
+
+/**
+ * @brief Get the number of live attribute objects created by the actions.
+ * 
+ * Attributes with the same content are counted once, since they are shared.
+ * 
+ * @return size_t Number of attribute objects.
+ */
+size_t BgpFilterActions::getAttribCount() const {
+    if (!state) return 0;
+    std::lock_guard<std::mutex> lock(state->mutex);
+
+    size_t count = 0;
+    for (const auto &attr : state->interned) {
+        if (!attr.second.expired()) count++;
+    }
+
+    return count;
+}
+
+bool BgpFilterActions::add(BgpFilterActionType type, uint32_t value, uint8_t count) {
+    if (!state) return false;
+
+    BgpFilterAction action;
+    action.type = type;
+    action.value = value;
+    action.count = count;
+
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->actions.push_back(action);
+
+    // results of the old actions.
+    state->cache.clear();
+
+    return true;
+}
+
+}
@@ -0,0 +1,147 @@
+/**
+ * @file bgp-filter-action.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Route-map actions of filter rules.
+ * @version 0.1
+ * @date 2019-08-09
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_FILTER_ACTION_H_
+#define BGP_FILTER_ACTION_H_
+#define BGP_FILTER_ACTION_CACHE_SIZE 65536
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include "bgp-path-attrib.h"
+#include "bgp-log-handler.h"
+
+namespace libbgp {
+
+struct BgpFilterActionState;
+
+/**
+ * @brief Type of route-map action.
+ * 
+ */
+enum BgpFilterActionType {
+    A_SET_LOCAL_PREF, /*!< Set LOCAL_PREF */
+    A_SET_MED, /*!< Set MULTI_EXIT_DISC */
+    A_PREPEND, /*!< Prepend an ASN to AS_PATH */
+    A_ADD_COMMUNITY, /*!< Add a community to COMMUNITY */
+    A_REMOVE_COMMUNITY, /*!< Remove a community from COMMUNITY */
+    A_SET_WEIGHT /*!< Set the weight of the route in the RIB */
+};
+
+/**
+ * @brief A route-map action.
+ * 
+ */
+struct BgpFilterAction {
+    BgpFilterActionType type; /*!< Type of the action. */
+    uint32_t value; /*!< Value to set / ASN to prepend / community (in network byte order). */
+    uint8_t count; /*!< Number of times to prepend. (A_PREPEND only) */
+};
+
+/**
+ * @brief Result of route-map actions on a set of path attributes.
+ * 
+ */
+struct BgpFilterActionResult {
+    /**
+     * @brief The modified path attributes. Attributes not touched by the
+     * actions are shared with the original path attributes.
+     * 
+     */
+    std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
+
+    /**
+     * @brief Weight set by A_SET_WEIGHT, if has_weight is true.
+     * 
+     */
+    int32_t weight;
+
+    /**
+     * @brief The actions set the weight of the route.
+     * 
+     */
+    bool has_weight;
+
+    /**
+     * @brief The actions set MULTI_EXIT_DISC. (BgpFsm drops non-transitive
+     * attributes from the routes it advertises, but keeps a MED set by the
+     * actions of out_filters)
+     * 
+     */
+    bool has_med;
+};
+
+/**
+ * @brief The route-map actions.
+ * 
+ * BgpFilterActions is a list of actions to run on the path attributes of
+ * routes accepted by a filter rule (see BgpFilterRule::actions). Actions run
+ * in the order they are added.
+ * 
+ * The original path attributes are never modified. An attribute changed by the
+ * actions is copied first, and other attributes are shared with the original
+ * path attributes (copy-on-write). Results are cached by the identity of the
+ * original path attributes, so routes sharing the same path attributes (e.g.,
+ * routes in the same update) share the same result. New attribute objects are
+ * also interned by their content: a policy applied to many routes creates only
+ * as many new attribute objects as there are distinct outcomes.
+ * 
+ * Attribute objects must not be modified once actions run on them. Results for
+ * attributes allocated from a BgpArena are not cached, and the arena
+ * attributes they share with the original path attributes are copied to the
+ * heap, so results can outlive the arena.
+ * 
+ * Copies of a BgpFilterActions share the same actions and cache.
+ */
+class BgpFilterActions {
+public:
+    BgpFilterActions();
+    BgpFilterActions(BgpLogHandler *logger);
+
+    // add actions
+    bool setLocalPref(uint32_t local_pref);
+    bool setMed(uint32_t med);
+    bool prepend(uint32_t asn, uint8_t count = 1);
+    bool addCommunity(uint16_t asn, uint16_t keyword);
+    bool addCommunity(uint32_t community);
+    bool removeCommunity(uint16_t asn, uint16_t keyword);
+    bool removeCommunity(uint32_t community);
+    bool setWeight(int32_t weight);
+
+    // get the actions
+    std::vector<BgpFilterAction> getActions() const;
+
+    // test if there are no actions
+    bool empty() const;
+
+    // run the actions on path attributes. NULL if nothing is changed
+    std::shared_ptr<const BgpFilterActionResult> apply(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) const;
+
+    // cache statistics
+    uint64_t getCacheHits() const;
+    uint64_t getCacheMisses() const;
+
+    // get number of live attribute objects created by the actions
+    size_t getAttribCount() const;
+
+private:
+    bool add(BgpFilterActionType type, uint32_t value, uint8_t count);
+
+    std::shared_ptr<BgpFilterActionState> state;
+};
+
+/**
+ * @example route-map.cc
+ * Example of modifying the path attributes of routes with route-map actions,
+ * and counting the attribute objects created for a full table.
+ */
+
+}
+
+#endif // BGP_FILTER_ACTION_H_
@@ -0,0 +1,670 @@
+/**
+ * @file bgp-filter-matcher.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief The compiled route filtering matcher.
+ * @version 0.1
+ * @date 2019-08-05
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <typeinfo>
+#include <algorithm>
+#include "bgp-filter-matcher.h"
+#include "prefix-trie.h"
+
+namespace libbgp {
+
+static inline void setMax(int32_t &target, int32_t value) {
+    if (value > target) target = value;
+}
+
+static inline uint64_t makeKey4(uint32_t prefix, uint8_t length) {
+    return ((uint64_t) prefix << 8) | length;
+}
+
+static inline BgpFilterKey6 makeKey6(const Prefix6 &prefix) {
+    BgpFilterKey6 key;
+    prefix.getPrefix(key.prefix);
+    key.length = prefix.getLength();
+    return key;
+}
+
+// test if bits after length are set in the prefix.
+static bool hasHostBits(const uint8_t *prefix, uint8_t length, uint8_t max_length) {
+    if (length >= max_length) return false;
+
+    uint8_t byte = length >> 3;
+    if ((length & 7) != 0 && (prefix[byte++] & (0xff >> (length & 7))) != 0) return true;
+
+    for (; byte < max_length >> 3; byte++) {
+        if (prefix[byte] != 0) return true;
+    }
+
+    return false;
+}
+
+// sort (index, value) pairs by index, highest first.
+template <typename T>
+static bool compareIndex(const std::pair<int32_t, T> &a, const std::pair<int32_t, T> &b) {
+    return a.first > b.first;
+}
+
+/**
+ * @brief Construct a new BgpFilterTrie object.
+ * 
+ * @param max_length Max prefix length. (32 for IPv4, 128 for IPv6)
+ */
+BgpFilterTrie::BgpFilterTrie(uint8_t max_length) {
+    this->max_length = max_length;
+    has_rules = false;
+    nodes.push_back(Node { { -1, -1 }, -1, -1, -1, -1 });
+}
+
+/**
+ * @brief Add a rule to the trie.
+ * 
+ * @param prefix The rule prefix, in network byte order.
+ * @param length Length of the rule prefix.
+ * @param match_type Match type. (M_LE, M_LT, M_GE or M_GT)
+ * @param index Index of the rule in the rules set.
+ */
+void BgpFilterTrie::insert(const uint8_t *prefix, uint8_t length, uint8_t match_type, int32_t index) {
+    int32_t node = 0;
+
+    for (uint8_t depth = 0; depth < length; depth++) {
+        uint8_t bit = getBit(prefix, depth);
+        int32_t next = nodes[node].child[bit];
+
+        if (next < 0) {
+            next = (int32_t) nodes.size();
+            nodes.push_back(Node { { -1, -1 }, -1, -1, -1, -1 });
+            nodes[node].child[bit] = next;
+        }
+
+        node = next;
+    }
+
+    Node &target = nodes[node];
+
+    switch (match_type) {
+        case M_LE: setMax(target.le, index); break;
+        case M_LT: setMax(target.lt, index); break;
+        case M_GE: setMax(target.ge, index); break;
+        case M_GT: setMax(target.gt, index); break;
+    }
+
+    has_rules = true;
+}
+
+/**
+ * @brief Propagate M_GE/M_GT indexes to the parent nodes.
+ * 
+ * After build(), ge and gt of a node are the highest index of the M_GE and
+ * M_GT rules in the subtree of the node.
+ */
+void BgpFilterTrie::build() {
+    build(0);
+}
+
+int32_t BgpFilterTrie::build(int32_t node) {
+    for (int i = 0; i < 2; i++) {
+        int32_t child = nodes[node].child[i];
+        if (child < 0) continue;
+        build(child);
+        setMax(nodes[node].ge, nodes[child].ge);
+        setMax(nodes[node].gt, nodes[child].gt);
+    }
+
+    return node;
+}
+
+/**
+ * @brief Match a route against the rules in the trie.
+ * 
+ * @param prefix The route prefix, in network byte order.
+ * @param length Length of the route prefix.
+ * @param host_bits_set Bits after length are set in the route prefix. Such
+ * route is never included by M_GE/M_GT rules.
+ * @return int32_t Highest index of the matching rules, -1 if none.
+ */
+int32_t BgpFilterTrie::match(const uint8_t *prefix, uint8_t length, bool host_bits_set) const {
+    if (!has_rules || length > max_length) return -1;
+
+    int32_t best = -1;
+    const Node *node = &nodes[0];
+
+    for (uint8_t depth = 0; ; depth++) {
+        setMax(best, node->le);
+
+        if (depth == length) {
+            // M_LT with the same length only includes routes that differ in
+            // the host bits.
+            if (host_bits_set) {
+                setMax(best, node->lt);
+                break;
+            }
+
+            // M_GE: this node and below, M_GT: strictly below.
+            setMax(best, node->ge);
+            if (node->child[0] >= 0) setMax(best, nodes[node->child[0]].gt);
+            if (node->child[1] >= 0) setMax(best, nodes[node->child[1]].gt);
+            break;
+        }
+
+        setMax(best, node->lt);
+
+        int32_t next = node->child[getBit(prefix, depth)];
+        if (next < 0) break;
+        node = &nodes[next];
+    }
+
+    return best;
+}
+
+/**
+ * @brief Test if there are rules in the trie.
+ * 
+ * @return true No rules in the trie.
+ * @return false There are rules in the trie.
+ */
+bool BgpFilterTrie::empty() const {
+    return !has_rules;
+}
+
+/**
+ * @brief Compile a list of rules.
+ * 
+ * @param rules The rules, in the order they were appended.
+ */
+BgpFilterMatcher::BgpFilterMatcher(const std::vector<std::shared_ptr<BgpFilterRule>> &rules) : trie4(32), trie6(128) {
+    not_has_asn = -1;
+    not_has_community = -1;
+    cache_hits = 0;
+    cache_misses = 0;
+
+    for (size_t i = 0; i < rules.size(); i++) {
+        const BgpFilterRule &rule = *rules[i];
+        const std::type_info &type = typeid(rule);
+        int32_t index = (int32_t) i;
+
+        if (type == typeid(BgpFilterRuleRoute4) || type == typeid(BgpFilterRuleRoute<Prefix4>)) {
+            const BgpFilterRuleRoute<Prefix4> &route_rule = dynamic_cast<const BgpFilterRuleRoute<Prefix4> &>(rule);
+            uint32_t prefix = route_rule.prefix.getPrefix();
+            uint8_t length = route_rule.prefix.getLength();
+
+            if (route_rule.match_type <= M_LE && (route_rule.match_type <= M_NE || !hasHostBits((const uint8_t *) &prefix, length, 32))) {
+                addRoute4(route_rule, index);
+                continue;
+            }
+        }
+
+        if (type == typeid(BgpFilterRuleRoute6) || type == typeid(BgpFilterRuleRoute<Prefix6>)) {
+            const BgpFilterRuleRoute<Prefix6> &route_rule = dynamic_cast<const BgpFilterRuleRoute<Prefix6> &>(rule);
+            uint8_t prefix[16];
+            route_rule.prefix.getPrefix(prefix);
+            uint8_t length = route_rule.prefix.getLength();
+
+            if (route_rule.match_type <= M_LE && (route_rule.match_type <= M_NE || !hasHostBits(prefix, length, 128))) {
+                addRoute6(route_rule, index);
+                continue;
+            }
+        }
+
+        if (type == typeid(BgpFilterRuleAsPath) && rule.match_type <= M_NOT_FROM_ASN) {
+            addAsPath(dynamic_cast<const BgpFilterRuleAsPath &>(rule), index);
+            continue;
+        }
+
+        if (type == typeid(BgpFilterRuleAsPathRegex) && rule.match_type <= M_REGEX_NOT_MATCH) {
+            as_path_regex.push_back(std::make_pair(index, rules[i]));
+            continue;
+        }
+
+        if (type == typeid(BgpFilterRuleCommunity) && rule.match_type <= M_NOT_HAS_COMMUNITY) {
+            addCommunity(dynamic_cast<const BgpFilterRuleCommunity &>(rule), index);
+            continue;
+        }
+
+        if (type == typeid(BgpFilterRuleLargeCommunity) && rule.match_type <= M_NOT_HAS_COMMUNITY) {
+            addLargeCommunity(dynamic_cast<const BgpFilterRuleLargeCommunity &>(rule), index);
+            continue;
+        }
+
+        if (type == typeid(BgpFilterRuleExtCommunity) && rule.match_type <= M_NOT_HAS_COMMUNITY) {
+            addExtCommunity(dynamic_cast<const BgpFilterRuleExtCommunity &>(rule), index);
+            continue;
+        }
+
+        others.push_back(std::make_pair(index, rules[i]));
+    }
+
+    trie4.build();
+    trie6.build();
+
+    std::sort(ne4.begin(), ne4.end(), compareIndex<uint64_t>);
+    std::sort(ne6.begin(), ne6.end(), compareIndex<BgpFilterKey6>);
+    std::sort(not_from_asn.begin(), not_from_asn.end(), compareIndex<uint32_t>);
+    std::sort(not_has_large_community.begin(), not_has_large_community.end(), compareIndex<BgpLargeCommunity>);
+    std::sort(not_has_ext_community.begin(), not_has_ext_community.end(), compareIndex<uint64_t>);
+    std::sort(as_path_regex.begin(), as_path_regex.end(), compareIndex<std::shared_ptr<BgpFilterRule>>);
+    std::sort(others.begin(), others.end(), compareIndex<std::shared_ptr<BgpFilterRule>>);
+}
+
+void BgpFilterMatcher::addRoute4(const BgpFilterRuleRoute<Prefix4> &rule, int32_t index) {
+    uint32_t prefix = rule.prefix.getPrefix();
+    uint8_t length = rule.prefix.getLength();
+    uint64_t key = makeKey4(prefix, length);
+
+    switch (rule.match_type) {
+        case M_EQ: {
+            std::unordered_map<uint64_t, int32_t>::iterator it = eq4.insert(std::make_pair(key, -1)).first;
+            setMax(it->second, index);
+            break;
+        }
+        case M_NE: ne4.push_back(std::make_pair(index, key)); break;
+        default: trie4.insert((const uint8_t *) &prefix, length, rule.match_type, index);
+    }
+}
+
+void BgpFilterMatcher::addRoute6(const BgpFilterRuleRoute<Prefix6> &rule, int32_t index) {
+    BgpFilterKey6 key = makeKey6(rule.prefix);
+
+    switch (rule.match_type) {
+        case M_EQ: {
+            std::unordered_map<BgpFilterKey6, int32_t, BgpFilterKey6Hash>::iterator it = eq6.insert(std::make_pair(key, -1)).first;
+            setMax(it->second, index);
+            break;
+        }
+        case M_NE: ne6.push_back(std::make_pair(index, key)); break;
+        default: trie6.insert(key.prefix, key.length, rule.match_type, index);
+    }
+}
+
+void BgpFilterMatcher::addAsPath(const BgpFilterRuleAsPath &rule, int32_t index) {
+    switch (rule.match_type) {
+        case M_HAS_ASN: {
+            std::unordered_map<uint32_t, int32_t>::iterator it = has_asn.insert(std::make_pair(rule.asn, -1)).first;
+            setMax(it->second, index);
+            break;
+        }
+        case M_FROM_ASN: {
+            std::unordered_map<uint32_t, int32_t>::iterator it = from_asn.insert(std::make_pair(rule.asn, -1)).first;
+            setMax(it->second, index);
+            break;
+        }
+        case M_NOT_FROM_ASN: not_from_asn.push_back(std::make_pair(index, rule.asn)); break;
+        case M_NOT_HAS_ASN: setMax(not_has_asn, index); break;
+    }
+}
+
+void BgpFilterMatcher::addCommunity(const BgpFilterRuleCommunity &rule, int32_t index) {
+    switch (rule.match_type) {
+        case M_HAS_COMMUNITY: {
+            std::unordered_map<uint32_t, int32_t>::iterator it = has_community.insert(std::make_pair(rule.community, -1)).first;
+            setMax(it->second, index);
+            break;
+        }
+        case M_NOT_HAS_COMMUNITY: setMax(not_has_community, index); break;
+    }
+}
+
+void BgpFilterMatcher::addLargeCommunity(const BgpFilterRuleLargeCommunity &rule, int32_t index) {
+    switch (rule.match_type) {
+        case M_HAS_COMMUNITY: {
+            std::unordered_map<BgpLargeCommunity, int32_t, BgpLargeCommunityHash>::iterator it = has_large_community.insert(std::make_pair(rule.community, -1)).first;
+            setMax(it->second, index);
+            break;
+        }
+        case M_NOT_HAS_COMMUNITY: not_has_large_community.push_back(std::make_pair(index, rule.community)); break;
+    }
+}
+
+void BgpFilterMatcher::addExtCommunity(const BgpFilterRuleExtCommunity &rule, int32_t index) {
+    switch (rule.match_type) {
+        case M_HAS_COMMUNITY: {
+            std::unordered_map<uint64_t, int32_t>::iterator it = has_ext_community.insert(std::make_pair(rule.community, -1)).first;
+            setMax(it->second, index);
+            break;
+        }
+        case M_NOT_HAS_COMMUNITY: not_has_ext_community.push_back(std::make_pair(index, rule.community)); break;
+    }
+}
+
+bool BgpFilterMatcher::hasAttribRules() const {
+    return has_asn.size() > 0 || from_asn.size() > 0 || not_from_asn.size() > 0 || not_has_asn >= 0 ||
+        has_community.size() > 0 || not_has_community >= 0 ||
+        has_large_community.size() > 0 || not_has_large_community.size() > 0 ||
+        has_ext_community.size() > 0 || not_has_ext_community.size() > 0 ||
+        as_path_regex.size() > 0;
+}
+
+int32_t BgpFilterMatcher::matchRoute4(const Prefix4 &prefix) const {
+    uint32_t prefix_val = prefix.getPrefix();
+    uint8_t length = prefix.getLength();
+    uint64_t key = makeKey4(prefix_val, length);
+    int32_t best = -1;
+
+    if (eq4.size() > 0) {
+        std::unordered_map<uint64_t, int32_t>::const_iterator it = eq4.find(key);
+        if (it != eq4.end()) best = it->second;
+    }
+
+    for (const std::pair<int32_t, uint64_t> &ne : ne4) {
+        if (ne.first <= best) break;
+        if (ne.second != key) {
+            best = ne.first;
+            break;
+        }
+    }
+
+    if (!trie4.empty()) {
+        const uint8_t *prefix_ptr = (const uint8_t *) &prefix_val;
+        setMax(best, trie4.match(prefix_ptr, length, hasHostBits(prefix_ptr, length, 32)));
+    }
+
+    return best;
+}
+
+int32_t BgpFilterMatcher::matchRoute6(const Prefix6 &prefix) const {
+    BgpFilterKey6 key = makeKey6(prefix);
+    int32_t best = -1;
+
+    if (eq6.size() > 0) {
+        std::unordered_map<BgpFilterKey6, int32_t, BgpFilterKey6Hash>::const_iterator it = eq6.find(key);
+        if (it != eq6.end()) best = it->second;
+    }
+
+    for (const std::pair<int32_t, BgpFilterKey6> &ne : ne6) {
+        if (ne.first <= best) break;
+        if (!(ne.second == key)) {
+            best = ne.first;
+            break;
+        }
+    }
+
+    if (!trie6.empty()) {
+        setMax(best, trie6.match(key.prefix, key.length, hasHostBits(key.prefix, key.length, 128)));
+    }
+
+    return best;
+}
+
+/**
+ * @brief Match path attributes against the AS_PATH and community rules.
+ * 
+ * The result only depends on the path attributes, so it can be shared by all
+ * routes with the same path attributes. (see match())
+ * 
+ * @param attribs Path attribues.
+ * @return int32_t Index of the matching AS_PATH/community rule with the highest
+ * index, -1 if none.
+ */
+int32_t BgpFilterMatcher::matchAttribs(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) const {
+    int32_t best = -1;
+
+    if (!hasAttribRules()) return best;
+
+    bool as_rules = has_asn.size() > 0 || from_asn.size() > 0 || not_from_asn.size() > 0 || not_has_asn >= 0;
+    bool community_rules = has_community.size() > 0 || not_has_community >= 0;
+    bool large_community_rules = has_large_community.size() > 0 || not_has_large_community.size() > 0;
+    bool ext_community_rules = has_ext_community.size() > 0 || not_has_ext_community.size() > 0;
+
+    // communities of the route, for M_NOT_HAS_COMMUNITY.
+    std::vector<BgpLargeCommunity> large_communities;
+    std::vector<uint64_t> ext_communities;
+
+    // origin ASN of the AS_SEQUENCE segments, for M_NOT_FROM_ASN.
+    bool has_origin = false;
+    bool multiple_origins = false;
+    uint32_t origin = 0;
+
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attribs) {
+        if (as_rules && attr->type_code == AS_PATH) {
+            const BgpPathAttribAsPath &as_path = dynamic_cast<const BgpPathAttribAsPath &>(*attr);
+            setMax(best, not_has_asn);
+
+            for (const BgpAsPathSegment &as_seg : as_path.as_paths) {
+                if (as_seg.type != AS_SEQUENCE || as_seg.value.size() == 0) continue;
+
+                uint32_t seg_origin = as_seg.value.back();
+                if (has_origin && seg_origin != origin) multiple_origins = true;
+                has_origin = true;
+                origin = seg_origin;
+
+                if (from_asn.size() > 0) {
+                    std::unordered_map<uint32_t, int32_t>::const_iterator it = from_asn.find(seg_origin);
+                    if (it != from_asn.end()) setMax(best, it->second);
+                }
+
+                if (has_asn.size() == 0) continue;
+
+                for (uint32_t asn : as_seg.value) {
+                    std::unordered_map<uint32_t, int32_t>::const_iterator it = has_asn.find(asn);
+                    if (it != has_asn.end()) setMax(best, it->second);
+                }
+            }
+        }
+
+        if (community_rules && attr->type_code == COMMUNITY) {
+            const BgpPathAttribCommunity &community = dynamic_cast<const BgpPathAttribCommunity &>(*attr);
+            setMax(best, not_has_community);
+
+            if (has_community.size() == 0) continue;
+
+            for (uint32_t community_val : community.communites) {
+                std::unordered_map<uint32_t, int32_t>::const_iterator it = has_community.find(community_val);
+                if (it != has_community.end()) setMax(best, it->second);
+            }
+        }
+
+        if (large_community_rules && attr->type_code == LARGE_COMMUNITY) {
+            const BgpPathAttribLargeCommunity &large = dynamic_cast<const BgpPathAttribLargeCommunity &>(*attr);
+
+            if (not_has_large_community.size() > 0) {
+                large_communities.insert(large_communities.end(), large.large_communities.begin(), large.large_communities.end());
+            }
+
+            if (has_large_community.size() == 0) continue;
+
+            for (const BgpLargeCommunity &community_val : large.large_communities) {
+                std::unordered_map<BgpLargeCommunity, int32_t, BgpLargeCommunityHash>::const_iterator it = has_large_community.find(community_val);
+                if (it != has_large_community.end()) setMax(best, it->second);
+            }
+        }
+
+        if (ext_community_rules && attr->type_code == EXTENDED_COMMUNITY) {
+            const BgpPathAttribExtCommunity &ext = dynamic_cast<const BgpPathAttribExtCommunity &>(*attr);
+
+            if (not_has_ext_community.size() > 0) {
+                ext_communities.insert(ext_communities.end(), ext.ext_communities.begin(), ext.ext_communities.end());
+            }
+
+            if (has_ext_community.size() == 0) continue;
+
+            for (uint64_t community_val : ext.ext_communities) {
+                std::unordered_map<uint64_t, int32_t>::const_iterator it = has_ext_community.find(community_val);
+                if (it != has_ext_community.end()) setMax(best, it->second);
+            }
+        }
+    }
+
+    if (not_has_large_community.size() > 0 && not_has_large_community[0].first > best) {
+        std::sort(large_communities.begin(), large_communities.end());
+
+        for (const std::pair<int32_t, BgpLargeCommunity> &rule : not_has_large_community) {
+            if (rule.first <= best) break;
+            if (!std::binary_search(large_communities.begin(), large_communities.end(), rule.second)) {
+                best = rule.first;
+                break;
+            }
+        }
+    }
+
+    if (not_has_ext_community.size() > 0 && not_has_ext_community[0].first > best) {
+        std::sort(ext_communities.begin(), ext_communities.end());
+
+        for (const std::pair<int32_t, uint64_t> &rule : not_has_ext_community) {
+            if (rule.first <= best) break;
+            if (!std::binary_search(ext_communities.begin(), ext_communities.end(), rule.second)) {
+                best = rule.first;
+                break;
+            }
+        }
+    }
+
+    if (has_origin) {
+        for (const std::pair<int32_t, uint32_t> &rule : not_from_asn) {
+            if (rule.first <= best) break;
+            if (multiple_origins || rule.second != origin) {
+                best = rule.first;
+                break;
+            }
+        }
+    }
+
+    for (const std::pair<int32_t, std::shared_ptr<BgpFilterRule>> &rule : as_path_regex) {
+        if (rule.first <= best) break;
+        const BgpFilterRuleAsPathRegex &regex_rule = static_cast<const BgpFilterRuleAsPathRegex &>(*rule.second);
+        if ((regex_rule.match_type == M_REGEX_MATCH) == regex_rule.regex.match(attribs)) {
+            best = rule.first;
+            break;
+        }
+    }
+
+    return best;
+}
+
+/**
+ * @brief Find the rule to use for a route.
+ * 
+ * @param prefix Route prefix.
+ * @param attribs Path attribues.
+ * @return int32_t Index of the rule in the rules set, -1 if no rule matches.
+ */
+int32_t BgpFilterMatcher::match(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) const {
+    return match(prefix, attribs, matchAttribs(attribs));
+}
+
+/**
+ * @brief Match path attributes, with the verdict cache.
+ * 
+ * Same as matchAttribs(), but the result is cached by the identity of the
+ * AS_PATH and community attributes. Attributes created in an arena (see
+ * BgpPathAttrib::in_arena) are not cached.
+ * 
+ * @param attribs Path attribues.
+ * @return int32_t Same as matchAttribs().
+ */
+int32_t BgpFilterMatcher::matchAttribsCached(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    if (!hasAttribRules()) return -1;
+
+    const std::shared_ptr<BgpPathAttrib> *as_path = NULL;
+    const std::shared_ptr<BgpPathAttrib> *community = NULL;
+    const std::shared_ptr<BgpPathAttrib> *large_community = NULL;
+    const std::shared_ptr<BgpPathAttrib> *ext_community = NULL;
+
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attribs) {
+        const std::shared_ptr<BgpPathAttrib> **slot = NULL;
+
+        switch (attr->type_code) {
+            case AS_PATH: slot = &as_path; break;
+            case COMMUNITY: slot = &community; break;
+            case LARGE_COMMUNITY: slot = &large_community; break;
+            case EXTENDED_COMMUNITY: slot = &ext_community; break;
+            default: continue;
+        }
+
+        // attributes in an arena: their address is reused by the attributes of
+        // the next message once the arena is reset, don't cache.
+        if (attr->in_arena.isSet()) return matchAttribs(attribs);
+
+        // duplicated attributes, don't cache.
+        if (*slot != NULL) return matchAttribs(attribs);
+        *slot = &attr;
+    }
+
+    // nothing to key the cache with. (no AS_PATH matches regular expressions
+    // as an empty path, no community matches M_NOT_HAS_COMMUNITY rules of
+    // large and extended communities)
+    if (as_path == NULL && community == NULL && large_community == NULL && ext_community == NULL) return matchAttribs(attribs);
+
+    BgpFilterAttribsKey key;
+    key.as_path = as_path == NULL ? NULL : as_path->get();
+    key.community = community == NULL ? NULL : community->get();
+    key.large_community = large_community == NULL ? NULL : large_community->get();
+    key.ext_community = ext_community == NULL ? NULL : ext_community->get();
+
+    {
+        std::lock_guard<std::mutex> lock(cache_mutex);
+        auto it = cache.find(key);
+
+        if (it != cache.end() && 
+            (as_path == NULL || !it->second.as_path.expired()) &&
+            (community == NULL || !it->second.community.expired()) &&
+            (large_community == NULL || !it->second.large_community.expired()) &&
+            (ext_community == NULL || !it->second.ext_community.expired())) {
+            cache_hits++;
+            return it->second.match;
+        }
+    }
+
+    cache_misses++;
+    int32_t match = matchAttribs(attribs);
+
+    BgpFilterAttribsVerdict verdict;
+    if (as_path != NULL) verdict.as_path = *as_path;
+    if (community != NULL) verdict.community = *community;
+    if (large_community != NULL) verdict.large_community = *large_community;
+    if (ext_community != NULL) verdict.ext_community = *ext_community;
+    verdict.match = match;
+
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (cache.size() >= BGP_FILTER_CACHE_SIZE) cache.clear();
+    cache[key] = verdict;
+
+    return match;
+}
+
+/**
+ * @brief Get the number of matchAttribsCached() calls answered by the cache.
+ * 
+ * @return uint64_t Number of cache hits.
+ */
+uint64_t BgpFilterMatcher::getCacheHits() const {
+    return cache_hits;
+}
+
+/**
+ * @brief Get the number of matchAttribsCached() calls not answered by the
+ * cache.
+ * 
+ * @return uint64_t Number of cache misses.
+ */
+uint64_t BgpFilterMatcher::getCacheMisses() const {
+    return cache_misses;
+}
+
+/**
+ * @brief Find the rule to use for a route, with the result of matchAttribs().
+ * 
+ * @param prefix Route prefix.
+ * @param attribs Path attribues.
+ * @param attribs_match Result of matchAttribs() on the path attribues.
+ * @return int32_t Index of the rule in the rules set, -1 if no rule matches.
+ */
+int32_t BgpFilterMatcher::match(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, int32_t attribs_match) const {
+    int32_t best = attribs_match;
+
+    if (prefix.afi == IPV4) setMax(best, matchRoute4(static_cast<const Prefix4 &>(prefix)));
+    else if (prefix.afi == IPV6) setMax(best, matchRoute6(static_cast<const Prefix6 &>(prefix)));
+
+    for (const std::pair<int32_t, std::shared_ptr<BgpFilterRule>> &rule : others) {
+        if (rule.first <= best) break;
+        if (rule.second->apply(prefix, attribs) != NOP) return rule.first;
+    }
+
+    return best;
+}
+
+}
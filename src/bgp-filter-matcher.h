@@ -0,0 +1,252 @@
+/**
+ * @file bgp-filter-matcher.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief The compiled route filtering matcher.
+ * @version 0.1
+ * @date 2019-08-05
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_FILTER_MATCHER_H_
+#define BGP_FILTER_MATCHER_H_
+#define BGP_FILTER_CACHE_SIZE 65536
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <unordered_map>
+#include "bgp-filter.h"
+
+namespace libbgp {
+
+/**
+ * @brief Binary prefix trie for route filtering rules.
+ * 
+ * Every node in the trie represents a prefix. A node keeps the highest index
+ * of the M_LE and M_LT rules on the node, and the highest index of the M_GE and
+ * M_GT rules in the subtree of the node, so a route can be matched against all
+ * of them with a single walk from the root.
+ * 
+ * Only rules with a prefix that has no host bits set can be added to the trie.
+ */
+class BgpFilterTrie {
+public:
+    BgpFilterTrie(uint8_t max_length);
+
+    // add a M_LE/M_LT/M_GE/M_GT rule to the trie.
+    void insert(const uint8_t *prefix, uint8_t length, uint8_t match_type, int32_t index);
+
+    // propagate M_GE/M_GT indexes to the parent nodes. call after all inserts.
+    void build();
+
+    // get the highest index of rules matching the route, -1 if none.
+    int32_t match(const uint8_t *prefix, uint8_t length, bool host_bits_set) const;
+
+    // test if there are rules in the trie.
+    bool empty() const;
+
+private:
+    struct Node {
+        int32_t child[2];
+        int32_t le;
+        int32_t lt;
+        int32_t ge;
+        int32_t gt;
+    };
+
+    int32_t build(int32_t node);
+
+    std::vector<Node> nodes;
+    uint8_t max_length;
+    bool has_rules;
+};
+
+/**
+ * @brief Key of the IPv6 M_EQ/M_NE rules.
+ * 
+ */
+struct BgpFilterKey6 {
+    uint8_t prefix[16];
+    uint8_t length;
+
+    bool operator== (const BgpFilterKey6 &other) const {
+        return length == other.length && memcmp(prefix, other.prefix, 16) == 0;
+    }
+};
+
+/**
+ * @brief Hasher for BgpFilterKey6.
+ * 
+ */
+struct BgpFilterKey6Hash {
+    std::size_t operator()(const BgpFilterKey6 &key) const {
+        uint64_t hi, lo;
+        memcpy(&hi, key.prefix, 8);
+        memcpy(&lo, key.prefix + 8, 8);
+        return (hi * 31 + lo) ^ key.length;
+    }
+};
+
+/**
+ * @brief Hasher for BgpLargeCommunity.
+ * 
+ */
+struct BgpLargeCommunityHash {
+    std::size_t operator()(const BgpLargeCommunity &community) const {
+        return ((uint64_t) community.global * 0x9e3779b1 + community.local1) * 0x9e3779b1 + community.local2;
+    }
+};
+
+/**
+ * @brief Key of the attribute verdict cache: the AS_PATH and community
+ * attributes of a route, by identity.
+ * 
+ */
+struct BgpFilterAttribsKey {
+    const BgpPathAttrib *as_path;
+    const BgpPathAttrib *community;
+    const BgpPathAttrib *large_community;
+    const BgpPathAttrib *ext_community;
+
+    bool operator== (const BgpFilterAttribsKey &other) const {
+        return as_path == other.as_path && community == other.community &&
+            large_community == other.large_community && ext_community == other.ext_community;
+    }
+};
+
+/**
+ * @brief Hasher for BgpFilterAttribsKey.
+ * 
+ */
+struct BgpFilterAttribsKeyHash {
+    std::size_t operator()(const BgpFilterAttribsKey &key) const {
+        std::hash<const void *> hash;
+        return ((hash(key.as_path) * 31 + hash(key.community)) * 31 + hash(key.large_community)) * 31 + hash(key.ext_community);
+    }
+};
+
+/**
+ * @brief Cached result of BgpFilterMatcher::matchAttribs.
+ * 
+ * The attributes are kept as weak references: an entry whose attributes are
+ * gone is stale (the address may have been reused by another attribute) and
+ * is replaced on the next lookup.
+ */
+struct BgpFilterAttribsVerdict {
+    std::weak_ptr<BgpPathAttrib> as_path;
+    std::weak_ptr<BgpPathAttrib> community;
+    std::weak_ptr<BgpPathAttrib> large_community;
+    std::weak_ptr<BgpPathAttrib> ext_community;
+    int32_t match;
+};
+
+/**
+ * @brief The compiled form of a BgpFilterRules rules set.
+ * 
+ * BgpFilterMatcher finds the rule that BgpFilterRules::apply would have
+ * picked without visiting every rule:
+ * 
+ * - Route rules go into a prefix trie (M_LE, M_LT, M_GE, M_GT) or a hash table
+ * (M_EQ), for each address family.
+ * - AS_PATH rules go into hashed ASN sets, COMMUNITY, LARGE_COMMUNITY and
+ * EXTENDED_COMMUNITY rules into hashed community sets, so the attributes are
+ * scanned once per route, instead of once per rule. M_NOT_HAS_COMMUNITY rules
+ * of large and extended communities are looked up in the sorted communities
+ * of the route, from the highest index down.
+ * - AS_PATH regular expression rules are kept with the other path attribute
+ * rules, so their result is cached with them.
+ * 
+ * The rule with the highest index among the matching rules wins, which is the
+ * same as walking the rules from the last one and stopping at the first match.
+ * Rules that can't be compiled (rule types unknown to the matcher, or route
+ * rules with host bits set in the prefix) are kept as-is and applied in that
+ * order.
+ * 
+ * Results of matchAttribs() can be cached with matchAttribsCached(), keyed by
+ * the AS_PATH and community attribute objects of the route. Routes received in
+ * the same update share those objects, so the path attribute rules are
+ * evaluated once per update instead of once per route or per peer. Attribute
+ * objects must not be modified once they are matched with the cache.
+ * Attributes in a message arena are matched without the cache, since their
+ * addresses are reused once the arena is reset.
+ */
+class BgpFilterMatcher {
+public:
+    BgpFilterMatcher(const std::vector<std::shared_ptr<BgpFilterRule>> &rules);
+
+    // get index of the rule to use, -1 if no rule matches.
+    int32_t match(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) const;
+    int32_t match(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, int32_t attribs_match) const;
+
+    // match path attributes only, for routes sharing the same attributes.
+    int32_t matchAttribs(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) const;
+
+    // matchAttribs(), with the verdict cache.
+    int32_t matchAttribsCached(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+
+    // get verdict cache statistics.
+    uint64_t getCacheHits() const;
+    uint64_t getCacheMisses() const;
+
+private:
+    void addRoute4(const BgpFilterRuleRoute<Prefix4> &rule, int32_t index);
+    void addRoute6(const BgpFilterRuleRoute<Prefix6> &rule, int32_t index);
+    void addAsPath(const BgpFilterRuleAsPath &rule, int32_t index);
+    void addCommunity(const BgpFilterRuleCommunity &rule, int32_t index);
+    void addLargeCommunity(const BgpFilterRuleLargeCommunity &rule, int32_t index);
+    void addExtCommunity(const BgpFilterRuleExtCommunity &rule, int32_t index);
+
+    // test if there are rules matching path attributes.
+    bool hasAttribRules() const;
+
+    int32_t matchRoute4(const Prefix4 &prefix) const;
+    int32_t matchRoute6(const Prefix6 &prefix) const;
+
+    // route rules.
+    BgpFilterTrie trie4;
+    BgpFilterTrie trie6;
+    std::unordered_map<uint64_t, int32_t> eq4;
+    std::unordered_map<BgpFilterKey6, int32_t, BgpFilterKey6Hash> eq6;
+    std::vector<std::pair<int32_t, uint64_t>> ne4;
+    std::vector<std::pair<int32_t, BgpFilterKey6>> ne6;
+
+    // AS_PATH rules.
+    std::unordered_map<uint32_t, int32_t> has_asn;
+    std::unordered_map<uint32_t, int32_t> from_asn;
+    std::vector<std::pair<int32_t, uint32_t>> not_from_asn;
+    int32_t not_has_asn;
+    std::vector<std::pair<int32_t, std::shared_ptr<BgpFilterRule>>> as_path_regex;
+
+    // COMMUNITY rules.
+    std::unordered_map<uint32_t, int32_t> has_community;
+    int32_t not_has_community;
+
+    // LARGE_COMMUNITY and EXTENDED_COMMUNITY rules.
+    std::unordered_map<BgpLargeCommunity, int32_t, BgpLargeCommunityHash> has_large_community;
+    std::vector<std::pair<int32_t, BgpLargeCommunity>> not_has_large_community;
+    std::unordered_map<uint64_t, int32_t> has_ext_community;
+    std::vector<std::pair<int32_t, uint64_t>> not_has_ext_community;
+
+    // rules to apply as-is.
+    std::vector<std::pair<int32_t, std::shared_ptr<BgpFilterRule>>> others;
+
+    // verdict cache.
+    std::unordered_map<BgpFilterAttribsKey, BgpFilterAttribsVerdict, BgpFilterAttribsKeyHash> cache;
+    std::mutex cache_mutex;
+    std::atomic<uint64_t> cache_hits;
+    std::atomic<uint64_t> cache_misses;
+};
+
+/**
+ * @example filter-compile.cc
+ * Example of compiling filter rules sets. The results of compiled and
+ * interpreted rules sets are compared on random rules, routes and attributes.
+ * This example also times a large prefix list with and without compiling.
+ */
+
+}
+
+#endif // BGP_FILTER_MATCHER_H_
@@ -10,6 +10,7 @@
  */
 #include <arpa/inet.h>
 #include "bgp-filter.h"
+#include "bgp-filter-matcher.h"
 #include "value-op.h"
 
 namespace libbgp {
@@ -122,6 +123,169 @@ BgpFilterOP BgpFilterRuleCommunity::apply(__attribute__((unused)) const Prefix &
     return NOP;
 }
 
+/**
+ * @brief Construct a new LARGE_COMMUNITY filtering object
+ * 
+ * @param op Action to take if the large community matched.
+ * @param type Type of matching.
+ * @param global Global administrator part of the large community.
+ * @param local1 Local data part 1 of the large community.
+ * @param local2 Local data part 2 of the large community.
+ */
+BgpFilterRuleLargeCommunity::BgpFilterRuleLargeCommunity(BgpFilterOP op, BgpFilterRuleCommunityMatchType type, uint32_t global, uint32_t local1, uint32_t local2) {
+    this->filter_type = F_LARGE_COMMUNITY;
+    this->op = op;
+    this->match_type = type;
+    community.global = global;
+    community.local1 = local1;
+    community.local2 = local2;
+}
+
+/**
+ * @brief Construct a new LARGE_COMMUNITY filtering object
+ * 
+ * @param op Action to take if the large community matched.
+ * @param type Type of matching.
+ * @param community The large community.
+ */
+BgpFilterRuleLargeCommunity::BgpFilterRuleLargeCommunity(BgpFilterOP op, BgpFilterRuleCommunityMatchType type, const BgpLargeCommunity &community) {
+    this->filter_type = F_LARGE_COMMUNITY;
+    this->op = op;
+    this->match_type = type;
+    this->community = community;
+}
+
+BgpFilterOP BgpFilterRuleLargeCommunity::apply(__attribute__((unused)) const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    bool has = false;
+
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attribs) {
+        if (attr->type_code != LARGE_COMMUNITY) continue;
+        const BgpPathAttribLargeCommunity &large = dynamic_cast<const BgpPathAttribLargeCommunity &>(*attr);
+
+        for (const BgpLargeCommunity &community_val : large.large_communities) {
+            if (community_val == community) {
+                has = true;
+                break;
+            }
+        }
+    }
+
+    return (match_type == M_HAS_COMMUNITY) == has ? op : NOP;
+}
+
+/**
+ * @brief Construct a new EXTENDED_COMMUNITY filtering object
+ * 
+ * @param op Action to take if the extended community matched.
+ * @param type Type of matching.
+ * @param community The extended community in host byte order.
+ */
+BgpFilterRuleExtCommunity::BgpFilterRuleExtCommunity(BgpFilterOP op, BgpFilterRuleCommunityMatchType type, uint64_t community) {
+    this->filter_type = F_EXT_COMMUNITY;
+    this->op = op;
+    this->match_type = type;
+    this->community = community;
+}
+
+BgpFilterOP BgpFilterRuleExtCommunity::apply(__attribute__((unused)) const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    bool has = false;
+
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attribs) {
+        if (attr->type_code != EXTENDED_COMMUNITY) continue;
+        const BgpPathAttribExtCommunity &ext = dynamic_cast<const BgpPathAttribExtCommunity &>(*attr);
+
+        for (uint64_t community_val : ext.ext_communities) {
+            if (community_val == community) {
+                has = true;
+                break;
+            }
+        }
+    }
+
+    return (match_type == M_HAS_COMMUNITY) == has ? op : NOP;
+}
+
+/**
+ * @brief Construct a new AS_PATH regular expression filtering object
+ * 
+ * @param op Action to take if the AS_PATH matched.
+ * @param type Type of matching.
+ * @param regex Compiled expression to match.
+ */
+BgpFilterRuleAsPathRegex::BgpFilterRuleAsPathRegex(BgpFilterOP op, BgpFilterRuleAsPathRegexMatchType type, const BgpAsPathRegex &regex) : regex(regex) {
+    this->filter_type = F_AS_PATH_REGEX;
+    this->op = op;
+    this->match_type = type;
+}
+
+BgpFilterOP BgpFilterRuleAsPathRegex::apply(__attribute__((unused)) const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    return (match_type == M_REGEX_MATCH) == regex.match(attribs) ? op : NOP;
+}
+
+/**
+ * @brief Construct a new RPKI filtering object
+ * 
+ * @param op Action to take if the validation state matched.
+ * @param type Type of matching.
+ * @param table The ROA table to validate routes with.
+ * @param local_asn Local ASN. Routes with an empty AS_PATH are validated with
+ * it as the origin.
+ */
+BgpFilterRuleRpki::BgpFilterRuleRpki(BgpFilterOP op, BgpFilterRuleRpkiMatchType type, const BgpRoaTable &table, uint32_t local_asn) : table(table) {
+    this->filter_type = F_RPKI;
+    this->op = op;
+    this->match_type = type;
+    this->local_asn = local_asn;
+}
+
+BgpFilterOP BgpFilterRuleRpki::apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    BgpRpkiState state = table.validate(prefix, attribs, local_asn);
+
+    if (match_type == M_RPKI_VALID) return state == RPKI_VALID ? op : NOP;
+    if (match_type == M_RPKI_INVALID) return state == RPKI_INVALID ? op : NOP;
+    if (match_type == M_RPKI_NOT_FOUND) return state == RPKI_NOT_FOUND ? op : NOP;
+
+    return NOP;
+}
+
+/**
+ * @brief Construct a new IPv4 prefix set filtering object
+ * 
+ * @param op Action to take if the prefix matched.
+ * @param type Type of matching.
+ * @param set Prefix set to match. The set is shared with the rule.
+ */
+BgpFilterRulePrefixSet4::BgpFilterRulePrefixSet4(BgpFilterOP op, BgpFilterRulePrefixSetMatchType type, const PrefixSet4 &set) : set(set) {
+    this->filter_type = F_PREFIX_SET;
+    this->op = op;
+    this->match_type = type;
+}
+
+BgpFilterOP BgpFilterRulePrefixSet4::apply(const Prefix &prefix, __attribute__((unused)) const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    if (prefix.afi != IPV4) return NOP;
+    bool in_set = set.includes(static_cast<const Prefix4 &>(prefix));
+    return (match_type == M_IN_SET) == in_set ? op : NOP;
+}
+
+/**
+ * @brief Construct a new IPv6 prefix set filtering object
+ * 
+ * @param op Action to take if the prefix matched.
+ * @param type Type of matching.
+ * @param set Prefix set to match. The set is shared with the rule.
+ */
+BgpFilterRulePrefixSet6::BgpFilterRulePrefixSet6(BgpFilterOP op, BgpFilterRulePrefixSetMatchType type, const PrefixSet6 &set) : set(set) {
+    this->filter_type = F_PREFIX_SET;
+    this->op = op;
+    this->match_type = type;
+}
+
+BgpFilterOP BgpFilterRulePrefixSet6::apply(const Prefix &prefix, __attribute__((unused)) const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    if (prefix.afi != IPV6) return NOP;
+    bool in_set = set.includes(static_cast<const Prefix6 &>(prefix));
+    return (match_type == M_IN_SET) == in_set ? op : NOP;
+}
+
 /**
  * @brief Construct a new BgpFilterRules rules set.
  * 
@@ -141,6 +305,23 @@ BgpFilterRules::BgpFilterRules(BgpFilterOP default_op) {
     this->default_op = default_op;
 }
 
+/**
+ * @brief Compile the rules set.
+ * 
+ * Build a BgpFilterMatcher from the rules, so apply() no longer has to try
+ * every rule on every route. The result of apply() is not changed. Appending a
+ * rule drops the compiled matcher; call compile() again after all rules are
+ * appended.
+ * 
+ * The compiled matcher also caches the result of the AS_PATH and community
+ * rules for each attribute set (see getCacheHits()). The cache is dropped with
+ * the matcher.
+ * 
+ */
+void BgpFilterRules::compile() {
+    matcher = std::shared_ptr<BgpFilterMatcher>(new BgpFilterMatcher(rules));
+}
+
 /**
  * @brief Apply the rules set on a route.
  * 
@@ -150,6 +331,11 @@ BgpFilterRules::BgpFilterRules(BgpFilterOP default_op) {
  */
 BgpFilterOP BgpFilterRules::apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
     if (rules.size() == 0) return default_op;
+
+    if (matcher) {
+        int32_t index = matcher->match(prefix, attribs, matcher->matchAttribsCached(attribs));
+        return index < 0 ? default_op : rules[index]->op;
+    }
     
     auto rule = rules.end();
 
@@ -162,4 +348,284 @@ BgpFilterOP BgpFilterRules::apply(const Prefix &prefix, const std::vector<std::s
     return default_op;
 }
 
-}
\ No newline at end of file
+/**
+ * @brief Prepare path attributes for apply().
+ * 
+ * Evaluate the rules that only depend on the path attributes, so they don't
+ * have to be evaluated again for every route with these path attributes.
+ * 
+ * @param attribs Path attribues. Must outlive the returned object.
+ * @return BgpFilterPrepared Prepared path attributes.
+ */
+BgpFilterPrepared BgpFilterRules::prepare(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    BgpFilterPrepared prepared;
+    prepared.attribs = &attribs;
+    prepared.attribs_match = matcher ? matcher->matchAttribsCached(attribs) : -1;
+    return prepared;
+}
+
+/**
+ * @brief Apply the rules set on a route with prepared path attributes.
+ * 
+ * @param prefix Route prefix.
+ * @param prepared Path attributes returned by prepare().
+ * @return BgpFilterOP Action to take.
+ */
+BgpFilterOP BgpFilterRules::apply(const Prefix &prefix, const BgpFilterPrepared &prepared) {
+    if (!matcher) return apply(prefix, *(prepared.attribs));
+    if (rules.size() == 0) return default_op;
+
+    int32_t index = matcher->match(prefix, *(prepared.attribs), prepared.attribs_match);
+    return index < 0 ? default_op : rules[index]->op;
+}
+
+/**
+ * @brief Apply the rules set on IPv4 routes with the same path attributes.
+ * 
+ * @param routes The routes.
+ * @param attribs Path attribues.
+ * @param accepted Result. accepted[i] is true if routes[i] is accepted.
+ * @return size_t Number of accepted routes.
+ */
+size_t BgpFilterRules::apply(const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted) {
+    return applyBatch(routes, attribs, accepted);
+}
+
+/**
+ * @brief Apply the rules set on IPv6 routes with the same path attributes.
+ * 
+ * @param routes The routes.
+ * @param attribs Path attribues.
+ * @param accepted Result. accepted[i] is true if routes[i] is accepted.
+ * @return size_t Number of accepted routes.
+ */
+size_t BgpFilterRules::apply(const std::vector<Prefix6> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted) {
+    return applyBatch(routes, attribs, accepted);
+}
+
+/**
+ * @brief Apply the rules set on a route with prepared path attributes, and get
+ * the route-map actions of the matching rule.
+ * 
+ * @param prefix Route prefix.
+ * @param prepared Path attributes returned by prepare().
+ * @param actions Set to the actions of the matching rule, or NULL if no rule
+ * matches or the rule has no actions. Valid as long as the rules set is not
+ * modified.
+ * @return BgpFilterOP Action to take.
+ */
+BgpFilterOP BgpFilterRules::apply(const Prefix &prefix, const BgpFilterPrepared &prepared, const BgpFilterActions* &actions) {
+    actions = NULL;
+    if (rules.size() == 0) return default_op;
+
+    int32_t index = find(prefix, prepared);
+    if (index < 0) return default_op;
+
+    if (!rules[index]->actions.empty()) actions = &(rules[index]->actions);
+    return rules[index]->op;
+}
+
+/**
+ * @brief Apply the rules set on IPv4 routes with the same path attributes,
+ * and run the route-map actions of the matching rules on the path attributes
+ * of accepted routes.
+ * 
+ * @param routes The routes.
+ * @param attribs Path attribues.
+ * @param accepted Result. accepted[i] is true if routes[i] is accepted.
+ * @param results Result. results[i] is the modified path attributes of
+ * routes[i], or NULL if the route is rejected or not modified. Routes with the
+ * same outcome share the same result object. Left empty if no route is
+ * modified.
+ * @return size_t Number of accepted routes.
+ */
+size_t BgpFilterRules::apply(const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted, std::vector<std::shared_ptr<const BgpFilterActionResult>> &results) {
+    return applyBatch(routes, attribs, accepted, results);
+}
+
+/**
+ * @brief Apply the rules set on IPv6 routes with the same path attributes,
+ * and run the route-map actions of the matching rules on the path attributes
+ * of accepted routes.
+ * 
+ * @param routes The routes.
+ * @param attribs Path attribues.
+ * @param accepted Result. accepted[i] is true if routes[i] is accepted.
+ * @param results Result. See the IPv4 version.
+ * @return size_t Number of accepted routes.
+ */
+size_t BgpFilterRules::apply(const std::vector<Prefix6> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted, std::vector<std::shared_ptr<const BgpFilterActionResult>> &results) {
+    return applyBatch(routes, attribs, accepted, results);
+}
+
+/**
+ * @brief Test if any rule in the rules set has route-map actions.
+ * 
+ * @return true Some rules have actions.
+ * @return false No rule has actions.
+ */
+bool BgpFilterRules::hasActions() const {
+    for (const std::shared_ptr<BgpFilterRule> &rule : rules) {
+        if (!rule->actions.empty()) return true;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Get the number of rules in the rules set.
+ * 
+ * @return size_t Number of rules.
+ */
+size_t BgpFilterRules::size() const {
+    return rules.size();
+}
+
+/**
+ * @brief Get the rules that may change the verdict on a route when this rules
+ * set is replaced by another rules set.
+ * 
+ * Rules are compared by identity: copies of a rules set share their rules, so
+ * a rules set made by copying this one and appending or removing some rules
+ * only differs from this one by those rules. The rules before the first
+ * difference and after the last difference are the same in both sets. Since
+ * the matching rule with the highest index wins, the verdict on a route can
+ * only change if one of the rules in between (from either set) matches it.
+ * 
+ * The changed rules are put in a compiled rules set: route rules go into a
+ * prefix trie and path attribute rules into the hashed sets of the matcher,
+ * with the verdict cached by attributes, so testing a route against them with
+ * matches() is cheap.
+ * 
+ * @param other The rules set to replace this one with.
+ * @param changed Result. The rules that differ.
+ * @return true Verdict may only change on routes matching a changed rule.
+ * @return false Default action differs, verdict may change on any route.
+ */
+bool BgpFilterRules::diff(const BgpFilterRules &other, BgpFilterRules &changed) const {
+    changed = BgpFilterRules(default_op);
+
+    size_t head = 0;
+    while (head < rules.size() && head < other.rules.size() && rules[head] == other.rules[head]) head++;
+
+    size_t tail = 0;
+    while (tail < rules.size() - head && tail < other.rules.size() - head &&
+        rules[rules.size() - 1 - tail] == other.rules[other.rules.size() - 1 - tail]) tail++;
+
+    for (size_t i = head; i < rules.size() - tail; i++) changed.rules.push_back(rules[i]);
+    for (size_t i = head; i < other.rules.size() - tail; i++) changed.rules.push_back(other.rules[i]);
+    changed.compile();
+
+    return default_op == other.default_op;
+}
+
+/**
+ * @brief Test if any rule in the rules set matches a route.
+ * 
+ * @param prefix Route prefix.
+ * @param prepared Path attributes returned by prepare().
+ * @return true A rule matches the route.
+ * @return false No rule matches the route.
+ */
+bool BgpFilterRules::matches(const Prefix &prefix, const BgpFilterPrepared &prepared) {
+    if (rules.size() == 0) return false;
+    return find(prefix, prepared) >= 0;
+}
+
+/**
+ * @brief Get the number of AS_PATH / COMMUNITY evaluations answered by the
+ * verdict cache of the compiled rules set.
+ * 
+ * @return uint64_t Number of cache hits. 0 if the rules set is not compiled.
+ */
+uint64_t BgpFilterRules::getCacheHits() const {
+    return matcher ? matcher->getCacheHits() : 0;
+}
+
+/**
+ * @brief Get the number of AS_PATH / COMMUNITY evaluations not answered by
+ * the verdict cache of the compiled rules set.
+ * 
+ * @return uint64_t Number of cache misses. 0 if the rules set is not compiled.
+ */
+uint64_t BgpFilterRules::getCacheMisses() const {
+    return matcher ? matcher->getCacheMisses() : 0;
+}
+
+template <typename T>
+size_t BgpFilterRules::applyBatch(const std::vector<T> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted) {
+    accepted.assign(routes.size(), false);
+    size_t n_accepted = 0;
+
+    if (rules.size() == 0) {
+        if (default_op != ACCEPT) return 0;
+        accepted.assign(routes.size(), true);
+        return routes.size();
+    }
+
+    BgpFilterPrepared prepared = prepare(attribs);
+
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (apply(routes[i], prepared) != ACCEPT) continue;
+        accepted[i] = true;
+        n_accepted++;
+    }
+
+    return n_accepted;
+}
+
+template <typename T>
+size_t BgpFilterRules::applyBatch(const std::vector<T> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted, std::vector<std::shared_ptr<const BgpFilterActionResult>> &results) {
+    results.clear();
+    if (rules.size() == 0) return applyBatch(routes, attribs, accepted);
+
+    accepted.assign(routes.size(), false);
+    size_t n_accepted = 0;
+
+    BgpFilterPrepared prepared = prepare(attribs);
+
+    // the path attributes are the same for all routes, run the actions of a
+    // rule only once.
+    std::vector<std::pair<int32_t, std::shared_ptr<const BgpFilterActionResult>>> done;
+
+    for (size_t i = 0; i < routes.size(); i++) {
+        int32_t index = find(routes[i], prepared);
+        if ((index < 0 ? default_op : rules[index]->op) != ACCEPT) continue;
+        accepted[i] = true;
+        n_accepted++;
+
+        if (index < 0) continue;
+
+        std::shared_ptr<const BgpFilterActionResult> result;
+        bool found = false;
+        for (const std::pair<int32_t, std::shared_ptr<const BgpFilterActionResult>> &d : done) {
+            if (d.first != index) continue;
+            result = d.second;
+            found = true;
+            break;
+        }
+
+        if (!found) {
+            result = rules[index]->actions.apply(attribs);
+            done.push_back(std::make_pair(index, result));
+        }
+
+        if (!result) continue;
+        if (results.size() == 0) results.resize(routes.size());
+        results[i] = result;
+    }
+
+    return n_accepted;
+}
+
+int32_t BgpFilterRules::find(const Prefix &prefix, const BgpFilterPrepared &prepared) {
+    if (matcher) return matcher->match(prefix, *(prepared.attribs), prepared.attribs_match);
+
+    for (int32_t index = rules.size() - 1; index >= 0; index--) {
+        if (rules[index]->apply(prefix, *(prepared.attribs)) != NOP) return index;
+    }
+
+    return -1;
+}
+
+}
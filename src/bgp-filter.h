@@ -15,10 +15,16 @@
 #include "bgp-afi.h"
 #include "prefix4.h"
 #include "prefix6.h"
+#include "prefix-set.h"
+#include "bgp-as-path-regex.h"
+#include "bgp-roa-table.h"
+#include "bgp-filter-action.h"
 #include "bgp-path-attrib.h"
 
 namespace libbgp {
 
+class BgpFilterMatcher;
+
 /**
  * @brief Type of filter rule.
  * 
@@ -26,7 +32,12 @@ namespace libbgp {
 enum BgpFilterRuleType {
     F_ROUTE, /*!< Match a IP prefix */
     F_AS_PATH, /*!< Match AS_PATH */
-    F_COMMUNITY /*!< Match COMMUNITY */
+    F_COMMUNITY, /*!< Match COMMUNITY */
+    F_PREFIX_SET, /*!< Match a prefix set */
+    F_AS_PATH_REGEX, /*!< Match AS_PATH with a regular expression */
+    F_RPKI, /*!< Match RPKI validation state */
+    F_LARGE_COMMUNITY, /*!< Match LARGE_COMMUNITY */
+    F_EXT_COMMUNITY /*!< Match EXTENDED_COMMUNITY */
 };
 
 /**
@@ -53,6 +64,25 @@ enum BgpFilterRuleAsPathMatchType {
     M_NOT_FROM_ASN /*!< Match routes that are not originating from the ASN */
 };
 
+/**
+ * @brief Matching type of AS_PATH regular expression rule.
+ * 
+ */
+enum BgpFilterRuleAsPathRegexMatchType {
+    M_REGEX_MATCH, /*!< Match routes with AS_PATH matching the expression */
+    M_REGEX_NOT_MATCH /*!< Match routes with AS_PATH not matching the expression */
+};
+
+/**
+ * @brief Matching type of RPKI rule.
+ * 
+ */
+enum BgpFilterRuleRpkiMatchType {
+    M_RPKI_VALID, /*!< Match RPKI-valid routes */
+    M_RPKI_INVALID, /*!< Match RPKI-invalid routes */
+    M_RPKI_NOT_FOUND /*!< Match routes not covered by any VRP */
+};
+
 /**
  * @brief Matching type of COMMUNITY rule.
  * 
@@ -62,6 +92,15 @@ enum BgpFilterRuleCommunityMatchType {
     M_NOT_HAS_COMMUNITY /*!< Match routes does not have the given community */
 };
 
+/**
+ * @brief Matching type of prefix set rule.
+ * 
+ */
+enum BgpFilterRulePrefixSetMatchType {
+    M_IN_SET, /*!< Match routes in the prefix set */
+    M_NOT_IN_SET /*!< Match routes not in the prefix set */
+};
+
 /**
  * @brief The filter operation.
  * 
@@ -82,6 +121,14 @@ public:
     uint8_t match_type;
     BgpFilterOP op;
 
+    /**
+     * @brief Route-map actions to run on the path attributes of routes
+     * accepted by this rule. (only used by the apply() of BgpFilterRules that
+     * reports the actions or their results)
+     * 
+     */
+    BgpFilterActions actions;
+
     /**
      * @brief Apply the rule on a route.
      * 
@@ -176,6 +223,51 @@ public:
     BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
 };
 
+/**
+ * @brief The AS_PATH regular expression filtering rule
+ * 
+ * See BgpAsPathRegex for the syntax. Routes without AS_PATH are matched as
+ * routes with an empty AS_PATH.
+ */
+class BgpFilterRuleAsPathRegex : public BgpFilterRule {
+public:
+    BgpFilterRuleAsPathRegex(BgpFilterOP op, BgpFilterRuleAsPathRegexMatchType type, const BgpAsPathRegex &regex);
+
+    /**
+     * @brief The compiled expression.
+     * 
+     */
+    BgpAsPathRegex regex;
+
+    BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+};
+
+/**
+ * @brief The RPKI route origin validation filtering rule
+ * 
+ * Routes are validated against the ROA table with the origin from AS_PATH
+ * (see BgpRoaTable::GetOrigin). The rule shares the VRP set with the table it
+ * was constructed from, so updates to the table apply to the rule right away.
+ */
+class BgpFilterRuleRpki : public BgpFilterRule {
+public:
+    BgpFilterRuleRpki(BgpFilterOP op, BgpFilterRuleRpkiMatchType type, const BgpRoaTable &table, uint32_t local_asn);
+
+    /**
+     * @brief The ROA table.
+     * 
+     */
+    BgpRoaTable table;
+
+    /**
+     * @brief Local ASN, used as the origin of routes with an empty AS_PATH.
+     * 
+     */
+    uint32_t local_asn;
+
+    BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+};
+
 /**
  * @brief BGP well-known communities
  * 
@@ -204,6 +296,110 @@ public:
     BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
 };
 
+/**
+ * @brief The LARGE_COMMUNITY filtering rule
+ * 
+ * M_HAS_COMMUNITY matches routes with the large community, M_NOT_HAS_COMMUNITY
+ * matches routes without it, including routes with no LARGE_COMMUNITY
+ * attribute.
+ */
+class BgpFilterRuleLargeCommunity : public BgpFilterRule {
+public:
+    BgpFilterRuleLargeCommunity(BgpFilterOP op, BgpFilterRuleCommunityMatchType type, uint32_t global, uint32_t local1, uint32_t local2);
+    BgpFilterRuleLargeCommunity(BgpFilterOP op, BgpFilterRuleCommunityMatchType type, const BgpLargeCommunity &community);
+
+    /**
+     * @brief Large community for this entry.
+     * 
+     */
+    BgpLargeCommunity community;
+
+    BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+};
+
+/**
+ * @brief The EXTENDED_COMMUNITY filtering rule
+ * 
+ * M_HAS_COMMUNITY matches routes with the extended community,
+ * M_NOT_HAS_COMMUNITY matches routes without it, including routes with no
+ * EXTENDED_COMMUNITY attribute.
+ */
+class BgpFilterRuleExtCommunity : public BgpFilterRule {
+public:
+    BgpFilterRuleExtCommunity(BgpFilterOP op, BgpFilterRuleCommunityMatchType type, uint64_t community);
+
+    /**
+     * @brief Extended community for this entry, in host byte order.
+     * 
+     */
+    uint64_t community;
+
+    BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+};
+
+/**
+ * @brief The IPv4 prefix set filtering rule.
+ * 
+ * One rule matches routes against a whole PrefixSet4. The set is shared, not
+ * copied, when the rule is appended to rules sets, so the same set can be
+ * used by the filters of all sessions, and reloading the set updates all of
+ * them.
+ */
+class BgpFilterRulePrefixSet4 : public BgpFilterRule {
+public:
+    BgpFilterRulePrefixSet4(BgpFilterOP op, BgpFilterRulePrefixSetMatchType type, const PrefixSet4 &set);
+
+    /**
+     * @brief The prefix set.
+     * 
+     */
+    PrefixSet4 set;
+
+    BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+};
+
+/**
+ * @brief The IPv6 prefix set filtering rule.
+ * 
+ * See BgpFilterRulePrefixSet4.
+ */
+class BgpFilterRulePrefixSet6 : public BgpFilterRule {
+public:
+    BgpFilterRulePrefixSet6(BgpFilterOP op, BgpFilterRulePrefixSetMatchType type, const PrefixSet6 &set);
+
+    /**
+     * @brief The prefix set.
+     * 
+     */
+    PrefixSet6 set;
+
+    BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+};
+
+/**
+ * @brief Path attributes prepared for filtering.
+ * 
+ * Routes in the same update message share the same path attributes. Prepare
+ * the path attributes once with BgpFilterRules::prepare(), and rules that only
+ * depend on the path attributes (AS_PATH, COMMUNITY) will not be evaluated
+ * again for every route.
+ */
+class BgpFilterPrepared {
+public:
+    /**
+     * @brief The path attributes.
+     * 
+     */
+    const std::vector<std::shared_ptr<BgpPathAttrib>> *attribs;
+
+    /**
+     * @brief Index of the matching path attribute rule, -1 if none. (only
+     * used by compiled rules set)
+     * 
+     */
+    int32_t attribs_match;
+};
+
 /**
  * @brief The BGP filtering rules set.
  * 
@@ -224,17 +420,65 @@ public:
     void append(const BgpFilterRule &rule) {
         const T &rule_typed = dynamic_cast<const T&> (rule);
         rules.push_back(std::shared_ptr<BgpFilterRule>(new T(rule_typed)));
+        matcher.reset();
     }
 #ifdef SWIG
 %template(appendAsPathRule) append<BgpFilterRuleAsPath>;
 %template(appendCommunityRule) append<BgpFilterRuleCommunity>;
 %template(appendRoute4Rule) append<BgpFilterRuleRoute4>;
 %template(appendRoute6Rule) append<BgpFilterRuleRoute6>;
+%template(appendPrefixSet4Rule) append<BgpFilterRulePrefixSet4>;
+%template(appendPrefixSet6Rule) append<BgpFilterRulePrefixSet6>;
+%template(appendAsPathRegexRule) append<BgpFilterRuleAsPathRegex>;
+%template(appendRpkiRule) append<BgpFilterRuleRpki>;
+%template(appendLargeCommunityRule) append<BgpFilterRuleLargeCommunity>;
+%template(appendExtCommunityRule) append<BgpFilterRuleExtCommunity>;
 #endif
 
+    // compile the rules set into a matcher. rules appended later drop it.
+    void compile();
+
     BgpFilterOP apply(const Prefix &prefix, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+
+    // apply on routes sharing the same path attributes.
+    BgpFilterPrepared prepare(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+    BgpFilterOP apply(const Prefix &prefix, const BgpFilterPrepared &prepared);
+    size_t apply(const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted);
+    size_t apply(const std::vector<Prefix6> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted);
+
+    // apply, with the route-map actions of the matching rule.
+    BgpFilterOP apply(const Prefix &prefix, const BgpFilterPrepared &prepared, const BgpFilterActions* &actions);
+    size_t apply(const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted, std::vector<std::shared_ptr<const BgpFilterActionResult>> &results);
+    size_t apply(const std::vector<Prefix6> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted, std::vector<std::shared_ptr<const BgpFilterActionResult>> &results);
+
+    // test if any rule has route-map actions.
+    bool hasActions() const;
+
+    // get number of rules in the rules set.
+    size_t size() const;
+
+    // get the rules that may change the verdict on a route when this rules set
+    // is replaced by another. false if the verdict may change on any route.
+    bool diff(const BgpFilterRules &other, BgpFilterRules &changed) const;
+
+    // test if any rule matches a route.
+    bool matches(const Prefix &prefix, const BgpFilterPrepared &prepared);
+
+    // verdict cache statistics of the compiled rules set.
+    uint64_t getCacheHits() const;
+    uint64_t getCacheMisses() const;
 private:
+    template <typename T>
+    size_t applyBatch(const std::vector<T> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted);
+
+    template <typename T>
+    size_t applyBatch(const std::vector<T> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, std::vector<bool> &accepted, std::vector<std::shared_ptr<const BgpFilterActionResult>> &results);
+
+    // get index of the rule to use for a route, -1 if none.
+    int32_t find(const Prefix &prefix, const BgpFilterPrepared &prepared);
+
     std::vector<std::shared_ptr<BgpFilterRule>> rules;
+    std::shared_ptr<BgpFilterMatcher> matcher;
     BgpFilterOP default_op;
 };
 
@@ -14,6 +14,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <map>
 
 namespace libbgp {
 
@@ -25,7 +26,7 @@ const char* bgp_fsm_state_str[] = {
     "Broken"
 };
 
-BgpFsm::BgpFsm(const BgpConfig &config) : in_sink(config.use_4b_asn) {
+BgpFsm::BgpFsm(const BgpConfig &config) : in_sink(config.use_4b_asn, config.no_sink_lock) {
     this->config = config;
     state = IDLE;
     out_buffer = (uint8_t *) malloc(BGP_FSM_BUFFER_SIZE);
@@ -53,6 +54,16 @@ BgpFsm::BgpFsm(const BgpConfig &config) : in_sink(config.use_4b_asn) {
 
     in_sink.setLogger(logger);
 
+    if (config.use_message_arena) {
+        arena = new BgpArena();
+        in_sink.setArena(arena);
+    } else arena = NULL;
+    arena_refs = 0;
+
+    if (config.update_visitor != NULL) {
+        update_scanner = new BgpUpdateScanner(logger, config.use_4b_asn, config.update_visitor);
+    } else update_scanner = NULL;
+
     if (!config.rib4) {
         rib4 = new BgpRib4(logger);
         rib4_local = true;
@@ -81,6 +92,8 @@ BgpFsm::~BgpFsm() {
     if (clock_local) delete clock;
     if (rev_bus_exist) config.rev_bus->unsubscribe(this);
     if (log_local) delete logger;
+    if (arena != NULL) delete arena;
+    if (update_scanner != NULL) delete update_scanner;
 }
 
 uint32_t BgpFsm::getAsn() const {
@@ -189,6 +202,30 @@ int BgpFsm::run(const uint8_t *buffer, const size_t buffer_size) {
         return -1;
     }
 
+    return runSink();
+}
+
+uint8_t* BgpFsm::acquireInput(size_t len) {
+    return in_sink.acquire(len);
+}
+
+int BgpFsm::commitInput(size_t len) {
+    if (state == BROKEN) {
+        logger->log(ERROR, "BgpFsm::commitInput: FSM is broken, consider reset.\n");
+        return -1;
+    }
+
+    ssize_t commit_ret = in_sink.commit(len);
+    if (commit_ret != (ssize_t) len) {
+        logger->log(ERROR, "BgpFsm::commitInput: failed to commit() sink.\n");
+        setState(BROKEN);
+        return -1;
+    }
+
+    return runSink();
+}
+
+int BgpFsm::runSink() {
     // tick the clock
     if (!config.no_autotick) {
         int tick_ret = tick();
@@ -201,6 +238,15 @@ int BgpFsm::run(const uint8_t *buffer, const size_t buffer_size) {
 
     // keep running untill sink empty
     while (in_sink.getBytesInSink() > 0) {
+        if (state == ESTABLISHED) {
+            int scan_ret = update_scanner != NULL ? scanUpdate() : withdrawUpdate();
+            if (scan_ret <= 0 || scan_ret == 3) return scan_ret;
+            if (scan_ret == 1) {
+                if (final_ret_val != 0 && final_ret_val != 2) final_ret_val = 1;
+                continue;
+            }
+        }
+
         BgpPacket *packet = NULL;
         ssize_t poured = in_sink.pour(&packet);
 
@@ -211,6 +257,7 @@ int BgpFsm::run(const uint8_t *buffer, const size_t buffer_size) {
         }
 
         if (poured == 0) return 3;
+        if (arena != NULL) arena_refs++;
 
         LIBBGP_LOG(logger, DEBUG) {
             logger->log(DEBUG, "BgpFsm::run: got message (Current state: %s):\n", bgp_fsm_state_str[state]);
@@ -229,14 +276,17 @@ int BgpFsm::run(const uint8_t *buffer, const size_t buffer_size) {
                     logger->log(ERROR, "BgpFsm::run: discarding all routes.\n");
                 }
 
-                delete packet;
+                disposePacket(packet);
                 setState(IDLE);
                 return 0;
             }
             BgpNotificationMessage notify (logger, msg->getErrorCode(), msg->getErrorSubCode(), msg->getError(), msg->getErrorLength());
+
+            // the notification has its own copy of the error data; dispose the
+            // packet first so the arena is released even if the write fails.
+            disposePacket(packet);
             setState(IDLE);
             if(!writeMessage(notify)) return -1;
-            delete packet;
             return 0;
         }
 
@@ -252,7 +302,7 @@ int BgpFsm::run(const uint8_t *buffer, const size_t buffer_size) {
                 case E_CEASE: err_sub_msg = bgp_cease_error_str[notify->subcode]; break;
             }
             logger->log(ERROR, "BgpFsm::run: got NOTIFICATION: %s (%d): %s (%d).\n", err_msg, notify->errcode, err_sub_msg, notify->subcode);
-            delete packet;
+            disposePacket(packet);
             setState(IDLE);
             return 0;
         }
@@ -261,7 +311,7 @@ int BgpFsm::run(const uint8_t *buffer, const size_t buffer_size) {
 
         int vald_ret = validateState(msg->type);
         if (vald_ret <= 0) {
-            delete packet;
+            disposePacket(packet);
             return vald_ret;
         }
 
@@ -272,12 +322,12 @@ int BgpFsm::run(const uint8_t *buffer, const size_t buffer_size) {
             case ESTABLISHED: retval = fsmEvalEstablished(msg); break;
             default: {
                 logger->log(ERROR, "BgpFsm::run: FSM in invalid state: %d.\n", state);
-                delete packet;
+                disposePacket(packet);
                 return -1;
             }
         }
 
-        delete packet;
+        disposePacket(packet);
         if (retval < 0) return retval;
         if (retval == 0) final_ret_val = 0;
         if (retval == 1 && final_ret_val != 0 && final_ret_val != 2) final_ret_val = 1;
@@ -287,6 +337,161 @@ int BgpFsm::run(const uint8_t *buffer, const size_t buffer_size) {
     return final_ret_val;
 }
 
+int BgpFsm::scanUpdate() {
+    const uint8_t *raw = NULL;
+    ssize_t raw_len = in_sink.peek(&raw);
+
+    if (raw_len <= -2) {
+        logger->log(ERROR, "BgpFsm::scanUpdate: sink seems to be broken, please reset.\n");
+        setState(BROKEN);
+        return -1;
+    }
+
+    if (raw_len == 0) return 3;
+
+    // not an update, let the usual path handle it.
+    if (raw[18] != UPDATE) return 4;
+
+    ssize_t scan_ret = update_scanner->parse(raw + 19, raw_len - 19);
+    in_sink.skip(raw_len);
+
+    if (scan_ret < 0) {
+        BgpNotificationMessage notify (logger, update_scanner->getErrorCode(), update_scanner->getErrorSubCode(), update_scanner->getError(), update_scanner->getErrorLength());
+        setState(IDLE);
+        if(!writeMessage(notify)) return -1;
+        return 0;
+    }
+
+    return 1;
+}
+
+int BgpFsm::withdrawUpdate() {
+    const uint8_t *raw = NULL;
+    ssize_t raw_len = in_sink.peek(&raw);
+
+    if (raw_len <= -2) {
+        logger->log(ERROR, "BgpFsm::withdrawUpdate: sink seems to be broken, please reset.\n");
+        setState(BROKEN);
+        return -1;
+    }
+
+    if (raw_len == 0) return 3;
+    if (raw[18] != UPDATE || raw_len < 23) return 4;
+
+    const uint8_t *buffer = raw + 19;
+    uint16_t withdrawn_len = ntohs(getValue<uint16_t>(&buffer));
+
+    // anything other than withdrawn routes (or malformed): use the parser.
+    if ((size_t) withdrawn_len + 23 != (size_t) raw_len) return 4;
+    buffer += withdrawn_len;
+    if (getValue<uint16_t>(&buffer) != 0) return 4;
+
+    if (withdrawn_len == 0) {
+        in_sink.skip(raw_len);
+        logger->log(INFO, "BgpFsm::withdrawUpdate: got End-of-RIB marker for IPv4 unicast.\n");
+        return 1;
+    }
+
+    std::vector<Prefix4> routes;
+    if (Prefix4::ParseList(raw + 21, withdrawn_len, routes) != withdrawn_len) return 4;
+    in_sink.skip(raw_len);
+
+    logger->log(DEBUG, "BgpFsm::withdrawUpdate: got withdraw-only update with %zu routes.\n", routes.size());
+
+    if (!send_ipv4_routes) return 1;
+
+    RibChanges4 changes;
+
+    {
+        std::lock_guard<BgpRib4> rib_lock(*rib4);
+        if (config.keep_adj_rib_in) adj_rib_in4.withdraw(routes);
+        withdrawRoutes4(routes, changes.unreach, changes.replaced_entries);
+        SnapshotChanges(changes);
+    }
+
+    publishChanges4(changes);
+
+    return 1;
+}
+
+void BgpFsm::withdrawRoutes4(const std::vector<Prefix4> &routes, std::vector<Prefix4> &unreach, std::vector<const BgpRib4Entry*> &changed_entries) {
+    if (routes.size() == 0) return;
+
+    rib4->withdraw(peer_bgp_id, routes, unreach, changed_entries);
+}
+
+void BgpFsm::withdrawRoutes6(const std::vector<Prefix6> &routes, std::vector<Prefix6> &unreach, std::vector<const BgpRib6Entry*> &changed_entries) {
+    if (routes.size() == 0) return;
+
+    rib6->withdraw(peer_bgp_id, routes, unreach, changed_entries);
+}
+
+void BgpFsm::SnapshotChanges(RibChanges4 &changes) {
+    for (RibChanges4::Inserted &inserted : changes.inserted) BgpRib<BgpRib4Entry>::snapshotEntries(inserted.replaced_entries, inserted.snapshot);
+    BgpRib<BgpRib4Entry>::snapshotEntries(changes.replaced_entries, changes.snapshot);
+}
+
+void BgpFsm::SnapshotChanges(RibChanges6 &changes) {
+    for (RibChanges6::Inserted &inserted : changes.inserted) BgpRib<BgpRib6Entry>::snapshotEntries(inserted.replaced_entries, inserted.snapshot);
+    BgpRib<BgpRib6Entry>::snapshotEntries(changes.replaced_entries, changes.snapshot);
+}
+
+void BgpFsm::publishChanges4(RibChanges4 &changes) {
+    if (!rev_bus_exist) return;
+
+    for (RibChanges4::Inserted &inserted : changes.inserted) {
+        logger->log(DEBUG, "BgpFsm::publishChanges4: publishing new v4 routes on event bus...\n");
+        Route4AddEvent aev;
+        aev.replaced_entries = inserted.replaced_entries.size() > 0 ? &(inserted.replaced_entries) : NULL;
+        aev.shared_attribs = &(inserted.attribs);
+        aev.new_routes = inserted.new_routes.size() > 0 ? &(inserted.new_routes) : NULL;
+        if (ibgp) aev.ibgp_peer_asn = peer_asn;
+        config.rev_bus->publish(this, aev);
+    }
+
+    if (changes.replaced_entries.size() > 0) {
+        Route4AddEvent aev;
+        aev.replaced_entries = &(changes.replaced_entries);
+        config.rev_bus->publish(this, aev);
+    }
+
+    if (changes.unreach.size() > 0) {
+        logger->log(DEBUG, "BgpFsm::publishChanges4: publishing dropped v4 routes on event bus...\n");
+        Route4WithdrawEvent wev;
+        wev.routes = &(changes.unreach);
+        config.rev_bus->publish(this, wev);
+    }
+}
+
+void BgpFsm::publishChanges6(RibChanges6 &changes) {
+    if (!rev_bus_exist) return;
+
+    for (RibChanges6::Inserted &inserted : changes.inserted) {
+        logger->log(DEBUG, "BgpFsm::publishChanges6: publishing new v6 routes on event bus...\n");
+        Route6AddEvent aev;
+        memcpy(aev.nexthop_global, inserted.nexthop_global, 16);
+        memcpy(aev.nexthop_linklocal, inserted.nexthop_linklocal, 16);
+        aev.replaced_entries = inserted.replaced_entries.size() > 0 ? &(inserted.replaced_entries) : NULL;
+        aev.shared_attribs = &(inserted.attribs);
+        aev.new_routes = inserted.new_routes.size() > 0 ? &(inserted.new_routes) : NULL;
+        if (ibgp) aev.ibgp_peer_asn = peer_asn;
+        config.rev_bus->publish(this, aev);
+    }
+
+    if (changes.replaced_entries.size() > 0) {
+        Route6AddEvent aev;
+        aev.replaced_entries = &(changes.replaced_entries);
+        config.rev_bus->publish(this, aev);
+    }
+
+    if (changes.unreach.size() > 0) {
+        logger->log(DEBUG, "BgpFsm::publishChanges6: publishing dropped v6 routes on event bus...\n");
+        Route6WithdrawEvent wev;
+        wev.routes = &(changes.unreach);
+        config.rev_bus->publish(this, wev);
+    }
+}
+
 int BgpFsm::tick() {
     if (state != ESTABLISHED) return 1;
 
@@ -392,6 +597,10 @@ int BgpFsm::openRecv(const BgpOpenMessage *open_msg) {
     hold_timer = config.hold_timer > open_msg->hold_time ? open_msg->hold_time : config.hold_timer;
     peer_bgp_id = open_msg->bgp_id;
     use_4b_asn = open_msg->hasCapability(ASN_4B) && config.use_4b_asn;
+
+    // parse messages from now on with the negotiated ASN size.
+    in_sink.setUse4bAsn(use_4b_asn);
+    if (update_scanner != NULL) update_scanner->setUse4bAsn(use_4b_asn);
     send_ipv4_routes = true;
     if (open_msg->hasCapability(MP_BGP) && (config.mp_bgp_ipv6 || config.mp_bgp_ipv4)) {
         send_ipv4_routes = send_ipv6_routes = false;
@@ -480,6 +689,166 @@ bool BgpFsm::handleRouteCollisionEvent(const RouteCollisionEvent &ev) {
     return resloveCollision(ev.peer_bgp_id, false) == 1;
 }
 
+const BgpRib4Entry* BgpFsm::findRoute4(const Prefix4 &route) const {
+    const Prefix4Value value = route.toValue();
+    std::pair<rib4_t::const_iterator, rib4_t::const_iterator> entries = rib4->get().equal_range(BgpRib4EntryKey(route));
+
+    for (rib4_t::const_iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.src_router_id == peer_bgp_id && it->second.route == value) return &(it->second);
+    }
+
+    return NULL;
+}
+
+const BgpRib6Entry* BgpFsm::findRoute6(const Prefix6 &route) const {
+    const Prefix6Value value = route.toValue();
+    std::pair<rib6_t::const_iterator, rib6_t::const_iterator> entries = rib6->get().equal_range(BgpRib6EntryKey(route));
+
+    for (rib6_t::const_iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.src_router_id == peer_bgp_id && it->second.route == value) return &(it->second);
+    }
+
+    return NULL;
+}
+
+void BgpFsm::insertRoutes4(RibChanges4 &changes, const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, int32_t weight) {
+    std::vector<const BgpRib4Entry*> replaced_entries;
+    std::vector<Prefix4> new_routes;
+    rib4->insert(peer_bgp_id, routes, attribs, weight, ibgp ? peer_asn : 0, replaced_entries, new_routes, changes.unreach);
+    logger->log(DEBUG, "BgpFsm::insertRoutes4: rib4.insert(): %zu altered and %zu added in %zu routes.\n", replaced_entries.size(), new_routes.size(), routes.size());
+
+    if (!rev_bus_exist || (replaced_entries.size() == 0 && new_routes.size() == 0)) return;
+
+    changes.inserted.push_back(RibChanges4::Inserted());
+    RibChanges4::Inserted &inserted = changes.inserted.back();
+    inserted.attribs = attribs;
+    inserted.new_routes.swap(new_routes);
+    inserted.replaced_entries.swap(replaced_entries);
+}
+
+void BgpFsm::insertRoutes6(RibChanges6 &changes, const std::vector<Prefix6> &routes, const uint8_t *nh_global, const uint8_t *nh_local, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, int32_t weight) {
+    std::vector<const BgpRib6Entry*> replaced_entries;
+    std::vector<Prefix6> new_routes;
+    rib6->insert(peer_bgp_id, routes, nh_global, nh_local, attribs, weight, ibgp ? peer_asn : 0, replaced_entries, new_routes, changes.unreach);
+    logger->log(DEBUG, "BgpFsm::insertRoutes6: rib6.insert(): %zu altered and %zu added in %zu routes.\n", replaced_entries.size(), new_routes.size(), routes.size());
+
+    if (!rev_bus_exist || (replaced_entries.size() == 0 && new_routes.size() == 0)) return;
+
+    changes.inserted.push_back(RibChanges6::Inserted());
+    RibChanges6::Inserted &inserted = changes.inserted.back();
+    memcpy(inserted.nexthop_global, nh_global, 16);
+    memcpy(inserted.nexthop_linklocal, nh_local, 16);
+    inserted.attribs = attribs;
+    inserted.new_routes.swap(new_routes);
+    inserted.replaced_entries.swap(replaced_entries);
+}
+
+size_t BgpFsm::refilterAdjIn4(RibChanges4 &changes, const std::vector<const BgpAdjIn4Entry *> &entries, std::vector<Prefix4> &rejected) {
+    // group the routes by the update they were received in.
+    std::unordered_map<const void *, std::pair<const BgpAdjIn4Entry *, std::vector<Prefix4>>> updates;
+
+    for (const BgpAdjIn4Entry *entry : entries) {
+        std::pair<const BgpAdjIn4Entry *, std::vector<Prefix4>> &update = updates[entry->attribs.get()];
+        update.first = entry;
+        update.second.push_back(Prefix4(entry->route));
+    }
+
+    size_t n_inserted = 0;
+
+    for (const std::pair<const void * const, std::pair<const BgpAdjIn4Entry *, std::vector<Prefix4>>> &update : updates) {
+        const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs = *(update.second.first->attribs);
+        const std::vector<Prefix4> &routes = update.second.second;
+
+        std::vector<bool> accepted;
+        std::vector<std::shared_ptr<const BgpFilterActionResult>> results;
+        config.in_filters4.apply(routes, attribs, accepted, results);
+
+        // routes to insert, grouped by the result of route-map actions.
+        // (NULL: not modified)
+        std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>>> groups;
+
+        for (size_t i = 0; i < routes.size(); i++) {
+            const BgpRib4Entry *current = findRoute4(routes[i]);
+
+            if (!accepted[i]) {
+                if (current != NULL) rejected.push_back(routes[i]);
+                continue;
+            }
+
+            std::shared_ptr<const BgpFilterActionResult> result;
+            if (results.size() > 0) result = results[i];
+
+            // already in RIB with the same path attributes and weight.
+            if (current != NULL && current->weight == (result && result->has_weight ? result->weight : config.weight) &&
+                current->attribs == (result ? result->attribs : attribs)) continue;
+
+            GroupRoute(groups, result, routes[i]);
+        }
+
+        for (const std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>> &group : groups) {
+            const BgpFilterActionResult *result = group.first.get();
+            insertRoutes4(changes, group.second, result != NULL ? result->attribs : attribs, result != NULL && result->has_weight ? result->weight : config.weight);
+            n_inserted += group.second.size();
+        }
+    }
+
+    return n_inserted;
+}
+
+size_t BgpFsm::refilterAdjIn6(RibChanges6 &changes, const std::vector<const BgpAdjIn6Entry *> &entries, std::vector<Prefix6> &rejected) {
+    // group the routes by the update they were received in.
+    std::unordered_map<const void *, std::pair<const BgpAdjIn6Entry *, std::vector<Prefix6>>> updates;
+
+    for (const BgpAdjIn6Entry *entry : entries) {
+        std::pair<const BgpAdjIn6Entry *, std::vector<Prefix6>> &update = updates[entry->attribs.get()];
+        update.first = entry;
+        update.second.push_back(Prefix6(entry->route));
+    }
+
+    size_t n_inserted = 0;
+
+    for (const std::pair<const void * const, std::pair<const BgpAdjIn6Entry *, std::vector<Prefix6>>> &update : updates) {
+        const BgpAdjIn6Entry &received = *(update.second.first);
+        const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs = *(received.attribs);
+        const std::vector<Prefix6> &routes = update.second.second;
+
+        std::vector<bool> accepted;
+        std::vector<std::shared_ptr<const BgpFilterActionResult>> results;
+        config.in_filters6.apply(routes, attribs, accepted, results);
+
+        std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>>> groups;
+
+        for (size_t i = 0; i < routes.size(); i++) {
+            const BgpRib6Entry *current = findRoute6(routes[i]);
+
+            if (!accepted[i]) {
+                if (current != NULL) rejected.push_back(routes[i]);
+                continue;
+            }
+
+            std::shared_ptr<const BgpFilterActionResult> result;
+            if (results.size() > 0) result = results[i];
+
+            // already in RIB with the same nexthops, path attributes and
+            // weight.
+            if (current != NULL && current->weight == (result && result->has_weight ? result->weight : config.weight) &&
+                memcmp(current->nexthop_global, received.nexthop_global, 16) == 0 &&
+                memcmp(current->nexthop_linklocal, received.nexthop_linklocal, 16) == 0 &&
+                current->attribs == (result ? result->attribs : attribs)) continue;
+
+            GroupRoute(groups, result, routes[i]);
+        }
+
+        for (const std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>> &group : groups) {
+            const BgpFilterActionResult *result = group.first.get();
+            insertRoutes6(changes, group.second, received.nexthop_global, received.nexthop_linklocal, result != NULL ? result->attribs : attribs, result != NULL && result->has_weight ? result->weight : config.weight);
+            n_inserted += group.second.size();
+        }
+    }
+
+    return n_inserted;
+}
+
 bool BgpFsm::handleRoute6AddEvent(const Route6AddEvent &ev) {
     if (state != ESTABLISHED) return false;
     if (!send_ipv6_routes) return false; 
@@ -491,6 +860,9 @@ bool BgpFsm::handleRoute6AddEvent(const Route6AddEvent &ev) {
 
     logger->log(DEBUG, "BgpFsm::handleRoute6AddEvent: got route-add event with %zu routes.\n", nroutes);
 
+    // wait for setOutFilters6() to finish writing.
+    std::lock_guard<std::recursive_mutex> filters_lock(out_filters_mutex);
+
     if (ev.new_routes != NULL && ev.shared_attribs != NULL) {
         if (!ibgp || ev.ibgp_peer_asn != peer_asn) {
             std::vector<Prefix6> routes;
@@ -498,8 +870,16 @@ bool BgpFsm::handleRoute6AddEvent(const Route6AddEvent &ev) {
             const uint8_t *nh_local = ev.nexthop_linklocal;
             alterNexthop6(nh_local, nh_global);
 
-            for (const Prefix6 &route : *(ev.new_routes)) {
-                if (config.out_filters6.apply(route, *(ev.shared_attribs))) {
+            std::vector<bool> accepted;
+            std::vector<std::shared_ptr<const BgpFilterActionResult>> results;
+            std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>>> modified;
+            routes.reserve(config.out_filters6.apply(*(ev.new_routes), *(ev.shared_attribs), accepted, results));
+
+            for (size_t i = 0; i < ev.new_routes->size(); i++) {
+                const Prefix6 &route = (*(ev.new_routes))[i];
+                if (accepted[i] && results.size() > 0 && results[i]) {
+                    GroupRoute(modified, results[i], route);
+                } else if (accepted[i]) {
                     routes.push_back(route);
                 } else {
                     LIBBGP_LOG(logger, DEBUG) {
@@ -521,6 +901,10 @@ bool BgpFsm::handleRoute6AddEvent(const Route6AddEvent &ev) {
                 if(!writeMessage(update)) return false;
             }
 
+            for (const std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>> &group : modified) {
+                if (!writeRoutes6(*(group.first), ev.nexthop_global, ev.nexthop_linklocal, group.second)) return false;
+            }
+
         } else {
             logger->log(DEBUG, "BgpFsm::handleRoute6AddEvent: ignoring new_routes in add event since remote is IBGP.\n");
         }
@@ -534,7 +918,8 @@ bool BgpFsm::handleRoute6AddEvent(const Route6AddEvent &ev) {
     }
 
     // consider merging of replaced_entries?
-    for (const BgpRib6Entry &entry : *(ev.replaced_entries)) {
+    for (const BgpRib6Entry *replaced : *(ev.replaced_entries)) {
+        const BgpRib6Entry &entry = *replaced;
         if (entry.src_router_id == peer_bgp_id) continue;
 
         if (ibgp && entry.ibgp_peer_asn == peer_asn) {
@@ -549,7 +934,8 @@ bool BgpFsm::handleRoute6AddEvent(const Route6AddEvent &ev) {
             continue;
         }
 
-        if (config.out_filters6.apply(entry.route, entry.attribs) != ACCEPT) {
+        const BgpFilterActions *actions;
+        if (config.out_filters6.apply(Prefix6(entry.route), config.out_filters6.prepare(entry.attribs), actions) != ACCEPT) {
             LIBBGP_LOG(logger, DEBUG) {
                 uint8_t prefix[16];
                 entry.route.getPrefix(prefix);
@@ -561,6 +947,13 @@ bool BgpFsm::handleRoute6AddEvent(const Route6AddEvent &ev) {
             continue;
         }
 
+        std::shared_ptr<const BgpFilterActionResult> result;
+        if (actions != NULL) result = actions->apply(entry.attribs);
+        if (result) {
+            if (!writeRoutes6(*result, entry.nexthop_global, entry.nexthop_linklocal, std::vector<Prefix6>(1, entry.route))) return false;
+            continue;
+        }
+
         BgpUpdateMessage update (logger, use_4b_asn);
         update.setAttribs(entry.attribs);
         const uint8_t *nh_global = entry.nexthop_global;
@@ -583,12 +976,9 @@ bool BgpFsm::handleRoute6WithdrawEvent(const Route6WithdrawEvent &ev) {
 
     logger->log(DEBUG, "BgpFsm::handleRoute6WithdrawEvent: got route-withdraw event with %zu routes.\n", ev.routes->size());
 
+    std::lock_guard<std::recursive_mutex> filters_lock(out_filters_mutex);
 
-    BgpUpdateMessage withdraw (logger, use_4b_asn);
-    withdraw.setWithdrawn6(*(ev.routes));
-
-    if(!writeMessage(withdraw)) return false;
-    return true;
+    return writeWithdrawn6(*(ev.routes));
 }
 
 bool BgpFsm::handleRoute4AddEvent(const Route4AddEvent &ev) {
@@ -602,13 +992,24 @@ bool BgpFsm::handleRoute4AddEvent(const Route4AddEvent &ev) {
 
     logger->log(DEBUG, "BgpFsm::handleRoute4AddEvent: got route-add event with %zu routes.\n", nroutes);
 
+    // wait for setOutFilters4() to finish writing.
+    std::lock_guard<std::recursive_mutex> filters_lock(out_filters_mutex);
+
     if (ev.new_routes != NULL && ev.shared_attribs != NULL) {
         if (!ibgp || ev.ibgp_peer_asn != peer_asn) {
             BgpUpdateMessage update (logger, use_4b_asn);
             update.setAttribs(*(ev.shared_attribs));
 
-            for (const Prefix4 &route : *(ev.new_routes)) {
-                if (config.out_filters4.apply(route, *(ev.shared_attribs)) == ACCEPT) {
+            std::vector<bool> accepted;
+            std::vector<std::shared_ptr<const BgpFilterActionResult>> results;
+            std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>>> modified;
+            config.out_filters4.apply(*(ev.new_routes), *(ev.shared_attribs), accepted, results);
+
+            for (size_t i = 0; i < ev.new_routes->size(); i++) {
+                const Prefix4 &route = (*(ev.new_routes))[i];
+                if (accepted[i] && results.size() > 0 && results[i]) {
+                    GroupRoute(modified, results[i], route);
+                } else if (accepted[i]) {
                     update.addNlri4(route);
                 } else {
                     LIBBGP_LOG(logger, DEBUG) {
@@ -626,6 +1027,10 @@ bool BgpFsm::handleRoute4AddEvent(const Route4AddEvent &ev) {
 
                 if(!writeMessage(update)) return false;
             }
+
+            for (const std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>> &group : modified) {
+                if (!writeRoutes4(*(group.first), group.second)) return false;
+            }
         } else {
             logger->log(DEBUG, "BgpFsm::handleRoute4AddEvent: ignoring new_routes in add event since remote is IBGP.\n");
         }
@@ -639,7 +1044,8 @@ bool BgpFsm::handleRoute4AddEvent(const Route4AddEvent &ev) {
     }
 
     // consider merging of replaced_entries?
-    for (const BgpRib4Entry &entry : *(ev.replaced_entries)) {
+    for (const BgpRib4Entry *replaced : *(ev.replaced_entries)) {
+        const BgpRib4Entry &entry = *replaced;
         if (entry.src_router_id == peer_bgp_id) continue;
 
         if (ibgp && entry.ibgp_peer_asn == peer_asn) {
@@ -653,7 +1059,8 @@ bool BgpFsm::handleRoute4AddEvent(const Route4AddEvent &ev) {
             continue;
         }
 
-        if (config.out_filters4.apply(entry.route, entry.attribs) != ACCEPT) {
+        const BgpFilterActions *actions;
+        if (config.out_filters4.apply(Prefix4(entry.route), config.out_filters4.prepare(entry.attribs), actions) != ACCEPT) {
             LIBBGP_LOG(logger, DEBUG) {
                 uint32_t prefix = entry.route.getPrefix();
                 char ip_str[INET_ADDRSTRLEN];
@@ -664,6 +1071,13 @@ bool BgpFsm::handleRoute4AddEvent(const Route4AddEvent &ev) {
             continue;
         }
 
+        std::shared_ptr<const BgpFilterActionResult> result;
+        if (actions != NULL) result = actions->apply(entry.attribs);
+        if (result) {
+            if (!writeRoutes4(*result, std::vector<Prefix4>(1, entry.route))) return false;
+            continue;
+        }
+
         BgpUpdateMessage update (logger, use_4b_asn);
         update.setAttribs(entry.attribs);
         update.addNlri4(entry.route);
@@ -682,11 +1096,9 @@ bool BgpFsm::handleRoute4WithdrawEvent(const Route4WithdrawEvent &ev) {
 
     logger->log(DEBUG, "BgpFsm::handleRoute4AddEvent: got route-withdraw event with %zu routes.\n", ev.routes->size());
 
-    BgpUpdateMessage withdraw (logger, use_4b_asn);
-    withdraw.setWithdrawn4(*(ev.routes));
+    std::lock_guard<std::recursive_mutex> filters_lock(out_filters_mutex);
 
-    if(!writeMessage(withdraw)) return false;
-    return true;
+    return writeWithdrawn4(*(ev.routes));
 }
 
 void BgpFsm::alterNexthop4 (BgpUpdateMessage &update) {
@@ -707,7 +1119,7 @@ void BgpFsm::alterNexthop4 (BgpUpdateMessage &update) {
         update.setNextHop(config.default_nexthop4);
     } else {
         // nexthop not forced, check w/ peering LAN
-        BgpPathAttribNexthop &nh = dynamic_cast<BgpPathAttribNexthop &> (update.getAttrib(NEXT_HOP));
+        BgpPathAttribNexthop &nh = *update.getNexthop();
         if (!config.peering_lan4.includes(nh.next_hop)) {
             LIBBGP_LOG(logger, INFO) {
                 char def_nexthop[INET_ADDRSTRLEN];
@@ -754,6 +1166,130 @@ void BgpFsm::prepareUpdateMessage(BgpUpdateMessage &update) {
     if (!ibgp) update.prepend(config.asn);
 }
 
+void BgpFsm::prepareUpdateMessage(BgpUpdateMessage &update, const BgpFilterActionResult &result) {
+    prepareUpdateMessage(update);
+    if (!result.has_med) return;
+
+    for (const std::shared_ptr<BgpPathAttrib> &attrib : result.attribs) {
+        if (attrib->type_code == MULTI_EXIT_DISC) update.updateAttribute(*attrib);
+    }
+}
+
+bool BgpFsm::writeRoutes4(const BgpFilterActionResult &result, const std::vector<Prefix4> &routes) {
+    size_t i = 0;
+
+    while (i < routes.size()) {
+        BgpUpdateMessage update (logger, use_4b_asn);
+        update.setAttribs(result.attribs);
+        alterNexthop4(update);
+        prepareUpdateMessage(update, result);
+
+        // length of the update message, 19: headers, 4: length fields
+        size_t msg_len = 19 + 4;
+        for (const std::shared_ptr<BgpPathAttrib> &attrib : update.path_attribute) {
+            msg_len += attrib->length();
+        }
+
+        for (; i < routes.size(); i++) {
+            size_t route_len = 1 + (routes[i].getLength() + 7) / 8;
+            if (update.nlri.size() > 0 && msg_len + route_len > 4096) break;
+            msg_len += route_len;
+            update.addNlri4(routes[i]);
+        }
+
+        if(!writeMessage(update)) return false;
+    }
+
+    return true;
+}
+
+bool BgpFsm::writeRoutes6(const BgpFilterActionResult &result, const uint8_t *nh_global, const uint8_t *nh_local, const std::vector<Prefix6> &routes) {
+    alterNexthop6(nh_global, nh_local);
+    size_t i = 0;
+
+    while (i < routes.size()) {
+        BgpUpdateMessage update (logger, use_4b_asn);
+        update.setAttribs(result.attribs);
+        prepareUpdateMessage(update, result);
+
+        // 8: mp-reach-nlri headers, 32: max nexthop len
+        size_t msg_len = 19 + 4 + 8 + 32;
+        for (const std::shared_ptr<BgpPathAttrib> &attrib : update.path_attribute) {
+            msg_len += attrib->length();
+        }
+
+        std::vector<Prefix6> part;
+        for (; i < routes.size(); i++) {
+            size_t route_len = 1 + (routes[i].getLength() + 7) / 8;
+            if (part.size() > 0 && msg_len + route_len > 4096) break;
+            msg_len += route_len;
+            part.push_back(routes[i]);
+        }
+
+        update.setNlri6(part, nh_global, nh_local);
+        if(!writeMessage(update)) return false;
+    }
+
+    return true;
+}
+
+bool BgpFsm::writeWithdrawn4(const std::vector<Prefix4> &routes) {
+    size_t i = 0;
+
+    while (i < routes.size()) {
+        // 19: headers, 4: length fields
+        size_t msg_len = 19 + 4;
+
+        std::vector<Prefix4> part;
+        for (; i < routes.size(); i++) {
+            size_t route_len = 1 + (routes[i].getLength() + 7) / 8;
+            if (msg_len + route_len > 4096) break;
+            msg_len += route_len;
+            part.push_back(routes[i]);
+        }
+
+        BgpUpdateMessage withdraw (logger, use_4b_asn);
+        withdraw.setWithdrawn4(part);
+        if(!writeMessage(withdraw)) return false;
+    }
+
+    return true;
+}
+
+bool BgpFsm::writeWithdrawn6(const std::vector<Prefix6> &routes) {
+    size_t i = 0;
+
+    while (i < routes.size()) {
+        // MP_UNREACH_NLRI is written with a one-octet length, 3: afi/safi
+        size_t attr_len = 3;
+
+        std::vector<Prefix6> part;
+        for (; i < routes.size(); i++) {
+            size_t route_len = 1 + (routes[i].getLength() + 7) / 8;
+            if (attr_len + route_len > 255) break;
+            attr_len += route_len;
+            part.push_back(routes[i]);
+        }
+
+        BgpUpdateMessage withdraw (logger, use_4b_asn);
+        withdraw.setWithdrawn6(part);
+        if(!writeMessage(withdraw)) return false;
+    }
+
+    return true;
+}
+
+template <typename T>
+void BgpFsm::GroupRoute(std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<T>>> &groups, const std::shared_ptr<const BgpFilterActionResult> &result, const T &route) {
+    for (std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<T>> &group : groups) {
+        if (group.first != result) continue;
+        group.second.push_back(route);
+        return;
+    }
+
+    groups.push_back(std::make_pair(result, std::vector<T>(1, route)));
+}
+
 int BgpFsm::validateState(uint8_t type) {
     switch(state) {
         case IDLE:
@@ -869,9 +1405,15 @@ int BgpFsm::fsmEvalOpenConfirm(__attribute__((unused)) const BgpMessage *msg) {
                 msg_len += attrib->length(); 
             }
 
+            // routes in the group share the same attributes.
+            BgpFilterPrepared prepared = config.out_filters4.prepare(update.path_attribute);
+
+            // routes with attributes modified by out_filters4, sent separately.
+            std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>>> modified;
+
             for (; iter != end && cur_group_id == iter->second.update_id && msg_len < 4096; iter++) {
                 const BgpRib4Entry &e = iter->second;
-                const Prefix4 &r = e.route;
+                const Prefix4 r (e.route);
                 if (e.status == RS_STANDBY) continue;
 
                 if (ibgp && e.src == SRC_IBGP && e.ibgp_peer_asn == peer_asn) {
@@ -895,7 +1437,16 @@ int BgpFsm::fsmEvalOpenConfirm(__attribute__((unused)) const BgpMessage *msg) {
                     last_iter = iter;
                     continue;
                 }
-                if (config.out_filters4.apply(r, update.path_attribute) == ACCEPT) {
+                const BgpFilterActions *actions;
+                if (config.out_filters4.apply(r, prepared, actions) == ACCEPT) {
+                    std::shared_ptr<const BgpFilterActionResult> result;
+                    if (actions != NULL) result = actions->apply(e.attribs);
+                    if (result) {
+                        GroupRoute(modified, result, r);
+                        last_iter = iter;
+                        continue;
+                    }
+
                     msg_len += 1 + (r.getLength() + 7) / 8;
                     if (msg_len > 4096) {
                         // size too big, roll back and break.
@@ -917,6 +1468,10 @@ int BgpFsm::fsmEvalOpenConfirm(__attribute__((unused)) const BgpMessage *msg) {
             if (update.nlri.size() > 0) {
                 if(!writeMessage(update)) return -1;
             }
+
+            for (const std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>> &group : modified) {
+                if (!writeRoutes4(*(group.first), group.second)) return -1;
+            }
         }
     }
 
@@ -929,6 +1484,8 @@ int BgpFsm::fsmEvalOpenConfirm(__attribute__((unused)) const BgpMessage *msg) {
             uint64_t cur_group_id = iter->second.update_id;
             const uint8_t *nh_global = iter->second.nexthop_global;
             const uint8_t *nh_linklocal = iter->second.nexthop_linklocal;
+            const uint8_t *group_nh_global = nh_global;
+            const uint8_t *group_nh_linklocal = nh_linklocal;
             BgpUpdateMessage update (logger, use_4b_asn);
             update.setAttribs(iter->second.attribs);
 
@@ -942,9 +1499,12 @@ int BgpFsm::fsmEvalOpenConfirm(__attribute__((unused)) const BgpMessage *msg) {
                 msg_len += attrib->length(); 
             }
 
+            BgpFilterPrepared prepared = config.out_filters6.prepare(update.path_attribute);
+            std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>>> modified;
+
             for (; iter != end && cur_group_id == iter->second.update_id && msg_len < 4096; iter++) {
                 const BgpRib6Entry &e = iter->second;
-                const Prefix6 &r = e.route;
+                const Prefix6 r (e.route);
                 if (e.status != RS_ACTIVE) continue;
                 if (ibgp && e.src == SRC_IBGP && e.ibgp_peer_asn == peer_asn) {
                     LIBBGP_LOG(logger, DEBUG) {
@@ -969,7 +1529,16 @@ int BgpFsm::fsmEvalOpenConfirm(__attribute__((unused)) const BgpMessage *msg) {
                     continue;
                 }
 
-                if (config.out_filters6.apply(r, update.path_attribute) == ACCEPT) {
+                const BgpFilterActions *actions;
+                if (config.out_filters6.apply(r, prepared, actions) == ACCEPT) {
+                    std::shared_ptr<const BgpFilterActionResult> result;
+                    if (actions != NULL) result = actions->apply(e.attribs);
+                    if (result) {
+                        GroupRoute(modified, result, r);
+                        last_iter = iter;
+                        continue;
+                    }
+
                     msg_len += 1 + (r.getLength() + 7) / 8;
                     if (msg_len > 4096) {
                         // size too big, roll back and break.
@@ -995,6 +1564,10 @@ int BgpFsm::fsmEvalOpenConfirm(__attribute__((unused)) const BgpMessage *msg) {
                 if(!writeMessage(update)) return -1;
             }
 
+            for (const std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>> &group : modified) {
+                if (!writeRoutes6(*(group.first), group_nh_global, group_nh_linklocal, group.second)) return -1;
+            }
+
         }
     }
 
@@ -1009,8 +1582,9 @@ int BgpFsm::fsmEvalEstablished(const BgpMessage *msg) {
     bool ignore_routes = false;
 
     // checks
-    if (update->hasAttrib(AS_PATH) && update->nlri.size() > 0) {
-        const BgpPathAttribAsPath &as_path = dynamic_cast<const BgpPathAttribAsPath&>(update->getAttrib(AS_PATH));
+    const BgpPathAttribAsPath *as_path_attrib = update->getAsPath();
+    if (as_path_attrib != NULL && update->nlri.size() > 0) {
+        const BgpPathAttribAsPath &as_path = *as_path_attrib;
 
         for (const BgpAsPathSegment &seg : as_path.as_paths) {
             int8_t local_count = 0;
@@ -1028,22 +1602,9 @@ int BgpFsm::fsmEvalEstablished(const BgpMessage *msg) {
     } else if (update->nlri.size() > 0) ignore_routes = true; // since no AS_PATH and nlri non empty. (should be handleded by update-msg already tho)
 
     if (send_ipv4_routes) {
-        std::vector<Prefix4> unreach;
-        std::vector<BgpRib4Entry> changed_entries;
-        for (const Prefix4 &r : update->withdrawn_routes) {
-            std::pair<bool, const void*> w_ret = rib4->withdraw(peer_bgp_id, r);
-            if (!rev_bus_exist) continue;
-            if (!w_ret.first) {
-                if (w_ret.second == NULL) unreach.push_back(r);
-            }
-            else if (w_ret.second != NULL) {
-                changed_entries.push_back(*((BgpRib4Entry *) w_ret.second));
-            }
-        }
-
         // more checks
         if (update->nlri.size() > 0) {
-            const BgpPathAttribNexthop &nh = dynamic_cast<const BgpPathAttribNexthop &>(update->getAttrib(NEXT_HOP));
+            const BgpPathAttribNexthop &nh = *update->getNexthop();
 
             if (!ignore_routes && !validAddr4(nh.next_hop)) {
                 LIBBGP_LOG(logger, WARN) {
@@ -1068,157 +1629,660 @@ int BgpFsm::fsmEvalEstablished(const BgpMessage *msg) {
             };
         }
 
-        // filter & insert to rib
+        // filter the routes before locking the RIB. (routes and attribs stay
+        // NULL if the routes are ignored)
+        std::vector<std::shared_ptr<BgpPathAttrib>> prepared;
+        std::vector<std::shared_ptr<BgpPathAttrib>> detached;
+        std::vector<Prefix4> filtered_routes;
+        const std::vector<Prefix4> *routes = NULL;
+        const std::vector<std::shared_ptr<BgpPathAttrib>> *attribs = NULL;
+
+        // routes with attributes modified by in_filters4, inserted separately.
+        std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>>> modified;
+
         if (!ignore_routes) {
-            std::vector<Prefix4> routes = std::vector<Prefix4> ();
-            for (const Prefix4 &route : update->nlri) {
-                if(config.in_filters4.apply(route, update->path_attribute) == ACCEPT) {
-                    routes.push_back(route);
-                } else {
-                    LIBBGP_LOG(logger, DEBUG) {
-                        uint32_t prefix = route.getPrefix();
-                        char ip_str[INET_ADDRSTRLEN];
-                        inet_ntop(AF_INET, &prefix, ip_str, INET_ADDRSTRLEN);
-                        logger->log(DEBUG, "BgpFsm::fsmEvalEstablished: route %s/%d filtered by in_filters4.\n", ip_str, route.getLength());
+            // copy the list if the attributes in it are to be replaced.
+            bool replace_attribs = config.as_path_store != NULL || (config.use_4b_asn && !use_4b_asn);
+            if (replace_attribs) {
+                prepared = update->path_attribute;
+                prepareRibAttribs(prepared);
+            }
+
+            const std::vector<std::shared_ptr<BgpPathAttrib>> &received = replace_attribs ? prepared : update->path_attribute;
+
+            std::vector<bool> accepted;
+            std::vector<std::shared_ptr<const BgpFilterActionResult>> results;
+            size_t n_accepted = config.in_filters4.apply(update->nlri, received, accepted, results);
+
+            // copy only if some routes are filtered or modified.
+            if (n_accepted < update->nlri.size() || results.size() > 0) {
+                filtered_routes.reserve(n_accepted);
+                for (size_t i = 0; i < update->nlri.size(); i++) {
+                    const Prefix4 &route = update->nlri[i];
+                    if (accepted[i] && results.size() > 0 && results[i]) {
+                        GroupRoute(modified, results[i], route);
+                    } else if (accepted[i]) {
+                        filtered_routes.push_back(route);
+                    } else {
+                        LIBBGP_LOG(logger, DEBUG) {
+                            uint32_t prefix = route.getPrefix();
+                            char ip_str[INET_ADDRSTRLEN];
+                            inet_ntop(AF_INET, &prefix, ip_str, INET_ADDRSTRLEN);
+                            logger->log(DEBUG, "BgpFsm::fsmEvalEstablished: route %s/%d filtered by in_filters4.\n", ip_str, route.getLength());
+                        }
                     }
                 }
             }
 
-            std::pair<std::vector<BgpRib4Entry>, std::vector<Prefix4>> rslt;
-            if (routes.size() > 0) {
-                rslt = rib4->insert(peer_bgp_id, routes, update->path_attribute, config.weight, ibgp ? peer_asn : 0);
-                for (const BgpRib4Entry &entry : rslt.first) {
-                    changed_entries.push_back(entry);
+            routes = n_accepted < update->nlri.size() || results.size() > 0 ? &filtered_routes : &(update->nlri);
+
+            // with the arena, copy the attributes to the heap only if they are
+            // kept. (routes modified by in_filters4 have their own copy)
+            bool detach = arena != NULL && (routes->size() > 0 || config.keep_adj_rib_in);
+            if (detach) detachAttribs(received, detached);
+
+            attribs = detach ? &detached : &received;
+        }
+
+        // the RIB is locked only while it is changed. the replaced entries are
+        // copied out of it, and published after it is unlocked.
+        RibChanges4 changes;
+
+        {
+            std::lock_guard<BgpRib4> rib_lock(*rib4);
+            withdrawRoutes4(update->withdrawn_routes, changes.unreach, changes.replaced_entries);
+            if (config.keep_adj_rib_in) adj_rib_in4.withdraw(update->withdrawn_routes);
+
+            if (attribs != NULL) {
+                if (config.keep_adj_rib_in && update->nlri.size() > 0) {
+                    adj_rib_in4.update(update->nlri, std::make_shared<const std::vector<std::shared_ptr<BgpPathAttrib>>>(*attribs));
                 }
-                logger->log(DEBUG, "BgpFsm::fsmEvalEstablished: rib4.insert(): %zu altered and %zu added in %zu routes.\n", rslt.first.size(), rslt.second.size(), routes.size());
-            }
 
-            if (rev_bus_exist && (changed_entries.size() > 0 || rslt.second.size() > 0)) {
-                logger->log(DEBUG, "BgpFsm::fsmEvalEstablished: publishing new v4 routes on event bus...\n");
-                Route4AddEvent aev = Route4AddEvent();
-                aev.replaced_entries = changed_entries.size() > 0 ? &changed_entries : NULL;
-                aev.shared_attribs = &(update->path_attribute);
-                aev.new_routes = rslt.second.size() > 0 ? &(rslt.second) : NULL;
-                if (ibgp) aev.ibgp_peer_asn = peer_asn;
-                config.rev_bus->publish(this, aev);
-            }
+                if (routes->size() > 0) insertRoutes4(changes, *routes, *attribs, config.weight);
 
-            if (rev_bus_exist && unreach.size() > 0) {
-                logger->log(DEBUG, "BgpFsm::fsmEvalEstablished: publishing dropped v4 routes on event bus...\n");
-                Route4WithdrawEvent wev = Route4WithdrawEvent();
-                wev.routes = &unreach;
-                config.rev_bus->publish(this, wev);
+                for (const std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>> &group : modified) {
+                    const BgpFilterActionResult &result = *(group.first);
+                    insertRoutes4(changes, group.second, result.attribs, result.has_weight ? result.weight : config.weight);
+                }
             }
+
+            SnapshotChanges(changes);
         }
+
+        publishChanges4(changes);
     }
 
     if (send_ipv6_routes) {
-        std::vector<Prefix6> unreach;
-        std::vector<BgpRib6Entry> changed_entries;
-        if (update->hasAttrib(MP_UNREACH_NLRI)) {
-            const BgpPathAttrib &attr = update->getAttrib(MP_UNREACH_NLRI);
-            const BgpPathAttribMpNlriBase &mp_unreach = dynamic_cast<const BgpPathAttribMpNlriBase &>(attr);
-            if (mp_unreach.afi == IPV6 && mp_unreach.safi == UNICAST) {
-                const BgpPathAttribMpUnreachNlriIpv6 &u = dynamic_cast<const BgpPathAttribMpUnreachNlriIpv6 &>(mp_unreach);
-
-                for (const Prefix6 &r : u.withdrawn_routes) {
-                    std::pair<bool, const void*> w_ret = rib6->withdraw(peer_bgp_id, r);
-                    if (!rev_bus_exist) continue;
-                    if (!w_ret.first) {
-                        if (w_ret.second == NULL) unreach.push_back(r);
-                    }
-                    else if (w_ret.second != NULL) {
-                        changed_entries.push_back(*((BgpRib6Entry *) w_ret.second));
-                    }
+        const std::vector<Prefix6> *withdrawn = NULL;
+        const BgpPathAttribMpUnreachNlriIpv6 *mp_unreach = update->getMpUnreachNlri6();
+        if (mp_unreach != NULL) {
+            if (mp_unreach->afi == IPV6 && mp_unreach->safi == UNICAST) {
+                const BgpPathAttribMpUnreachNlriIpv6 &u = *mp_unreach;
+
+                if (u.withdrawn_routes.size() == 0 && update->path_attribute.size() == 1) {
+                    logger->log(INFO, "BgpFsm::fsmEvalEstablished: got End-of-RIB marker for IPv6 unicast.\n");
                 }
+
+                withdrawn = &(u.withdrawn_routes);
             }
         }
 
+        // routes to insert. (NULL if none, or if they are ignored)
+        const BgpPathAttribMpReachNlriIpv6 *reach = NULL;
         if (!ignore_routes && update->hasAttrib(MP_REACH_NLRI)) {
-            const BgpPathAttrib &attr = update->getAttrib(MP_REACH_NLRI);
-            const BgpPathAttribMpNlriBase &mp_reach = dynamic_cast<const BgpPathAttribMpNlriBase &>(attr);
-            if (mp_reach.afi == IPV6 && mp_reach.safi == UNICAST) {
-                const BgpPathAttribMpReachNlriIpv6 &reach = dynamic_cast<const BgpPathAttribMpReachNlriIpv6 &>(mp_reach);
-
-                if (!validAddr6(reach.nexthop_global) || (!v6addr_is_zero(reach.nexthop_linklocal) && !validAddr6(reach.nexthop_linklocal))) {
-                    logger->log(WARN, "BgpFsm::fsmEvalEstablished: ignored %zu routes with invalid nexthop:\n", reach.nlri.size());
-                    logger->log(WARN, reach);
-                    return 1;
-                }
+            const BgpPathAttribMpReachNlriIpv6 *mp_reach = update->getMpReachNlri6();
+            if (mp_reach != NULL && mp_reach->afi == IPV6 && mp_reach->safi == UNICAST) reach = mp_reach;
+        }
 
-                // filter toures
-                std::vector<Prefix6> filtered_routes;
-                for (const Prefix6 &route : reach.nlri) {
-                    if (config.in_filters6.apply(route, update->path_attribute) == ACCEPT) filtered_routes.push_back(route);
-                }
+        if (reach != NULL && (!validAddr6(reach->nexthop_global) || (!v6addr_is_zero(reach->nexthop_linklocal) && !validAddr6(reach->nexthop_linklocal)))) {
+            logger->log(WARN, "BgpFsm::fsmEvalEstablished: ignored %zu routes with invalid nexthop:\n", reach->nlri.size());
+            logger->log(WARN, *reach);
+            reach = NULL;
+        }
 
-                if (filtered_routes.size() <= 0) return 1;
+        // TODO verify with no_nexthop_check6
 
-                // TODO verify with no_nexthop_check6
+        // filter the routes before locking the RIB, see the IPv4 part.
+        std::vector<std::shared_ptr<BgpPathAttrib>> attrs;
+        std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>>> modified;
+        std::vector<Prefix6> filtered_routes;
 
-                // remove MP_* & nexthop attribute
-                std::vector<std::shared_ptr<BgpPathAttrib>> attrs;
+        if (reach != NULL) {
+            // remove MP_* & nexthop attribute
+            for (const std::shared_ptr<BgpPathAttrib> &attr : update->path_attribute) {
+                if (attr->type_code == MP_REACH_NLRI || attr->type_code == MP_UNREACH_NLRI || attr->type_code == NEXT_HOP) continue;
+                attrs.push_back(attr);
+            }
 
-                for (const std::shared_ptr<BgpPathAttrib> &attr : update->path_attribute) {
-                    if (attr->type_code == MP_REACH_NLRI || attr->type_code == MP_UNREACH_NLRI || attr->type_code == NEXT_HOP) continue;
-                    attrs.push_back(attr);
-                }
+            prepareRibAttribs(attrs);
 
-                std::pair<std::vector<BgpRib6Entry>, std::vector<Prefix6>> rslt = rib6->insert(peer_bgp_id, filtered_routes, reach.nexthop_global, reach.nexthop_linklocal, attrs, config.weight, ibgp ? peer_asn : 0);
-                logger->log(DEBUG, "BgpFsm::fsmEvalEstablished: rib6.insert(): %zu altered and %zu added in %zu routes.\n", rslt.first.size(), rslt.second.size(), filtered_routes.size());
+            // filter toures
+            std::vector<bool> accepted;
+            std::vector<std::shared_ptr<const BgpFilterActionResult>> results;
+            filtered_routes.reserve(config.in_filters6.apply(reach->nlri, attrs, accepted, results));
+            for (size_t i = 0; i < reach->nlri.size(); i++) {
+                if (accepted[i] && results.size() > 0 && results[i]) GroupRoute(modified, results[i], reach->nlri[i]);
+                else if (accepted[i]) filtered_routes.push_back(reach->nlri[i]);
+            }
 
-                for (const BgpRib6Entry &e : rslt.first) {
-                    changed_entries.push_back(e);
-                }
+            // copy arena attributes only if they are kept, see the IPv4 part.
+            if (arena != NULL && (filtered_routes.size() > 0 || config.keep_adj_rib_in)) {
+                std::vector<std::shared_ptr<BgpPathAttrib>> detached;
+                detachAttribs(attrs, detached);
+                attrs.swap(detached);
+            }
+        }
+
+        RibChanges6 changes;
+
+        {
+            std::lock_guard<BgpRib6> rib_lock(*rib6);
 
-                if (rev_bus_exist && (changed_entries.size() > 0 || rslt.second.size() > 0)) {
-                    Route6AddEvent aev = Route6AddEvent();
-                    memcpy(aev.nexthop_global, reach.nexthop_global, 16);
-                    memcpy(aev.nexthop_linklocal, reach.nexthop_linklocal, 16);
-                    aev.new_routes = rslt.second.size() > 0 ? &(rslt.second) : NULL;
-                    aev.replaced_entries = changed_entries.size() > 0 ? &changed_entries : NULL;
-                    aev.shared_attribs = &attrs;
-                    if (ibgp) aev.ibgp_peer_asn = peer_asn;
-                    config.rev_bus->publish(this, aev);
+            if (withdrawn != NULL) {
+                withdrawRoutes6(*withdrawn, changes.unreach, changes.replaced_entries);
+                if (config.keep_adj_rib_in) adj_rib_in6.withdraw(*withdrawn);
+            }
+
+            if (reach != NULL) {
+                if (config.keep_adj_rib_in) {
+                    adj_rib_in6.update(reach->nlri, reach->nexthop_global, reach->nexthop_linklocal, std::make_shared<const std::vector<std::shared_ptr<BgpPathAttrib>>>(attrs));
                 }
 
-                if (rev_bus_exist && unreach.size() > 0) {
-                    logger->log(DEBUG, "BgpFsm::fsmEvalEstablished: publishing dropped v6 routes on event bus...\n");
-                    Route6WithdrawEvent wev = Route6WithdrawEvent();
-                    wev.routes = &unreach;
-                    config.rev_bus->publish(this, wev);
+                if (filtered_routes.size() > 0) insertRoutes6(changes, filtered_routes, reach->nexthop_global, reach->nexthop_linklocal, attrs, config.weight);
+
+                for (const std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>> &group : modified) {
+                    const BgpFilterActionResult &result = *(group.first);
+                    insertRoutes6(changes, group.second, reach->nexthop_global, reach->nexthop_linklocal, result.attribs, result.has_weight ? result.weight : config.weight);
                 }
             }
+
+            SnapshotChanges(changes);
         }
+
+        publishChanges6(changes);
     }
 
     return 1;
 }
 
-void BgpFsm::dropAllRoutes() {
-    if (peer_bgp_id != 0) {
-        std::pair<std::vector<Prefix4>, std::vector<BgpRib4Entry>> rslt4 = rib4->discard(peer_bgp_id);
-        if (rev_bus_exist && rslt4.first.size() > 0) {
-            Route4WithdrawEvent wev;
-            wev.routes = &(rslt4.first);
-            config.rev_bus->publish(this, wev);
+/**
+ * @brief Count the prefixes covered by prefix set entries.
+ * 
+ * @param entries The entries.
+ * @param limit Stop counting after limit prefixes.
+ * @return size_t Number of prefixes, or limit + 1 if more than limit.
+ */
+template <typename T>
+static size_t CountCovered(const std::vector<T> &entries, size_t limit) {
+    size_t n = 0;
+
+    for (const T &entry : entries) {
+        for (uint32_t len = entry.ge; len <= entry.le; len++) {
+            if (len - entry.length >= 32) return limit + 1;
+            n += (size_t) 1 << (len - entry.length);
+            if (n > limit) return limit + 1;
+        }
+    }
+
+    return n;
+}
+
+/**
+ * @brief Visit the IPv4 prefixes covered by prefix set entries.
+ * 
+ * @param entries The entries. Must cover less than 2^32 prefixes each (see
+ * CountCovered).
+ * @param visit Called with each prefix (in network byte order) and length.
+ */
+template <typename F>
+static void ExpandEntries4(const std::vector<PrefixSetEntry4> &entries, const F &visit) {
+    for (const PrefixSetEntry4 &entry : entries) {
+        uint32_t prefix = ntohl(entry.prefix);
+
+        for (uint32_t len = entry.ge; len <= entry.le; len++) {
+            uint32_t n = (uint32_t) 1 << (len - entry.length);
+            for (uint32_t i = 0; i < n; i++) visit(htonl(i == 0 ? prefix : prefix | (i << (32 - len))), len);
+        }
+    }
+}
+
+/**
+ * @brief Visit the IPv6 prefixes covered by prefix set entries.
+ * 
+ * @param entries The entries. Must cover less than 2^32 prefixes each (see
+ * CountCovered).
+ * @param visit Called with each prefix and length.
+ */
+template <typename F>
+static void ExpandEntries6(const std::vector<PrefixSetEntry6> &entries, const F &visit) {
+    for (const PrefixSetEntry6 &entry : entries) {
+        for (uint32_t len = entry.ge; len <= entry.le; len++) {
+            uint32_t n = (uint32_t) 1 << (len - entry.length);
+
+            for (uint32_t i = 0; i < n; i++) {
+                uint8_t prefix[16];
+                memcpy(prefix, entry.prefix, 16);
+                for (uint32_t bit = entry.length; bit < len; bit++) {
+                    if ((i >> (len - 1 - bit)) & 1) prefix[bit >> 3] |= 0x80 >> (bit & 7);
+                }
+                visit(prefix, len);
+            }
+        }
+    }
+}
+
+int BgpFsm::revalidate(const PrefixSet4 &scope) {
+    if (state != ESTABLISHED || scope.size() == 0) return 0;
+
+    RibChanges4 changes;
+    std::unique_lock<BgpRib4> rib_lock(*rib4);
+
+    // look up the prefixes in the scope one by one, unless there are more of
+    // them than routes to scan.
+    std::vector<PrefixSetEntry4> entries;
+    scope.getEntries(entries);
+    size_t n_routes = config.keep_adj_rib_in ? adj_rib_in4.size() : rib4->get().size();
+    bool lookup = CountCovered(entries, n_routes) <= n_routes;
+
+    std::vector<Prefix4> rejected;
+    size_t n_evaluated = 0;
+    size_t n_inserted = 0;
+
+    if (!config.keep_adj_rib_in) {
+        std::vector<const BgpRib4Entry *> in_scope;
+
+        if (lookup) {
+            ExpandEntries4(entries, [&](uint32_t prefix, uint8_t length) {
+                const BgpRib4Entry *entry = findRoute4(Prefix4(prefix, length));
+                if (entry != NULL) in_scope.push_back(entry);
+            });
+        } else for (const std::pair<const BgpRib4EntryKey, BgpRib4Entry> &kv : rib4->get()) {
+            const BgpRib4Entry &entry = kv.second;
+            if (entry.src_router_id == peer_bgp_id && scope.includes(entry.route.prefix, entry.route.length)) in_scope.push_back(&entry);
+        }
+
+        n_evaluated = in_scope.size();
+
+        for (const BgpRib4Entry *entry : in_scope) {
+            if (config.in_filters4.apply(Prefix4(entry->route), entry->attribs) != ACCEPT) rejected.push_back(entry->route);
         }
-        if (rev_bus_exist && rslt4.second.size() > 0) {
-            Route4AddEvent aev;
-            aev.replaced_entries = &(rslt4.second);
-            config.rev_bus->publish(this, aev);
+    } else {
+        std::vector<const BgpAdjIn4Entry *> in_scope;
+
+        if (lookup) {
+            ExpandEntries4(entries, [&](uint32_t prefix, uint8_t length) {
+                adj_in4_t::const_iterator it = adj_rib_in4.get().find(BgpRib4EntryKey(prefix, length));
+                if (it != adj_rib_in4.get().end()) in_scope.push_back(&(it->second));
+            });
+        } else for (const std::pair<const BgpRib4EntryKey, BgpAdjIn4Entry> &kv : adj_rib_in4.get()) {
+            const BgpAdjIn4Entry &entry = kv.second;
+            if (scope.includes(entry.route.prefix, entry.route.length)) in_scope.push_back(&entry);
+        }
+
+        n_evaluated = in_scope.size();
+        n_inserted = refilterAdjIn4(changes, in_scope, rejected);
+    }
+
+    withdrawRoutes4(rejected, changes.unreach, changes.replaced_entries);
+    SnapshotChanges(changes);
+    rib_lock.unlock();
+    publishChanges4(changes);
+
+    logger->log(DEBUG, "BgpFsm::revalidate: %zu v4 routes evaluated (%s), %zu inserted, %zu withdrawn.\n", n_evaluated, lookup ? "looked up" : "scanned", n_inserted, rejected.size());
+
+    return n_inserted + rejected.size();
+}
+
+int BgpFsm::revalidate(const PrefixSet6 &scope) {
+    if (state != ESTABLISHED || scope.size() == 0) return 0;
+
+    RibChanges6 changes;
+    std::unique_lock<BgpRib6> rib_lock(*rib6);
+
+    // see the IPv4 version.
+    std::vector<PrefixSetEntry6> entries;
+    scope.getEntries(entries);
+    size_t n_routes = config.keep_adj_rib_in ? adj_rib_in6.size() : rib6->get().size();
+    bool lookup = CountCovered(entries, n_routes) <= n_routes;
+
+    std::vector<Prefix6> rejected;
+    size_t n_evaluated = 0;
+    size_t n_inserted = 0;
+
+    if (!config.keep_adj_rib_in) {
+        std::vector<const BgpRib6Entry *> in_scope;
+
+        if (lookup) {
+            ExpandEntries6(entries, [&](const uint8_t *prefix, uint8_t length) {
+                const BgpRib6Entry *entry = findRoute6(Prefix6(prefix, length));
+                if (entry != NULL) in_scope.push_back(entry);
+            });
+        } else for (const std::pair<const BgpRib6EntryKey, BgpRib6Entry> &kv : rib6->get()) {
+            const BgpRib6Entry &entry = kv.second;
+            if (entry.src_router_id == peer_bgp_id && scope.includes(entry.route.prefix, entry.route.length)) in_scope.push_back(&entry);
+        }
+
+        n_evaluated = in_scope.size();
+
+        for (const BgpRib6Entry *entry : in_scope) {
+            if (config.in_filters6.apply(Prefix6(entry->route), entry->attribs) != ACCEPT) rejected.push_back(entry->route);
+        }
+    } else {
+        std::vector<const BgpAdjIn6Entry *> in_scope;
+
+        if (lookup) {
+            ExpandEntries6(entries, [&](const uint8_t *prefix, uint8_t length) {
+                adj_in6_t::const_iterator it = adj_rib_in6.get().find(BgpRib6EntryKey(Prefix6Value(prefix, length)));
+                if (it != adj_rib_in6.get().end()) in_scope.push_back(&(it->second));
+            });
+        } else for (const std::pair<const BgpRib6EntryKey, BgpAdjIn6Entry> &kv : adj_rib_in6.get()) {
+            const BgpAdjIn6Entry &entry = kv.second;
+            if (scope.includes(entry.route.prefix, entry.route.length)) in_scope.push_back(&entry);
+        }
+
+        n_evaluated = in_scope.size();
+        n_inserted = refilterAdjIn6(changes, in_scope, rejected);
+    }
+
+    withdrawRoutes6(rejected, changes.unreach, changes.replaced_entries);
+    SnapshotChanges(changes);
+    rib_lock.unlock();
+    publishChanges6(changes);
+
+    logger->log(DEBUG, "BgpFsm::revalidate: %zu v6 routes evaluated (%s), %zu inserted, %zu withdrawn.\n", n_evaluated, lookup ? "looked up" : "scanned", n_inserted, rejected.size());
+
+    return n_inserted + rejected.size();
+}
+
+int BgpFsm::setInFilters4(const BgpFilterRules &filters) {
+    // ingress filters are applied with RIB locked, hold the lock from the swap
+    // until the changes are made.
+    RibChanges4 changes;
+    std::unique_lock<BgpRib4> rib_lock(*rib4);
+    BgpFilterRules changed;
+    bool partial = config.in_filters4.diff(filters, changed);
+    config.in_filters4 = filters;
+
+    if (state != ESTABLISHED || !send_ipv4_routes || (partial && changed.size() == 0)) return 0;
+
+    std::vector<Prefix4> rejected;
+    size_t n_evaluated = 0;
+    size_t n_inserted = 0;
+
+    if (!config.keep_adj_rib_in) {
+        logger->log(WARN, "BgpFsm::setInFilters4: keep_adj_rib_in not set, only routes in RIB are evaluated again.\n");
+
+        for (const std::pair<const BgpRib4EntryKey, BgpRib4Entry> &kv : rib4->get()) {
+            const BgpRib4Entry &entry = kv.second;
+            if (entry.src_router_id != peer_bgp_id) continue;
+            const Prefix4 route (entry.route);
+            if (partial && !changed.matches(route, changed.prepare(entry.attribs))) continue;
+            n_evaluated++;
+            if (config.in_filters4.apply(route, entry.attribs) == ACCEPT) continue;
+            rejected.push_back(route);
+        }
+    } else {
+        // routes that may get a different verdict.
+        std::vector<const BgpAdjIn4Entry *> entries;
+
+        for (const std::pair<const BgpRib4EntryKey, BgpAdjIn4Entry> &kv : adj_rib_in4.get()) {
+            const BgpAdjIn4Entry &entry = kv.second;
+            if (partial && !changed.matches(Prefix4(entry.route), changed.prepare(*(entry.attribs)))) continue;
+            entries.push_back(&entry);
+        }
+
+        n_evaluated = entries.size();
+        n_inserted = refilterAdjIn4(changes, entries, rejected);
+    }
+
+    withdrawRoutes4(rejected, changes.unreach, changes.replaced_entries);
+    SnapshotChanges(changes);
+    rib_lock.unlock();
+    publishChanges4(changes);
+
+    logger->log(DEBUG, "BgpFsm::setInFilters4: %zu v4 routes evaluated, %zu inserted, %zu withdrawn.\n", n_evaluated, n_inserted, rejected.size());
+
+    return n_inserted + rejected.size();
+}
+
+int BgpFsm::setInFilters6(const BgpFilterRules &filters) {
+    // ingress filters are applied with RIB locked, hold the lock from the swap
+    // until the changes are made.
+    RibChanges6 changes;
+    std::unique_lock<BgpRib6> rib_lock(*rib6);
+    BgpFilterRules changed;
+    bool partial = config.in_filters6.diff(filters, changed);
+    config.in_filters6 = filters;
+
+    if (state != ESTABLISHED || !send_ipv6_routes || (partial && changed.size() == 0)) return 0;
+
+    std::vector<Prefix6> rejected;
+    size_t n_evaluated = 0;
+    size_t n_inserted = 0;
+
+    if (!config.keep_adj_rib_in) {
+        logger->log(WARN, "BgpFsm::setInFilters6: keep_adj_rib_in not set, only routes in RIB are evaluated again.\n");
+
+        for (const std::pair<const BgpRib6EntryKey, BgpRib6Entry> &kv : rib6->get()) {
+            const BgpRib6Entry &entry = kv.second;
+            if (entry.src_router_id != peer_bgp_id) continue;
+            const Prefix6 route (entry.route);
+            if (partial && !changed.matches(route, changed.prepare(entry.attribs))) continue;
+            n_evaluated++;
+            if (config.in_filters6.apply(route, entry.attribs) == ACCEPT) continue;
+            rejected.push_back(route);
+        }
+    } else {
+        // routes that may get a different verdict.
+        std::vector<const BgpAdjIn6Entry *> entries;
+
+        for (const std::pair<const BgpRib6EntryKey, BgpAdjIn6Entry> &kv : adj_rib_in6.get()) {
+            const BgpAdjIn6Entry &entry = kv.second;
+            if (partial && !changed.matches(Prefix6(entry.route), changed.prepare(*(entry.attribs)))) continue;
+            entries.push_back(&entry);
+        }
+
+        n_evaluated = entries.size();
+        n_inserted = refilterAdjIn6(changes, entries, rejected);
+    }
+
+    withdrawRoutes6(rejected, changes.unreach, changes.replaced_entries);
+    SnapshotChanges(changes);
+    rib_lock.unlock();
+    publishChanges6(changes);
+
+    logger->log(DEBUG, "BgpFsm::setInFilters6: %zu v6 routes evaluated, %zu inserted, %zu withdrawn.\n", n_evaluated, n_inserted, rejected.size());
+
+    return n_inserted + rejected.size();
+}
+
+int BgpFsm::setOutFilters4(const BgpFilterRules &filters) {
+    // route event handlers wait on out_filters_mutex until the routes are
+    // written, so no event is sent with the rules half replaced. the RIB is
+    // only locked while it is scanned. (in this order: events may be published
+    // with the RIB locked)
+    std::unique_lock<BgpRib4> rib_lock(*rib4);
+    std::lock_guard<std::recursive_mutex> filters_lock(out_filters_mutex);
+    BgpFilterRules changed;
+    bool partial = config.out_filters4.diff(filters, changed);
+    BgpFilterRules old_filters = config.out_filters4;
+    config.out_filters4 = filters;
+
+    if (state != ESTABLISHED || !send_ipv4_routes || (partial && changed.size() == 0)) return 0;
+
+    std::vector<Prefix4> withdrawn;
+
+    // routes to send, grouped by update and the result of route-map actions.
+    std::map<std::pair<uint64_t, const BgpFilterActionResult *>, std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>>> announced;
+    size_t n_announced = 0;
+
+    for (const std::pair<const BgpRib4EntryKey, BgpRib4Entry> &kv : rib4->get()) {
+        const BgpRib4Entry &e = kv.second;
+        if (e.status != RS_ACTIVE || e.src_router_id == peer_bgp_id) continue;
+        if (ibgp && e.src == SRC_IBGP && e.ibgp_peer_asn == peer_asn) continue;
+        const Prefix4 route (e.route);
+        if (partial && !changed.matches(route, changed.prepare(e.attribs))) continue;
+
+        const BgpFilterActions *old_actions, *new_actions;
+        bool was_sent = old_filters.apply(route, old_filters.prepare(e.attribs), old_actions) == ACCEPT;
+        bool send = config.out_filters4.apply(route, config.out_filters4.prepare(e.attribs), new_actions) == ACCEPT;
+
+        if (!send) {
+            if (was_sent) withdrawn.push_back(route);
+            continue;
+        }
+
+        std::shared_ptr<const BgpFilterActionResult> result;
+        if (new_actions != NULL) result = new_actions->apply(e.attribs);
+
+        if (was_sent) {
+            std::shared_ptr<const BgpFilterActionResult> old_result;
+            if (old_actions != NULL) old_result = old_actions->apply(e.attribs);
+            if (old_result == result) continue;
+        }
+
+        std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>> &group = announced[std::make_pair(e.update_id, result.get())];
+        if (!group.first && result) group.first = result;
+        if (!group.first) {
+            // not modified: send the attributes in RIB as-is.
+            BgpFilterActionResult *unmodified = new BgpFilterActionResult();
+            unmodified->attribs = e.attribs;
+            unmodified->weight = 0;
+            unmodified->has_weight = unmodified->has_med = false;
+            group.first.reset(unmodified);
         }
-        std::pair<std::vector<Prefix6>, std::vector<BgpRib6Entry>> rslt6 = rib6->discard(peer_bgp_id);
-        if (rev_bus_exist && rslt6.first.size() > 0) {
-            Route6WithdrawEvent wev;
-            wev.routes = &(rslt6.first);
-            config.rev_bus->publish(this, wev);
+
+        group.second.push_back(route);
+        n_announced++;
+    }
+
+    rib_lock.unlock();
+
+    logger->log(DEBUG, "BgpFsm::setOutFilters4: sending %zu v4 routes and withdrawing %zu v4 routes.\n", n_announced, withdrawn.size());
+
+    if (!writeWithdrawn4(withdrawn)) return -1;
+
+    for (const std::pair<const std::pair<uint64_t, const BgpFilterActionResult *>, std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix4>>> &group : announced) {
+        if (!writeRoutes4(*(group.second.first), group.second.second)) return -1;
+    }
+
+    return n_announced + withdrawn.size();
+}
+
+int BgpFsm::setOutFilters6(const BgpFilterRules &filters) {
+    // route event handlers wait on out_filters_mutex until the routes are
+    // written, so no event is sent with the rules half replaced. the RIB is
+    // only locked while it is scanned. (in this order: events may be published
+    // with the RIB locked)
+    std::unique_lock<BgpRib6> rib_lock(*rib6);
+    std::lock_guard<std::recursive_mutex> filters_lock(out_filters_mutex);
+    BgpFilterRules changed;
+    bool partial = config.out_filters6.diff(filters, changed);
+    BgpFilterRules old_filters = config.out_filters6;
+    config.out_filters6 = filters;
+
+    if (state != ESTABLISHED || !send_ipv6_routes || (partial && changed.size() == 0)) return 0;
+
+    std::vector<Prefix6> withdrawn;
+
+    // routes to send, grouped by update and the result of route-map actions.
+    // routes in the same update share the same nexthops.
+    std::map<std::pair<uint64_t, const BgpFilterActionResult *>, std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>>> announced;
+    struct Nexthops {
+        uint8_t global[16];
+        uint8_t linklocal[16];
+    };
+
+    std::map<std::pair<uint64_t, const BgpFilterActionResult *>, Nexthops> nexthops;
+    size_t n_announced = 0;
+
+    for (const std::pair<const BgpRib6EntryKey, BgpRib6Entry> &kv : rib6->get()) {
+        const BgpRib6Entry &e = kv.second;
+        if (e.status != RS_ACTIVE || e.src_router_id == peer_bgp_id) continue;
+        if (ibgp && e.src == SRC_IBGP && e.ibgp_peer_asn == peer_asn) continue;
+        const Prefix6 route (e.route);
+        if (partial && !changed.matches(route, changed.prepare(e.attribs))) continue;
+
+        const BgpFilterActions *old_actions, *new_actions;
+        bool was_sent = old_filters.apply(route, old_filters.prepare(e.attribs), old_actions) == ACCEPT;
+        bool send = config.out_filters6.apply(route, config.out_filters6.prepare(e.attribs), new_actions) == ACCEPT;
+
+        if (!send) {
+            if (was_sent) withdrawn.push_back(route);
+            continue;
         }
-        if (rev_bus_exist && rslt6.second.size() > 0) {
-            Route6AddEvent aev;
-            aev.replaced_entries = &(rslt6.second);
-            config.rev_bus->publish(this, aev);
+
+        std::shared_ptr<const BgpFilterActionResult> result;
+        if (new_actions != NULL) result = new_actions->apply(e.attribs);
+
+        if (was_sent) {
+            std::shared_ptr<const BgpFilterActionResult> old_result;
+            if (old_actions != NULL) old_result = old_actions->apply(e.attribs);
+            if (old_result == result) continue;
+        }
+
+        std::pair<uint64_t, const BgpFilterActionResult *> key = std::make_pair(e.update_id, result.get());
+        std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>> &group = announced[key];
+        if (!group.first && result) group.first = result;
+        if (!group.first) {
+            // not modified: send the attributes in RIB as-is.
+            BgpFilterActionResult *unmodified = new BgpFilterActionResult();
+            unmodified->attribs = e.attribs;
+            unmodified->weight = 0;
+            unmodified->has_weight = unmodified->has_med = false;
+            group.first.reset(unmodified);
         }
+
+        if (group.second.size() == 0) {
+            Nexthops &nh = nexthops[key];
+            memcpy(nh.global, e.nexthop_global, 16);
+            memcpy(nh.linklocal, e.nexthop_linklocal, 16);
+        }
+
+        group.second.push_back(route);
+        n_announced++;
+    }
+
+    rib_lock.unlock();
+
+    logger->log(DEBUG, "BgpFsm::setOutFilters6: sending %zu v6 routes and withdrawing %zu v6 routes.\n", n_announced, withdrawn.size());
+
+    if (!writeWithdrawn6(withdrawn)) return -1;
+
+    for (const std::pair<const std::pair<uint64_t, const BgpFilterActionResult *>, std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<Prefix6>>> &group : announced) {
+        const Nexthops &nh = nexthops[group.first];
+        if (!writeRoutes6(*(group.second.first), nh.global, nh.linklocal, group.second.second)) return -1;
+    }
+
+    return n_announced + withdrawn.size();
+}
+
+void BgpFsm::dropAllRoutes() {
+    if (peer_bgp_id != 0) {
+        // switch the path lists to the backup paths before the routes are
+        // selected again, so both families fail over at once.
+        rib4->failover(peer_bgp_id);
+        rib6->failover(peer_bgp_id);
+
+        // publish after unlocking, with the replacements copied out of RIB.
+        RibChanges4 changes4;
+        RibChanges6 changes6;
+
+        {
+            std::lock_guard<BgpRib4> rib_lock(*rib4);
+            rib4->discard(peer_bgp_id, changes4.unreach, changes4.replaced_entries);
+            SnapshotChanges(changes4);
+        }
+
+        publishChanges4(changes4);
+
+        {
+            std::lock_guard<BgpRib6> rib_lock(*rib6);
+            rib6->discard(peer_bgp_id, changes6.unreach, changes6.replaced_entries);
+            SnapshotChanges(changes6);
+        }
+
+        publishChanges6(changes6);
     }
 }
 
@@ -1234,6 +2298,14 @@ void BgpFsm::setState(BgpState new_state) {
 
         // moved from ESTABLISHED to something else. Drop all routes.
         dropAllRoutes();
+        adj_rib_in4.clear();
+        adj_rib_in6.clear();
+    }
+
+    if (new_state == IDLE) {
+        // OPEN of the next session is parsed with the configured ASN size.
+        in_sink.setUse4bAsn(config.use_4b_asn);
+        if (update_scanner != NULL) update_scanner->setUse4bAsn(config.use_4b_asn);
     }
 
     state = new_state;
@@ -1260,6 +2332,40 @@ bool BgpFsm::validAddr6(const uint8_t addr[16]) const {
     return !bad_range.includes(addr);
 }
 
+void BgpFsm::disposePacket(BgpPacket *packet) {
+    if (arena == NULL) {
+        delete packet;
+        return;
+    }
+
+    BgpArena::destroy(packet);
+    if (--arena_refs == 0) arena->reset();
+}
+
+void BgpFsm::prepareRibAttribs(std::vector<std::shared_ptr<BgpPathAttrib>> &attribs) {
+    // from a two octets ASN peer: restore AS_PATH and AGGREGATOR here, once,
+    // so routes in RIB are always in the four octets ASN form.
+    if (config.use_4b_asn && !use_4b_asn) {
+        BgpUpdateMessage restored (logger, true);
+        restored.setAttribs(attribs);
+        restored.restoreAsPath();
+        restored.restoreAggregator();
+        attribs.swap(restored.path_attribute);
+    }
+
+    // share the AS_PATH attribute with routes of the same path.
+    if (config.as_path_store != NULL) config.as_path_store->internAttribs(attribs);
+}
+
+void BgpFsm::detachAttribs(const std::vector<std::shared_ptr<BgpPathAttrib>> &attrs, std::vector<std::shared_ptr<BgpPathAttrib>> &detached) const {
+    detached.reserve(attrs.size());
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attrs) {
+        // attributes replaced by prepareRibAttribs are on the heap already.
+        if (!attr->in_arena.isSet()) detached.push_back(attr);
+        else detached.push_back(std::shared_ptr<BgpPathAttrib>(attr->clone()));
+    }
+}
+
 bool BgpFsm::writeMessage(const BgpMessage &msg) {
     BgpPacket pkt(logger, use_4b_asn, &msg);
     LIBBGP_LOG(logger, DEBUG) {
@@ -16,7 +16,9 @@
 #include "bgp-rib4.h"
 #include "bgp-rib6.h"
 #include "bgp-config.h"
+#include "bgp-adj-rib-in.h"
 #include "bgp-sink.h"
+#include "bgp-update-scanner.h"
 #include "route-event-receiver.h"
 #include "bgp.h"
 #include <stdint.h>
@@ -144,6 +146,26 @@ public:
      */
     int run(const uint8_t *buffer, const size_t buffer_size);
 
+    /**
+     * @brief Get a buffer to read input into.
+     * 
+     * Get a pointer to free space in the input sink of the FSM, so input can be
+     * read into the sink directly (e.g., read(fd, fsm.acquireInput(n), n)). 
+     * Call commitInput() with the number of bytes read to run the FSM on it.
+     * 
+     * @param len Max number of bytes to be read into the buffer.
+     * @return uint8_t* Pointer to at least len bytes of free space.
+     */
+    uint8_t* acquireInput(size_t len);
+
+    /**
+     * @brief Run the FSM on data read into buffer from acquireInput().
+     * 
+     * @param len Number of bytes read into the buffer.
+     * @return int Same as run().
+     */
+    int commitInput(size_t len);
+
     /**
      * @brief Tick the clock (Check for time-based events)
      * 
@@ -186,6 +208,104 @@ public:
      */
     void resetHard();
 
+    /**
+     * @brief Re-apply the ingress filter on routes from peer.
+     * 
+     * Apply in_filters4 again on the IPv4 routes received from peer that are
+     * in the scope, and withdraw the ones now rejected. This is used when the
+     * data a filter depends on changes, for example, with the prefixes changed
+     * by BgpRoaTable::update, so only the affected routes are evaluated.
+     * 
+     * The prefixes in the scope are looked up one by one, unless there are
+     * more of them than routes to scan (e.g., a VRP for a /8 with all its
+     * sub-prefixes).
+     * 
+     * With BgpConfig::keep_adj_rib_in set, the routes in Adj-RIB-In are
+     * evaluated, and routes now accepted are inserted to RIB too. Otherwise,
+     * routes rejected before the change are not kept by the FSM, and can't be
+     * accepted again without the peer sending them again.
+     * 
+     * @param scope Routes to re-apply the filter on.
+     * @return int Number of routes withdrawn or inserted.
+     */
+    int revalidate(const PrefixSet4 &scope);
+
+    /**
+     * @brief Re-apply the ingress filter on IPv6 routes from peer.
+     * 
+     * See revalidate(const PrefixSet4 &).
+     * 
+     * @param scope Routes to re-apply the filter on.
+     * @return int Number of routes withdrawn or inserted.
+     */
+    int revalidate(const PrefixSet6 &scope);
+
+    /**
+     * @brief Replace the IPv4 ingress filters.
+     * 
+     * Replace in_filters4 without resetting the session. Only the routes that
+     * may get a different verdict (the ones matching a rule that differs 
+     * between the old and the new filters, see BgpFilterRules::diff) are 
+     * evaluated again. With BgpConfig::keep_adj_rib_in set, they are taken 
+     * from the routes received from the peer: newly accepted routes and routes
+     * with a different outcome of route-map actions are inserted to the RIB, 
+     * and newly rejected routes are withdrawn. Otherwise, only the routes in 
+     * the RIB can be evaluated again, and newly rejected ones are withdrawn 
+     * (like revalidate()). Route events are published for the changes.
+     * 
+     * Build the new filters from a copy of the current filters (copies share
+     * the rules), so that only the rules added or removed are in the diff.
+     * 
+     * The RIB is locked from the replacement of the filters until the changes
+     * are made. Route events for them are published after the RIB is unlocked.
+     * This must be called from the thread that calls run() (or
+     * run() must not be running), since the filters and the routes received 
+     * from the peer are also used there.
+     * 
+     * @param filters The new filters.
+     * @return int Number of routes inserted or withdrawn.
+     */
+    int setInFilters4(const BgpFilterRules &filters);
+
+    /**
+     * @brief Replace the IPv6 ingress filters.
+     * See setInFilters4().
+     * 
+     * @param filters The new filters.
+     * @return int Number of routes inserted or withdrawn.
+     */
+    int setInFilters6(const BgpFilterRules &filters);
+
+    /**
+     * @brief Replace the IPv4 egress filters.
+     * 
+     * Replace out_filters4 without resetting the session. The routes in the 
+     * RIB that may get a different verdict (see setInFilters4()) are evaluated
+     * with both the old and the new filters: routes now rejected are withdrawn
+     * from the peer, and routes now accepted, or accepted with a different 
+     * outcome of route-map actions, are sent to the peer.
+     * 
+     * The RIB is locked only while it is scanned, and the routes are written
+     * after it is unlocked. Route events for the peer wait until the routes 
+     * are written. Like setInFilters4(), this must be called from the thread 
+     * that calls run().
+     * 
+     * @param filters The new filters.
+     * @return int Number of routes sent or withdrawn.
+     * @retval -1 Failed to write to the peer. FSM is now in BROKEN state.
+     */
+    int setOutFilters4(const BgpFilterRules &filters);
+
+    /**
+     * @brief Replace the IPv6 egress filters.
+     * See setOutFilters4().
+     * 
+     * @param filters The new filters.
+     * @return int Number of routes sent or withdrawn.
+     * @retval -1 Failed to write to the peer. FSM is now in BROKEN state.
+     */
+    int setOutFilters6(const BgpFilterRules &filters);
+
 private:
     bool rib4_local;
     bool rib6_local;
@@ -206,6 +326,84 @@ private:
     int fsmEvalOpenConfirm(const BgpMessage *msg);
     int fsmEvalEstablished(const BgpMessage *msg);
 
+    // process packets in in_sink. (after fill/commit)
+    int runSink();
+
+    // scan next update in in_sink with update_scanner. return value: same as
+    // run(), or 4 if next packet is not an update.
+    int scanUpdate();
+
+    // handle next packet in in_sink directly if it is an IPv4 withdraw-only
+    // update or End-of-RIB marker. return value: same as run(), or 4 if next
+    // packet needs to go through the parser.
+    int withdrawUpdate();
+
+    // withdraw routes from peer in RIB. replaced entries are only copied when
+    // event bus exists.
+    void withdrawRoutes4(const std::vector<Prefix4> &routes, std::vector<Prefix4> &unreach, std::vector<const BgpRib4Entry*> &changed_entries);
+    void withdrawRoutes6(const std::vector<Prefix6> &routes, std::vector<Prefix6> &unreach, std::vector<const BgpRib6Entry*> &changed_entries);
+
+    // changes made to the RIB with the RIB locked, to be published after the
+    // RIB is unlocked. the replaced entries are copied out of the RIB with
+    // SnapshotChanges() before unlocking.
+    struct RibChanges4 {
+        // routes inserted with the same attributes and their replaced entries.
+        struct Inserted {
+            std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
+            std::vector<Prefix4> new_routes;
+            std::vector<const BgpRib4Entry*> replaced_entries;
+            std::vector<BgpRib4Entry> snapshot;
+        };
+
+        std::vector<Inserted> inserted;
+
+        // entries replaced by withdrawals.
+        std::vector<const BgpRib4Entry*> replaced_entries;
+        std::vector<BgpRib4Entry> snapshot;
+
+        std::vector<Prefix4> unreach;
+    };
+
+    struct RibChanges6 {
+        struct Inserted {
+            uint8_t nexthop_global[16];
+            uint8_t nexthop_linklocal[16];
+            std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
+            std::vector<Prefix6> new_routes;
+            std::vector<const BgpRib6Entry*> replaced_entries;
+            std::vector<BgpRib6Entry> snapshot;
+        };
+
+        std::vector<Inserted> inserted;
+        std::vector<const BgpRib6Entry*> replaced_entries;
+        std::vector<BgpRib6Entry> snapshot;
+        std::vector<Prefix6> unreach;
+    };
+
+    // copy the replaced entries in changes out of the RIB. (RIB must be locked)
+    static void SnapshotChanges(RibChanges4 &changes);
+    static void SnapshotChanges(RibChanges6 &changes);
+
+    // publish the changes on the event bus, after the RIB is unlocked.
+    void publishChanges4(RibChanges4 &changes);
+    void publishChanges6(RibChanges6 &changes);
+
+    // get the RIB entry of a route from peer, NULL if none.
+    const BgpRib4Entry* findRoute4(const Prefix4 &route) const;
+    const BgpRib6Entry* findRoute6(const Prefix6 &route) const;
+
+    // insert routes from peer to RIB and add the changes to changes. (RIB 
+    // must be locked)
+    void insertRoutes4(RibChanges4 &changes, const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, int32_t weight);
+    void insertRoutes6(RibChanges6 &changes, const std::vector<Prefix6> &routes, const uint8_t *nh_global, const uint8_t *nh_local, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, int32_t weight);
+
+    // apply the ingress filters again on routes in Adj-RIB-In. accepted routes
+    // not in RIB (or in RIB with other attributes) are inserted, rejected
+    // routes in RIB are added to rejected. return number of routes inserted.
+    // (RIB must be locked)
+    size_t refilterAdjIn4(RibChanges4 &changes, const std::vector<const BgpAdjIn4Entry *> &entries, std::vector<Prefix4> &rejected);
+    size_t refilterAdjIn6(RibChanges6 &changes, const std::vector<const BgpAdjIn6Entry *> &entries, std::vector<Prefix6> &rejected);
+
     // dropAll: drop all routes from peer and notify other FSMs w/ route event
     // bus (if exists) (called on FSM go from ESTABLISED to IDLE)
     void dropAllRoutes();
@@ -232,6 +430,17 @@ private:
 
     bool writeMessage(const BgpMessage &msg);
 
+    // release a packet poured from in_sink (and reset the arena, if in use)
+    void disposePacket(BgpPacket *packet);
+
+    // copy arena-allocated attributes to heap so they can be kept in RIB (or
+    // Adj-RIB-In). attributes not in the arena are shared.
+    void detachAttribs(const std::vector<std::shared_ptr<BgpPathAttrib>> &attrs, std::vector<std::shared_ptr<BgpPathAttrib>> &detached) const;
+
+    // restore received attributes to four octets ASN form and intern AS_PATH,
+    // before the attributes are filtered
+    void prepareRibAttribs(std::vector<std::shared_ptr<BgpPathAttrib>> &attribs);
+
     // automaically change IPv4 nexthop for outgoing routes if needed
     void alterNexthop4 (BgpUpdateMessage &update);
 
@@ -242,6 +451,22 @@ private:
     // non-trans attrs)
     void prepareUpdateMessage(BgpUpdateMessage &update);
 
+    // advertise routes with the path attributes from out_filters actions, in
+    // as many updates as needed.
+    bool writeRoutes4(const BgpFilterActionResult &result, const std::vector<Prefix4> &routes);
+    bool writeRoutes6(const BgpFilterActionResult &result, const uint8_t *nh_global, const uint8_t *nh_local, const std::vector<Prefix6> &routes);
+
+    // withdraw routes from the peer, in as many updates as needed.
+    bool writeWithdrawn4(const std::vector<Prefix4> &routes);
+    bool writeWithdrawn6(const std::vector<Prefix6> &routes);
+
+    // prepareUpdateMessage, and keep the MED set by out_filters actions.
+    void prepareUpdateMessage(BgpUpdateMessage &update, const BgpFilterActionResult &result);
+
+    // add a route to the group of routes with the same actions result.
+    template <typename T>
+    static void GroupRoute(std::vector<std::pair<std::shared_ptr<const BgpFilterActionResult>, std::vector<T>>> &groups, const std::shared_ptr<const BgpFilterActionResult> &result, const T &route);
+
     BgpSink in_sink;
     BgpState state;
     BgpConfig config;
@@ -250,8 +475,28 @@ private:
     Clock *clock;
     BgpLogHandler *logger;
 
+    // routes received from peer before ingress filtering (only kept if 
+    // keep_adj_rib_in is set)
+    BgpAdjRibIn4 adj_rib_in4;
+    BgpAdjRibIn6 adj_rib_in6;
+
+    // arena for received messages (NULL if use_message_arena not set)
+    BgpArena *arena;
+
+    // number of packets in arena not yet disposed. run() may be re-entered
+    // from out_handler, so arena can only be reset when this drops to 0.
+    size_t arena_refs;
+
+    // scanner for received updates (NULL if update_visitor not set)
+    BgpUpdateScanner *update_scanner;
+
     std::recursive_mutex out_buffer_mutex;
 
+    // held while out_filters4/6 are used or replaced. route events are 
+    // handled without the RIB locked, so this keeps them from seeing the
+    // filters change halfway, and from racing setOutFilters4/6.
+    std::recursive_mutex out_filters_mutex;
+
     // pointer to output buffer
     uint8_t *out_buffer;
 
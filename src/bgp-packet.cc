@@ -27,6 +27,21 @@ BgpPacket::BgpPacket(BgpLogHandler *logger, bool is_4b) : Serializable(logger) {
     m_msg = NULL;
     is_message_owner = true;
     this->is_4b = is_4b;
+    arena = NULL;
+}
+
+/**
+ * @brief Construct a new BgpPacket object for deserializing BGP message, with
+ * the message and its members allocated from an arena.
+ * 
+ * The BgpPacket object must be destroyed before the arena is reset.
+ * 
+ * @param logger Pointer to logger object for error logging.
+ * @param is_4b Enable four octets ASN support.
+ * @param arena The arena to allocate message from.
+ */
+BgpPacket::BgpPacket(BgpLogHandler *logger, bool is_4b, BgpArena *arena) : BgpPacket(logger, is_4b) {
+    this->arena = arena;
 }
 
 /**
@@ -41,10 +56,13 @@ BgpPacket::BgpPacket(BgpLogHandler *logger, bool is_4b, const BgpMessage *msg) :
     m_msg = NULL;
     this->is_4b = is_4b;
     is_message_owner = false;
+    arena = NULL;
 }
 
 BgpPacket::~BgpPacket() {
-    if (m_msg != NULL && is_message_owner) delete m_msg;
+    if (m_msg == NULL || !is_message_owner) return;
+    if (arena != NULL) BgpArena::destroy(m_msg);
+    else delete m_msg;
 }
 
 ssize_t BgpPacket::doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const {
@@ -91,12 +109,22 @@ ssize_t BgpPacket::parse(const uint8_t *from, size_t buf_sz) {
     const uint8_t *buffer = from + 18;
     uint8_t msg_type = getValue<uint8_t>(&buffer);
 
-    switch (msg_type) {
-        case OPEN: m_msg = new BgpOpenMessage(logger, is_4b); break;
-        case UPDATE: m_msg = new BgpUpdateMessage(logger, is_4b); break;
-        case KEEPALIVE: m_msg = new BgpKeepaliveMessage(logger); break;
-        case NOTIFICATION: m_msg = new BgpNotificationMessage(logger); break;
-        default: m_msg = new BgpBadMessage(logger, msg_type); break;
+    if (arena != NULL) {
+        switch (msg_type) {
+            case OPEN: m_msg = arena->create<BgpOpenMessage>(logger, is_4b); break;
+            case UPDATE: m_msg = arena->create<BgpUpdateMessage>(logger, is_4b, arena); break;
+            case KEEPALIVE: m_msg = arena->create<BgpKeepaliveMessage>(logger); break;
+            case NOTIFICATION: m_msg = arena->create<BgpNotificationMessage>(logger); break;
+            default: m_msg = arena->create<BgpBadMessage>(logger, msg_type); break;
+        }
+    } else {
+        switch (msg_type) {
+            case OPEN: m_msg = new BgpOpenMessage(logger, is_4b); break;
+            case UPDATE: m_msg = new BgpUpdateMessage(logger, is_4b); break;
+            case KEEPALIVE: m_msg = new BgpKeepaliveMessage(logger); break;
+            case NOTIFICATION: m_msg = new BgpNotificationMessage(logger); break;
+            default: m_msg = new BgpBadMessage(logger, msg_type); break;
+        }
     }
 
     size_t msg_sz = buf_sz - 19;
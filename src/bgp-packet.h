@@ -12,6 +12,7 @@
 #define BGP_PACKET_H_
 #include "serializable.h"
 #include "bgp-message.h"
+#include "bgp-arena.h"
 
 namespace libbgp {
 
@@ -27,6 +28,7 @@ class BgpPacket : public Serializable {
 public:
     BgpPacket(BgpLogHandler *logger, bool is_4b, const BgpMessage *msg);
     BgpPacket(BgpLogHandler *logger, bool is_4b);
+    BgpPacket(BgpLogHandler *logger, bool is_4b, BgpArena *arena);
     virtual ~BgpPacket();
     ssize_t doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const;
 
@@ -45,6 +47,9 @@ private:
     bool is_message_owner;
     
     bool is_4b;
+
+    // arena to create the message in. (NULL: use heap)
+    BgpArena *arena;
 };
 
 /**
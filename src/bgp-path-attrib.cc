@@ -38,7 +38,7 @@ uint8_t BgpPathAttrib::GetTypeFromBuffer(const uint8_t *from, size_t buffer_sz)
  */
 BgpPathAttrib::BgpPathAttrib(BgpLogHandler *logger) : Serializable(logger) {
     optional = transitive = partial = extended = false;
-    value_ptr = NULL;
+    value_len = 0;
 }
 
 /**
@@ -49,23 +49,38 @@ BgpPathAttrib::BgpPathAttrib(BgpLogHandler *logger) : Serializable(logger) {
  * @param val_len Length of the value buffer.
  */
 BgpPathAttrib::BgpPathAttrib(BgpLogHandler *logger, const uint8_t *value, uint16_t val_len) : BgpPathAttrib(logger) {
-    if (value_len > 0) {
+    if (val_len > 0 && value == NULL) {
         logger->log(FATAL, "BgpPathAttrib::BgpPathAttrib: unknow attribute created with length != 0 but buffer NULL.\n");
         throw "bad_value_buffer";
     }
 
-    value_ptr = (uint8_t *) malloc(val_len);
-    memcpy(value_ptr, value, value_len);
+    value_len = val_len;
+    opaque_value = BgpByteSlice(value, val_len);
 }
 
 /**
- * @brief Destroy the Bgp Path Attrib:: Bgp Path Attrib object
+ * @brief Construct a new Bgp Path Attrib:: Bgp Path Attrib object sharing the
+ * value buffer.
  * 
+ * @param logger Pointer to logger object for error logging.
+ * @param value Value of unknow type attribute.
  */
-BgpPathAttrib::~BgpPathAttrib() {
-    if (value_ptr != NULL) free(value_ptr);
+BgpPathAttrib::BgpPathAttrib(BgpLogHandler *logger, const BgpByteSlice &value) : BgpPathAttrib(logger) {
+    if (value.getLength() > 0xffff) {
+        logger->log(FATAL, "BgpPathAttrib::BgpPathAttrib: unknow attribute created with length > 65535.\n");
+        throw "bad_value_buffer";
+    }
+
+    value_len = value.getLength();
+    opaque_value = value;
 }
 
+/**
+ * @brief Destroy the Bgp Path Attrib:: Bgp Path Attrib object
+ * 
+ */
+BgpPathAttrib::~BgpPathAttrib() {}
+
 BgpPathAttrib* BgpPathAttrib::clone(BgpLogHandler *new_logger) const {
     BgpPathAttrib* cloned = clone();
     cloned->setLogger(new_logger);
@@ -77,14 +92,20 @@ BgpPathAttrib* BgpPathAttrib::clone() const {
         logger->log(FATAL, "BgpPathAttrib::clone: can't clone an attribute with error.\n");
         throw "has_error";
     }
-    BgpPathAttrib *attr = new BgpPathAttrib(logger, value_ptr, value_len);
+    // the value is shared, not copied.
+    BgpPathAttrib *attr = new BgpPathAttrib(logger, opaque_value);
     attr->transitive = transitive;
     attr->optional = optional;
     attr->partial = partial;
-    attr->extended = attr->extended;
+    attr->extended = extended;
+    attr->type_code = type_code;
     return attr;
 }
 
+const BgpByteSlice& BgpPathAttrib::getOpaqueValue() const {
+    return opaque_value;
+}
+
 /**
  * @brief Utility function to print flags for attribute.
  * 
@@ -131,7 +152,7 @@ ssize_t BgpPathAttrib::parse(const uint8_t *from, size_t length) {
 
     if (header_len < 0) return -1;
 
-    const uint8_t *buffer = from + 3;
+    const uint8_t *buffer = from + header_len;
 
     // Well-Known, Mandatory = !optional, transitive
     // Well-Known, Discretionary = !optional, !transitive
@@ -141,8 +162,6 @@ ssize_t BgpPathAttrib::parse(const uint8_t *from, size_t length) {
         // well-known mandatory, but not recognized
         setError(E_UPDATE, E_BAD_WELL_KNOWN, from, value_len + header_len);
         logger->log(ERROR, "BgpPathAttrib::parse: flag indicates well-known, mandatory but this attribute is unknown.\n");
-        // set value_len = 0, so we won't free() nullptr when destruct.
-        value_len = 0; 
         return -1;
     }
 
@@ -150,13 +169,11 @@ ssize_t BgpPathAttrib::parse(const uint8_t *from, size_t length) {
         // optional non-transitive must not be partial
         setError(E_UPDATE, E_ATTR_FLAG, from, value_len + header_len);
         logger->log(ERROR, "BgpPathAttrib::parse: optional non-transitive must not be partial.\n");
-        // set value_len = 0, so we won't free() nullptr when destruct.
-        value_len = 0; 
         return -1;
     }
 
-    value_ptr = (uint8_t *) malloc(value_len);
-    memcpy(value_ptr, buffer, value_len);
+    // this is the only copy of the value: clones of this attribute share it.
+    opaque_value = BgpByteSlice(buffer, value_len);
 
     return value_len + header_len;
 }
@@ -166,13 +183,15 @@ ssize_t BgpPathAttrib::length() const {
 }
 
 ssize_t BgpPathAttrib::write(uint8_t *to, size_t buffer_sz) const {
-    if (buffer_sz < (size_t) (value_len + 3)) {
+    size_t header_len = extended ? 4 : 3;
+
+    if (buffer_sz < value_len + header_len) {
         logger->log(ERROR, "BgpPathAttrib::write: destination buffer size too small.\n");
         return -1;
     }
 
-    if (!extended && value_len >= 0xffff) {
-        logger->log(ERROR, "BgpPathAttrib::write: non-extended value has size > 65535: %d\n", value_len);
+    if (!extended && value_len > 0xff) {
+        logger->log(ERROR, "BgpPathAttrib::write: non-extended value has size > 255: %d\n", value_len);
         return -1;
     }
 
@@ -182,9 +201,9 @@ ssize_t BgpPathAttrib::write(uint8_t *to, size_t buffer_sz) const {
     if (extended) putValue<uint16_t>(&buffer, htons(value_len));
     else putValue<uint8_t>(&buffer, value_len);
 
-    if (value_len > 0) memcpy(buffer, value_ptr, value_len);
+    if (value_len > 0) memcpy(buffer, opaque_value.getData(), value_len);
 
-    return value_len + 3;   
+    return value_len + header_len;
 }
 
 /**
@@ -221,7 +240,7 @@ ssize_t BgpPathAttrib::parseHeader(const uint8_t *from, size_t buffer_sz) {
     if (extended) value_len = ntohs(getValue<uint16_t>(&buffer));
     else value_len = getValue<uint8_t>(&buffer);
 
-    if (value_len > buffer_sz - 3) {
+    if (value_len > buffer_sz - (extended ? 4 : 3)) {
         err_code = E_UPDATE;
         // This is kind of "invalid length", but we are not using E_ATTR_LEN.
         // E_ATTR_LEN: "Attribute Length that conflict with the expected length
@@ -370,6 +389,23 @@ BgpPathAttribAsPath::BgpPathAttribAsPath(BgpLogHandler *logger, bool is_4b) : Bg
     type_code = AS_PATH;
 }
 
+/**
+ * @brief Copy an AS_PATH attribute. The two octets ASN encoding is not copied:
+ * the copy may be modified, and the encoding of the original may be set by
+ * another thread while it is copied.
+ * 
+ * @param other The attribute to copy.
+ */
+BgpPathAttribAsPath::BgpPathAttribAsPath(const BgpPathAttribAsPath &other) : BgpPathAttrib(other), as_paths(other.as_paths), is_4b(other.is_4b) {}
+
+BgpPathAttribAsPath& BgpPathAttribAsPath::operator= (const BgpPathAttribAsPath &other) {
+    BgpPathAttrib::operator=(other);
+    as_paths = other.as_paths;
+    is_4b = other.is_4b;
+    downgraded.reset();
+    return *this;
+}
+
 /**
  * @brief Construct a new Bgp As Path Segment:: Bgp As Path Segment object
  * 
@@ -410,6 +446,7 @@ BgpPathAttrib* BgpPathAttribAsPath::clone() const {
         logger->log(FATAL, "BgpPathAttribAsPath::clone: can't clone an attribute with error.\n");
         throw "has_error";
     }
+
     return new BgpPathAttribAsPath(*this);
 }
 
@@ -541,6 +578,8 @@ void BgpPathAttribAsPath::addSeg(uint32_t asn) {
  * handler.
  */
 bool BgpPathAttribAsPath::prepend(uint32_t asn) {
+    downgraded.reset();
+
     if (as_paths.size() == 0) {
         // nothing here yet, add a new sequence. (5.1.2.b.3)
         addSeg(asn);
@@ -570,6 +609,90 @@ bool BgpPathAttribAsPath::prepend(uint32_t asn) {
     return false;
 }
 
+/**
+ * @brief Get the two octets ASN encoding of a four octets path.
+ * 
+ * Four octets ASNs are replaced with AS_TRANS in the two octets AS_PATH, and
+ * the four octets path is kept in AS4_PATH.
+ * 
+ * @param as2_path The AS_PATH attribute to put the two octets path in. Can be
+ * this attribute.
+ * @param as4_path The AS4_PATH attribute to put the four octets path in.
+ * @return true Path downgraded.
+ * @return false Failed to downgrade path: the path is not four octets.
+ */
+bool BgpPathAttribAsPath::downgrade(BgpPathAttribAsPath &as2_path, BgpPathAttribAs4Path &as4_path) const {
+    std::vector<BgpAsPathSegment> new_segs;
+    std::vector<BgpAsPathSegment> as4_segs;
+
+    for (const BgpAsPathSegment &seg4 : as_paths) {
+        if (!seg4.is_4b) {
+            logger->log(ERROR, "BgpPathAttribAsPath::downgrade: 2b seg found in 4b attrib.\n");
+            return false;
+        }
+
+        BgpAsPathSegment new_seg (false, seg4.type);
+        new_seg.value.reserve(seg4.value.size());
+        for (uint32_t asn : seg4.value) {
+            uint16_t new_as = asn >= 0xffff ? 23456 : asn;
+            new_seg.value.push_back(new_as);
+        }
+
+        as4_segs.push_back(seg4);
+        new_segs.push_back(new_seg);
+    }
+
+    as4_path.as4_paths.swap(as4_segs);
+    as2_path.is_4b = false;
+    as2_path.as_paths.swap(new_segs);
+    as2_path.downgraded.reset();
+    return true;
+}
+
+struct BgpPathAttribAsPath::Downgraded {
+    std::shared_ptr<const BgpPathAttribAsPath> path;
+    std::shared_ptr<const BgpPathAttribAs4Path> as4_path;
+};
+
+/**
+ * @brief Get the two octets ASN encoding of a four octets path.
+ * 
+ * The encoding is computed on the first call and kept in the attribute, so a
+ * path shared by many routes (e.g., in RIB) is downgraded once, and only if it
+ * is sent to a two octets ASN speaker. Safe to call from different threads on
+ * a shared attribute, as long as no thread modifies the attribute.
+ * prepend() drops the encoding; modify as_paths directly only on attributes no
+ * one called this on.
+ * 
+ * @param as2_path The AS_PATH with AS_TRANS. MUST NOT be modified.
+ * @param as4_path The AS4_PATH. MUST NOT be modified.
+ * @return true Encoding returned.
+ * @return false Failed to get encoding: the path is not four octets.
+ */
+bool BgpPathAttribAsPath::getDowngraded(std::shared_ptr<const BgpPathAttribAsPath> &as2_path, std::shared_ptr<const BgpPathAttribAs4Path> &as4_path) const {
+    if (!is_4b) return false;
+
+    std::shared_ptr<const Downgraded> cached = std::atomic_load(&downgraded);
+
+    if (cached == NULL) {
+        std::shared_ptr<BgpPathAttribAsPath> path = std::make_shared<BgpPathAttribAsPath>(*this);
+        std::shared_ptr<BgpPathAttribAs4Path> path4 = std::make_shared<BgpPathAttribAs4Path>(logger);
+        if (!downgrade(*path, *path4)) return false;
+
+        std::shared_ptr<Downgraded> computed = std::make_shared<Downgraded>();
+        computed->path = path;
+        computed->as4_path = path4;
+
+        // another thread may have done the same, the encodings are equal.
+        cached = computed;
+        std::atomic_store(&downgraded, cached);
+    }
+
+    as2_path = cached->path;
+    as4_path = cached->as4_path;
+    return true;
+}
+
 ssize_t BgpPathAttribAsPath::write(uint8_t *to, size_t buffer_sz) const {
     if (buffer_sz < 3) {
         logger->log(ERROR, "BgpPathAttribAsPath::write: destination buffer size too small.\n");
@@ -1468,6 +1591,252 @@ ssize_t BgpPathAttribCommunity::length() const {
     return 3 + 4 * communites.size();
 }
 
+/**
+ * @brief Construct a new Bgp Path Attrib Ext Community:: Bgp Path Attrib Ext Community object
+ * 
+ * @param logger Pointer to logger object for error logging.
+ */
+BgpPathAttribExtCommunity::BgpPathAttribExtCommunity(BgpLogHandler *logger) : BgpPathAttrib(logger) {
+    type_code = EXTENDED_COMMUNITY;
+    optional = true;
+    transitive = true;
+}
+
+ssize_t BgpPathAttribExtCommunity::doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const {
+    size_t written = 0;
+    written += _print(indent, to, buf_sz, "ExtendedCommunityAttribute {\n");
+    indent++; {
+        written += printFlags(indent, to, buf_sz);
+        written += _print(indent, to, buf_sz, "ExtendedCommunity {\n");
+        indent++; {
+            for (uint64_t community : ext_communities) {
+                uint8_t type = community >> 56;
+                uint8_t subtype = (community >> 48) & 0xff;
+                uint64_t value = community & 0xffffffffffffULL;
+
+                // transitive and non-transitive variants differ only in bit 6.
+                switch (type & 0xbf) {
+                    case 0x00:
+                        written += _print(indent, to, buf_sz, "(0x%02x, 0x%02x) %u:%u\n", type, subtype, (uint32_t) (value >> 32), (uint32_t) value);
+                        break;
+                    case 0x01: {
+                        uint32_t addr = htonl(value >> 16);
+                        written += _print(indent, to, buf_sz, "(0x%02x, 0x%02x) %s:%u\n", type, subtype, inet_ntoa(*(struct in_addr*) &addr), (uint32_t) (value & 0xffff));
+                        break;
+                    }
+                    case 0x02:
+                        written += _print(indent, to, buf_sz, "(0x%02x, 0x%02x) %u:%u\n", type, subtype, (uint32_t) (value >> 16), (uint32_t) (value & 0xffff));
+                        break;
+                    default:
+                        written += _print(indent, to, buf_sz, "(0x%02x, 0x%02x) 0x%012llx\n", type, subtype, (unsigned long long) value);
+                }
+            }
+        }; indent--;
+        written += _print(indent, to, buf_sz, "}\n");
+    }; indent--;
+    written += _print(indent, to, buf_sz, "}\n");
+
+    return written;
+}
+
+BgpPathAttrib* BgpPathAttribExtCommunity::clone() const {
+    if(hasError()) {
+        logger->log(FATAL, "BgpPathAttribExtCommunity::clone: can't clone an attribute with error.\n");
+        throw "has_error";
+    }
+    return new BgpPathAttribExtCommunity(*this);
+}
+
+ssize_t BgpPathAttribExtCommunity::parse(const uint8_t *from, size_t length) {
+    ssize_t header_length = parseHeader(from, length);
+    if (header_length < 0) return -1;
+
+    if (type_code != EXTENDED_COMMUNITY) {
+        logger->log(FATAL, "BgpPathAttribExtCommunity::parse: type in header mismatch.\n");
+        throw "bad_type";
+    }
+
+    const uint8_t *buffer = from + header_length;
+
+    if (value_len < 8) {
+        logger->log(ERROR, "BgpPathAttribExtCommunity::parse: incomplete attrib.\n");
+        setError(E_UPDATE, E_UNSPEC_UPDATE, NULL, 0);
+        return -1;
+    }
+
+    if (value_len % 8 != 0) {
+        logger->log(ERROR, "BgpPathAttribExtCommunity::parse: bad length, want multiple of 8, saw %d.\n", value_len);
+        setError(E_UPDATE, E_ATTR_LEN, from, value_len + header_length);
+        return -1;
+    }
+
+    if (!optional || !transitive) {
+        logger->log(ERROR, "BgpPathAttribExtCommunity::parse: bad flag bits, must be optional, transitive.\n");
+        setError(E_UPDATE, E_ATTR_FLAG, from, value_len + header_length);
+        return -1;
+    }
+
+    ext_communities.reserve(value_len / 8);
+
+    for (size_t read_len = 0; read_len < value_len; read_len += 8) {
+        uint64_t high = ntohl(getValue<uint32_t>(&buffer));
+        uint64_t low = ntohl(getValue<uint32_t>(&buffer));
+        ext_communities.push_back((high << 32) | low);
+    }
+
+    return value_len + header_length;
+}
+
+ssize_t BgpPathAttribExtCommunity::write(uint8_t *to, size_t buffer_sz) const {
+    size_t len = 8 * ext_communities.size();
+    bool extended_len = extended || len > 0xff;
+    size_t hdr_len = extended_len ? 4 : 3;
+
+    if (len > 0xffff) {
+        logger->log(ERROR, "BgpPathAttribExtCommunity::write: too many communities: %zu\n", ext_communities.size());
+        return -1;
+    }
+
+    if (buffer_sz < hdr_len + len) {
+        logger->log(ERROR, "BgpPathAttribExtCommunity::write: destination buffer size too small.\n");
+        return -1;
+    }
+
+    uint8_t *buffer = to;
+    putValue<uint8_t>(&buffer, (optional << 7) | (transitive << 6) | (partial << 5) | (extended_len << 4));
+    putValue<uint8_t>(&buffer, type_code);
+
+    if (extended_len) putValue<uint16_t>(&buffer, htons(len));
+    else putValue<uint8_t>(&buffer, len);
+
+    for (uint64_t community : ext_communities) {
+        putValue<uint32_t>(&buffer, htonl(community >> 32));
+        putValue<uint32_t>(&buffer, htonl(community & 0xffffffff));
+    }
+
+    return hdr_len + len;
+}
+
+ssize_t BgpPathAttribExtCommunity::length() const {
+    size_t len = 8 * ext_communities.size();
+    return (extended || len > 0xff ? 4 : 3) + len;
+}
+
+/**
+ * @brief Construct a new Bgp Path Attrib Large Community:: Bgp Path Attrib Large Community object
+ * 
+ * @param logger Pointer to logger object for error logging.
+ */
+BgpPathAttribLargeCommunity::BgpPathAttribLargeCommunity(BgpLogHandler *logger) : BgpPathAttrib(logger) {
+    type_code = LARGE_COMMUNITY;
+    optional = true;
+    transitive = true;
+}
+
+ssize_t BgpPathAttribLargeCommunity::doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const {
+    size_t written = 0;
+    written += _print(indent, to, buf_sz, "LargeCommunityAttribute {\n");
+    indent++; {
+        written += printFlags(indent, to, buf_sz);
+        written += _print(indent, to, buf_sz, "LargeCommunity {\n");
+        indent++; {
+            for (const BgpLargeCommunity &community : large_communities) {
+                written += _print(indent, to, buf_sz, "%u:%u:%u\n", community.global, community.local1, community.local2);
+            }
+        }; indent--;
+        written += _print(indent, to, buf_sz, "}\n");
+    }; indent--;
+    written += _print(indent, to, buf_sz, "}\n");
+
+    return written;
+}
+
+BgpPathAttrib* BgpPathAttribLargeCommunity::clone() const {
+    if(hasError()) {
+        logger->log(FATAL, "BgpPathAttribLargeCommunity::clone: can't clone an attribute with error.\n");
+        throw "has_error";
+    }
+    return new BgpPathAttribLargeCommunity(*this);
+}
+
+ssize_t BgpPathAttribLargeCommunity::parse(const uint8_t *from, size_t length) {
+    ssize_t header_length = parseHeader(from, length);
+    if (header_length < 0) return -1;
+
+    if (type_code != LARGE_COMMUNITY) {
+        logger->log(FATAL, "BgpPathAttribLargeCommunity::parse: type in header mismatch.\n");
+        throw "bad_type";
+    }
+
+    const uint8_t *buffer = from + header_length;
+
+    if (value_len < 12) {
+        logger->log(ERROR, "BgpPathAttribLargeCommunity::parse: incomplete attrib.\n");
+        setError(E_UPDATE, E_UNSPEC_UPDATE, NULL, 0);
+        return -1;
+    }
+
+    if (value_len % 12 != 0) {
+        logger->log(ERROR, "BgpPathAttribLargeCommunity::parse: bad length, want multiple of 12, saw %d.\n", value_len);
+        setError(E_UPDATE, E_ATTR_LEN, from, value_len + header_length);
+        return -1;
+    }
+
+    if (!optional || !transitive) {
+        logger->log(ERROR, "BgpPathAttribLargeCommunity::parse: bad flag bits, must be optional, transitive.\n");
+        setError(E_UPDATE, E_ATTR_FLAG, from, value_len + header_length);
+        return -1;
+    }
+
+    large_communities.reserve(value_len / 12);
+
+    for (size_t read_len = 0; read_len < value_len; read_len += 12) {
+        BgpLargeCommunity community;
+        community.global = ntohl(getValue<uint32_t>(&buffer));
+        community.local1 = ntohl(getValue<uint32_t>(&buffer));
+        community.local2 = ntohl(getValue<uint32_t>(&buffer));
+        large_communities.push_back(community);
+    }
+
+    return value_len + header_length;
+}
+
+ssize_t BgpPathAttribLargeCommunity::write(uint8_t *to, size_t buffer_sz) const {
+    size_t len = 12 * large_communities.size();
+    bool extended_len = extended || len > 0xff;
+    size_t hdr_len = extended_len ? 4 : 3;
+
+    if (len > 0xffff) {
+        logger->log(ERROR, "BgpPathAttribLargeCommunity::write: too many communities: %zu\n", large_communities.size());
+        return -1;
+    }
+
+    if (buffer_sz < hdr_len + len) {
+        logger->log(ERROR, "BgpPathAttribLargeCommunity::write: destination buffer size too small.\n");
+        return -1;
+    }
+
+    uint8_t *buffer = to;
+    putValue<uint8_t>(&buffer, (optional << 7) | (transitive << 6) | (partial << 5) | (extended_len << 4));
+    putValue<uint8_t>(&buffer, type_code);
+
+    if (extended_len) putValue<uint16_t>(&buffer, htons(len));
+    else putValue<uint8_t>(&buffer, len);
+
+    for (const BgpLargeCommunity &community : large_communities) {
+        putValue<uint32_t>(&buffer, htonl(community.global));
+        putValue<uint32_t>(&buffer, htonl(community.local1));
+        putValue<uint32_t>(&buffer, htonl(community.local2));
+    }
+
+    return hdr_len + len;
+}
+
+ssize_t BgpPathAttribLargeCommunity::length() const {
+    size_t len = 12 * large_communities.size();
+    return (extended || len > 0xff ? 4 : 3) + len;
+}
+
 BgpPathAttribMpNlriBase::BgpPathAttribMpNlriBase(BgpLogHandler *logger) : BgpPathAttrib(logger) {
     optional = true;
 }
@@ -1509,6 +1878,7 @@ ssize_t BgpPathAttribMpNlriBase::parseHeader(const uint8_t *from, size_t length)
 
 BgpPathAttribMpReachNlriIpv6::BgpPathAttribMpReachNlriIpv6(BgpLogHandler *logger) : BgpPathAttribMpNlriBase(logger) {
     afi = IPV6;
+    type_code = MP_REACH_NLRI;
 }
 
 BgpPathAttrib* BgpPathAttribMpReachNlriIpv6::clone() const {
@@ -1566,24 +1936,10 @@ ssize_t BgpPathAttribMpReachNlriIpv6::parse(const uint8_t *from, size_t length)
         logger->log(WARN, "BgpPathAttribMpReachNlriIpv6::parse: reserved bits != 0\n");
     }
 
-    while (buf_left > 0) {
-        Prefix6 this_prefix = Prefix6();
-        ssize_t pfx_read_len = this_prefix.parse(buffer, buf_left);
-
-        if (pfx_read_len < 0) {
-            logger->log(ERROR, "BgpPathAttribMpReachNlriIpv6::parse: error parsing nlri entry.\n");
-            setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
-            return -1;
-        }
-
-        buffer += pfx_read_len;
-        buf_left -= pfx_read_len;
-        nlri.push_back(this_prefix);
-    }
-
-    if (buf_left != 0) {
-        logger->log(FATAL, "BgpPathAttribMpReachNlriIpv6::parse: parsed end with non-zero buf_left (%d).\n", buf_left);
-        throw "bad_parse";
+    if (Prefix6::ParseList(buffer, buf_left, nlri) < 0) {
+        logger->log(ERROR, "BgpPathAttribMpReachNlriIpv6::parse: error parsing nlri entry.\n");
+        setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
+        return -1;
     }
 
     return value_len + hdr_len - 3; // 3: afi/safi, already part of "value_len"
@@ -1624,15 +1980,13 @@ ssize_t BgpPathAttribMpReachNlriIpv6::write(uint8_t *to, size_t buffer_sz) const
     putValue<uint8_t>(&buffer, 0);
     written_len++;
 
-    for (const Prefix6 &route : nlri) {
-        ssize_t rou_wrt_len = route.write(buffer, buffer_sz - written_len);
-        if (rou_wrt_len < 0) {
-            logger->log(ERROR, "BgpPathAttribMpReachNlriIpv6::write: failed to write nlri.\n");
-            return -1;
-        }
-        written_len += rou_wrt_len;
-        buffer += rou_wrt_len;
+    ssize_t nlri_wrt_len = Prefix6::WriteList(nlri, buffer, buffer_sz - written_len);
+    if (nlri_wrt_len < 0) {
+        logger->log(ERROR, "BgpPathAttribMpReachNlriIpv6::write: failed to write nlri.\n");
+        return -1;
     }
+    written_len += nlri_wrt_len;
+    buffer += nlri_wrt_len;
 
     putValue<uint8_t>(&attr_len_field, written_len - 3);
 
@@ -1698,6 +2052,7 @@ ssize_t BgpPathAttribMpReachNlriIpv6::length() const {
 }
 
 BgpPathAttribMpReachNlriUnknow::BgpPathAttribMpReachNlriUnknow(BgpLogHandler *logger) : BgpPathAttribMpNlriBase(logger) {
+    type_code = MP_REACH_NLRI;
     nexthop = NULL;
     nexthop_len = 0;
     nlri = NULL;
@@ -1705,6 +2060,7 @@ BgpPathAttribMpReachNlriUnknow::BgpPathAttribMpReachNlriUnknow(BgpLogHandler *lo
 }
 
 BgpPathAttribMpReachNlriUnknow::BgpPathAttribMpReachNlriUnknow(BgpLogHandler *logger, const uint8_t *nexthop, size_t nexthop_len, const uint8_t *nlri, size_t nlri_len) : BgpPathAttribMpNlriBase(logger) {
+    type_code = MP_REACH_NLRI;
     if (nexthop_len > 0) {
         this->nexthop = (uint8_t *) malloc(nexthop_len);
         memcpy(this->nexthop, nexthop, nexthop_len);
@@ -1833,6 +2189,7 @@ size_t BgpPathAttribMpReachNlriUnknow::getNlriLength() const {
 
 BgpPathAttribMpUnreachNlriIpv6::BgpPathAttribMpUnreachNlriIpv6(BgpLogHandler *logger) : BgpPathAttribMpNlriBase(logger) {
     afi = IPV6;
+    type_code = MP_UNREACH_NLRI;
 }
 
 BgpPathAttrib* BgpPathAttribMpUnreachNlriIpv6::clone() const {
@@ -1856,24 +2213,10 @@ ssize_t BgpPathAttribMpUnreachNlriIpv6::parse(const uint8_t *from, size_t length
     size_t buf_left = value_len - hdr_len + 3; // 3: attrib headers
     const uint8_t *buffer = from + hdr_len;
 
-    while (buf_left > 0) {
-        Prefix6 this_prefix = Prefix6();
-        ssize_t pfx_read_len = this_prefix.parse(buffer, buf_left);
-
-        if (pfx_read_len < 0) {
-            logger->log(ERROR, "BgpPathAttribMpUnreachNlriIpv6::parse: error parsing withdrawn entry.\n");
-            setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
-            return -1;
-        }
-
-        buffer += pfx_read_len;
-        buf_left -= pfx_read_len;
-        withdrawn_routes.push_back(this_prefix);
-    }
-
-    if (buf_left != 0) {
-        logger->log(FATAL, "BgpPathAttribMpUnreachNlriIpv6::parse: parsed end with non-zero buf_left (%d).\n", buf_left);
-        throw "bad_parse";
+    if (Prefix6::ParseList(buffer, buf_left, withdrawn_routes) < 0) {
+        logger->log(ERROR, "BgpPathAttribMpUnreachNlriIpv6::parse: error parsing withdrawn entry.\n");
+        setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
+        return -1;
     }
 
     return hdr_len + value_len - 3; // 3: afi/safi, already part of "value_len"
@@ -1895,17 +2238,15 @@ ssize_t BgpPathAttribMpUnreachNlriIpv6::write(uint8_t *to, size_t buffer_sz) con
     putValue<uint8_t>(&buffer, safi);
     size_t written_val_len = 3;
 
-    for (const Prefix6 &route : withdrawn_routes) {
-        ssize_t pfx_wrt_ret = route.write(buffer, buffer_sz - 3 - written_val_len);
-        if (pfx_wrt_ret < 0) {
-            logger->log(ERROR, "BgpPathAttribMpUnreachNlriIpv6::write: error writing withdrawn routes.\n");
-            return -1;
-        }
-
-        buffer += pfx_wrt_ret;
-        written_val_len += pfx_wrt_ret;
+    ssize_t pfx_wrt_ret = Prefix6::WriteList(withdrawn_routes, buffer, buffer_sz - 3 - written_val_len);
+    if (pfx_wrt_ret < 0) {
+        logger->log(ERROR, "BgpPathAttribMpUnreachNlriIpv6::write: error writing withdrawn routes.\n");
+        return -1;
     }
 
+    written_val_len += pfx_wrt_ret;
+    putValue<uint8_t>(&len_field, written_val_len);
+
     return 3 + written_val_len;
 }
 
@@ -1946,11 +2287,13 @@ ssize_t BgpPathAttribMpUnreachNlriIpv6::length() const {
 }
 
 BgpPathAttribMpUnreachNlriUnknow::BgpPathAttribMpUnreachNlriUnknow(BgpLogHandler *logger) : BgpPathAttribMpNlriBase(logger) {
+    type_code = MP_UNREACH_NLRI;
     withdrawn_routes_len = 0;
     withdrawn_routes = NULL;
 }
 
 BgpPathAttribMpUnreachNlriUnknow::BgpPathAttribMpUnreachNlriUnknow(BgpLogHandler *logger, const uint8_t *withdrawn, size_t len) : BgpPathAttribMpNlriBase(logger) {
+    type_code = MP_UNREACH_NLRI;
     withdrawn_routes_len = len;
 
     if (len > 0) {
@@ -13,9 +13,12 @@
 
 #include "serializable.h"
 #include "prefix6.h"
+#include "bgp-byte-slice.h"
+#include "bgp-arena.h"
 #include <stdint.h>
 #include <unistd.h>
 #include <vector>
+#include <memory>
 
 namespace libbgp {
 
@@ -36,8 +39,10 @@ enum BgpPathAttribType {
     COMMUNITY = 8,
     MP_REACH_NLRI = 14,
     MP_UNREACH_NLRI = 15,
+    EXTENDED_COMMUNITY = 16,
     AS4_PATH = 17,
-    AS4_AGGREGATOR = 18
+    AS4_AGGREGATOR = 18,
+    LARGE_COMMUNITY = 32
 };
 
 /**
@@ -77,8 +82,16 @@ public:
      */
     uint8_t type_code;
 
+    /**
+     * @brief Set if the attribute was created in a BgpArena, and is only valid
+     * until the arena is reset. Clones are not marked.
+     * 
+     */
+    BgpArenaMark in_arena;
+
     BgpPathAttrib(BgpLogHandler *logger);
     BgpPathAttrib(BgpLogHandler *logger, const uint8_t *value, uint16_t val_len);
+    BgpPathAttrib(BgpLogHandler *logger, const BgpByteSlice &value);
 
     // get attribute type from buffer, return 0 if failed.
     static uint8_t GetTypeFromBuffer(const uint8_t *buffer, size_t buffer_sz);
@@ -133,6 +146,16 @@ public:
      */
     virtual BgpPathAttrib* clone() const;
 
+    /**
+     * @brief Get value of an unknow type attribute.
+     * 
+     * The value is shared by the attribute and its clones, and is not copied
+     * when the attribute is cloned.
+     * 
+     * @return const BgpByteSlice& The value.
+     */
+    const BgpByteSlice& getOpaqueValue() const;
+
     virtual ~BgpPathAttrib();
 
 protected:
@@ -155,7 +178,8 @@ protected:
     uint16_t value_len;
 
 private:
-    uint8_t* value_ptr;
+    // value of unknow type attribute
+    BgpByteSlice opaque_value;
 };
 
 /**
@@ -222,6 +246,8 @@ public:
     std::vector<uint32_t> value;
 };
 
+class BgpPathAttribAs4Path;
+
 /**
  * @brief AS Path attribute.
  * 
@@ -230,6 +256,8 @@ class BgpPathAttribAsPath : public BgpPathAttrib {
 public:
     // is_4b: 4b ASN in AS_PATH?
     BgpPathAttribAsPath(BgpLogHandler *logger, bool is_4b);
+    BgpPathAttribAsPath(const BgpPathAttribAsPath &other);
+    BgpPathAttribAsPath& operator= (const BgpPathAttribAsPath &other);
 
     BgpPathAttrib* clone() const;
 
@@ -248,6 +276,12 @@ public:
     // prepend: utility function to prepend an ASN to path
     bool prepend(uint32_t asn);
 
+    // downgrade: get the two octets ASN encoding of a four octets path
+    bool downgrade(BgpPathAttribAsPath &as2_path, BgpPathAttribAs4Path &as4_path) const;
+
+    // getDowngraded: get the two octets ASN encoding, computed on first use
+    bool getDowngraded(std::shared_ptr<const BgpPathAttribAsPath> &as2_path, std::shared_ptr<const BgpPathAttribAs4Path> &as4_path) const;
+
     ssize_t parse(const uint8_t *buffer, size_t length);
     ssize_t write(uint8_t *buffer, size_t buffer_sz) const;
     ssize_t doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const;
@@ -255,6 +289,10 @@ public:
 private:
     // addSeg: add a new AS_SEQUENCE with one ASN to AS_PATH 
     void addSeg(uint32_t asn);
+
+    // the two octets ASN encoding, set by getDowngraded(). not copied.
+    struct Downgraded;
+    mutable std::shared_ptr<const Downgraded> downgraded;
 };
 
 /**
@@ -442,6 +480,69 @@ public:
     ssize_t length() const;
 };
 
+/**
+ * @brief BGP extended community attribute. (RFC 4360)
+ * 
+ */
+class BgpPathAttribExtCommunity : public BgpPathAttrib {
+public:
+    BgpPathAttribExtCommunity(BgpLogHandler *logger);
+
+    /**
+     * @brief Extended communities in host byte order. The type is the highest
+     * byte and the sub-type is the second highest byte.
+     * 
+     */
+    std::vector<uint64_t> ext_communities;
+
+    BgpPathAttrib* clone() const;
+    ssize_t parse(const uint8_t *buffer, size_t length);
+    ssize_t write(uint8_t *buffer, size_t buffer_sz) const;
+    ssize_t doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const;
+    ssize_t length() const;
+};
+
+/**
+ * @brief A BGP large community.
+ * 
+ */
+struct BgpLargeCommunity {
+    uint32_t global; /*!< Global administrator (ASN), in host byte order. */
+    uint32_t local1; /*!< Local data part 1, in host byte order. */
+    uint32_t local2; /*!< Local data part 2, in host byte order. */
+
+    bool operator== (const BgpLargeCommunity &other) const {
+        return global == other.global && local1 == other.local1 && local2 == other.local2;
+    }
+
+    bool operator< (const BgpLargeCommunity &other) const {
+        if (global != other.global) return global < other.global;
+        if (local1 != other.local1) return local1 < other.local1;
+        return local2 < other.local2;
+    }
+};
+
+/**
+ * @brief BGP large community attribute. (RFC 8092)
+ * 
+ */
+class BgpPathAttribLargeCommunity : public BgpPathAttrib {
+public:
+    BgpPathAttribLargeCommunity(BgpLogHandler *logger);
+
+    /**
+     * @brief The large communities.
+     * 
+     */
+    std::vector<BgpLargeCommunity> large_communities;
+
+    BgpPathAttrib* clone() const;
+    ssize_t parse(const uint8_t *buffer, size_t length);
+    ssize_t write(uint8_t *buffer, size_t buffer_sz) const;
+    ssize_t doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const;
+    ssize_t length() const;
+};
+
 /**
  * @brief MP-BGP Reach/Unreach NLRI base class.
  * 
@@ -0,0 +1,98 @@
+/**
+ * @file bgp-path-list.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Shared lists of primary and backup paths.
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include "bgp-path-list.h"
+
+namespace libbgp {
+
+/**
+ * @brief Construct a new BgpPathState object. Paths are up by default.
+ * 
+ */
+BgpPathState::BgpPathState() : up(true) {}
+
+/**
+ * @brief Test if the paths can be used.
+ * 
+ * @return true The paths are up.
+ * @return false The paths are down.
+ */
+bool BgpPathState::isUp() const {
+    return up.load(std::memory_order_acquire);
+}
+
+/**
+ * @brief Mark the paths usable or not.
+ * 
+ * @param up Paths are up.
+ */
+void BgpPathState::setUp(bool up) {
+    this->up.store(up, std::memory_order_release);
+}
+
+/**
+ * @brief Construct a new BgpPathList4 object.
+ * 
+ * @param paths The paths, primary first.
+ */
+BgpPathList4::BgpPathList4(const std::vector<BgpPath4> &paths) : paths(paths) {}
+
+/**
+ * @brief Get the path to use: the first path that is up.
+ * 
+ * @return const BgpPath4* The path. (NULL if all paths are down)
+ */
+const BgpPath4* BgpPathList4::getActive() const {
+    for (const BgpPath4 &path : paths) {
+        if (path.state->isUp()) return &path;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Get all paths.
+ * 
+ * @return const std::vector<BgpPath4>& The paths, primary first.
+ */
+const std::vector<BgpPath4>& BgpPathList4::getPaths() const {
+    return paths;
+}
+
+/**
+ * @brief Construct a new BgpPathList6 object.
+ * 
+ * @param paths The paths, primary first.
+ */
+BgpPathList6::BgpPathList6(const std::vector<BgpPath6> &paths) : paths(paths) {}
+
+/**
+ * @brief Get the path to use: the first path that is up.
+ * 
+ * @return const BgpPath6* The path. (NULL if all paths are down)
+ */
+const BgpPath6* BgpPathList6::getActive() const {
+    for (const BgpPath6 &path : paths) {
+        if (path.state->isUp()) return &path;
+    }
+
+    return NULL;
+}
+
+/**
+ * @brief Get all paths.
+ * 
+ * @return const std::vector<BgpPath6>& The paths, primary first.
+ */
+const std::vector<BgpPath6>& BgpPathList6::getPaths() const {
+    return paths;
+}
+
+}
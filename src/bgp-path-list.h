@@ -0,0 +1,147 @@
+/**
+ * @file bgp-path-list.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Shared lists of primary and backup paths.
+ * @version 0.1
+ * @date 2019-08-11
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_PATH_LIST_H_
+#define BGP_PATH_LIST_H_
+#include <stdint.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+
+namespace libbgp {
+
+/**
+ * @brief State of the paths learned from a BGP speaker.
+ * 
+ * One state object is shared by all the path lists with a path from the same
+ * speaker, so marking the speaker down switches all of them to their backup
+ * paths at once, no matter how many prefixes use them. The state can be read
+ * and changed by different threads.
+ */
+class BgpPathState {
+public:
+    BgpPathState();
+
+    // test if the paths can be used.
+    bool isUp() const;
+
+    // mark the paths usable or not.
+    void setUp(bool up);
+
+private:
+    std::atomic<bool> up;
+};
+
+/**
+ * @brief A path to IPv4 destinations.
+ * 
+ */
+struct BgpPath4 {
+    /**
+     * @brief Originating BGP speaker's ID in network bytes order.
+     * 
+     */
+    uint32_t src_router_id;
+
+    /**
+     * @brief Nexthop in network byte order.
+     * 
+     */
+    uint32_t nexthop;
+
+    /**
+     * @brief State of the paths from the speaker.
+     * 
+     */
+    std::shared_ptr<BgpPathState> state;
+};
+
+/**
+ * @brief A path to IPv6 destinations.
+ * 
+ */
+struct BgpPath6 {
+    /**
+     * @brief Originating BGP speaker's ID in network bytes order.
+     * 
+     */
+    uint32_t src_router_id;
+
+    /**
+     * @brief Global IPv6 nexthop in network byte order.
+     * 
+     */
+    uint8_t nexthop_global[16];
+
+    /**
+     * @brief Link local IPv6 nexthop in network byte order.
+     * 
+     */
+    uint8_t nexthop_linklocal[16];
+
+    /**
+     * @brief State of the paths from the speaker.
+     * 
+     */
+    std::shared_ptr<BgpPathState> state;
+};
+
+/**
+ * @brief The BgpPathList4 class: primary and backup paths of IPv4 prefixes.
+ * 
+ * Path lists are shared by all prefixes with the same primary and backup
+ * paths, so a forwarding table built on them switches all the prefixes to
+ * the backup path once the primary path goes down (see BgpPathState). Path
+ * lists never change once created; when the paths of a prefix change, the
+ * prefix gets another path list.
+ */
+class BgpPathList4 {
+public:
+    BgpPathList4(const std::vector<BgpPath4> &paths);
+
+    // get the first path that is up, NULL if all paths are down.
+    const BgpPath4* getActive() const;
+
+    // get all paths, primary first.
+    const std::vector<BgpPath4>& getPaths() const;
+
+private:
+    std::vector<BgpPath4> paths;
+};
+
+/**
+ * @brief The BgpPathList6 class: primary and backup paths of IPv6 prefixes.
+ * 
+ * See BgpPathList4.
+ */
+class BgpPathList6 {
+public:
+    BgpPathList6(const std::vector<BgpPath6> &paths);
+
+    // get the first path that is up, NULL if all paths are down.
+    const BgpPath6* getActive() const;
+
+    // get all paths, primary first.
+    const std::vector<BgpPath6>& getPaths() const;
+
+private:
+    std::vector<BgpPath6> paths;
+};
+
+/**
+ * @example path-list.cc
+ * Example of switching the routes of a failed peer to their backup paths with
+ * shared path lists, before the routes are selected again. This example also
+ * times the switch and the selection.
+ */
+
+}
+
+#endif // BGP_PATH_LIST_H_
@@ -3,10 +3,19 @@
 #include <stdint.h>
 #include <vector>
 #include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
 #include <arpa/inet.h>
 #include "bgp-path-attrib.h"
 #include "bgp-log-handler.h"
 
+// number of routes in a range re-evaluated by a discard worker.
+#define BGP_RIB_DISCARD_CHUNK 1024
+
+// number of cached path lists before the unused ones are removed.
+#define BGP_RIB_PATH_LISTS_SWEEP 1024
+
 namespace libbgp {
 
 /**
@@ -40,7 +49,7 @@ public:
      * source default to SRC_EBGP 
      * 
      */
-    BgpRibEntry () { src = SRC_EBGP; status = RS_ACTIVE; }
+    BgpRibEntry () { src = SRC_EBGP; status = RS_ACTIVE; nexthop_reachable = true; }
 
     /**
      * @brief The originating BGP speaker's ID of this entry. (network bytes order)
@@ -99,6 +108,15 @@ public:
      */
     uint32_t ibgp_peer_asn;
 
+    /**
+     * @brief Reachability of the nexthop of this entry.
+     * 
+     * Entries with unreachable nexthop stay in the RIB, but are never selected
+     * as the best route. Nexthops are reachable unless marked unreachable with
+     * setNexthopReachable() of the RIB.
+     */
+    bool nexthop_reachable;
+
     /**
      * @brief Test if this entry has greater weight then anoter entry. 
      * Please note that weight are only calculated based on path attribues. 
@@ -222,17 +240,44 @@ class BgpRib4Entry;
  * @tparam T Type of BgpRibEntry.
  */
 template<typename T> class BgpRib {
+public:
+#ifndef SWIG
+    /**
+     * @brief Copy entries out of the RIB.
+     *
+     * Copy the entries pointed to into snapshot, and point to the copies
+     * instead, so the pointers stay valid after the RIB is unlocked and
+     * changed again. Used to publish route events after unlocking the RIB.
+     *
+     * @param entries Pointers to entries in the RIB. Pointed to the copies
+     * on return.
+     * @param snapshot Where the copies are kept. Must not be changed while the
+     * pointers are used.
+     */
+    static void snapshotEntries(std::vector<const T*> &entries, std::vector<T> &snapshot) {
+        snapshot.clear();
+        snapshot.reserve(entries.size());
+
+        for (const T *&entry : entries) {
+            snapshot.push_back(*entry);
+            entry = &snapshot.back();
+        }
+    }
+#endif
+
 protected:
     /**
      * @brief Select an entry from two to use.
      * 
      * @param a Entry A
      * @param b Entry B
-     * @return const T* Selected entry. One of A and B. 
+     * @return const T* Selected entry. One of A and B. (NULL if none of them
+     * has reachable nexthop)
      */
     static const T* selectEntry (const T *a, const T *b) {
-        if (a == NULL) return b;
-        if (b == NULL) return a;
+        // entries with unreachable nexthop are never selected.
+        if (a == NULL || !a->nexthop_reachable) return (b == NULL || !b->nexthop_reachable) ? NULL : b;
+        if (b == NULL || !b->nexthop_reachable) return a;
 
         auto &ra = a->route;
         auto &rb = b->route;
@@ -255,11 +300,13 @@ protected:
      * 
      * @param a Entry A
      * @param b Entry B
-     * @return T* Selected entry. One of A and B. 
+     * @return T* Selected entry. One of A and B. (NULL if none of them has
+     * reachable nexthop)
      */
     static T* selectEntry (T *a, T *b) {
-        if (a == NULL) return b;
-        if (b == NULL) return a;
+        // entries with unreachable nexthop are never selected.
+        if (a == NULL || !a->nexthop_reachable) return (b == NULL || !b->nexthop_reachable) ? NULL : b;
+        if (b == NULL || !b->nexthop_reachable) return a;
 
         auto &ra = a->route;
         auto &rb = b->route;
@@ -276,6 +323,50 @@ protected:
         // b is more specific, use b
         return b;
     }
+
+#ifndef SWIG
+    /**
+     * @brief Call fn(i) for every i in [0, n) with up to n_workers threads.
+     * 
+     * Indices are split into ranges of chunk_size. Workers keep claiming the
+     * next unclaimed range until none is left, so workers done early take over
+     * the ranges the slower ones have not reached yet. The calling thread is
+     * one of the workers. If a thread can't be started, the work is done by
+     * the workers already running.
+     * 
+     * @param n Number of indices.
+     * @param n_workers Max number of workers.
+     * @param chunk_size Number of indices in a range.
+     * @param fn The function. It must be safe to call concurrently with 
+     * different indices.
+     */
+    template<typename F> static void parallelFor(size_t n, size_t n_workers, size_t chunk_size, const F &fn) {
+        size_t n_chunks = (n + chunk_size - 1) / chunk_size;
+        if (n_workers > n_chunks) n_workers = n_chunks;
+
+        std::atomic<size_t> next_chunk(0);
+        auto worker = [&]() {
+            size_t chunk;
+            while ((chunk = next_chunk.fetch_add(1, std::memory_order_relaxed)) < n_chunks) {
+                size_t end = std::min(n, (chunk + 1) * chunk_size);
+                for (size_t i = chunk * chunk_size; i < end; i++) fn(i);
+            }
+        };
+
+        std::vector<std::thread> threads;
+        threads.reserve(n_workers);
+        for (size_t i = 1; i < n_workers; i++) {
+            try {
+                threads.push_back(std::thread(worker));
+            } catch (...) {
+                break;
+            }
+        }
+
+        worker();
+        for (std::thread &t : threads) t.join();
+    }
+#endif
 };
 
 }
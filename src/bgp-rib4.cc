@@ -9,13 +9,24 @@
  * 
  */
 #include "bgp-rib4.h"
+#include "route-event-bus.h"
 #include <arpa/inet.h>
 #define MAKE_ENTRY4(r, e) std::make_pair(BgpRib4EntryKey(r), e)
 
 namespace libbgp {
 
+// find the NEXT_HOP attribute of an entry, NULL if there is none.
+static const BgpPathAttribNexthop* FindNexthop(const BgpRib4Entry &entry) {
+    for (const std::shared_ptr<BgpPathAttrib> &attr : entry.attribs) {
+        if (attr->type_code == NEXT_HOP) return &dynamic_cast<const BgpPathAttribNexthop &>(*attr);
+    }
+
+    return NULL;
+}
+
 BgpRib4Entry::BgpRib4Entry() {
     src_router_id = 0;
+    nexthop_slot = 0;
 }
 
 /**
@@ -25,9 +36,10 @@ BgpRib4Entry::BgpRib4Entry() {
  * @param src Originating BGP speaker's ID in network bytes order.
  * @param as Path attributes for this entry.
  */
-BgpRib4Entry::BgpRib4Entry(Prefix4 r, uint32_t src, const std::vector<std::shared_ptr<BgpPathAttrib>> as) : route(r) {
+BgpRib4Entry::BgpRib4Entry(Prefix4 r, uint32_t src, const std::vector<std::shared_ptr<BgpPathAttrib>> as) : route(r.toValue()) {
     src_router_id = src;
     attribs = as;
+    nexthop_slot = 0;
 }
 
 /**
@@ -54,10 +66,15 @@ uint32_t BgpRib4Entry::getNexthop() const {
  */
 BgpRib4::BgpRib4(BgpLogHandler *logger) {
     this->logger = logger;
-    update_id = 0;    
+    update_id = 0;
+    discard_workers = 1;
+    nexthop_tracking = false;
+    use_path_lists = false;
+    path_lists_sweep = BGP_RIB_PATH_LISTS_SWEEP;
 }
 
 rib4_t::iterator BgpRib4::find_best (const Prefix4 &prefix) {
+    const Prefix4Value value = prefix.toValue();
     std::pair<rib4_t::iterator, rib4_t::iterator> its = 
         rib.equal_range(BgpRib4EntryKey(prefix));
 
@@ -65,7 +82,7 @@ rib4_t::iterator BgpRib4::find_best (const Prefix4 &prefix) {
     if (its.first == rib.end()) return rib.end();
 
     for (rib4_t::iterator it = its.first; it != its.second; it++) {
-        if (it->second.route == prefix) {
+        if (it->second.route == value && it->second.nexthop_reachable) {
             if (best == rib.end()) best = it;
             else {
                 const BgpRib4Entry *best_ptr = selectEntry(&(best->second), &(it->second));
@@ -78,13 +95,14 @@ rib4_t::iterator BgpRib4::find_best (const Prefix4 &prefix) {
 }
 
 rib4_t::iterator BgpRib4::find_entry (const Prefix4 &prefix, uint32_t src) {
+    const Prefix4Value value = prefix.toValue();
     std::pair<rib4_t::iterator, rib4_t::iterator> its = 
         rib.equal_range(BgpRib4EntryKey(prefix));
 
     if (its.first == rib.end()) return rib.end();
 
     for (rib4_t::iterator it = its.first; it != its.second; it++) {
-        if (it->second.route == prefix && it->second.src_router_id == src) {
+        if (it->second.route == value && it->second.src_router_id == src) {
             return it;
         }
     }
@@ -109,8 +127,11 @@ rib4_t::iterator BgpRib4::find_entry (const Prefix4 &prefix, uint32_t src) {
  * in const BgpRib4Entry*.
  * @retval <NULL, false> inserted route is not the new best, and current best
  * has not changed.
+ * @retval <NULL, true> inserted route replaced current best route, and no
+ * route has reachable nexthop now. The route is no longer reachable.
  */
 std::pair<const BgpRib4Entry*, bool> BgpRib4::insertPriv(uint32_t src_router_id, const Prefix4 &route, const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight, uint32_t ibgp_asn) {
+    const Prefix4Value value = route.toValue();
     std::lock_guard<std::recursive_mutex> lock(mutex);
 
     /* construct the new entry object */
@@ -119,6 +140,7 @@ std::pair<const BgpRib4Entry*, bool> BgpRib4::insertPriv(uint32_t src_router_id,
     new_entry.weight = weight;
     new_entry.src = ibgp_asn > 0 ? SRC_IBGP : SRC_EBGP;
     new_entry.ibgp_peer_asn = ibgp_asn;
+    if (nexthop_tracking) new_entry.nexthop_reachable = nexthopReachable(new_entry);
 
     // for logging
     const char *op = "new_entry";
@@ -138,7 +160,7 @@ std::pair<const BgpRib4Entry*, bool> BgpRib4::insertPriv(uint32_t src_router_id,
         rib4_t::const_iterator to_replace = rib.end();
         BgpRib4Entry *old_best = NULL;
         for (rib4_t::iterator it = entries.first; it != entries.second; it++) {
-            if (it->second.route != route) continue;
+            if (it->second.route != value) continue;
             if (it->second.src_router_id == src_router_id) {
                 to_replace = it;
                 continue;
@@ -165,23 +187,39 @@ std::pair<const BgpRib4Entry*, bool> BgpRib4::insertPriv(uint32_t src_router_id,
             }
             // we need to replace a route
             op = "update";
+            removeLocal(to_replace->second);
+            untrackEntry(to_replace->second);
             rib.erase(to_replace);
         }
 
         rib4_t::iterator inserted = rib.insert(MAKE_ENTRY4(route, new_entry));
+        trackEntry(inserted->second);
 
         if (best_changed) {
             newly_inserted_is_best = candidate == &new_entry;
             new_best = newly_inserted_is_best ? &(inserted->second) : old_best;
         }
 
+    } else if (!new_entry.nexthop_reachable) { // no older route, but new one can't be used
+        new_entry.status = RS_STANDBY;
+        act = "nexthop_unreachable";
+        rib4_t::iterator inserted = rib.insert(MAKE_ENTRY4(route, new_entry));
+        trackEntry(inserted->second);
     } else { // no older route, new one is best
         best_changed = newly_inserted_is_best = true;
         rib4_t::iterator inserted = rib.insert(MAKE_ENTRY4(route, new_entry));
+        trackEntry(inserted->second);
         new_best = &(inserted->second);
     }
 
     if (new_best != NULL) new_best->status = RS_ACTIVE;
+    else if (best_changed) {
+        // the replaced route was the best, and nothing can replace it.
+        act = "unreachabled";
+        newly_inserted_is_best = true;
+    }
+
+    refreshPathList(route);
     
     LIBBGP_LOG(logger, DEBUG) {
         uint32_t prefix = route.getPrefix();
@@ -199,7 +237,8 @@ std::pair<const BgpRib4Entry*, bool> BgpRib4::insertPriv(uint32_t src_router_id,
  * 
  * Local routes are routes inserted to the RIB by user. The scope (src_router_id)
  * of local routes are 0. This method will create necessary path attribues
- * before inserting entry to RIB (AS_PATH, ORIGIN, NEXT_HOP). 
+ * before inserting entry to RIB (AS_PATH, ORIGIN, NEXT_HOP). Local routes with
+ * the same nexthop share the attributes and the update ID.
  * 
  * The logger pointer passed in is for attribues. (so if a attribute failed to 
  * deserialize, it will print to the provided logger).
@@ -216,44 +255,14 @@ std::pair<const BgpRib4Entry*, bool> BgpRib4::insertPriv(uint32_t src_router_id,
  * @retval !=NULL Inserted route.
  */
 const BgpRib4Entry* BgpRib4::insert(BgpLogHandler *logger, const Prefix4 &route, uint32_t nexthop, int32_t weight) {
-    std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
-    BgpPathAttribOrigin *origin = new BgpPathAttribOrigin(logger);
-    BgpPathAttribNexthop *nexhop_attr = new BgpPathAttribNexthop(logger);
-    BgpPathAttribAsPath *as_path = new BgpPathAttribAsPath(logger, true);
-    nexhop_attr->next_hop = nexthop;
-    origin->origin = IGP;
-
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(origin));
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(nexhop_attr));
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(as_path));
-
-    uint64_t use_update_id = update_id;
-
-    for (const auto &entry : rib) {
-        if (entry.second.src_router_id == 0 && entry.second.route == route) {
-            this->logger->log(ERROR, "BgpRib4::insert: route exists.\n");
-            return NULL;
-        }
+    std::lock_guard<std::recursive_mutex> lock(mutex);
 
-        // see if we can group this entry to other local entries
-        if (entry.second.src_router_id == 0) {
-            for (const std::shared_ptr<BgpPathAttrib> &attr : entry.second.attribs) {
-                if (attr->type_code == NEXT_HOP) {
-                    const BgpPathAttribNexthop &nh = dynamic_cast<const BgpPathAttribNexthop &>(*attr);
-                    if (nh.next_hop == nexthop) use_update_id = entry.second.update_id;
-                }
-            }
-        }
+    if (find_entry(route, 0) != rib.end()) {
+        this->logger->log(ERROR, "BgpRib4::insert: route exists.\n");
+        return NULL;
     }
 
-    BgpRib4Entry new_entry(route, 0, attribs);
-    std::lock_guard<std::recursive_mutex> lock(mutex);
-    new_entry.update_id = use_update_id;
-    new_entry.weight = weight;
-    if (use_update_id == update_id) update_id++;
-    rib4_t::const_iterator it = rib.insert(MAKE_ENTRY4(route, new_entry));
-
-    return &(it->second);
+    return insertLocal(getLocalGroup(logger, nexthop), route, weight);
 }
 
 /**
@@ -271,30 +280,59 @@ const BgpRib4Entry* BgpRib4::insert(BgpLogHandler *logger, const Prefix4 &route,
  */
 const std::vector<BgpRib4Entry> BgpRib4::insert(BgpLogHandler *logger, const std::vector<Prefix4> &routes, uint32_t nexthop, int32_t weight) {
     std::vector<BgpRib4Entry> inserted;
-    std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
-    BgpPathAttribOrigin *origin = new BgpPathAttribOrigin(logger);
-    BgpPathAttribNexthop *nexhop_attr = new BgpPathAttribNexthop(logger);
-    BgpPathAttribAsPath *as_path = new BgpPathAttribAsPath(logger, true);
-    nexhop_attr->next_hop = nexthop;
-    origin->origin = IGP;
-
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(origin));
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(nexhop_attr));
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(as_path));
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    LocalGroup &group = getLocalGroup(logger, nexthop);
 
     for (const Prefix4 &route : routes) {
         rib4_t::const_iterator it = find_entry(route, 0);
 
         if (it != rib.end()) continue;
 
-        BgpRib4Entry new_entry (route, 0, attribs);
-        new_entry.update_id = update_id;
-        new_entry.weight = weight;
-        rib4_t::const_iterator isrt_it = rib.insert(MAKE_ENTRY4(route, new_entry));
-        inserted.push_back(isrt_it->second);
+        inserted.push_back(*insertLocal(group, route, weight));
+    }
+
+    return inserted;
+}
+
+/**
+ * @brief Insert local routes with their own nexthops into RIB.
+ * 
+ * Same as the other local inserts, but each route has its own nexthop. Local
+ * routes are indexed by prefix and by nexthop, so the time spent is linear to
+ * the number of routes. Use this to load a large set of static routes.
+ * 
+ * Routes already in RIB as local routes are skipped. Routes with the same
+ * nexthop share their path attributes and update ID, with the local routes
+ * already in RIB too. Routes are usually given sorted by prefix, but they
+ * don't need to be.
+ * 
+ * This SHOULD NOT be called when the any of the upper FSM is running. 
+ * 
+ * @param logger Pointer to logger for the created path attributes to use. 
+ * @param routes Routes.
+ * @param nexthops Nexthops of the routes. (nexthops[i] for routes[i])
+ * @param weight weight of the entries.
+ * @return const std::vector<BgpRib4Entry> Inserted routes. (empty if the 
+ * number of routes and nexthops do not match)
+ */
+const std::vector<BgpRib4Entry> BgpRib4::insert(BgpLogHandler *logger, const std::vector<Prefix4> &routes, const std::vector<uint32_t> &nexthops, int32_t weight) {
+    std::vector<BgpRib4Entry> inserted;
+
+    if (routes.size() != nexthops.size()) {
+        this->logger->log(ERROR, "BgpRib4::insert: got %zu routes but %zu nexthops.\n", routes.size(), nexthops.size());
+        return inserted;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    inserted.reserve(routes.size());
+    rib.reserve(rib.size() + routes.size());
+
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (find_entry(routes[i], 0) != rib.end()) continue;
+
+        inserted.push_back(*insertLocal(getLocalGroup(logger, nexthops[i]), routes[i], weight));
     }
 
-    update_id++;
     return inserted;
 }
 
@@ -316,6 +354,9 @@ std::pair<const BgpRib4Entry*, bool> BgpRib4::insert(uint32_t src_router_id, con
 /**
  * @brief Insert new entries into RIB.
  * 
+ * This copies every updated entry, use the other insert with output buffers to
+ * avoid the copies.
+ * 
  * @param src_router_id Originating BGP speaker's ID in network bytes order.
  * @param routes Routes.
  * @param attrib Path attribs.
@@ -325,17 +366,48 @@ std::pair<const BgpRib4Entry*, bool> BgpRib4::insert(uint32_t src_router_id, con
  * vectors. <updated_entries, unchanged_entries>.
  */
 std::pair<std::vector<BgpRib4Entry>, std::vector<Prefix4>> BgpRib4::insert(uint32_t src_router_id, const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight,  uint32_t ibgp_asn) {
+    std::pair<std::vector<BgpRib4Entry>, std::vector<Prefix4>> rslt;
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::vector<const BgpRib4Entry*> updated;
+    std::vector<Prefix4> unreach;
+    insert(src_router_id, routes, attrib, weight, ibgp_asn, updated, rslt.second, unreach);
+
+    rslt.first.reserve(updated.size());
+    for (const BgpRib4Entry *entry : updated) rslt.first.push_back(*entry);
+
+    return rslt;
+}
+
+/**
+ * @brief Insert new entries into RIB, with one lock acquisition.
+ * 
+ * Results are appended to the output buffers, so the caller can reuse them
+ * for many calls. Updated entries are not copied; the pointers point into the
+ * RIB and stay valid until the RIB is modified again. Hold the RIB lock (see
+ * lock()) across the call and the use of the pointers if other threads may
+ * modify the RIB.
+ * 
+ * @param src_router_id Originating BGP speaker's ID in network bytes order.
+ * @param routes Routes.
+ * @param attrib Path attribs.
+ * @param weight weight of this entry.
+ * @param ibgp_asn ASN of the peer if the route is from an IBGP peer. 0 if not.
+ * @param updated Output: entries become the best in place of the inserted
+ * routes. (with different attributes then provided)
+ * @param unchanged Output: inserted routes become the best routes.
+ * @param unreach Output: routes no longer reachable, since the inserted routes
+ * replaced the best routes and have unreachable nexthop.
+ */
+void BgpRib4::insert(uint32_t src_router_id, const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight,  uint32_t ibgp_asn, std::vector<const BgpRib4Entry*> &updated, std::vector<Prefix4> &unchanged, std::vector<Prefix4> &unreach) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     update_id++;
-    std::vector<BgpRib4Entry> updated;
-    std::vector<Prefix4> unchanged;
     for (const Prefix4 &route : routes) {
         std::pair<const BgpRib4Entry*, bool> rslt = insertPriv(src_router_id, route, attrib, weight, ibgp_asn);
         if (rslt.first != NULL) {
-            if (!rslt.second) updated.push_back(*(rslt.first));
+            if (!rslt.second) updated.push_back(rslt.first);
             else unchanged.push_back(route);
-        }
+        } else if (rslt.second) unreach.push_back(route);
     }
-    return std::make_pair(updated, unchanged);
 }
 
 /**
@@ -353,6 +425,58 @@ std::pair<std::vector<BgpRib4Entry>, std::vector<Prefix4>> BgpRib4::insert(uint3
  */
 std::pair<bool, const void*> BgpRib4::withdraw(uint32_t src_router_id, const Prefix4 &route) {
     std::lock_guard<std::recursive_mutex> lock(mutex);
+    return withdrawPriv(src_router_id, route);
+}
+
+/**
+ * @brief Withdraw mutiple routes from RIB.
+ * 
+ * Same as the other withdraw, but this one withdraw mutiple routes with only
+ * one lock acquisition. Replacement entries are not copied; the pointers point
+ * into the RIB and stay valid until the RIB is modified again.
+ * 
+ * @param src_router_id Originating BGP speaker's ID in network bytes order.
+ * @param routes Routes to withdraw.
+ * @return std::pair<std::vector<Prefix4>, std::vector<const BgpRib4Entry*>> 
+ * <unreachabled_routes, replacement_entries> pair. unreachabled_routes should
+ * be send as withdrawn to peers, replacement_entries should be send as update
+ * to peers.
+ */
+std::pair<std::vector<Prefix4>, std::vector<const BgpRib4Entry*>> BgpRib4::withdraw(uint32_t src_router_id, const std::vector<Prefix4> &routes) {
+    std::pair<std::vector<Prefix4>, std::vector<const BgpRib4Entry*>> rslt;
+    rslt.first.reserve(routes.size());
+    withdraw(src_router_id, routes, rslt.first, rslt.second);
+    return rslt;
+}
+
+/**
+ * @brief Withdraw mutiple routes from RIB, with the results appended to output
+ * buffers.
+ * 
+ * Same as the other batch withdraw, but the caller can reuse the buffers for
+ * many calls.
+ * 
+ * @param src_router_id Originating BGP speaker's ID in network bytes order.
+ * @param routes Routes to withdraw.
+ * @param unreach Output: withdrawn routes that are no longer reachable.
+ * @param replacements Output: new best entries of withdrawn routes that are 
+ * still reachable.
+ */
+void BgpRib4::withdraw(uint32_t src_router_id, const std::vector<Prefix4> &routes, std::vector<Prefix4> &unreach, std::vector<const BgpRib4Entry*> &replacements) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    for (const Prefix4 &route : routes) {
+        std::pair<bool, const void*> w_ret = withdrawPriv(src_router_id, route);
+        if (!w_ret.first) {
+            if (w_ret.second == NULL) unreach.push_back(route);
+        } else if (w_ret.second != NULL) {
+            replacements.push_back((const BgpRib4Entry *) w_ret.second);
+        }
+    }
+}
+
+std::pair<bool, const void*> BgpRib4::withdrawPriv(uint32_t src_router_id, const Prefix4 &route) {
+    const Prefix4Value value = route.toValue();
     std::pair<rib4_t::iterator, rib4_t::iterator> old_entries = 
         rib.equal_range(BgpRib4EntryKey(route));
 
@@ -374,7 +498,7 @@ std::pair<bool, const void*> BgpRib4::withdraw(uint32_t src_router_id, const Pre
     rib4_t::const_iterator to_remove = rib.end();
     
     for (rib4_t::iterator it = old_entries.first; it != old_entries.second; it++) {
-        if (it->second.route == route) {
+        if (it->second.route == value) {
             if (it->second.src_router_id == src_router_id) {
                 to_remove = it;
                 continue;
@@ -386,20 +510,24 @@ std::pair<bool, const void*> BgpRib4::withdraw(uint32_t src_router_id, const Pre
     bool reachabled = true;
 
     if (to_remove == rib.end()) 
-        return std::make_pair<bool, const void*>(false, NULL);
+        return std::make_pair<bool, const void*>(false, &route); // not in RIB.
     
-    if (replacement != NULL) {
+    if (to_remove->second.status != RS_ACTIVE) {
+        // not the best route (or nexthop unreachable), nothing changes.
+        replacement = NULL;
+    } else if (replacement != NULL) {
         // const BgpRib4Entry *candidate = selectEntry(replacement, &(to_remove->second));
-        if (to_remove->second.status == RS_ACTIVE) {
-            op = "dropped/best_changed";
-        } else replacement = NULL;
+        op = "dropped/best_changed";
     } else {
         reachabled = false;
         op = "dropped/unreachabled";
     }
 
+    removeLocal(to_remove->second);
+    untrackEntry(to_remove->second);
     rib.erase(to_remove);
     if (replacement != NULL) replacement->status = RS_ACTIVE;
+    refreshPathList(route);
 
     LIBBGP_LOG(logger, DEBUG) {
         uint32_t prefix = route.getPrefix();
@@ -415,6 +543,9 @@ std::pair<bool, const void*> BgpRib4::withdraw(uint32_t src_router_id, const Pre
 /**
  * @brief Drop all routes from RIB that originated from a BGP speaker.
  * 
+ * This copies every replacement entry, use the other discard with output
+ * buffers to avoid the copies.
+ * 
  * @param src_router_id src_router_id Originating BGP speaker's ID in network bytes order.
  * @return std::pair<std::vector<Prefix4>, std::vector<BgpRib4Entry>> 
  * <dropped_routes, updated_routes> pair. dropped_routes should be send as
@@ -422,9 +553,40 @@ std::pair<bool, const void*> BgpRib4::withdraw(uint32_t src_router_id, const Pre
  * 
  */
 std::pair<std::vector<Prefix4>, std::vector<BgpRib4Entry>> BgpRib4::discard(uint32_t src_router_id) {
+    std::pair<std::vector<Prefix4>, std::vector<BgpRib4Entry>> rslt;
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::vector<const BgpRib4Entry*> replacements;
+    discard(src_router_id, rslt.first, replacements);
+
+    rslt.second.reserve(replacements.size());
+    for (const BgpRib4Entry *entry : replacements) rslt.second.push_back(*entry);
+
+    return rslt;
+}
+
+/**
+ * @brief Drop all routes from RIB that originated from a BGP speaker, with the
+ * results appended to output buffers.
+ * 
+ * Replacement entries are not copied; the pointers point into the RIB and stay
+ * valid until the RIB is modified again.
+ * 
+ * With more than one discard worker (see setDiscardWorkers()), the best routes
+ * of the dropped prefixes are looked up in parallel. The results are the same,
+ * in the same order, as with one worker.
+ * 
+ * @param src_router_id src_router_id Originating BGP speaker's ID in network bytes order.
+ * @param dropped Output: routes no longer reachable, should be send as
+ * withdrawn to peers.
+ * @param replacements Output: new best entries of the dropped routes that are
+ * still reachable, should be send as update to peers.
+ */
+void BgpRib4::discard(uint32_t src_router_id, std::vector<Prefix4> &dropped, std::vector<const BgpRib4Entry*> &replacements) {
     std::lock_guard<std::recursive_mutex> lock(mutex);
     std::vector<Prefix4> reevaluate_routes;
-    std::vector<Prefix4> dropped_routes;
+
+    // routes with a path from the speaker get new path lists.
+    std::vector<Prefix4> path_list_routes;
 
     for (rib4_t::const_iterator it = rib.begin(); it != rib.end();) {
         const char *op = "dropped/silent";
@@ -436,6 +598,7 @@ std::pair<std::vector<Prefix4>, std::vector<BgpRib4Entry>> BgpRib4::discard(uint
             reevaluate_routes.push_back(it->second.route);
             op = "dropped/pending-reevaluate";
         }
+        if (use_path_lists && it->second.path_list) path_list_routes.push_back(it->second.route);
         LIBBGP_LOG(logger, DEBUG) {
             uint32_t prefix = it->second.route.getPrefix();
             char src_router_id_str[INET_ADDRSTRLEN], prefix_str[INET_ADDRSTRLEN];
@@ -443,21 +606,28 @@ std::pair<std::vector<Prefix4>, std::vector<BgpRib4Entry>> BgpRib4::discard(uint
             inet_ntop(AF_INET, &prefix, prefix_str, INET_ADDRSTRLEN);
             logger->log(DEBUG, "BgpRib4::discard: (%s) scope %s, route %s/%d\n", op, src_router_id_str, prefix_str, it->second.route.getLength());
         }
+        removeLocal(it->second);
+        untrackEntry(it->second);
         it = rib.erase(it);
     }
 
-    std::vector<BgpRib4Entry> replacements;
+    // find_best only reads the RIB, and the RIB is locked, so the prefixes can
+    // be re-evaluated concurrently. the replacements are then taken in order.
+    std::vector<rib4_t::iterator> best_entries(reevaluate_routes.size());
+    parallelFor(reevaluate_routes.size(), discard_workers, BGP_RIB_DISCARD_CHUNK, [&](size_t i) {
+        best_entries[i] = find_best(reevaluate_routes[i]);
+    });
 
-    for (std::vector<Prefix4>::const_iterator it = reevaluate_routes.begin(); it != reevaluate_routes.end(); it++) {
+    for (size_t i = 0; i < reevaluate_routes.size(); i++) {
         const char *op = "replacement found";
-        const Prefix4 &prefix = *it;
-        rib4_t::iterator replacement = find_best(prefix);
+        const Prefix4 &prefix = reevaluate_routes[i];
+        rib4_t::iterator replacement = best_entries[i];
         if (replacement == rib.end()) { // no replacement.
-            dropped_routes.push_back(prefix);
+            dropped.push_back(prefix);
             op = "no available replacement";
         } else {
             replacement->second.status = RS_ACTIVE;
-            replacements.push_back(replacement->second);
+            replacements.push_back(&(replacement->second));
         }
 
         LIBBGP_LOG(logger, DEBUG) {
@@ -468,7 +638,378 @@ std::pair<std::vector<Prefix4>, std::vector<BgpRib4Entry>> BgpRib4::discard(uint
         }
     }
 
-    return std::make_pair(dropped_routes, replacements);
+    // no path list uses the speaker now, its next session starts up.
+    path_states.erase(src_router_id);
+    for (const Prefix4 &route : path_list_routes) refreshPathList(route);
+}
+
+/**
+ * @brief Get the group of local routes with a nexthop, create the group if
+ * there is none.
+ * 
+ * @param logger Pointer to logger for the created path attributes to use. 
+ * @param nexthop The nexthop.
+ * @return LocalGroup& The group.
+ */
+BgpRib4::LocalGroup& BgpRib4::getLocalGroup(BgpLogHandler *logger, uint32_t nexthop) {
+    std::unordered_map<uint32_t, LocalGroup>::iterator it = local_groups.find(nexthop);
+    if (it != local_groups.end()) return it->second;
+
+    LocalGroup &group = local_groups[nexthop];
+    // increase before use, like the other inserts do, so no route from the 
+    // other inserts has the update ID of a group.
+    group.update_id = ++update_id;
+    group.size = 0;
+
+    BgpPathAttribOrigin *origin = new BgpPathAttribOrigin(logger);
+    BgpPathAttribNexthop *nexhop_attr = new BgpPathAttribNexthop(logger);
+    BgpPathAttribAsPath *as_path = new BgpPathAttribAsPath(logger, true);
+    nexhop_attr->next_hop = nexthop;
+    origin->origin = IGP;
+
+    group.attribs.push_back(std::shared_ptr<BgpPathAttrib>(origin));
+    group.attribs.push_back(std::shared_ptr<BgpPathAttrib>(nexhop_attr));
+    group.attribs.push_back(std::shared_ptr<BgpPathAttrib>(as_path));
+
+    return group;
+}
+
+/**
+ * @brief Insert a local route of a group into RIB. The caller must make sure
+ * the route is not in RIB as local route.
+ * 
+ * @param group The group.
+ * @param route The route.
+ * @param weight weight of this entry.
+ * @return const BgpRib4Entry* Inserted route.
+ */
+const BgpRib4Entry* BgpRib4::insertLocal(LocalGroup &group, const Prefix4 &route, int32_t weight) {
+    BgpRib4Entry new_entry(route, 0, group.attribs);
+    new_entry.update_id = group.update_id;
+    new_entry.weight = weight;
+    if (nexthop_tracking && !nexthopReachable(new_entry)) {
+        new_entry.nexthop_reachable = false;
+        new_entry.status = RS_STANDBY;
+    }
+    group.size++;
+
+    rib4_t::iterator it = rib.insert(MAKE_ENTRY4(route, new_entry));
+    trackEntry(it->second);
+    refreshPathList(route);
+    return &(it->second);
+}
+
+/**
+ * @brief Remove an entry from the local route groups. This must be called 
+ * before an entry is removed from RIB.
+ * 
+ * @param entry The entry. Entries that are not local routes are ignored.
+ */
+void BgpRib4::removeLocal(const BgpRib4Entry &entry) {
+    if (entry.src_router_id != 0) return;
+
+    for (const std::shared_ptr<BgpPathAttrib> &attr : entry.attribs) {
+        if (attr->type_code != NEXT_HOP) continue;
+
+        const BgpPathAttribNexthop &nh = dynamic_cast<const BgpPathAttribNexthop &>(*attr);
+        std::unordered_map<uint32_t, LocalGroup>::iterator group = local_groups.find(nh.next_hop);
+
+        // routes inserted with insert(src_router_id = 0, ...) are in no group.
+        if (group != local_groups.end() && group->second.update_id == entry.update_id) {
+            if (--group->second.size == 0) local_groups.erase(group);
+        }
+
+        return;
+    }
+}
+
+/**
+ * @brief Build the lists of entries using the nexthops, if not built yet.
+ * 
+ */
+void BgpRib4::enableNexthopTracking() {
+    if (nexthop_tracking) return;
+    nexthop_tracking = true;
+
+    for (std::pair<const BgpRib4EntryKey, BgpRib4Entry> &kv : rib) trackEntry(kv.second);
+}
+
+/**
+ * @brief Test if the nexthop of an entry (not in RIB yet) is reachable.
+ * 
+ * @param entry The entry.
+ * @return true The nexthop is reachable, or the entry has no nexthop.
+ * @return false The nexthop has been marked unreachable.
+ */
+bool BgpRib4::nexthopReachable(const BgpRib4Entry &entry) const {
+    const BgpPathAttribNexthop *nh = FindNexthop(entry);
+    return nh == NULL || isNexthopReachable(nh->next_hop);
+}
+
+/**
+ * @brief Add an entry in RIB to the list of entries using its nexthop.
+ * 
+ * @param entry The entry.
+ */
+void BgpRib4::trackEntry(BgpRib4Entry &entry) {
+    if (!nexthop_tracking) return;
+
+    const BgpPathAttribNexthop *nh = FindNexthop(entry);
+    if (nh == NULL) return;
+
+    TrackedNexthop &tracked = nexthops[nh->next_hop];
+
+    entry.nexthop_slot = tracked.entries.size();
+    tracked.entries.push_back(&entry);
+}
+
+/**
+ * @brief Remove an entry to be erased from the list of entries using its
+ * nexthop.
+ * 
+ * @param entry The entry.
+ */
+void BgpRib4::untrackEntry(const BgpRib4Entry &entry) {
+    if (!nexthop_tracking) return;
+
+    const BgpPathAttribNexthop *nh = FindNexthop(entry);
+    if (nh == NULL) return;
+
+    std::unordered_map<uint32_t, TrackedNexthop>::iterator it = nexthops.find(nh->next_hop);
+    if (it == nexthops.end()) return;
+
+    // move the last entry to the slot of the removed one.
+    std::vector<BgpRib4Entry*> &entries = it->second.entries;
+    BgpRib4Entry *last = entries.back();
+    entries[entry.nexthop_slot] = last;
+    last->nexthop_slot = entry.nexthop_slot;
+    entries.pop_back();
+
+    // keep unreachable nexthops, they apply to routes inserted later too.
+    if (entries.size() == 0 && it->second.reachable) nexthops.erase(it);
+}
+
+/**
+ * @brief Select the best route of a prefix again.
+ * 
+ * @param route The prefix.
+ * @param unreach Output: the prefix, if it is no longer reachable.
+ * @param updated Output: the new best entry, if the best entry changed.
+ */
+void BgpRib4::reselect(const Prefix4 &route, std::vector<Prefix4> &unreach, std::vector<const BgpRib4Entry*> &updated) {
+    const Prefix4Value value = route.toValue();
+    std::pair<rib4_t::iterator, rib4_t::iterator> entries = rib.equal_range(BgpRib4EntryKey(route));
+
+    BgpRib4Entry *best = NULL;
+    bool had_best = false;
+    for (rib4_t::iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.route != value) continue;
+        if (it->second.status == RS_ACTIVE) had_best = true;
+        best = selectEntry(best, &(it->second));
+    }
+
+    bool best_changed = best != NULL && best->status != RS_ACTIVE;
+    for (rib4_t::iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.route == value && &(it->second) != best) it->second.status = RS_STANDBY;
+    }
+
+    if (best != NULL) {
+        best->status = RS_ACTIVE;
+        if (best_changed) updated.push_back(best);
+    } else if (had_best) unreach.push_back(route);
+
+    refreshPathList(route);
+
+    LIBBGP_LOG(logger, DEBUG) {
+        uint32_t prefix = route.getPrefix();
+        char prefix_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &prefix, prefix_str, INET_ADDRSTRLEN);
+        const char *op = best_changed ? "best_changed" : (best == NULL && had_best ? "unreachabled" : "no_change");
+        logger->log(DEBUG, "BgpRib4::reselect: (%s) route %s/%d\n", op, prefix_str, route.getLength());
+    }
+}
+
+/**
+ * @brief Mark a nexthop reachable or unreachable.
+ * 
+ * Call this when an IGP or link event changes the reachability of a nexthop.
+ * Routes with unreachable nexthop stay in the RIB, but are never selected as
+ * the best route. Only routes using the nexthop are selected again: the RIB
+ * keeps a list of entries for every nexthop. The lists are built the first
+ * time a nexthop is marked unreachable, and kept updated since then.
+ * 
+ * Nexthops are reachable unless marked unreachable. Results are appended to
+ * the output buffers. Updated entries are not copied; the pointers point into
+ * the RIB and stay valid until the RIB is modified again.
+ * 
+ * @param nexthop The nexthop in network byte order.
+ * @param reachable Reachability of the nexthop.
+ * @param unreach Output: routes no longer reachable, should be send as
+ * withdrawn to peers.
+ * @param updated Output: new best entries of routes, should be send as update
+ * to peers.
+ */
+void BgpRib4::setNexthopReachable(uint32_t nexthop, bool reachable, std::vector<Prefix4> &unreach, std::vector<const BgpRib4Entry*> &updated) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    // all nexthops are reachable until one is marked unreachable.
+    if (!nexthop_tracking && reachable) return;
+    enableNexthopTracking();
+
+    TrackedNexthop &tracked = nexthops[nexthop];
+    if (tracked.entries.size() == 0 && reachable) {
+        nexthops.erase(nexthop);
+        return;
+    }
+
+    if (tracked.reachable == reachable) return;
+    tracked.reachable = reachable;
+
+    LIBBGP_LOG(logger, INFO) {
+        char nexthop_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &nexthop, nexthop_str, INET_ADDRSTRLEN);
+        logger->log(INFO, "BgpRib4::setNexthopReachable: nexthop %s is now %s, %zu routes affected.\n", nexthop_str, reachable ? "reachable" : "unreachable", tracked.entries.size());
+    }
+
+    for (BgpRib4Entry *entry : tracked.entries) entry->nexthop_reachable = reachable;
+
+    // routes with more than one entry using the nexthop are selected again
+    // more than once, but only the first one can change the best route.
+    for (BgpRib4Entry *entry : tracked.entries) reselect(entry->route, unreach, updated);
+}
+
+/**
+ * @brief Mark a nexthop reachable or unreachable, and publish the changed
+ * routes on the event bus.
+ * 
+ * Same as the other setNexthopReachable, but the changes are published with a
+ * Route4WithdrawEvent and a Route4AddEvent, so the FSMs on the bus send them
+ * to their peers. The events are published after the RIB is unlocked, with
+ * copies of the changed entries.
+ * 
+ * @param nexthop The nexthop in network byte order.
+ * @param reachable Reachability of the nexthop.
+ * @param rev_bus The event bus.
+ * @return size_t Number of changed routes.
+ */
+size_t BgpRib4::setNexthopReachable(uint32_t nexthop, bool reachable, RouteEventBus *rev_bus) {
+    std::vector<Prefix4> unreach;
+    std::vector<const BgpRib4Entry*> updated;
+    std::vector<BgpRib4Entry> snapshot;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        setNexthopReachable(nexthop, reachable, unreach, updated);
+        if (rev_bus != NULL) snapshotEntries(updated, snapshot);
+    }
+
+    if (rev_bus != NULL && unreach.size() > 0) {
+        Route4WithdrawEvent wev;
+        wev.routes = &unreach;
+        rev_bus->publish(NULL, wev);
+    }
+
+    if (rev_bus != NULL && updated.size() > 0) {
+        Route4AddEvent aev;
+        aev.replaced_entries = &updated;
+        rev_bus->publish(NULL, aev);
+    }
+
+    return unreach.size() + updated.size();
+}
+
+/**
+ * @brief Test if a nexthop is reachable.
+ * 
+ * @param nexthop The nexthop in network byte order.
+ * @return true The nexthop is reachable.
+ * @return false The nexthop has been marked unreachable.
+ */
+bool BgpRib4::isNexthopReachable(uint32_t nexthop) const {
+    std::unordered_map<uint32_t, TrackedNexthop>::const_iterator it = nexthops.find(nexthop);
+    return it == nexthops.end() || it->second.reachable;
+}
+
+/**
+ * @brief Update the path list of a prefix after its entries changed.
+ * 
+ * @param route The prefix.
+ */
+void BgpRib4::refreshPathList(const Prefix4 &route) {
+    const Prefix4Value value = route.toValue();
+    if (!use_path_lists) return;
+
+    std::pair<rib4_t::iterator, rib4_t::iterator> entries = rib.equal_range(BgpRib4EntryKey(route));
+
+    const BgpRib4Entry *primary = NULL;
+    for (rib4_t::iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.route == value && it->second.status == RS_ACTIVE) primary = selectEntry(primary, &(it->second));
+    }
+
+    // the backup is the best route from another speaker, so it is still up
+    // when the speaker of the primary goes down.
+    const BgpRib4Entry *backup = NULL;
+    if (primary != NULL) {
+        for (rib4_t::iterator it = entries.first; it != entries.second; it++) {
+            if (it->second.route == value && it->second.src_router_id != primary->src_router_id) backup = selectEntry(backup, &(it->second));
+        }
+    }
+
+    std::shared_ptr<const BgpPathList4> path_list;
+    if (primary != NULL) path_list = getPathList(primary, backup);
+
+    for (rib4_t::iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.route == value) it->second.path_list = path_list;
+    }
+}
+
+/**
+ * @brief Get the path list with the given primary and backup paths, create
+ * one if no prefix is using such path list.
+ * 
+ * @param primary The best entry.
+ * @param backup The backup entry. (NULL-able)
+ * @return std::shared_ptr<const BgpPathList4> The path list.
+ */
+std::shared_ptr<const BgpPathList4> BgpRib4::getPathList(const BgpRib4Entry *primary, const BgpRib4Entry *backup) {
+    const BgpRib4Entry *selected[2] = { primary, backup };
+
+    PathListKey key;
+    key.n_paths = backup == NULL ? 1 : 2;
+    for (size_t i = 0; i < 2; i++) {
+        const BgpPathAttribNexthop *nh = i < key.n_paths ? FindNexthop(*selected[i]) : NULL;
+        key.src_router_id[i] = i < key.n_paths ? selected[i]->src_router_id : 0;
+        key.nexthop[i] = nh == NULL ? 0 : nh->next_hop;
+    }
+
+    std::weak_ptr<const BgpPathList4> &cached = path_lists[key];
+    std::shared_ptr<const BgpPathList4> path_list = cached.lock();
+    if (path_list) return path_list;
+
+    std::vector<BgpPath4> paths(key.n_paths);
+    for (size_t i = 0; i < key.n_paths; i++) {
+        std::shared_ptr<BgpPathState> &state = path_states[key.src_router_id[i]];
+        if (!state) state = std::make_shared<BgpPathState>();
+
+        paths[i].src_router_id = key.src_router_id[i];
+        paths[i].nexthop = key.nexthop[i];
+        paths[i].state = state;
+    }
+
+    path_list = std::make_shared<const BgpPathList4>(paths);
+    cached = path_list;
+
+    // remove the path lists no prefix is using.
+    if (path_lists.size() >= path_lists_sweep) {
+        for (path_lists_t::iterator it = path_lists.begin(); it != path_lists.end();) {
+            if (it->second.expired()) it = path_lists.erase(it);
+            else it++;
+        }
+
+        path_lists_sweep = std::max((size_t) BGP_RIB_PATH_LISTS_SWEEP, path_lists.size() * 2);
+    }
+
+    return path_list;
 }
 
 /**
@@ -484,8 +1025,8 @@ const BgpRib4Entry* BgpRib4::lookup(uint32_t dest) const {
 
     for (const auto &entry : rib) {
         if (entry.second.status != RS_ACTIVE) continue;
-        const Prefix4 &route = entry.second.route;
-        if (route.includes(dest)) 
+        const Prefix4Value &route = entry.second.route;
+        if (Prefix4::Includes(route.prefix, route.length, dest)) 
             selected_entry = selectEntry(&entry.second, selected_entry);
     }
 
@@ -510,14 +1051,112 @@ const BgpRib4Entry* BgpRib4::lookup(uint32_t src_router_id, uint32_t dest) const
     for (const auto &entry : rib) {
         if (entry.second.src_router_id != src_router_id) continue;
         if (entry.second.status != RS_ACTIVE) continue;
-        const Prefix4 &route = entry.second.route;
-        if (route.includes(dest)) 
+        const Prefix4Value &route = entry.second.route;
+        if (Prefix4::Includes(route.prefix, route.length, dest)) 
             selected_entry = selectEntry(&entry.second, selected_entry);
     }
 
     return selected_entry;
 }
 
+/**
+ * @brief Set the number of threads discard() uses to find the replacements of
+ * the dropped routes.
+ * 
+ * @param n_workers Number of threads, including the calling one. 1 (the
+ * default) for no extra threads, 0 for one thread per CPU.
+ */
+void BgpRib4::setDiscardWorkers(size_t n_workers) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (n_workers == 0) n_workers = std::thread::hardware_concurrency();
+    discard_workers = n_workers > 0 ? n_workers : 1;
+}
+
+/**
+ * @brief Enable or disable shared path lists.
+ * 
+ * With path lists enabled, the entries of every prefix point to a path list
+ * (BgpRib4Entry::path_list) with the path of the best route, and the path of
+ * the best route from another speaker as backup. Prefixes with the same paths
+ * share one path list. A forwarding table built on the path lists switches all
+ * the prefixes of a failed speaker to their backup paths with one failover(),
+ * no matter how many prefixes there are; the routes are then selected again by
+ * discard(), which can run later or in another thread.
+ * 
+ * Path lists are disabled by default. Enabling them builds the path lists for
+ * the routes already in RIB.
+ * 
+ * @param enabled Enable path lists.
+ */
+void BgpRib4::setPathLists(bool enabled) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (use_path_lists == enabled) return;
+    use_path_lists = enabled;
+
+    if (enabled) {
+        for (std::pair<const BgpRib4EntryKey, BgpRib4Entry> &kv : rib) {
+            if (kv.second.status == RS_ACTIVE && !kv.second.path_list) refreshPathList(kv.second.route);
+        }
+
+        return;
+    }
+
+    for (std::pair<const BgpRib4EntryKey, BgpRib4Entry> &kv : rib) kv.second.path_list.reset();
+    path_lists.clear();
+    path_states.clear();
+    path_lists_sweep = BGP_RIB_PATH_LISTS_SWEEP;
+}
+
+/**
+ * @brief Switch the path lists using a speaker to their backup paths.
+ * 
+ * Call this when the session with a speaker goes down. This marks the paths
+ * from the speaker down, which takes the same time no matter how many prefixes
+ * are using them; the RIB itself is not changed. Call discard() with the same
+ * speaker after this to select the best routes again and get the routes to
+ * send to other peers. The paths of the speaker are up again after discard().
+ * 
+ * @param src_router_id Originating BGP speaker's ID in network bytes order.
+ * @return true Paths from the speaker marked down.
+ * @return false No path list uses the speaker, or path lists are not enabled.
+ */
+bool BgpRib4::failover(uint32_t src_router_id) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    std::unordered_map<uint32_t, std::shared_ptr<BgpPathState>>::iterator it = path_states.find(src_router_id);
+    if (it == path_states.end()) return false;
+
+    it->second->setUp(false);
+
+    LIBBGP_LOG(logger, INFO) {
+        char src_router_id_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &src_router_id, src_router_id_str, INET_ADDRSTRLEN);
+        logger->log(INFO, "BgpRib4::failover: paths from %s are now down.\n", src_router_id_str);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Lock the RIB.
+ * 
+ * The lock is recursive and is the one taken by every RIB operation. Hold it
+ * to keep entry pointers returned by the RIB valid while other threads may
+ * modify the RIB. BgpRib4 is BasicLockable, so std::lock_guard<BgpRib4> works.
+ * 
+ */
+void BgpRib4::lock() {
+    mutex.lock();
+}
+
+/**
+ * @brief Unlock the RIB.
+ * 
+ */
+void BgpRib4::unlock() {
+    mutex.unlock();
+}
+
 /**
  * @brief Get the RIB.
  * 
@@ -527,4 +1166,22 @@ const rib4_t& BgpRib4::get() const {
     return rib;
 }
 
+bool BgpRib4::PathListKey::operator== (const PathListKey &other) const {
+    if (n_paths != other.n_paths) return false;
+    for (size_t i = 0; i < n_paths; i++) {
+        if (src_router_id[i] != other.src_router_id[i] || nexthop[i] != other.nexthop[i]) return false;
+    }
+
+    return true;
+}
+
+std::size_t BgpRib4::PathListKeyHash::operator()(const PathListKey &key) const {
+    uint64_t h = key.n_paths;
+    for (size_t i = 0; i < key.n_paths; i++) {
+        h = h * 31 + (((uint64_t) key.src_router_id[i] << 32) | key.nexthop[i]);
+    }
+
+    return h ^ (h >> 29);
+}
+
 }
\ No newline at end of file
@@ -19,9 +19,13 @@
 #include "bgp-rib.h"
 #include "prefix4.h"
 #include "bgp-path-attrib.h"
+#include "bgp-path-list.h"
 
 namespace libbgp {
 
+/* forward */
+class RouteEventBus;
+
 /**
  * @brief Key for the Rib4 entry map.
  * 
@@ -34,6 +38,11 @@ public:
         this->length = prefix.getLength();
         hash = this->prefix | (this->length << 4);
     }
+    BgpRib4EntryKey(const Prefix4Value &prefix) {
+        this->prefix = prefix.prefix;
+        this->length = prefix.length;
+        hash = this->prefix | (this->length << 4);
+    }
     BgpRib4EntryKey(uint32_t prefix, uint32_t length) {
         this->prefix = prefix;
         this->length = length;
@@ -69,13 +78,28 @@ public:
     BgpRib4Entry (Prefix4 r, uint32_t src, const std::vector<std::shared_ptr<BgpPathAttrib>> attribs);
 
     /**
-     * @brief The prefix of this entry.
+     * @brief The prefix of this entry, as a value. Use Prefix4(route) where a
+     * Prefix4 is needed.
      * 
      */
-    Prefix4 route;
+    Prefix4Value route;
 
     // get nexthop of this entry.
     uint32_t getNexthop() const;
+
+    /**
+     * @brief Primary and backup paths of the prefix, shared with other prefixes
+     * using the same paths. NULL if path lists are not enabled (see
+     * BgpRib4::setPathLists()), or the prefix has no best route.
+     * 
+     */
+    std::shared_ptr<const BgpPathList4> path_list;
+
+private:
+    friend class BgpRib4;
+
+    // position of this entry in the list of entries using its nexthop.
+    size_t nexthop_slot;
 };
 
 typedef std::unordered_multimap<BgpRib4EntryKey, BgpRib4Entry, BgpRib4EntryHash> rib4_t;
@@ -92,10 +116,14 @@ public:
     const BgpRib4Entry* insert(BgpLogHandler *logger, const Prefix4 &route, uint32_t nexthop, int32_t weight = 0);
     const std::vector<BgpRib4Entry> insert(BgpLogHandler *logger, const std::vector<Prefix4> &routes, uint32_t nexthop, int32_t weight = 0);
 
+    // insert local routes with their own nexthops, in time linear to number of routes.
+    const std::vector<BgpRib4Entry> insert(BgpLogHandler *logger, const std::vector<Prefix4> &routes, const std::vector<uint32_t> &nexthops, int32_t weight = 0);
+
     // insert a new route into RIB, return BgpRib4Entry that should be send to other peers.
     // <NULL, false> if a better route is already exist
     // <BgpRib4Entry*, false> if inserted route replaced current best route, and another route become the new best
     // <BgpRib4Entry*, true> if inserted route become the new best route
+    // <NULL, true> if inserted route replaced current best route, and no route has reachable nexthop now
     std::pair<const BgpRib4Entry*, bool> insert(uint32_t src_router_id, const Prefix4 &route, const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight,  uint32_t ibgp_asn);
 
     // insert new routes w/ common attribs.
@@ -103,11 +131,28 @@ public:
     // containing routes with different attribute then provided.
     std::pair<std::vector<BgpRib4Entry>, std::vector<Prefix4>> insert(uint32_t src_router_id, const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight,  uint32_t ibgp_asn);
 
+    // insert new routes w/ common attribs, append results to caller's buffers w/o copying entries.
+    void insert(uint32_t src_router_id, const std::vector<Prefix4> &routes, const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight,  uint32_t ibgp_asn, std::vector<const BgpRib4Entry*> &updated, std::vector<Prefix4> &unchanged, std::vector<Prefix4> &unreach);
+
     // remove a route from RIB
     std::pair<bool, const void*> withdraw(uint32_t src_router_id, const Prefix4 &route);
 
+    // remove routes from RIB w/ one lock, return <unreachabled routes, replacement entries>.
+    std::pair<std::vector<Prefix4>, std::vector<const BgpRib4Entry*>> withdraw(uint32_t src_router_id, const std::vector<Prefix4> &routes);
+    void withdraw(uint32_t src_router_id, const std::vector<Prefix4> &routes, std::vector<Prefix4> &unreach, std::vector<const BgpRib4Entry*> &replacements);
+
     // remove all routes from a peer, return <unreachabled routes, updated_routes>.
     std::pair<std::vector<Prefix4>, std::vector<BgpRib4Entry>> discard(uint32_t src_router_id);
+    void discard(uint32_t src_router_id, std::vector<Prefix4> &dropped, std::vector<const BgpRib4Entry*> &replacements);
+
+    // mark a nexthop reachable or unreachable, select best routes again for the routes using it.
+    void setNexthopReachable(uint32_t nexthop, bool reachable, std::vector<Prefix4> &unreach, std::vector<const BgpRib4Entry*> &updated);
+
+    // same as above, and publish the changes on the event bus.
+    size_t setNexthopReachable(uint32_t nexthop, bool reachable, RouteEventBus *rev_bus);
+
+    // test if a nexthop is reachable.
+    bool isNexthopReachable(uint32_t nexthop) const;
 
     // lookup in rib, return null if not found
     const BgpRib4Entry* lookup(uint32_t dest) const;
@@ -117,21 +162,92 @@ public:
 
     // get RIB
     const rib4_t &get() const;
+
+    // set number of threads used by discard to re-evaluate the dropped routes.
+    void setDiscardWorkers(size_t n_workers);
+
+    // enable or disable shared primary/backup path lists of the best routes.
+    void setPathLists(bool enabled);
+
+    // switch the path lists using a peer to their backup paths, before the routes are discarded.
+    bool failover(uint32_t src_router_id);
+
+    // lock the RIB, so entry pointers returned by the RIB stay valid.
+    void lock();
+    void unlock();
 private:
+    // local routes with the same nexthop: they share update ID and attributes.
+    struct LocalGroup {
+        uint64_t update_id;
+        size_t size;
+        std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
+    };
+
+    // entries using a nexthop, and reachability of the nexthop.
+    struct TrackedNexthop {
+        TrackedNexthop() : reachable(true) {}
+
+        bool reachable;
+        std::vector<BgpRib4Entry*> entries;
+    };
+
+    // paths of a path list: primary, and backup if n_paths is 2.
+    struct PathListKey {
+        bool operator== (const PathListKey &other) const;
+
+        size_t n_paths;
+        uint32_t src_router_id[2];
+        uint32_t nexthop[2];
+    };
+
+    struct PathListKeyHash {
+        std::size_t operator()(const PathListKey &key) const;
+    };
+
+    typedef std::unordered_map<PathListKey, std::weak_ptr<const BgpPathList4>, PathListKeyHash> path_lists_t;
+
     rib4_t::iterator find_best (const Prefix4 &prefix);
     rib4_t::iterator find_entry (const Prefix4 &prefix, uint32_t src);
     std::pair<const BgpRib4Entry*, bool> insertPriv(uint32_t src_router_id, const Prefix4 &route, const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight, uint32_t ibgp_asn);
+    std::pair<bool, const void*> withdrawPriv(uint32_t src_router_id, const Prefix4 &route);
+    LocalGroup& getLocalGroup(BgpLogHandler *logger, uint32_t nexthop);
+    const BgpRib4Entry* insertLocal(LocalGroup &group, const Prefix4 &route, int32_t weight);
+    void removeLocal(const BgpRib4Entry &entry);
+    void enableNexthopTracking();
+    bool nexthopReachable(const BgpRib4Entry &entry) const;
+    void trackEntry(BgpRib4Entry &entry);
+    void untrackEntry(const BgpRib4Entry &entry);
+    void reselect(const Prefix4 &route, std::vector<Prefix4> &unreach, std::vector<const BgpRib4Entry*> &updated);
+    void refreshPathList(const Prefix4 &route);
+    std::shared_ptr<const BgpPathList4> getPathList(const BgpRib4Entry *primary, const BgpRib4Entry *backup);
     rib4_t rib;
+    std::unordered_map<uint32_t, LocalGroup> local_groups;
+    std::unordered_map<uint32_t, TrackedNexthop> nexthops;
+    bool nexthop_tracking;
+    path_lists_t path_lists;
+    std::unordered_map<uint32_t, std::shared_ptr<BgpPathState>> path_states;
+    size_t path_lists_sweep;
+    bool use_path_lists;
     std::recursive_mutex mutex;
+    size_t discard_workers;
     BgpLogHandler *logger;
     uint64_t update_id;
 };
 
 /**
+ * @example nexthop-tracking.cc
+ * Example of selecting the best routes again when a nexthop becomes unreachable.
+ * This example also times marking a nexthop down and up.
+ * 
  * @example peer-and-print.cc
  * A simple BGP speaker listen on TCP 0.0.0.0:179, wait for a peer, and print 
  * all BGP messages sent/received with BgpFsm. 
  * 
+ * @example peer-drop.cc
+ * Example of dropping the routes of a peer from BgpRib4, with the replacement
+ * routes looked up by multiple threads. This example also times the drop with
+ * one and with multiple workers.
+ * 
  * @example route-event-bus.cc
  * Example of adding new routes to RIB while BGP FSM is running. Notify BGP FSM
  * to send updates to the peer with RouteEventBus. This example also shows how
@@ -142,6 +258,11 @@ private:
  * shared BgpRib4 is demoed in this example. This example also shows how you can
  * implement your own BgpLogHandler.
  * 
+ * @example static-routes.cc
+ * Example of loading a large set of static routes into BgpRib4 and BgpRib6 as
+ * local routes, one by one and with the bulk insert. This example also times
+ * both ways of inserting.
+ * 
  */
 
 }
@@ -26,13 +26,14 @@ namespace libbgp {
  */
 BgpRib6Entry::BgpRib6Entry (Prefix6 r, uint32_t src, const uint8_t nexthop_global[16], 
     const uint8_t nexthop_linklocal[16], const std::vector<std::shared_ptr<BgpPathAttrib>> attribs)
-    : route(r) {
+    : route(r.toValue()) {
 
     memcpy(this->nexthop_global, nexthop_global, 16);
     if (nexthop_linklocal != NULL) memcpy(this->nexthop_linklocal, nexthop_linklocal, 16);
     else memset(this->nexthop_linklocal, 0, 16);
     src_router_id = src;
     this->attribs = attribs;
+    nexthop_slot = 0;
 }
 
 /**
@@ -43,16 +44,21 @@ BgpRib6Entry::BgpRib6Entry (Prefix6 r, uint32_t src, const uint8_t nexthop_globa
 BgpRib6::BgpRib6(BgpLogHandler *logger) {
     this->logger = logger;
     update_id = 0;
+    discard_workers = 1;
+    nexthop_tracking = false;
+    use_path_lists = false;
+    path_lists_sweep = BGP_RIB_PATH_LISTS_SWEEP;
 }
 
 rib6_t::iterator BgpRib6::find_entry(const Prefix6 &prefix, uint32_t src) {
+    const Prefix6Value value = prefix.toValue();
     std::pair<rib6_t::iterator, rib6_t::iterator> its = 
         rib.equal_range(BgpRib6EntryKey(prefix));
 
     if (its.first == rib.end()) return rib.end();
 
     for (rib6_t::iterator it = its.first; it != its.second; it++) {
-        if (it->second.route == prefix && it->second.src_router_id == src) {
+        if (it->second.route == value && it->second.src_router_id == src) {
             return it;
         }
     }
@@ -61,6 +67,7 @@ rib6_t::iterator BgpRib6::find_entry(const Prefix6 &prefix, uint32_t src) {
 }
 
 rib6_t::iterator BgpRib6::find_best (const Prefix6 &prefix) {
+    const Prefix6Value value = prefix.toValue();
     std::pair<rib6_t::iterator, rib6_t::iterator> its = 
         rib.equal_range(BgpRib6EntryKey(prefix));
 
@@ -68,7 +75,7 @@ rib6_t::iterator BgpRib6::find_best (const Prefix6 &prefix) {
     if (its.first == rib.end()) return rib.end();
 
     for (rib6_t::iterator it = its.first; it != its.second; it++) {
-        if (it->second.route == prefix) {
+        if (it->second.route == value && it->second.nexthop_reachable) {
             if (best == rib.end()) best = it;
             else {
                 const BgpRib6Entry *best_ptr = selectEntry(&(best->second), &(it->second));
@@ -85,12 +92,14 @@ std::pair<const BgpRib6Entry*, bool> BgpRib6::insertPriv(uint32_t src_router_id,
     const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], 
     const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, 
     int32_t weight, uint32_t ibgp_asn) {
+    const Prefix6Value value = route.toValue();
     std::lock_guard<std::recursive_mutex> lock(mutex);
     BgpRib6Entry new_entry(route, src_router_id, nexthop_global, nexthop_linklocal, attribs);
     new_entry.update_id = update_id;
     new_entry.weight = weight;
     new_entry.src = ibgp_asn > 0 ? SRC_IBGP : SRC_EBGP;
     new_entry.ibgp_peer_asn = ibgp_asn;
+    if (nexthop_tracking) new_entry.nexthop_reachable = isNexthopReachable(nexthop_global);
 
     const char *op = "new_entry";
     const char *act = "new_best";
@@ -108,7 +117,7 @@ std::pair<const BgpRib6Entry*, bool> BgpRib6::insertPriv(uint32_t src_router_id,
         rib6_t::const_iterator to_replace = rib.end();
         BgpRib6Entry *old_best = NULL;
         for (rib6_t::iterator it = entries.first; it != entries.second; it++) {
-            if (it->second.route != route) continue;
+            if (it->second.route != value) continue;
             if (it->second.src_router_id == src_router_id) {
                 to_replace = it;
                 continue;
@@ -135,23 +144,39 @@ std::pair<const BgpRib6Entry*, bool> BgpRib6::insertPriv(uint32_t src_router_id,
             }
             // we need to replace a route
             op = "update";
+            removeLocal(to_replace->second);
+            untrackEntry(to_replace->second);
             rib.erase(to_replace);
         }
 
         rib6_t::iterator inserted = rib.insert(MAKE_ENTRY6(route, new_entry));
+        trackEntry(inserted->second);
 
         if (best_changed) {
             newly_inserted_is_best = candidate == &new_entry;
             new_best = newly_inserted_is_best ? &(inserted->second) : old_best;
         }
 
+    } else if (!new_entry.nexthop_reachable) { // no older route, but new one can't be used
+        new_entry.status = RS_STANDBY;
+        act = "nexthop_unreachable";
+        rib6_t::iterator inserted = rib.insert(MAKE_ENTRY6(route, new_entry));
+        trackEntry(inserted->second);
     } else { // no older route, new one is best
         best_changed = newly_inserted_is_best = true;
         rib6_t::iterator inserted = rib.insert(MAKE_ENTRY6(route, new_entry));
+        trackEntry(inserted->second);
         new_best = &(inserted->second);
     }
 
     if (new_best != NULL) new_best->status = RS_ACTIVE;
+    else if (best_changed) {
+        // the replaced route was the best, and nothing can replace it.
+        act = "unreachabled";
+        newly_inserted_is_best = true;
+    }
+
+    refreshPathList(route);
     
     LIBBGP_LOG(logger, INFO) {
         uint8_t prefix_arr[16];
@@ -170,7 +195,8 @@ std::pair<const BgpRib6Entry*, bool> BgpRib6::insertPriv(uint32_t src_router_id,
  * 
  * Local routes are routes inserted to the RIB by user. The scope (src_router_id)
  * of local routes are 0. This method will create necessary path attribues
- * before inserting entry to RIB (AS_PATH, ORIGIN, NEXT_HOP). 
+ * before inserting entry to RIB (AS_PATH, ORIGIN, NEXT_HOP). Local routes with
+ * the same nexthops share the attributes and the update ID.
  * 
  * The logger pointer passed in is for attribues. (so if a attribute failed to 
  * deserialize, it will print to the provided logger).
@@ -190,39 +216,15 @@ std::pair<const BgpRib6Entry*, bool> BgpRib6::insertPriv(uint32_t src_router_id,
  */
 const BgpRib6Entry* BgpRib6::insert(BgpLogHandler *logger, const Prefix6 &route,
     const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], int32_t weight) {
-    std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
-    BgpPathAttribOrigin *origin = new BgpPathAttribOrigin(logger);
-    BgpPathAttribAsPath *as_path = new BgpPathAttribAsPath(logger, true);
-    origin->origin = IGP;
-
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(origin));
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(as_path));
-
-    BgpRib6Entry new_entry(route, 0, nexthop_global, nexthop_linklocal, attribs);
-    new_entry.weight = weight;
-    uint64_t use_update_id = update_id;
-
-    for (const auto &entry : rib) {
-        if (entry.second.src_router_id == 0 && entry.second.route == route) {
-            this->logger->log(ERROR, "BgpRib6::insert: route exists.\n");
-            return NULL;
-        }
+    std::lock_guard<std::recursive_mutex> lock(mutex);
 
-        // see if we can group this entry to other local entries
-        if (entry.second.src_router_id == 0) {
-            if (memcmp(new_entry.nexthop_global, entry.second.nexthop_global, 16) == 0 &&
-                memcmp(new_entry.nexthop_linklocal, entry.second.nexthop_linklocal, 16) == 0) {
-                use_update_id = entry.second.update_id;
-            }
-        }
+    if (find_entry(route, 0) != rib.end()) {
+        this->logger->log(ERROR, "BgpRib6::insert: route exists.\n");
+        return NULL;
     }
 
-    std::lock_guard<std::recursive_mutex> lock(mutex);
-    new_entry.update_id = use_update_id;
-    if (use_update_id == update_id) update_id++;
-    rib6_t::const_iterator it = rib.insert(MAKE_ENTRY6(route, new_entry));
-
-    return &(it->second);
+    LocalGroupKey key(nexthop_global, nexthop_linklocal);
+    return insertLocal(getLocalGroup(logger, key), route, key, weight);
 }
 
 /**
@@ -243,27 +245,65 @@ const std::vector<BgpRib6Entry> BgpRib6::insert(BgpLogHandler *logger,
         const std::vector<Prefix6> &routes, const uint8_t nexthop_global[16], 
         const uint8_t nexthop_linklocal[16], int32_t weight) {
     std::vector<BgpRib6Entry> inserted;
-    std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
-    BgpPathAttribOrigin *origin = new BgpPathAttribOrigin(logger);
-    BgpPathAttribAsPath *as_path = new BgpPathAttribAsPath(logger, true);
-    origin->origin = IGP;
-
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(origin));
-    attribs.push_back(std::shared_ptr<BgpPathAttrib>(as_path));
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    LocalGroupKey key(nexthop_global, nexthop_linklocal);
+    LocalGroup &group = getLocalGroup(logger, key);
 
     for (const Prefix6 &route : routes) {
         rib6_t::const_iterator it = find_entry(route, 0);
 
         if (it != rib.end()) continue;
 
-        BgpRib6Entry new_entry (route, 0, nexthop_global, nexthop_linklocal, attribs);
-        new_entry.update_id = update_id;
-        new_entry.weight = weight;
-        rib6_t::const_iterator isrt_it = rib.insert(MAKE_ENTRY6(route, new_entry));
-        inserted.push_back(isrt_it->second);
+        inserted.push_back(*insertLocal(group, route, key, weight));
+    }
+
+    return inserted;
+}
+
+/**
+ * @brief Insert local routes with their own nexthops into RIB.
+ * 
+ * Same as the other local inserts, but each route has its own nexthops. Local
+ * routes are indexed by prefix and by nexthops, so the time spent is linear to
+ * the number of routes. Use this to load a large set of static routes.
+ * 
+ * Routes already in RIB as local routes are skipped. Routes with the same
+ * nexthops share their path attributes and update ID, with the local routes
+ * already in RIB too. Routes are usually given sorted by prefix, but they
+ * don't need to be.
+ * 
+ * This SHOULD NOT be called when the any of the upper FSM is running. 
+ * 
+ * @param logger Pointer to logger for the created path attributes to use. 
+ * @param routes Routes.
+ * @param nexthops_global Global IPv6 addresses of nexthops, one for each
+ * route.
+ * @param nexthops_linklocal Link local IPv6 addresses of nexthops, one for 
+ * each route. (if none, use NULL)
+ * @param weight weight of the entries.
+ * @return const std::vector<BgpRib6Entry> Inserted routes.
+ */
+const std::vector<BgpRib6Entry> BgpRib6::insert(BgpLogHandler *logger, 
+        const std::vector<Prefix6> &routes, const uint8_t (*nexthops_global)[16], 
+        const uint8_t (*nexthops_linklocal)[16], int32_t weight) {
+    std::vector<BgpRib6Entry> inserted;
+
+    if (routes.size() > 0 && nexthops_global == NULL) {
+        this->logger->log(ERROR, "BgpRib6::insert: no nexthops given.\n");
+        return inserted;
+    }
+
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    inserted.reserve(routes.size());
+    rib.reserve(rib.size() + routes.size());
+
+    for (size_t i = 0; i < routes.size(); i++) {
+        if (find_entry(routes[i], 0) != rib.end()) continue;
+
+        LocalGroupKey key(nexthops_global[i], nexthops_linklocal == NULL ? NULL : nexthops_linklocal[i]);
+        inserted.push_back(*insertLocal(getLocalGroup(logger, key), routes[i], key, weight));
     }
 
-    update_id++;
     return inserted;
 }
 
@@ -286,6 +326,8 @@ const std::vector<BgpRib6Entry> BgpRib6::insert(BgpLogHandler *logger,
  * in const BgpRib6Entry*.
  * @retval <NULL, false> inserted route is not the new best, and current best
  * has not changed.
+ * @retval <NULL, true> inserted route replaced current best route, and no
+ * route has reachable nexthop now. The route is no longer reachable.
  */
 std::pair<const BgpRib6Entry*, bool> BgpRib6::insert(uint32_t src_router_id, 
     const Prefix6 &route, 
@@ -300,6 +342,9 @@ std::pair<const BgpRib6Entry*, bool> BgpRib6::insert(uint32_t src_router_id,
 /**
  * @brief Insert new entries into RIB.
  * 
+ * This copies every updated entry, use the other insert with output buffers to
+ * avoid the copies.
+ * 
  * @param src_router_id Originating BGP speaker's ID in network bytes order.
  * @param routes List of routes.
  * @param nexthop_global Global IPv6 address of nexthop.
@@ -313,17 +358,54 @@ std::pair<std::vector<BgpRib6Entry>, std::vector<Prefix6>> BgpRib6::insert(
     uint32_t src_router_id, const std::vector<Prefix6> &routes, 
     const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], 
     const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, int32_t weight, uint32_t ibgp_asn) {
+    std::pair<std::vector<BgpRib6Entry>, std::vector<Prefix6>> rslt;
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    std::vector<const BgpRib6Entry*> updated;
+    std::vector<Prefix6> unreach;
+    insert(src_router_id, routes, nexthop_global, nexthop_linklocal, attribs, weight, ibgp_asn, updated, rslt.second, unreach);
+
+    rslt.first.reserve(updated.size());
+    for (const BgpRib6Entry *entry : updated) rslt.first.push_back(*entry);
+
+    return rslt;
+}
+
+/**
+ * @brief Insert new entries into RIB, with one lock acquisition.
+ * 
+ * Results are appended to the output buffers, so the caller can reuse them
+ * for many calls. Updated entries are not copied; the pointers point into the
+ * RIB and stay valid until the RIB is modified again. Hold the RIB lock (see
+ * lock()) across the call and the use of the pointers if other threads may
+ * modify the RIB.
+ * 
+ * @param src_router_id Originating BGP speaker's ID in network bytes order.
+ * @param routes List of routes.
+ * @param nexthop_global Global IPv6 address of nexthop.
+ * @param nexthop_linklocal Link local IPv6 address of nexthop. (if none, use NULL)
+ * @param attrib Path attribute. 
+ * @param weight weight of this entry.
+ * @param ibgp_asn ASN of the peer if the route is from an IBGP peer. 0 if not.
+ * @param updated Output: entries become the best in place of the inserted
+ * routes. (with different attributes then provided)
+ * @param unchanged Output: inserted routes become the best routes.
+ * @param unreach Output: routes no longer reachable, since the inserted routes
+ * replaced the best routes and have unreachable nexthop.
+ */
+void BgpRib6::insert(
+    uint32_t src_router_id, const std::vector<Prefix6> &routes, 
+    const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], 
+    const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, int32_t weight,
+    uint32_t ibgp_asn, std::vector<const BgpRib6Entry*> &updated, std::vector<Prefix6> &unchanged, std::vector<Prefix6> &unreach) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     update_id++;
-    std::vector<BgpRib6Entry> updated;
-    std::vector<Prefix6> unchanged;
     for (const Prefix6 &route : routes) {
         std::pair<const BgpRib6Entry*, bool> rslt = insertPriv(src_router_id, route, nexthop_global, nexthop_linklocal, attribs, weight, ibgp_asn);
         if (rslt.first != NULL) {
-            if (!rslt.second) updated.push_back(*(rslt.first));
+            if (!rslt.second) updated.push_back(rslt.first);
             else unchanged.push_back(route);
-        }
+        } else if (rslt.second) unreach.push_back(route);
     }
-    return std::make_pair(updated, unchanged);
 }
 
 /**
@@ -341,6 +423,58 @@ std::pair<std::vector<BgpRib6Entry>, std::vector<Prefix6>> BgpRib6::insert(
  */
 std::pair<bool, const void*> BgpRib6::withdraw(uint32_t src_router_id, const Prefix6 &route) {
     std::lock_guard<std::recursive_mutex> lock(mutex);
+    return withdrawPriv(src_router_id, route);
+}
+
+/**
+ * @brief Withdraw mutiple routes from RIB.
+ * 
+ * Same as the other withdraw, but this one withdraw mutiple routes with only
+ * one lock acquisition. Replacement entries are not copied; the pointers point
+ * into the RIB and stay valid until the RIB is modified again.
+ * 
+ * @param src_router_id Originating BGP speaker's ID in network bytes order.
+ * @param routes Routes to withdraw.
+ * @return std::pair<std::vector<Prefix6>, std::vector<const BgpRib6Entry*>> 
+ * <unreachabled_routes, replacement_entries> pair. unreachabled_routes should
+ * be send as withdrawn to peers, replacement_entries should be send as update
+ * to peers.
+ */
+std::pair<std::vector<Prefix6>, std::vector<const BgpRib6Entry*>> BgpRib6::withdraw(uint32_t src_router_id, const std::vector<Prefix6> &routes) {
+    std::pair<std::vector<Prefix6>, std::vector<const BgpRib6Entry*>> rslt;
+    rslt.first.reserve(routes.size());
+    withdraw(src_router_id, routes, rslt.first, rslt.second);
+    return rslt;
+}
+
+/**
+ * @brief Withdraw mutiple routes from RIB, with the results appended to output
+ * buffers.
+ * 
+ * Same as the other batch withdraw, but the caller can reuse the buffers for
+ * many calls.
+ * 
+ * @param src_router_id Originating BGP speaker's ID in network bytes order.
+ * @param routes Routes to withdraw.
+ * @param unreach Output: withdrawn routes that are no longer reachable.
+ * @param replacements Output: new best entries of withdrawn routes that are 
+ * still reachable.
+ */
+void BgpRib6::withdraw(uint32_t src_router_id, const std::vector<Prefix6> &routes, std::vector<Prefix6> &unreach, std::vector<const BgpRib6Entry*> &replacements) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    for (const Prefix6 &route : routes) {
+        std::pair<bool, const void*> w_ret = withdrawPriv(src_router_id, route);
+        if (!w_ret.first) {
+            if (w_ret.second == NULL) unreach.push_back(route);
+        } else if (w_ret.second != NULL) {
+            replacements.push_back((const BgpRib6Entry *) w_ret.second);
+        }
+    }
+}
+
+std::pair<bool, const void*> BgpRib6::withdrawPriv(uint32_t src_router_id, const Prefix6 &route) {
+    const Prefix6Value value = route.toValue();
 
     std::pair<rib6_t::iterator, rib6_t::iterator> old_entries = 
         rib.equal_range(BgpRib6EntryKey(route));
@@ -355,7 +489,7 @@ std::pair<bool, const void*> BgpRib6::withdraw(uint32_t src_router_id, const Pre
     rib6_t::const_iterator to_remove = rib.end();
     
     for (rib6_t::iterator it = old_entries.first; it != old_entries.second; it++) {
-        if (it->second.route == route) {
+        if (it->second.route == value) {
             if (it->second.src_router_id == src_router_id) {
                 to_remove = it;
                 continue;
@@ -367,27 +501,31 @@ std::pair<bool, const void*> BgpRib6::withdraw(uint32_t src_router_id, const Pre
     bool reachabled = true;
 
     if (to_remove == rib.end()) 
-        return std::make_pair<bool, const void*>(false, NULL);
+        return std::make_pair<bool, const void*>(false, &route); // not in RIB.
     
-    if (replacement != NULL) {
-        if (to_remove->second.status == RS_ACTIVE) {
-            op = "dropped/best_changed";
-        } else replacement = NULL;
+    if (to_remove->second.status != RS_ACTIVE) {
+        // not the best route (or nexthop unreachable), nothing changes.
+        replacement = NULL;
+    } else if (replacement != NULL) {
+        op = "dropped/best_changed";
     } else {
         reachabled = false;
         op = "dropped/unreachabled";
     }
 
+    removeLocal(to_remove->second);
+    untrackEntry(to_remove->second);
     rib.erase(to_remove);
     if (replacement != NULL) replacement->status = RS_ACTIVE;
+    refreshPathList(route);
 
-    LIBBGP_LOG(logger, INFO) {
+    LIBBGP_LOG(logger, DEBUG) {
         uint8_t prefix_arr[16];
         route.getPrefix(prefix_arr);
         char src_router_id_str[INET_ADDRSTRLEN], prefix_str[INET6_ADDRSTRLEN];
         inet_ntop(AF_INET, &src_router_id, src_router_id_str, INET_ADDRSTRLEN);
         inet_ntop(AF_INET6, prefix_arr, prefix_str, INET6_ADDRSTRLEN);
-        logger->log(INFO, "BgpRib6::withdraw: (%s) scope %s, route %s/%d\n", op, src_router_id_str, prefix_str, route.getLength());
+        logger->log(DEBUG, "BgpRib6::withdraw: (%s) scope %s, route %s/%d\n", op, src_router_id_str, prefix_str, route.getLength());
     }
 
     return std::pair<bool, const BgpRib6Entry*>(reachabled, replacement);
@@ -396,32 +534,49 @@ std::pair<bool, const void*> BgpRib6::withdraw(uint32_t src_router_id, const Pre
 /**
  * @brief Drop all routes from RIB that originated from a BGP speaker.
  * 
+ * This copies every replacement entry, use the other discard with output
+ * buffers to avoid the copies.
+ * 
  * @param src_router_id src_router_id Originating BGP speaker's ID in network bytes order.
  * @return std::pair<std::vector<Prefix6>, std::vector<BgpRib6Entry>> 
  * <dropped_routes, updated_routes> pair. dropped_routes should be send as
  * withdrawn to peers, updated_routes should be send as update to peer.
  */
 std::pair<std::vector<Prefix6>, std::vector<BgpRib6Entry>> BgpRib6::discard(uint32_t src_router_id) {
+    std::pair<std::vector<Prefix6>, std::vector<BgpRib6Entry>> rslt;
     std::lock_guard<std::recursive_mutex> lock(mutex);
-    /*std::vector<Prefix6> dropped_routes;
+    std::vector<const BgpRib6Entry*> replacements;
+    discard(src_router_id, rslt.first, replacements);
 
-    for (rib6_t::const_iterator it = rib.begin(); it != rib.end();) {
-        if (it->second.src_router_id == src_router_id) {
-            dropped_routes.push_back(it->second.route);
-            LIBBGP_LOG(logger, INFO) {
-                    uint8_t prefix_arr[16];
-                    it->second.route.getPrefix(prefix_arr);
-                    char src_router_id_str[INET_ADDRSTRLEN], prefix_str[INET6_ADDRSTRLEN];
-                    inet_ntop(AF_INET, &src_router_id, src_router_id_str, INET_ADDRSTRLEN);
-                    inet_ntop(AF_INET6, prefix_arr, prefix_str, INET6_ADDRSTRLEN);
-                logger->log(INFO, "BgpRib6::discard: (dropped) scope %s, route %s/%d\n", src_router_id_str, prefix_str, it->second.route.getLength());
-            }
-            it = rib.erase(it);
-        } else it++;
-    }*/
+    rslt.second.reserve(replacements.size());
+    for (const BgpRib6Entry *entry : replacements) rslt.second.push_back(*entry);
+
+    return rslt;
+}
 
+/**
+ * @brief Drop all routes from RIB that originated from a BGP speaker, with the
+ * results appended to output buffers.
+ * 
+ * Replacement entries are not copied; the pointers point into the RIB and stay
+ * valid until the RIB is modified again.
+ * 
+ * With more than one discard worker (see setDiscardWorkers()), the best routes
+ * of the dropped prefixes are looked up in parallel. The results are the same,
+ * in the same order, as with one worker.
+ * 
+ * @param src_router_id src_router_id Originating BGP speaker's ID in network bytes order.
+ * @param dropped Output: routes no longer reachable, should be send as
+ * withdrawn to peers.
+ * @param replacements Output: new best entries of the dropped routes that are
+ * still reachable, should be send as update to peers.
+ */
+void BgpRib6::discard(uint32_t src_router_id, std::vector<Prefix6> &dropped, std::vector<const BgpRib6Entry*> &replacements) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
     std::vector<Prefix6> reevaluate_routes;
-    std::vector<Prefix6> dropped_routes;
+
+    // routes with a path from the speaker get new path lists.
+    std::vector<Prefix6> path_list_routes;
 
     for (rib6_t::const_iterator it = rib.begin(); it != rib.end();) {
         const char *op = "dropped/silent";
@@ -433,6 +588,7 @@ std::pair<std::vector<Prefix6>, std::vector<BgpRib6Entry>> BgpRib6::discard(uint
             reevaluate_routes.push_back(it->second.route);
             op = "dropped/pending-reevaluate";
         }
+        if (use_path_lists && it->second.path_list) path_list_routes.push_back(it->second.route);
         LIBBGP_LOG(logger, INFO) {
             uint8_t prefix_arr[16];
             it->second.route.getPrefix(prefix_arr);
@@ -441,21 +597,28 @@ std::pair<std::vector<Prefix6>, std::vector<BgpRib6Entry>> BgpRib6::discard(uint
             inet_ntop(AF_INET6, prefix_arr, prefix_str, INET6_ADDRSTRLEN);
             logger->log(INFO, "BgpRib6::discard: (%s) scope %s, route %s/%d\n", op, src_router_id_str, prefix_str, it->second.route.getLength());
         }
+        removeLocal(it->second);
+        untrackEntry(it->second);
         it = rib.erase(it);
     }
 
-    std::vector<BgpRib6Entry> replacements;
+    // find_best only reads the RIB, and the RIB is locked, so the prefixes can
+    // be re-evaluated concurrently. the replacements are then taken in order.
+    std::vector<rib6_t::iterator> best_entries(reevaluate_routes.size());
+    parallelFor(reevaluate_routes.size(), discard_workers, BGP_RIB_DISCARD_CHUNK, [&](size_t i) {
+        best_entries[i] = find_best(reevaluate_routes[i]);
+    });
 
-    for (std::vector<Prefix6>::const_iterator it = reevaluate_routes.begin(); it != reevaluate_routes.end(); it++) {
+    for (size_t i = 0; i < reevaluate_routes.size(); i++) {
         const char *op = "replacement found";
-        const Prefix6 &prefix = *it;
-        rib6_t::iterator replacement = find_best(prefix);
+        const Prefix6 &prefix = reevaluate_routes[i];
+        rib6_t::iterator replacement = best_entries[i];
         if (replacement == rib.end()) { // no replacement.
-            dropped_routes.push_back(prefix);
+            dropped.push_back(prefix);
             op = "no available replacement";
         } else {
             replacement->second.status = RS_ACTIVE;
-            replacements.push_back(replacement->second);
+            replacements.push_back(&(replacement->second));
         }
 
         LIBBGP_LOG(logger, INFO) {
@@ -468,9 +631,413 @@ std::pair<std::vector<Prefix6>, std::vector<BgpRib6Entry>> BgpRib6::discard(uint
         }
     }
 
-    return std::make_pair(dropped_routes, replacements);
+    // no path list uses the speaker now, its next session starts up.
+    path_states.erase(src_router_id);
+    for (const Prefix6 &route : path_list_routes) refreshPathList(route);
+}
+
+/**
+ * @brief Construct a new key of local route group.
+ * 
+ * @param nexthop_global Global IPv6 address of nexthop.
+ * @param nexthop_linklocal Link local IPv6 address of nexthop. (if none, use NULL)
+ */
+BgpRib6::LocalGroupKey::LocalGroupKey(const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16]) {
+    memcpy(this->nexthop_global, nexthop_global, 16);
+    if (nexthop_linklocal != NULL) memcpy(this->nexthop_linklocal, nexthop_linklocal, 16);
+    else memset(this->nexthop_linklocal, 0, 16);
+}
+
+bool BgpRib6::LocalGroupKey::operator== (const LocalGroupKey &other) const {
+    return memcmp(nexthop_global, other.nexthop_global, 16) == 0 && 
+        memcmp(nexthop_linklocal, other.nexthop_linklocal, 16) == 0;
+}
 
-    // return dropped_routes;
+std::size_t BgpRib6::LocalGroupKeyHash::operator()(const LocalGroupKey &key) const {
+    uint64_t words[4];
+    memcpy(words, key.nexthop_global, 16);
+    memcpy(words + 2, key.nexthop_linklocal, 16);
+    return (words[0] ^ (words[1] * 31)) ^ ((words[2] ^ (words[3] * 31)) * 17);
+}
+
+/**
+ * @brief Get the group of local routes with nexthops, create the group if
+ * there is none.
+ * 
+ * @param logger Pointer to logger for the created path attributes to use. 
+ * @param key The nexthops.
+ * @return LocalGroup& The group.
+ */
+BgpRib6::LocalGroup& BgpRib6::getLocalGroup(BgpLogHandler *logger, const LocalGroupKey &key) {
+    local_groups_t::iterator it = local_groups.find(key);
+    if (it != local_groups.end()) return it->second;
+
+    LocalGroup &group = local_groups[key];
+    // increase before use, like the other inserts do, so no route from the 
+    // other inserts has the update ID of a group.
+    group.update_id = ++update_id;
+    group.size = 0;
+
+    BgpPathAttribOrigin *origin = new BgpPathAttribOrigin(logger);
+    BgpPathAttribAsPath *as_path = new BgpPathAttribAsPath(logger, true);
+    origin->origin = IGP;
+
+    group.attribs.push_back(std::shared_ptr<BgpPathAttrib>(origin));
+    group.attribs.push_back(std::shared_ptr<BgpPathAttrib>(as_path));
+
+    return group;
+}
+
+/**
+ * @brief Insert a local route of a group into RIB. The caller must make sure
+ * the route is not in RIB as local route.
+ * 
+ * @param group The group.
+ * @param route The route.
+ * @param key The nexthops of the group.
+ * @param weight weight of this entry.
+ * @return const BgpRib6Entry* Inserted route.
+ */
+const BgpRib6Entry* BgpRib6::insertLocal(LocalGroup &group, const Prefix6 &route, const LocalGroupKey &key, int32_t weight) {
+    BgpRib6Entry new_entry(route, 0, key.nexthop_global, key.nexthop_linklocal, group.attribs);
+    new_entry.update_id = group.update_id;
+    new_entry.weight = weight;
+    if (nexthop_tracking && !isNexthopReachable(key.nexthop_global)) {
+        new_entry.nexthop_reachable = false;
+        new_entry.status = RS_STANDBY;
+    }
+    group.size++;
+
+    rib6_t::iterator it = rib.insert(MAKE_ENTRY6(route, new_entry));
+    trackEntry(it->second);
+    refreshPathList(route);
+    return &(it->second);
+}
+
+/**
+ * @brief Remove an entry from the local route groups. This must be called 
+ * before an entry is removed from RIB.
+ * 
+ * @param entry The entry. Entries that are not local routes are ignored.
+ */
+void BgpRib6::removeLocal(const BgpRib6Entry &entry) {
+    if (entry.src_router_id != 0) return;
+
+    local_groups_t::iterator group = local_groups.find(LocalGroupKey(entry.nexthop_global, entry.nexthop_linklocal));
+
+    // routes inserted with insert(src_router_id = 0, ...) are in no group.
+    if (group != local_groups.end() && group->second.update_id == entry.update_id) {
+        if (--group->second.size == 0) local_groups.erase(group);
+    }
+}
+
+/**
+ * @brief Build the lists of entries using the nexthops, if not built yet.
+ * 
+ */
+void BgpRib6::enableNexthopTracking() {
+    if (nexthop_tracking) return;
+    nexthop_tracking = true;
+
+    for (std::pair<const BgpRib6EntryKey, BgpRib6Entry> &kv : rib) trackEntry(kv.second);
+}
+
+/**
+ * @brief Add an entry in RIB to the list of entries using its global nexthop.
+ * 
+ * @param entry The entry.
+ */
+void BgpRib6::trackEntry(BgpRib6Entry &entry) {
+    if (!nexthop_tracking) return;
+
+    TrackedNexthop &tracked = nexthops[NexthopKey(entry.nexthop_global)];
+    entry.nexthop_slot = tracked.entries.size();
+    tracked.entries.push_back(&entry);
+}
+
+/**
+ * @brief Remove an entry to be erased from the list of entries using its
+ * global nexthop.
+ * 
+ * @param entry The entry.
+ */
+void BgpRib6::untrackEntry(const BgpRib6Entry &entry) {
+    if (!nexthop_tracking) return;
+
+    nexthops_t::iterator it = nexthops.find(NexthopKey(entry.nexthop_global));
+    if (it == nexthops.end()) return;
+
+    // move the last entry to the slot of the removed one.
+    std::vector<BgpRib6Entry*> &entries = it->second.entries;
+    BgpRib6Entry *last = entries.back();
+    entries[entry.nexthop_slot] = last;
+    last->nexthop_slot = entry.nexthop_slot;
+    entries.pop_back();
+
+    // keep unreachable nexthops, they apply to routes inserted later too.
+    if (entries.size() == 0 && it->second.reachable) nexthops.erase(it);
+}
+
+/**
+ * @brief Select the best route of a prefix again.
+ * 
+ * @param route The prefix.
+ * @param unreach Output: the prefix, if it is no longer reachable.
+ * @param updated Output: the new best entry, if the best entry changed.
+ */
+void BgpRib6::reselect(const Prefix6 &route, std::vector<Prefix6> &unreach, std::vector<const BgpRib6Entry*> &updated) {
+    const Prefix6Value value = route.toValue();
+    std::pair<rib6_t::iterator, rib6_t::iterator> entries = rib.equal_range(BgpRib6EntryKey(route));
+
+    BgpRib6Entry *best = NULL;
+    bool had_best = false;
+    for (rib6_t::iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.route != value) continue;
+        if (it->second.status == RS_ACTIVE) had_best = true;
+        best = selectEntry(best, &(it->second));
+    }
+
+    bool best_changed = best != NULL && best->status != RS_ACTIVE;
+    for (rib6_t::iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.route == value && &(it->second) != best) it->second.status = RS_STANDBY;
+    }
+
+    if (best != NULL) {
+        best->status = RS_ACTIVE;
+        if (best_changed) updated.push_back(best);
+    } else if (had_best) unreach.push_back(route);
+
+    refreshPathList(route);
+
+    LIBBGP_LOG(logger, DEBUG) {
+        uint8_t prefix_arr[16];
+        route.getPrefix(prefix_arr);
+        char prefix_str[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, prefix_arr, prefix_str, INET6_ADDRSTRLEN);
+        const char *op = best_changed ? "best_changed" : (best == NULL && had_best ? "unreachabled" : "no_change");
+        logger->log(DEBUG, "BgpRib6::reselect: (%s) route %s/%d\n", op, prefix_str, route.getLength());
+    }
+}
+
+/**
+ * @brief Mark a global nexthop reachable or unreachable.
+ * 
+ * Call this when an IGP or link event changes the reachability of a nexthop.
+ * Routes with unreachable global nexthop stay in the RIB, but are never
+ * selected as the best route. Only routes using the nexthop are selected
+ * again: the RIB keeps a list of entries for every global nexthop. The lists
+ * are built the first time a nexthop is marked unreachable, and kept updated
+ * since then.
+ * 
+ * Nexthops are reachable unless marked unreachable. Results are appended to
+ * the output buffers. Updated entries are not copied; the pointers point into
+ * the RIB and stay valid until the RIB is modified again.
+ * 
+ * @param nexthop The global IPv6 nexthop in network byte order.
+ * @param reachable Reachability of the nexthop.
+ * @param unreach Output: routes no longer reachable, should be send as
+ * withdrawn to peers.
+ * @param updated Output: new best entries of routes, should be send as update
+ * to peers.
+ */
+void BgpRib6::setNexthopReachable(const uint8_t nexthop[16], bool reachable, std::vector<Prefix6> &unreach, std::vector<const BgpRib6Entry*> &updated) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    // all nexthops are reachable until one is marked unreachable.
+    if (!nexthop_tracking && reachable) return;
+    enableNexthopTracking();
+
+    NexthopKey key(nexthop);
+    TrackedNexthop &tracked = nexthops[key];
+    if (tracked.entries.size() == 0 && reachable) {
+        nexthops.erase(key);
+        return;
+    }
+
+    if (tracked.reachable == reachable) return;
+    tracked.reachable = reachable;
+
+    LIBBGP_LOG(logger, INFO) {
+        char nexthop_str[INET6_ADDRSTRLEN];
+        inet_ntop(AF_INET6, nexthop, nexthop_str, INET6_ADDRSTRLEN);
+        logger->log(INFO, "BgpRib6::setNexthopReachable: nexthop %s is now %s, %zu routes affected.\n", nexthop_str, reachable ? "reachable" : "unreachable", tracked.entries.size());
+    }
+
+    for (BgpRib6Entry *entry : tracked.entries) entry->nexthop_reachable = reachable;
+
+    // routes with more than one entry using the nexthop are selected again
+    // more than once, but only the first one can change the best route.
+    for (BgpRib6Entry *entry : tracked.entries) reselect(entry->route, unreach, updated);
+}
+
+/**
+ * @brief Mark a global nexthop reachable or unreachable, and publish the
+ * changed routes on the event bus.
+ * 
+ * Same as the other setNexthopReachable, but the changes are published with a
+ * Route6WithdrawEvent and a Route6AddEvent, so the FSMs on the bus send them
+ * to their peers. The events are published after the RIB is unlocked, with
+ * copies of the changed entries.
+ * 
+ * @param nexthop The global IPv6 nexthop in network byte order.
+ * @param reachable Reachability of the nexthop.
+ * @param rev_bus The event bus.
+ * @return size_t Number of changed routes.
+ */
+size_t BgpRib6::setNexthopReachable(const uint8_t nexthop[16], bool reachable, RouteEventBus *rev_bus) {
+    std::vector<Prefix6> unreach;
+    std::vector<const BgpRib6Entry*> updated;
+    std::vector<BgpRib6Entry> snapshot;
+
+    {
+        std::lock_guard<std::recursive_mutex> lock(mutex);
+        setNexthopReachable(nexthop, reachable, unreach, updated);
+        if (rev_bus != NULL) snapshotEntries(updated, snapshot);
+    }
+
+    if (rev_bus != NULL && unreach.size() > 0) {
+        Route6WithdrawEvent wev;
+        wev.routes = &unreach;
+        rev_bus->publish(NULL, wev);
+    }
+
+    if (rev_bus != NULL && updated.size() > 0) {
+        Route6AddEvent aev;
+        aev.replaced_entries = &updated;
+        rev_bus->publish(NULL, aev);
+    }
+
+    return unreach.size() + updated.size();
+}
+
+/**
+ * @brief Test if a global nexthop is reachable.
+ * 
+ * @param nexthop The global IPv6 nexthop in network byte order.
+ * @return true The nexthop is reachable.
+ * @return false The nexthop has been marked unreachable.
+ */
+bool BgpRib6::isNexthopReachable(const uint8_t nexthop[16]) const {
+    nexthops_t::const_iterator it = nexthops.find(NexthopKey(nexthop));
+    return it == nexthops.end() || it->second.reachable;
+}
+
+BgpRib6::NexthopKey::NexthopKey(const uint8_t nexthop[16]) {
+    memcpy(this->nexthop, nexthop, 16);
+}
+
+bool BgpRib6::NexthopKey::operator== (const NexthopKey &other) const {
+    return memcmp(nexthop, other.nexthop, 16) == 0;
+}
+
+std::size_t BgpRib6::NexthopKeyHash::operator()(const NexthopKey &key) const {
+    uint64_t words[2];
+    memcpy(words, key.nexthop, 16);
+    return words[0] ^ (words[1] * 31);
+}
+
+bool BgpRib6::PathListKey::operator== (const PathListKey &other) const {
+    if (n_paths != other.n_paths) return false;
+    for (size_t i = 0; i < n_paths; i++) {
+        if (src_router_id[i] != other.src_router_id[i] ||
+            memcmp(nexthop_global[i], other.nexthop_global[i], 16) != 0 ||
+            memcmp(nexthop_linklocal[i], other.nexthop_linklocal[i], 16) != 0) return false;
+    }
+
+    return true;
+}
+
+std::size_t BgpRib6::PathListKeyHash::operator()(const PathListKey &key) const {
+    uint64_t h = key.n_paths;
+    for (size_t i = 0; i < key.n_paths; i++) {
+        uint64_t words[2];
+        memcpy(words, key.nexthop_global[i], 16);
+        h = h * 31 + (words[0] ^ (words[1] * 31)) + key.src_router_id[i];
+    }
+
+    return h ^ (h >> 29);
+}
+
+/**
+ * @brief Update the path list of a prefix after its entries changed.
+ * 
+ * @param route The prefix.
+ */
+void BgpRib6::refreshPathList(const Prefix6 &route) {
+    const Prefix6Value value = route.toValue();
+    if (!use_path_lists) return;
+
+    std::pair<rib6_t::iterator, rib6_t::iterator> entries = rib.equal_range(BgpRib6EntryKey(route));
+
+    const BgpRib6Entry *primary = NULL;
+    for (rib6_t::iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.route == value && it->second.status == RS_ACTIVE) primary = selectEntry(primary, &(it->second));
+    }
+
+    // the backup is the best route from another speaker, see BgpRib4.
+    const BgpRib6Entry *backup = NULL;
+    if (primary != NULL) {
+        for (rib6_t::iterator it = entries.first; it != entries.second; it++) {
+            if (it->second.route == value && it->second.src_router_id != primary->src_router_id) backup = selectEntry(backup, &(it->second));
+        }
+    }
+
+    std::shared_ptr<const BgpPathList6> path_list;
+    if (primary != NULL) path_list = getPathList(primary, backup);
+
+    for (rib6_t::iterator it = entries.first; it != entries.second; it++) {
+        if (it->second.route == value) it->second.path_list = path_list;
+    }
+}
+
+/**
+ * @brief Get the path list with the given primary and backup paths, create
+ * one if no prefix is using such path list.
+ * 
+ * @param primary The best entry.
+ * @param backup The backup entry. (NULL-able)
+ * @return std::shared_ptr<const BgpPathList6> The path list.
+ */
+std::shared_ptr<const BgpPathList6> BgpRib6::getPathList(const BgpRib6Entry *primary, const BgpRib6Entry *backup) {
+    const BgpRib6Entry *selected[2] = { primary, backup };
+
+    PathListKey key;
+    key.n_paths = backup == NULL ? 1 : 2;
+    for (size_t i = 0; i < key.n_paths; i++) {
+        key.src_router_id[i] = selected[i]->src_router_id;
+        memcpy(key.nexthop_global[i], selected[i]->nexthop_global, 16);
+        memcpy(key.nexthop_linklocal[i], selected[i]->nexthop_linklocal, 16);
+    }
+
+    std::weak_ptr<const BgpPathList6> &cached = path_lists[key];
+    std::shared_ptr<const BgpPathList6> path_list = cached.lock();
+    if (path_list) return path_list;
+
+    std::vector<BgpPath6> paths(key.n_paths);
+    for (size_t i = 0; i < key.n_paths; i++) {
+        std::shared_ptr<BgpPathState> &state = path_states[key.src_router_id[i]];
+        if (!state) state = std::make_shared<BgpPathState>();
+
+        paths[i].src_router_id = key.src_router_id[i];
+        memcpy(paths[i].nexthop_global, key.nexthop_global[i], 16);
+        memcpy(paths[i].nexthop_linklocal, key.nexthop_linklocal[i], 16);
+        paths[i].state = state;
+    }
+
+    path_list = std::make_shared<const BgpPathList6>(paths);
+    cached = path_list;
+
+    // remove the path lists no prefix is using.
+    if (path_lists.size() >= path_lists_sweep) {
+        for (path_lists_t::iterator it = path_lists.begin(); it != path_lists.end();) {
+            if (it->second.expired()) it = path_lists.erase(it);
+            else it++;
+        }
+
+        path_lists_sweep = std::max((size_t) BGP_RIB_PATH_LISTS_SWEEP, path_lists.size() * 2);
+    }
+
+    return path_list;
 }
 
 /**
@@ -486,8 +1053,8 @@ const BgpRib6Entry* BgpRib6::lookup(const uint8_t dest[16]) const {
 
     for (const auto &entry : rib) {
         if (entry.second.status != RS_ACTIVE) continue;
-        const Prefix6 &route = entry.second.route;
-        if (route.includes(dest)) 
+        const Prefix6Value &route = entry.second.route;
+        if (Prefix6::Includes(route.prefix, route.length, dest)) 
             selected_entry = selectEntry(&entry.second, selected_entry);
     }
 
@@ -512,14 +1079,101 @@ const BgpRib6Entry* BgpRib6::lookup(uint32_t src_router_id, const uint8_t dest[1
     for (const auto &entry : rib) {
         if (entry.second.status != RS_ACTIVE) continue;
         if (entry.second.src_router_id != src_router_id) continue;
-        const Prefix6 &route = entry.second.route;
-        if (route.includes(dest)) 
+        const Prefix6Value &route = entry.second.route;
+        if (Prefix6::Includes(route.prefix, route.length, dest)) 
             selected_entry = selectEntry(&entry.second, selected_entry);
     }
 
     return selected_entry;
 }
 
+/**
+ * @brief Set the number of threads discard() uses to find the replacements of
+ * the dropped routes.
+ * 
+ * @param n_workers Number of threads, including the calling one. 1 (the
+ * default) for no extra threads, 0 for one thread per CPU.
+ */
+void BgpRib6::setDiscardWorkers(size_t n_workers) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (n_workers == 0) n_workers = std::thread::hardware_concurrency();
+    discard_workers = n_workers > 0 ? n_workers : 1;
+}
+
+/**
+ * @brief Enable or disable shared path lists.
+ * 
+ * Same as BgpRib4::setPathLists(). The paths of the path lists have both the
+ * global and the link local nexthops.
+ * 
+ * @param enabled Enable path lists.
+ */
+void BgpRib6::setPathLists(bool enabled) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+    if (use_path_lists == enabled) return;
+    use_path_lists = enabled;
+
+    if (enabled) {
+        for (std::pair<const BgpRib6EntryKey, BgpRib6Entry> &kv : rib) {
+            if (kv.second.status == RS_ACTIVE && !kv.second.path_list) refreshPathList(kv.second.route);
+        }
+
+        return;
+    }
+
+    for (std::pair<const BgpRib6EntryKey, BgpRib6Entry> &kv : rib) kv.second.path_list.reset();
+    path_lists.clear();
+    path_states.clear();
+    path_lists_sweep = BGP_RIB_PATH_LISTS_SWEEP;
+}
+
+/**
+ * @brief Switch the path lists using a speaker to their backup paths.
+ * 
+ * Same as BgpRib4::failover(). Call discard() with the same speaker after this
+ * to select the best routes again.
+ * 
+ * @param src_router_id Originating BGP speaker's ID in network bytes order.
+ * @return true Paths from the speaker marked down.
+ * @return false No path list uses the speaker, or path lists are not enabled.
+ */
+bool BgpRib6::failover(uint32_t src_router_id) {
+    std::lock_guard<std::recursive_mutex> lock(mutex);
+
+    std::unordered_map<uint32_t, std::shared_ptr<BgpPathState>>::iterator it = path_states.find(src_router_id);
+    if (it == path_states.end()) return false;
+
+    it->second->setUp(false);
+
+    LIBBGP_LOG(logger, INFO) {
+        char src_router_id_str[INET_ADDRSTRLEN];
+        inet_ntop(AF_INET, &src_router_id, src_router_id_str, INET_ADDRSTRLEN);
+        logger->log(INFO, "BgpRib6::failover: paths from %s are now down.\n", src_router_id_str);
+    }
+
+    return true;
+}
+
+/**
+ * @brief Lock the RIB.
+ * 
+ * The lock is recursive and is the one taken by every RIB operation. Hold it
+ * to keep entry pointers returned by the RIB valid while other threads may
+ * modify the RIB. BgpRib6 is BasicLockable, so std::lock_guard<BgpRib6> works.
+ * 
+ */
+void BgpRib6::lock() {
+    mutex.lock();
+}
+
+/**
+ * @brief Unlock the RIB.
+ * 
+ */
+void BgpRib6::unlock() {
+    mutex.unlock();
+}
+
 /**
  * @brief Get the RIB.
  * 
@@ -19,6 +19,7 @@
 #include "bgp-rib.h"
 #include "prefix6.h"
 #include "bgp-path-attrib.h"
+#include "bgp-path-list.h"
 #include "route-event-bus.h"
 
 namespace libbgp {
@@ -33,15 +34,19 @@ public:
     BgpRib6EntryKey(const Prefix6 &prefix) {
         prefix.getPrefix(this->prefix);
         length = prefix.getLength();
-
-        uint64_t prefix_pre = 0;
-        memcpy(&prefix_pre, this->prefix, 8);
-        hash = prefix_pre;
+        memcpy(&hash, this->prefix, 8);
+    }
+    BgpRib6EntryKey(const Prefix6Value &prefix) {
+        memcpy(this->prefix, prefix.prefix, 16);
+        length = prefix.length;
+        memcpy(&hash, this->prefix, 8);
     }
 
     bool operator== (const BgpRib6EntryKey &other) const {
-        return memcmp(other.prefix, prefix, 16) == 0 && 
-            length == other.length;
+        uint64_t words[2], other_words[2];
+        memcpy(words, prefix, 16);
+        memcpy(other_words, other.prefix, 16);
+        return ((words[0] ^ other_words[0]) | (words[1] ^ other_words[1])) == 0 && length == other.length;
     }
 
     uint8_t prefix[16];
@@ -70,10 +75,11 @@ public:
         const std::vector<std::shared_ptr<BgpPathAttrib>> attribs);
 
     /**
-     * @brief The prefix of this entry.
+     * @brief The prefix of this entry, as a value. Use Prefix6(route) where a
+     * Prefix6 is needed.
      * 
      */
-    Prefix6 route;
+    Prefix6Value route;
 
     /**
      * @brief Global IPv6 address of the next hop in network btyes order.
@@ -87,6 +93,20 @@ public:
      * 
      */
     uint8_t nexthop_linklocal[16];
+
+    /**
+     * @brief Primary and backup paths of the prefix, shared with other prefixes
+     * using the same paths. NULL if path lists are not enabled (see
+     * BgpRib6::setPathLists()), or the prefix has no best route.
+     * 
+     */
+    std::shared_ptr<const BgpPathList6> path_list;
+
+private:
+    friend class BgpRib6;
+
+    // position of this entry in the list of entries using its global nexthop.
+    size_t nexthop_slot;
 };
 
 typedef std::unordered_multimap<BgpRib6EntryKey, BgpRib6Entry, BgpRib6EntryHash> rib6_t;
@@ -108,10 +128,16 @@ public:
         const std::vector<Prefix6> &routes, const uint8_t nexthop_global[16], 
         const uint8_t nexthop_linklocal[16], int32_t weight = 0);
 
+    // insert local routes with their own nexthops, in time linear to number of routes.
+    const std::vector<BgpRib6Entry> insert(BgpLogHandler *logger, 
+        const std::vector<Prefix6> &routes, const uint8_t (*nexthops_global)[16], 
+        const uint8_t (*nexthops_linklocal)[16], int32_t weight = 0);
+
     // insert a new route into RIB, return BgpRib6Entry that should be send to other peers.
     // <NULL, false> if a better route is already exist
     // <BgpRib6Entry*, false> if inserted route replaced current best route, and another route become the new best
     // <BgpRib6Entry*, true> if inserted route become the new best route
+    // <NULL, true> if inserted route replaced current best route, and no route has reachable nexthop now
     std::pair<const BgpRib6Entry*, bool> insert(uint32_t src_router_id, 
         const Prefix6 &route, 
         const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], 
@@ -127,11 +153,32 @@ public:
         const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight,
         uint32_t ibgp_asn);
 
+    // insert new routes w/ common attribs, append results to caller's buffers w/o copying entries.
+    void insert(
+        uint32_t src_router_id, const std::vector<Prefix6> &routes, 
+        const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], 
+        const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, int32_t weight,
+        uint32_t ibgp_asn, std::vector<const BgpRib6Entry*> &updated, std::vector<Prefix6> &unchanged, std::vector<Prefix6> &unreach);
+
     // remove a route from RIB
     std::pair<bool, const void*> withdraw(uint32_t src_router_id, const Prefix6 &route);
 
+    // remove routes from RIB w/ one lock, return <unreachabled routes, replacement entries>.
+    std::pair<std::vector<Prefix6>, std::vector<const BgpRib6Entry*>> withdraw(uint32_t src_router_id, const std::vector<Prefix6> &routes);
+    void withdraw(uint32_t src_router_id, const std::vector<Prefix6> &routes, std::vector<Prefix6> &unreach, std::vector<const BgpRib6Entry*> &replacements);
+
     // remove all routes from a peer, return <unreachabled routes, updated_routes>.
     std::pair<std::vector<Prefix6>, std::vector<BgpRib6Entry>> discard(uint32_t src_router_id);
+    void discard(uint32_t src_router_id, std::vector<Prefix6> &dropped, std::vector<const BgpRib6Entry*> &replacements);
+
+    // mark a global nexthop reachable or unreachable, select best routes again for the routes using it.
+    void setNexthopReachable(const uint8_t nexthop[16], bool reachable, std::vector<Prefix6> &unreach, std::vector<const BgpRib6Entry*> &updated);
+
+    // same as above, and publish the changes on the event bus.
+    size_t setNexthopReachable(const uint8_t nexthop[16], bool reachable, RouteEventBus *rev_bus);
+
+    // test if a global nexthop is reachable.
+    bool isNexthopReachable(const uint8_t nexthop[16]) const;
 
     // lookup in rib, return null if not found
     const BgpRib6Entry* lookup(const uint8_t dest[16]) const;
@@ -141,7 +188,80 @@ public:
 
     // get RIB
     const rib6_t &get() const;
+
+    // set number of threads used by discard to re-evaluate the dropped routes.
+    void setDiscardWorkers(size_t n_workers);
+
+    // enable or disable shared primary/backup path lists of the best routes.
+    void setPathLists(bool enabled);
+
+    // switch the path lists using a peer to their backup paths, before the routes are discarded.
+    bool failover(uint32_t src_router_id);
+
+    // lock the RIB, so entry pointers returned by the RIB stay valid.
+    void lock();
+    void unlock();
 private:
+    // nexthops of local routes.
+    struct LocalGroupKey {
+        LocalGroupKey(const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16]);
+        bool operator== (const LocalGroupKey &other) const;
+
+        uint8_t nexthop_global[16];
+        uint8_t nexthop_linklocal[16];
+    };
+
+    struct LocalGroupKeyHash {
+        std::size_t operator()(const LocalGroupKey &key) const;
+    };
+
+    // local routes with the same nexthops: they share update ID and attributes.
+    struct LocalGroup {
+        uint64_t update_id;
+        size_t size;
+        std::vector<std::shared_ptr<BgpPathAttrib>> attribs;
+    };
+
+    typedef std::unordered_map<LocalGroupKey, LocalGroup, LocalGroupKeyHash> local_groups_t;
+
+    // global nexthop of routes.
+    struct NexthopKey {
+        NexthopKey(const uint8_t nexthop[16]);
+        bool operator== (const NexthopKey &other) const;
+
+        uint8_t nexthop[16];
+    };
+
+    struct NexthopKeyHash {
+        std::size_t operator()(const NexthopKey &key) const;
+    };
+
+    // entries using a global nexthop, and reachability of the nexthop.
+    struct TrackedNexthop {
+        TrackedNexthop() : reachable(true) {}
+
+        bool reachable;
+        std::vector<BgpRib6Entry*> entries;
+    };
+
+    typedef std::unordered_map<NexthopKey, TrackedNexthop, NexthopKeyHash> nexthops_t;
+
+    // paths of a path list: primary, and backup if n_paths is 2.
+    struct PathListKey {
+        bool operator== (const PathListKey &other) const;
+
+        size_t n_paths;
+        uint32_t src_router_id[2];
+        uint8_t nexthop_global[2][16];
+        uint8_t nexthop_linklocal[2][16];
+    };
+
+    struct PathListKeyHash {
+        std::size_t operator()(const PathListKey &key) const;
+    };
+
+    typedef std::unordered_map<PathListKey, std::weak_ptr<const BgpPathList6>, PathListKeyHash> path_lists_t;
+
     rib6_t::iterator find_best (const Prefix6 &prefix);
     rib6_t::iterator find_entry (const Prefix6 &prefix, uint32_t src);
 
@@ -150,9 +270,27 @@ private:
         const uint8_t nexthop_global[16], const uint8_t nexthop_linklocal[16], 
         const std::vector<std::shared_ptr<BgpPathAttrib>> &attrib, 
         int32_t weight, uint32_t ibgp_asn);
+    std::pair<bool, const void*> withdrawPriv(uint32_t src_router_id, const Prefix6 &route);
+    LocalGroup& getLocalGroup(BgpLogHandler *logger, const LocalGroupKey &key);
+    const BgpRib6Entry* insertLocal(LocalGroup &group, const Prefix6 &route, const LocalGroupKey &key, int32_t weight);
+    void removeLocal(const BgpRib6Entry &entry);
+    void enableNexthopTracking();
+    void trackEntry(BgpRib6Entry &entry);
+    void untrackEntry(const BgpRib6Entry &entry);
+    void reselect(const Prefix6 &route, std::vector<Prefix6> &unreach, std::vector<const BgpRib6Entry*> &updated);
+    void refreshPathList(const Prefix6 &route);
+    std::shared_ptr<const BgpPathList6> getPathList(const BgpRib6Entry *primary, const BgpRib6Entry *backup);
 
     rib6_t rib;
+    local_groups_t local_groups;
+    nexthops_t nexthops;
+    bool nexthop_tracking;
+    path_lists_t path_lists;
+    std::unordered_map<uint32_t, std::shared_ptr<BgpPathState>> path_states;
+    size_t path_lists_sweep;
+    bool use_path_lists;
     std::recursive_mutex mutex;
+    size_t discard_workers;
     BgpLogHandler *logger;
     uint64_t update_id;
 };
@@ -0,0 +1,547 @@
+/**
+ * @file bgp-roa-table.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief RPKI route origin validation.
+ * @version 0.1
+ * @date 2019-08-08
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include <algorithm>
+#include <mutex>
+#include "bgp-roa-table.h"
+#include "prefix-trie.h"
+
+namespace libbgp {
+
+/**
+ * @brief Path-compressed trie of VRPs for one address family.
+ * 
+ * Only nodes where prefixes branch or end are stored. VRPs on the same prefix
+ * are stored next to each other, and the node of the prefix points to them.
+ * 
+ * @tparam N Size of the address in bytes.
+ */
+template <size_t N>
+class BgpRoaTrie {
+public:
+    BgpRoaTrie() : trie(BlankNode()) {}
+
+    // add VRPs of a prefix. each prefix must only be added once.
+    void insert(const uint8_t *prefix, uint8_t length, const std::vector<BgpVrp>::const_iterator &begin, const std::vector<BgpVrp>::const_iterator &end) {
+        uint32_t node = trie.insert(prefix, length);
+        std::vector<Node> &nodes = trie.nodes;
+        nodes[node].first = vrps.size();
+        nodes[node].count = end - begin;
+
+        for (std::vector<BgpVrp>::const_iterator it = begin; it != end; it++) {
+            Vrp vrp;
+            vrp.asn = it->asn;
+            vrp.max_length = it->max_length;
+            vrps.push_back(vrp);
+        }
+    }
+
+    BgpRpkiState validate(const uint8_t *prefix, uint8_t length, uint32_t origin) const {
+        const std::vector<Node> &nodes = trie.nodes;
+        uint32_t start = length >= JUMP_BITS && jump.size() > 0 ? jump[(prefix[0] << 8) | prefix[1]] : 0;
+
+        // deepest node with VRPs covering the route. ancestors of the start
+        // node all cover the route.
+        uint32_t deepest = nodes[start].cover;
+
+        trie.walk(prefix, length, start, [&](uint32_t cur) {
+            if (nodes[cur].count > 0) deepest = cur;
+            return false;
+        });
+
+        if (deepest == NO_NODE) return RPKI_NOT_FOUND;
+        if (origin == 0) return RPKI_INVALID;
+
+        for (uint32_t n = deepest; n != NO_NODE; n = nodes[n].cover) {
+            const Node &node = nodes[n];
+            for (uint32_t i = node.first; i < node.first + node.count; i++) {
+                if (vrps[i].asn == origin && length <= vrps[i].max_length) return RPKI_VALID;
+            }
+        }
+
+        return RPKI_INVALID;
+    }
+
+    // link nodes to their covering VRPs, and build the jump table. called once
+    // after all inserts.
+    void finalize() {
+        std::vector<Node> &nodes = trie.nodes;
+        nodes.shrink_to_fit();
+        vrps.shrink_to_fit();
+
+        linkCover(0);
+
+        // not worth it for small tries.
+        if (nodes.size() < 1024) return;
+
+        jump.resize(1 << JUMP_BITS);
+        uint8_t key[N];
+        memset(key, 0, N);
+
+        for (uint32_t i = 0; i < jump.size(); i++) {
+            key[0] = i >> 8;
+            key[1] = i & 0xff;
+
+            uint32_t cur = 0;
+            while (nodes[cur].length < JUMP_BITS) {
+                uint32_t next = nodes[cur].child[getBit(key, nodes[cur].length)];
+                if (next == 0 || nodes[next].length > JUMP_BITS) break;
+                if (commonLength(key, nodes[next].prefix, nodes[next].length) < nodes[next].length) break;
+                cur = next;
+            }
+
+            jump[i] = cur;
+        }
+    }
+
+private:
+    struct Node {
+        uint8_t prefix[N];
+        uint8_t length;
+        uint32_t child[2];
+        uint32_t first;
+        uint32_t count;
+        uint32_t cover; // closest ancestor with VRPs, or NO_NODE.
+    };
+
+    struct Vrp {
+        uint32_t asn;
+        uint8_t max_length;
+    };
+
+    static Node BlankNode() {
+        Node node;
+        memset(&node, 0, sizeof(Node));
+        node.cover = NO_NODE;
+        return node;
+    }
+
+    void linkCover(uint32_t root) {
+        std::vector<Node> &nodes = trie.nodes;
+        std::vector<uint32_t> stack;
+        stack.push_back(root);
+
+        while (stack.size() > 0) {
+            uint32_t cur = stack.back();
+            stack.pop_back();
+
+            uint32_t cover = nodes[cur].count > 0 ? cur : nodes[cur].cover;
+            for (uint8_t bit = 0; bit < 2; bit++) {
+                uint32_t child = nodes[cur].child[bit];
+                if (child == 0) continue;
+                nodes[child].cover = cover;
+                stack.push_back(child);
+            }
+        }
+    }
+
+    static const uint32_t NO_NODE = 0xffffffff;
+
+    // the jump table is indexed with the first two bytes of the prefix.
+    static const uint8_t JUMP_BITS = 16;
+
+    PrefixTrie<N, Node> trie;
+    std::vector<Vrp> vrps;
+
+    // node to start the walk from, for each value of the leading bits.
+    std::vector<uint32_t> jump;
+};
+
+/**
+ * @brief A version of the VRP set.
+ * 
+ */
+struct BgpRoaData {
+    std::vector<BgpVrp> vrps; // sorted.
+    BgpRoaTrie<4> trie4;
+    BgpRoaTrie<16> trie6;
+};
+
+/**
+ * @brief The VRP set shared by copies of a BgpRoaTable.
+ * 
+ */
+struct BgpRoaSlot {
+    std::mutex update_mutex;
+    std::shared_ptr<const BgpRoaData> data;
+};
+
+/**
+ * @brief Compare two VRPs, by address family, prefix, length, max length,
+ * and ASN.
+ * 
+ * @param other The other VRP.
+ * @retval true This VRP goes first.
+ * @retval false This VRP does not go first.
+ */
+bool BgpVrp::operator< (const BgpVrp &other) const {
+    if (afi != other.afi) return afi < other.afi;
+    int cmp = memcmp(prefix, other.prefix, 16);
+    if (cmp != 0) return cmp < 0;
+    if (length != other.length) return length < other.length;
+    if (max_length != other.max_length) return max_length < other.max_length;
+    return asn < other.asn;
+}
+
+/**
+ * @brief Test if two VRPs are the same.
+ * 
+ * @param other The other VRP.
+ * @retval true Same.
+ * @retval false Not the same.
+ */
+bool BgpVrp::operator== (const BgpVrp &other) const {
+    return afi == other.afi && memcmp(prefix, other.prefix, 16) == 0 && length == other.length &&
+        max_length == other.max_length && asn == other.asn;
+}
+
+static bool sameRoute(const BgpVrp &a, const BgpVrp &b) {
+    return a.afi == b.afi && a.length == b.length && memcmp(a.prefix, b.prefix, 16) == 0;
+}
+
+/**
+ * @brief Parse a line of VRP file.
+ * 
+ * Two formats are accepted: the CSV output of RPKI validators
+ * ("AS13335,1.1.1.0/24,24[,...]", a header line starting with "ASN," is
+ * skipped), and "prefix/length max_length asn".
+ * 
+ * @param line The line.
+ * @param vrp Parsed VRP.
+ * @retval 1 Line parsed.
+ * @retval 0 Line is empty, a comment, or the CSV header.
+ * @retval -1 Line is invalid.
+ */
+static int ParseLine(char *line, BgpVrp &vrp) {
+    char *fields[3];
+    int n_fields = 0;
+
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '\n' || *line == '\r' || *line == '#') return 0;
+
+    bool csv = strchr(line, ',') != NULL;
+    if (csv && strncmp(line, "ASN,", 4) == 0) return 0;
+
+    const char *delim = csv ? ",\r\n" : " \t\r\n";
+    char *save = NULL;
+    for (char *field = strtok_r(line, delim, &save); field != NULL && n_fields < 3; field = strtok_r(NULL, delim, &save)) {
+        fields[n_fields++] = field;
+    }
+
+    if (n_fields < 3) return -1;
+
+    const char *asn_str = csv ? fields[0] : fields[2];
+    char *prefix_str = csv ? fields[1] : fields[0];
+    const char *max_length_str = csv ? fields[2] : fields[1];
+
+    if (strncmp(asn_str, "AS", 2) == 0) asn_str += 2;
+
+    char *end;
+    unsigned long asn = strtoul(asn_str, &end, 10);
+    if (*end != '\0' || end == asn_str || asn > 0xffffffff) return -1;
+
+    unsigned long max_length = strtoul(max_length_str, &end, 10);
+    if (*end != '\0' || end == max_length_str) return -1;
+
+    char *slash = strchr(prefix_str, '/');
+    if (slash == NULL) return -1;
+    *slash = '\0';
+
+    unsigned long length = strtoul(slash + 1, &end, 10);
+    if (*end != '\0' || end == slash + 1) return -1;
+
+    memset(vrp.prefix, 0, 16);
+    if (inet_pton(AF_INET, prefix_str, vrp.prefix) == 1) vrp.afi = IPV4;
+    else if (inet_pton(AF_INET6, prefix_str, vrp.prefix) == 1) vrp.afi = IPV6;
+    else return -1;
+
+    if (length > 128 || max_length > 128) return -1;
+
+    vrp.length = length;
+    vrp.max_length = max_length;
+    vrp.asn = asn;
+
+    return 1;
+}
+
+/**
+ * @brief Construct a new, empty ROA table.
+ * 
+ * @param logger Log handler.
+ */
+BgpRoaTable::BgpRoaTable(BgpLogHandler *logger) {
+    this->logger = logger;
+    slot = std::make_shared<BgpRoaSlot>();
+    slot->data = std::make_shared<BgpRoaData>();
+}
+
+/**
+ * @brief Replace all VRPs.
+ * 
+ * @param vrps The new VRPs.
+ * @param changed4 If not NULL, loaded with the IPv4 prefixes (and their
+ * sub-prefixes) affected by the change.
+ * @param changed6 If not NULL, loaded with the IPv6 prefixes (and their
+ * sub-prefixes) affected by the change.
+ * @retval true VRPs loaded.
+ * @retval false Invalid VRP. The table is not changed.
+ */
+bool BgpRoaTable::load(const std::vector<BgpVrp> &vrps, PrefixSet4 *changed4, PrefixSet6 *changed6) {
+    for (const BgpVrp &vrp : vrps) {
+        if (!validateVrp(vrp)) return false;
+    }
+
+    std::vector<BgpVrp> new_vrps = vrps;
+    std::sort(new_vrps.begin(), new_vrps.end());
+    new_vrps.erase(std::unique(new_vrps.begin(), new_vrps.end()), new_vrps.end());
+
+    std::lock_guard<std::mutex> lock(slot->update_mutex);
+    const std::vector<BgpVrp> &old_vrps = slot->data->vrps;
+
+    std::vector<BgpVrp> changed;
+    std::set_symmetric_difference(old_vrps.begin(), old_vrps.end(), new_vrps.begin(), new_vrps.end(), std::back_inserter(changed));
+
+    return replace(new_vrps, changed, changed4, changed6);
+}
+
+/**
+ * @brief Replace all VRPs with the ones from a file.
+ * 
+ * The file can be the CSV output of RPKI validators ("ASN,IP Prefix,Max
+ * Length,..."), or have one VRP per line, in the form of "prefix/length
+ * max_length asn". Empty lines and lines starting with "#" are ignored.
+ * 
+ * @param filename Path to the file.
+ * @param changed4 See load(vrps).
+ * @param changed6 See load(vrps).
+ * @retval true VRPs loaded.
+ * @retval false Failed to load the file. The table is not changed.
+ */
+bool BgpRoaTable::load(const char *filename, PrefixSet4 *changed4, PrefixSet6 *changed6) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        logger->log(ERROR, "BgpRoaTable::load: failed to open %s.\n", filename);
+        return false;
+    }
+
+    std::vector<BgpVrp> vrps;
+    char line[256];
+    size_t line_no = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        BgpVrp vrp;
+        int ret = ParseLine(line, vrp);
+        if (ret == 0) continue;
+        if (ret < 0) {
+            logger->log(ERROR, "BgpRoaTable::load: %s:%zu: invalid line.\n", filename, line_no);
+            fclose(file);
+            return false;
+        }
+        vrps.push_back(vrp);
+    }
+
+    fclose(file);
+    return load(vrps, changed4, changed6);
+}
+
+/**
+ * @brief Apply announced and withdrawn VRPs.
+ * 
+ * Withdrawn VRPs are removed first. Announcing a VRP already in the table, or
+ * withdrawing one not in the table has no effect.
+ * 
+ * @param announced VRPs to add.
+ * @param withdrawn VRPs to remove.
+ * @param changed4 See load(vrps).
+ * @param changed6 See load(vrps).
+ * @retval true Update applied.
+ * @retval false Invalid VRP. The table is not changed.
+ */
+bool BgpRoaTable::update(const std::vector<BgpVrp> &announced, const std::vector<BgpVrp> &withdrawn, PrefixSet4 *changed4, PrefixSet6 *changed6) {
+    for (const BgpVrp &vrp : announced) {
+        if (!validateVrp(vrp)) return false;
+    }
+
+    std::vector<BgpVrp> add = announced;
+    std::vector<BgpVrp> del = withdrawn;
+    std::sort(add.begin(), add.end());
+    std::sort(del.begin(), del.end());
+
+    std::lock_guard<std::mutex> lock(slot->update_mutex);
+    const std::vector<BgpVrp> &old_vrps = slot->data->vrps;
+
+    std::vector<BgpVrp> kept, new_vrps, changed;
+    std::set_difference(old_vrps.begin(), old_vrps.end(), del.begin(), del.end(), std::back_inserter(kept));
+    std::set_union(kept.begin(), kept.end(), add.begin(), add.end(), std::back_inserter(new_vrps));
+    new_vrps.erase(std::unique(new_vrps.begin(), new_vrps.end()), new_vrps.end());
+    std::set_symmetric_difference(old_vrps.begin(), old_vrps.end(), new_vrps.begin(), new_vrps.end(), std::back_inserter(changed));
+
+    if (changed.size() == 0) {
+        if (changed4 != NULL) changed4->load(std::vector<PrefixSetEntry4>());
+        if (changed6 != NULL) changed6->load(std::vector<PrefixSetEntry6>());
+        return true;
+    }
+
+    return replace(new_vrps, changed, changed4, changed6);
+}
+
+/**
+ * @brief Validate a route.
+ * 
+ * @param route The route.
+ * @param origin Origin ASN of the route. 0 if the route has no origin (e.g.,
+ * the path ends with an AS_SET): such routes are never valid.
+ * @return BgpRpkiState Validation state.
+ */
+BgpRpkiState BgpRoaTable::validate(const Prefix4 &route, uint32_t origin) const {
+    std::shared_ptr<const BgpRoaData> data = std::atomic_load(&slot->data);
+    uint32_t prefix = route.getPrefix();
+    return data->trie4.validate((const uint8_t *) &prefix, route.getLength(), origin);
+}
+
+/**
+ * @brief Validate a route.
+ * 
+ * @param route The route.
+ * @param origin Origin ASN of the route, 0 if none.
+ * @return BgpRpkiState Validation state.
+ */
+BgpRpkiState BgpRoaTable::validate(const Prefix6 &route, uint32_t origin) const {
+    std::shared_ptr<const BgpRoaData> data = std::atomic_load(&slot->data);
+    uint8_t prefix[16];
+    route.getPrefix(prefix);
+    return data->trie6.validate(prefix, route.getLength(), origin);
+}
+
+/**
+ * @brief Validate a route, with the origin from AS_PATH.
+ * 
+ * @param route The route.
+ * @param attribs Path attributes of the route.
+ * @param local_asn Local ASN, the origin of routes with an empty AS_PATH.
+ * @return BgpRpkiState Validation state.
+ */
+BgpRpkiState BgpRoaTable::validate(const Prefix &route, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, uint32_t local_asn) const {
+    uint32_t origin = GetOrigin(attribs, local_asn);
+
+    if (route.afi == IPV4) return validate(static_cast<const Prefix4 &>(route), origin);
+    if (route.afi == IPV6) return validate(static_cast<const Prefix6 &>(route), origin);
+
+    return RPKI_NOT_FOUND;
+}
+
+/**
+ * @brief Get number of VRPs.
+ * 
+ * @return size_t Number of VRPs.
+ */
+size_t BgpRoaTable::size() const {
+    return std::atomic_load(&slot->data)->vrps.size();
+}
+
+/**
+ * @brief Get origin ASN of a path.
+ * 
+ * A route with an empty AS_PATH (or no AS_PATH) is originated by the local AS
+ * (RFC 6811, section 2).
+ * 
+ * @param attribs Path attributes.
+ * @param local_asn Local ASN.
+ * @return uint32_t The last ASN of AS_PATH, local_asn if the path is empty, or
+ * 0 if the path ends with an AS_SET.
+ */
+uint32_t BgpRoaTable::GetOrigin(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, uint32_t local_asn) {
+    for (const std::shared_ptr<BgpPathAttrib> &attr : attribs) {
+        if (attr->type_code != AS_PATH) continue;
+        const BgpPathAttribAsPath &as_path = dynamic_cast<const BgpPathAttribAsPath &>(*attr);
+
+        if (as_path.as_paths.size() == 0) return local_asn;
+        const BgpAsPathSegment &last = as_path.as_paths.back();
+        if (last.type != AS_SEQUENCE || last.value.size() == 0) return 0;
+
+        return last.value.back();
+    }
+
+    return local_asn;
+}
+
+bool BgpRoaTable::replace(const std::vector<BgpVrp> &vrps, const std::vector<BgpVrp> &changed, PrefixSet4 *changed4, PrefixSet6 *changed6) {
+    std::shared_ptr<BgpRoaData> data = std::make_shared<BgpRoaData>();
+    data->vrps = vrps;
+
+    std::vector<BgpVrp>::const_iterator begin = data->vrps.begin();
+    while (begin != data->vrps.end()) {
+        std::vector<BgpVrp>::const_iterator end = begin + 1;
+        while (end != data->vrps.end() && sameRoute(*begin, *end)) end++;
+
+        if (begin->afi == IPV4) data->trie4.insert(begin->prefix, begin->length, begin, end);
+        else data->trie6.insert(begin->prefix, begin->length, begin, end);
+
+        begin = end;
+    }
+
+    data->trie4.finalize();
+    data->trie6.finalize();
+
+    std::vector<PrefixSetEntry4> entries4;
+    std::vector<PrefixSetEntry6> entries6;
+
+    for (const BgpVrp &vrp : changed) {
+        if (vrp.afi == IPV4 && changed4 != NULL) {
+            PrefixSetEntry4 entry;
+            memcpy(&entry.prefix, vrp.prefix, 4);
+            entry.length = entry.ge = vrp.length;
+            entry.le = 32;
+            entries4.push_back(entry);
+        }
+
+        if (vrp.afi == IPV6 && changed6 != NULL) {
+            PrefixSetEntry6 entry;
+            memcpy(entry.prefix, vrp.prefix, 16);
+            entry.length = entry.ge = vrp.length;
+            entry.le = 128;
+            entries6.push_back(entry);
+        }
+    }
+
+    std::atomic_store(&slot->data, std::shared_ptr<const BgpRoaData>(data));
+
+    logger->log(INFO, "BgpRoaTable::replace: %zu VRPs loaded, %zu changed.\n", vrps.size(), changed.size());
+
+    if (changed4 != NULL) changed4->load(entries4);
+    if (changed6 != NULL) changed6->load(entries6);
+
+    return true;
+}
+
+bool BgpRoaTable::validateVrp(const BgpVrp &vrp) const {
+    uint8_t max = vrp.afi == IPV4 ? 32 : 128;
+
+    if ((vrp.afi != IPV4 && vrp.afi != IPV6) || vrp.length > vrp.max_length || vrp.max_length > max) {
+        logger->log(ERROR, "BgpRoaTable::validateVrp: invalid VRP (AS%u, length %d, max length %d).\n", vrp.asn, vrp.length, vrp.max_length);
+        return false;
+    }
+
+    for (uint8_t bit = vrp.length; bit < 128; bit++) {
+        if (getBit(vrp.prefix, bit)) {
+            logger->log(ERROR, "BgpRoaTable::validateVrp: VRP has host bits set (AS%u, length %d).\n", vrp.asn, vrp.length);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+}
@@ -0,0 +1,110 @@
+/**
+ * @file bgp-roa-table.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief RPKI route origin validation.
+ * @version 0.1
+ * @date 2019-08-08
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_ROA_TABLE_H_
+#define BGP_ROA_TABLE_H_
+#include <stdint.h>
+#include <vector>
+#include <memory>
+#include "bgp-afi.h"
+#include "prefix4.h"
+#include "prefix6.h"
+#include "prefix-set.h"
+#include "bgp-path-attrib.h"
+#include "bgp-log-handler.h"
+
+namespace libbgp {
+
+struct BgpRoaSlot;
+
+/**
+ * @brief Route origin validation state (RFC 6811).
+ * 
+ */
+enum BgpRpkiState {
+    RPKI_NOT_FOUND, /*!< No VRP covers the route. */
+    RPKI_VALID, /*!< A VRP covering the route matches its origin and length. */
+    RPKI_INVALID /*!< VRPs cover the route, but none of them matches. */
+};
+
+/**
+ * @brief A Validated ROA Payload.
+ * 
+ */
+struct BgpVrp {
+    Afi afi; /*!< Address family (IPV4 or IPV6). */
+    uint8_t prefix[16]; /*!< Prefix. IPv4 prefixes use the first 4 bytes. */
+    uint8_t length; /*!< Prefix length. */
+    uint8_t max_length; /*!< Max length. */
+    uint32_t asn; /*!< Origin ASN. */
+
+    bool operator< (const BgpVrp &other) const;
+    bool operator== (const BgpVrp &other) const;
+};
+
+/**
+ * @brief The ROA table.
+ * 
+ * BgpRoaTable keeps a set of VRPs in a compact trie for each address family,
+ * and validates the origin of routes against them (RFC 6811). A route is
+ * validated with a single walk from the root of the trie.
+ * 
+ * VRPs can be loaded from a file, or from a feed like RTR (RFC 8210) with
+ * update(), which applies announced and withdrawn VRPs. Both report the
+ * prefixes covered by the VRPs that actually changed, so only the routes in
+ * them need to be validated again (see BgpFsm::revalidate).
+ * 
+ * Like PrefixSet4, copies of a BgpRoaTable share the same VRP set, and changes
+ * are swapped in atomically.
+ */
+class BgpRoaTable {
+public:
+    BgpRoaTable(BgpLogHandler *logger);
+
+    // replace all VRPs
+    bool load(const std::vector<BgpVrp> &vrps, PrefixSet4 *changed4 = NULL, PrefixSet6 *changed6 = NULL);
+
+    // replace all VRPs with the ones from a file
+    bool load(const char *filename, PrefixSet4 *changed4 = NULL, PrefixSet6 *changed6 = NULL);
+
+    // apply announced / withdrawn VRPs
+    bool update(const std::vector<BgpVrp> &announced, const std::vector<BgpVrp> &withdrawn, PrefixSet4 *changed4 = NULL, PrefixSet6 *changed6 = NULL);
+
+    // validate a route. origin 0 means no origin (e.g., path ends with AS_SET)
+    BgpRpkiState validate(const Prefix4 &route, uint32_t origin) const;
+    BgpRpkiState validate(const Prefix6 &route, uint32_t origin) const;
+
+    // validate a route, with the origin from AS_PATH
+    BgpRpkiState validate(const Prefix &route, const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, uint32_t local_asn) const;
+
+    // get number of VRPs
+    size_t size() const;
+
+    // get origin ASN of a path, local_asn if the path is empty, 0 if none
+    static uint32_t GetOrigin(const std::vector<std::shared_ptr<BgpPathAttrib>> &attribs, uint32_t local_asn);
+
+private:
+    bool replace(const std::vector<BgpVrp> &vrps, const std::vector<BgpVrp> &changed, PrefixSet4 *changed4, PrefixSet6 *changed6);
+    bool validateVrp(const BgpVrp &vrp) const;
+
+    BgpLogHandler *logger;
+    std::shared_ptr<BgpRoaSlot> slot;
+};
+
+/**
+ * @example rpki.cc
+ * Example of validating routes with BgpRoaTable, and rejecting RPKI-invalid
+ * routes with BgpFilterRuleRpki. This example also benchmarks validating a
+ * full table.
+ */
+
+}
+
+#endif // BGP_ROA_TABLE_H_
@@ -12,20 +12,78 @@
 #include <stdlib.h>
 #include <string.h>
 #include <arpa/inet.h>
+#include <sys/mman.h>
 #define BGP_SINK_DEFAULT_BUFSZ 65536
 
+// lock the sink mutex, unless the sink is single-threaded.
+#define BGP_SINK_LOCK() \
+    std::unique_lock<std::recursive_mutex> lock(mutex, std::defer_lock); \
+    if (!no_lock) lock.lock();
+
 namespace libbgp {
 
+/**
+ * @brief Map a ring buffer twice back-to-back in virtual memory.
+ * 
+ * @param size Size of the ring. Must be multiple of page size.
+ * @return uint8_t* Pointer to the mapping, 2 * size bytes long.
+ * @retval NULL Mirrored mapping not supported or failed.
+ */
+static uint8_t* mirror_map(size_t size) {
+#if defined(__linux__) && defined(MFD_CLOEXEC)
+    if (size % (size_t) sysconf(_SC_PAGESIZE) != 0) return NULL;
+
+    int fd = memfd_create("libbgp-sink", MFD_CLOEXEC);
+    if (fd < 0) return NULL;
+
+    if (ftruncate(fd, size) != 0) {
+        close(fd);
+        return NULL;
+    }
+
+    uint8_t *base = (uint8_t *) mmap(NULL, size * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (base == MAP_FAILED) {
+        close(fd);
+        return NULL;
+    }
+
+    void *lo = mmap(base, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    void *hi = mmap(base + size, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_FIXED, fd, 0);
+    close(fd);
+
+    if (lo != base || hi != base + size) {
+        munmap(base, size * 2);
+        return NULL;
+    }
+
+    return base;
+#else
+    (void) size;
+    return NULL;
+#endif
+}
+
 /**
  * @brief Construct a new Bgp Sink:: Bgp Sink object
  * 
  * @param use_4b_asn Enable four octets ASN support.
  */
-BgpSink::BgpSink(bool use_4b_asn) {
-    this->buffer_size = BGP_SINK_DEFAULT_BUFSZ;
-    this->buffer = (uint8_t *) malloc(buffer_size);
+BgpSink::BgpSink(bool use_4b_asn) : BgpSink(use_4b_asn, false) {}
+
+/**
+ * @brief Construct a new Bgp Sink:: Bgp Sink object
+ * 
+ * @param use_4b_asn Enable four octets ASN support.
+ * @param no_lock Do not lock the sink. Set this only if the sink is never
+ * accessed from more than one thread.
+ */
+BgpSink::BgpSink(bool use_4b_asn, bool no_lock) {
+    this->buffer = NULL;
+    allocBuffer(BGP_SINK_DEFAULT_BUFSZ);
     this->use_4b_asn = use_4b_asn;
+    this->no_lock = no_lock;
     this->logger = NULL;
+    this->arena = NULL;
     offset_start = offset_end = 0;
 }
 
@@ -34,7 +92,7 @@ BgpSink::BgpSink(bool use_4b_asn) {
  * 
  */
 BgpSink::~BgpSink() {
-    free(buffer);
+    freeBuffer();
 }
 
 /**
@@ -48,7 +106,32 @@ BgpSink::~BgpSink() {
  * @retval >=0 Bytes consumed.
  */
 ssize_t BgpSink::fill(const uint8_t *buffer, size_t len) {
-    std::lock_guard<std::recursive_mutex> lock(mutex);
+    BGP_SINK_LOCK();
+
+    uint8_t *dst = acquire(len);
+    memcpy(dst, buffer, len);
+
+    return commit(len);
+}
+
+/**
+ * @brief Get a pointer to writable space in the sink.
+ * 
+ * acquire() allows the caller to read data directly into the sink (e.g., with
+ * read(2)) instead of filling the sink from another buffer. Write at most len
+ * bytes to the returned pointer, then call commit() with the number of bytes
+ * written. The pointer is invalidated by any other operation on the sink.
+ * 
+ * @param len Number of bytes needed.
+ * @return uint8_t* Pointer to at least len bytes of contiguous free space.
+ */
+uint8_t* BgpSink::acquire(size_t len) {
+    BGP_SINK_LOCK();
+
+    if (mirrored) {
+        while (buffer_size - getBytesInSink() < len) expand();
+        return this->buffer + offset_end;
+    }
 
     // expand if too small
     while (len > buffer_size) expand();
@@ -59,9 +142,28 @@ ssize_t BgpSink::fill(const uint8_t *buffer, size_t len) {
     // if still too small, expand
     while (offset_end + len > buffer_size) expand();
 
-    memcpy(this->buffer + offset_end, buffer, len);
-    offset_end += len;
+    return this->buffer + offset_end;
+}
 
+/**
+ * @brief Commit data written to space returned by acquire().
+ * 
+ * @param len Number of bytes written.
+ * @return ssize_t Bytes committed.
+ * @retval -1 Failed to commit. (len larger than the free space in sink) error
+ * may be written to stderr with log handler.
+ * @retval >=0 Bytes committed.
+ */
+ssize_t BgpSink::commit(size_t len) {
+    BGP_SINK_LOCK();
+
+    size_t space = mirrored ? buffer_size - getBytesInSink() : buffer_size - offset_end;
+    if (len > space) {
+        if (logger) logger->log(ERROR, "BgpSink::commit: commit size (%zu) larger then free space (%zu).\n", len, space);
+        return -1;
+    }
+
+    offset_end += len;
     return len;
 }
 
@@ -79,68 +181,145 @@ ssize_t BgpSink::fill(const uint8_t *buffer, size_t len) {
  * peer may be avaliable.
  * @retval >=0 Bytes poured.
  * @throws "bad_packet" Parsed packet length mismatch.
+ * 
+ * If an arena is set with setArena(), the packet is created in the arena and
+ * must be destroyed with BgpArena::destroy() instead of delete.
  */
 ssize_t BgpSink::pour(BgpPacket **pkt) {
-    std::lock_guard<std::recursive_mutex> lock(mutex);
+    BGP_SINK_LOCK();
+
+    const uint8_t *cur = NULL;
+    ssize_t field_len = peek(&cur);
+    if (field_len <= 0) return field_len;
+
+    // data in cur stays valid until next fill.
+    skip(field_len);
+
+    BgpPacket *new_pkt = NULL;
+    if (arena != NULL) new_pkt = arena->create<BgpPacket>(logger, use_4b_asn, arena);
+    else new_pkt = new BgpPacket(logger, use_4b_asn);
+    ssize_t par_ret = new_pkt->parse(cur, field_len);
+
+    *pkt = new_pkt;
+
+    if (par_ret < 0) return -1;
 
-    uint8_t *cur = this->buffer + offset_start;
+    if (par_ret != field_len) throw "bad_packet";
+
+    return par_ret;
+}
+
+/**
+ * @brief Get a pointer to the next packet in sink, without removing it.
+ * 
+ * The packet header is validated, but the packet is not parsed. Use skip() to
+ * remove the packet from sink once done with it.
+ * 
+ * @param pkt Pointer to the pointer to set to the packet. The packet stays 
+ * valid until next fill().
+ * @return ssize_t Length of the packet.
+ * @retval -2 Invalid packet header. error may be written to stderr with log
+ * handler.
+ * @retval 0 No complete packet in sink.
+ * @retval >0 Length of the packet.
+ */
+ssize_t BgpSink::peek(const uint8_t **pkt) {
+    BGP_SINK_LOCK();
+
+    const uint8_t *cur = this->buffer + offset_start;
 
     if (offset_end - offset_start < 19) return 0;
     if (memcmp(cur, "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff", 16) != 0) {
-        if (logger) logger->log(ERROR, "BgpSink::pour: invalid BGP marker.\n");
+        if (logger) logger->log(ERROR, "BgpSink::peek: invalid BGP marker.\n");
         return -2;
     }
 
     uint16_t field_len = ntohs(*(uint16_t *) (cur + 16));
 
     if (field_len < 19 || field_len > 4096) {
-        if (logger) logger->log(ERROR, "BgpSink::pourPtr: invalid BGP packet length (%d).\n", field_len);
+        if (logger) logger->log(ERROR, "BgpSink::peek: invalid BGP packet length (%d).\n", field_len);
         return -2;
     }
 
     ssize_t bytes = getBytesInSink();
     if (field_len > bytes) return 0; // incomplete packet, wait for more.
 
-    offset_start += field_len;
-
-    BgpPacket *new_pkt = new BgpPacket(logger, use_4b_asn);
-    ssize_t par_ret = new_pkt->parse(cur, field_len);
-
-    *pkt = new_pkt;
+    *pkt = cur;
+    return field_len;
+}
 
-    if (par_ret < 0) return -1;
+/**
+ * @brief Remove bytes from the front of sink.
+ * 
+ * Usually used to remove the packet returned by peek(). The removed data 
+ * stays valid until next fill().
+ * 
+ * @param len Number of bytes to remove.
+ */
+void BgpSink::skip(size_t len) {
+    BGP_SINK_LOCK();
 
-    if (par_ret != field_len) throw "bad_packet";
+    if (len > getBytesInSink()) len = getBytesInSink();
+    offset_start += len;
 
-    return par_ret;
+    // wrap offsets back to first half of the ring (or to the front of buffer
+    // if sink is now empty).
+    if (offset_start == offset_end) offset_start = offset_end = 0;
+    else if (mirrored && offset_start >= buffer_size) {
+        offset_start -= buffer_size;
+        offset_end -= buffer_size;
+    }
 }
 
 void BgpSink::settle() {
     if (offset_start > 0) {
         if (offset_start == offset_end) offset_start = offset_end = 0;
-        else memmove(buffer, buffer + offset_start, offset_end - offset_start);
+        else {
+            memmove(buffer, buffer + offset_start, offset_end - offset_start);
+            offset_end -= offset_start;
+            offset_start = 0;
+        }
     }
 }
 
 void BgpSink::expand() {
     size_t new_buf_sz = buffer_size * 2;
     size_t content_sz = getBytesInSink();
-    uint8_t *new_buffer = (uint8_t *) malloc(new_buf_sz);
-    memcpy(new_buffer, buffer + offset_start, content_sz);
-    free(buffer);
-    buffer = new_buffer;
-    buffer_size = new_buf_sz;
+    uint8_t *old_buffer = buffer;
+    size_t old_buf_sz = buffer_size;
+    bool old_mirrored = mirrored;
+
+    allocBuffer(new_buf_sz);
+    memcpy(buffer, old_buffer + offset_start, content_sz);
+
+    if (old_mirrored) munmap(old_buffer, old_buf_sz * 2);
+    else free(old_buffer);
+
     offset_start = 0;
     offset_end = content_sz;
     if (logger) logger->log(DEBUG, "BgpSink::expand: expanded size to %zu\n", buffer_size);
 }
 
+void BgpSink::allocBuffer(size_t size) {
+    buffer_size = size;
+    buffer = mirror_map(size);
+    mirrored = buffer != NULL;
+    if (!mirrored) buffer = (uint8_t *) malloc(size);
+}
+
+void BgpSink::freeBuffer() {
+    if (buffer == NULL) return;
+    if (mirrored) munmap(buffer, buffer_size * 2);
+    else free(buffer);
+    buffer = NULL;
+}
+
 /**
  * @brief Drain the sink. (Remove all data from sink buffer)
  * 
  */
 void BgpSink::drain() {
-    std::lock_guard<std::recursive_mutex> lock(mutex);
+    BGP_SINK_LOCK();
     offset_end = offset_start = 0;
 }
 
@@ -162,4 +341,25 @@ void BgpSink::setLogger(BgpLogHandler *logger) {
     this->logger = logger;
 }
 
+/**
+ * @brief Set the arena to create poured packets in. If NULL or not set, packets
+ * are created on the heap.
+ * 
+ * @param arena Pointer to the arena.
+ */
+void BgpSink::setArena(BgpArena *arena) {
+    BGP_SINK_LOCK();
+    this->arena = arena;
+}
+
+/**
+ * @brief Set the ASN size to parse packets poured from now on with.
+ * 
+ * @param use_4b_asn Enable four octets ASN support.
+ */
+void BgpSink::setUse4bAsn(bool use_4b_asn) {
+    BGP_SINK_LOCK();
+    this->use_4b_asn = use_4b_asn;
+}
+
 }
\ No newline at end of file
@@ -15,6 +15,7 @@
 #include <unistd.h>
 #include "bgp-packet.h"
 #include "bgp-log-handler.h"
+#include "bgp-arena.h"
 
 namespace libbgp {
 
@@ -25,15 +26,32 @@ namespace libbgp {
  * fill the sink (buffer) and allows users to get full BGP packet from the sink
  * (buffer). This is useful since BGP uses TCP, and TCP streams the data. (so we
  * might not get a full BGP packet in buffer every time)
+ * 
+ * Where supported, the sink buffer is a ring mapped twice back-to-back in
+ * virtual memory, so packets wrapping around the end of the ring can be read
+ * without moving data. Otherwise, a linear buffer is used and data is moved to
+ * the front of the buffer when the end is reached.
+ * 
+ * By default, all sink operations are serialized with a mutex. A sink created
+ * with no_lock set skips locking and must only be used from one thread.
  */
 class BgpSink {
 public:
     // create a new sink
     BgpSink(bool use_4b_asn);
 
+    // create a new sink, optionally without locking (single-threaded use only)
+    BgpSink(bool use_4b_asn, bool no_lock);
+
     // feed stream of packets into sink
     ssize_t fill(const uint8_t *buffer, size_t len);
 
+    // get pointer to at least len bytes of writable space in sink
+    uint8_t* acquire(size_t len);
+
+    // mark len bytes written to the acquired space as filled
+    ssize_t commit(size_t len);
+
     // get a pointer to next packet from sink (might chane if fill())
     //BufferPtr pourPtr();
 
@@ -51,6 +69,15 @@ public:
     // returned. (> 0)
     ssize_t pour(BgpPacket **pkt);
 
+    // get a pointer to next packet in sink without removing or parsing it. if
+    // no packet currently avaliable, 0 will be returned. if the packet header
+    // is invalid, -2 will be returned. otherwise, pkt is set to point to the
+    // packet, and length of the packet is returned. (> 0)
+    ssize_t peek(const uint8_t **pkt);
+
+    // remove len bytes from sink
+    void skip(size_t len);
+
     // get and remove all packets from sink (max size = sink buffer size)
     //ssize_t pourAll(uint8_t *buffer, size_t len);
 
@@ -62,22 +89,42 @@ public:
 
     void setLogger(BgpLogHandler *logger);
 
+    // create poured packets in the arena instead of on the heap
+    void setArena(BgpArena *arena);
+
+    // set the ASN size to parse packets with
+    void setUse4bAsn(bool use_4b_asn);
+
     ~BgpSink();
 
 private:
-    // settle the sink
+    // settle the sink (linear buffer only)
     void settle();
 
     // exapnd the sink
     void expand();
 
+    // allocate a buffer of size bytes
+    void allocBuffer(size_t size);
+
+    // free the buffer
+    void freeBuffer();
+
     uint8_t *buffer;
     size_t buffer_size;
     size_t offset_start;
     size_t offset_end;
     bool use_4b_asn;
+
+    // skip locking of the mutex. (single-threaded sink)
+    bool no_lock;
+
+    // buffer is a ring with second half mapped onto the first half, so data
+    // from offset_start to offset_end is always contiguous.
+    bool mirrored;
     std::recursive_mutex mutex;
     BgpLogHandler *logger;
+    BgpArena *arena;
 };
 
 }
@@ -13,6 +13,7 @@
 #include "bgp-afi.h"
 #include "value-op.h"
 #include <arpa/inet.h>
+#include <string.h>
 
 namespace libbgp {
 
@@ -25,6 +26,166 @@ namespace libbgp {
 BgpUpdateMessage::BgpUpdateMessage(BgpLogHandler *logger, bool use_4b_asn) : BgpMessage(logger) {
     type = UPDATE;
     this->use_4b_asn = use_4b_asn;
+    arena = NULL;
+    reindexAttribs();
+}
+
+/**
+ * @brief Construct a new Bgp Update Message object with parsed path 
+ * attributes allocated from an arena.
+ * 
+ * Attributes created by parse() live in the arena. They must not be 
+ * referenced after the arena is reset, clone() them if they need to outlive
+ * the message (e.g., inserting to RIB).
+ * 
+ * @param logger Pointer to logger object for error logging.
+ * @param use_4b_asn Enable four octets ASN support.
+ * @param arena The arena to allocate attributes from.
+ */
+BgpUpdateMessage::BgpUpdateMessage(BgpLogHandler *logger, bool use_4b_asn, BgpArena *arena) : BgpUpdateMessage(logger, use_4b_asn) {
+    this->arena = arena;
+}
+
+/**
+ * @brief Create a path attribute object, on the heap or in the arena.
+ * 
+ * @tparam T Type of attribute.
+ * @tparam Args Types of constructor arguments.
+ * @param arena The arena. (NULL: use heap)
+ * @param args Constructor arguments.
+ * @return std::shared_ptr<BgpPathAttrib> The new attribute.
+ */
+template <typename T, typename... Args>
+static std::shared_ptr<BgpPathAttrib> newAttrib(BgpArena *arena, Args&&... args) {
+    if (arena != NULL) {
+        std::shared_ptr<BgpPathAttrib> attrib = arena->makeShared<T>(std::forward<Args>(args)...);
+        attrib->in_arena.set();
+        return attrib;
+    }
+
+    return std::shared_ptr<BgpPathAttrib>(new T(std::forward<Args>(args)...));
+}
+
+/**
+ * @brief Test if an attribute is of the class returned by the typed getter of
+ * its type.
+ * 
+ * @param attrib The attribute.
+ * @return true The attribute can be returned by the typed getter.
+ * @return false The attribute is of other class.
+ */
+static bool IsTypedAttrib(const BgpPathAttrib *attrib) {
+    switch (attrib->type_code) {
+        case ORIGIN: return dynamic_cast<const BgpPathAttribOrigin *>(attrib) != NULL;
+        case AS_PATH: return dynamic_cast<const BgpPathAttribAsPath *>(attrib) != NULL;
+        case NEXT_HOP: return dynamic_cast<const BgpPathAttribNexthop *>(attrib) != NULL;
+        case MULTI_EXIT_DISC: return dynamic_cast<const BgpPathAttribMed *>(attrib) != NULL;
+        case LOCAL_PREF: return dynamic_cast<const BgpPathAttribLocalPref *>(attrib) != NULL;
+        case AGGREATOR: return dynamic_cast<const BgpPathAttribAggregator *>(attrib) != NULL;
+        case COMMUNITY: return dynamic_cast<const BgpPathAttribCommunity *>(attrib) != NULL;
+        case AS4_PATH: return dynamic_cast<const BgpPathAttribAs4Path *>(attrib) != NULL;
+        case AS4_AGGREGATOR: return dynamic_cast<const BgpPathAttribAs4Aggregator *>(attrib) != NULL;
+        case EXTENDED_COMMUNITY: return dynamic_cast<const BgpPathAttribExtCommunity *>(attrib) != NULL;
+        case LARGE_COMMUNITY: return dynamic_cast<const BgpPathAttribLargeCommunity *>(attrib) != NULL;
+        case MP_REACH_NLRI: return dynamic_cast<const BgpPathAttribMpReachNlriIpv6 *>(attrib) != NULL;
+        case MP_UNREACH_NLRI: return dynamic_cast<const BgpPathAttribMpUnreachNlriIpv6 *>(attrib) != NULL;
+    }
+
+    return false;
+}
+
+/**
+ * @brief Rebuild the attribute index.
+ * 
+ * Attributes are indexed by type code, so getting an attribute by type does
+ * not scan the attribute list. The index is kept up to date by the methods of
+ * BgpUpdateMessage. If path_attribute is modified directly, attributes are 
+ * looked up by scanning the list until this is called.
+ */
+void BgpUpdateMessage::reindexAttribs() {
+    memset(attrib_slots, 0, sizeof(attrib_slots));
+    memset(attrib_typed, 0, sizeof(attrib_typed));
+
+    for (size_t i = 0; i < path_attribute.size(); i++) {
+        const BgpPathAttrib *attrib = path_attribute[i].get();
+        uint8_t type = attrib->type_code;
+
+        // keep the first one if there are duplicates, like a scan does.
+        if (attrib_slots[type] != 0) continue;
+
+        attrib_slots[type] = i + 1;
+        if (IsTypedAttrib(attrib)) attrib_typed[type / 32] |= 1U << (type % 32);
+    }
+
+    indexed_data = path_attribute.data();
+    indexed_size = path_attribute.size();
+}
+
+/**
+ * @brief Test if the attribute index is up to date.
+ * 
+ * @return true The index is up to date.
+ * @return false path_attribute was modified directly.
+ */
+bool BgpUpdateMessage::indexValid() const {
+    return indexed_data == path_attribute.data() && indexed_size == path_attribute.size();
+}
+
+/**
+ * @brief Get position of an attribute in the attribute list.
+ * 
+ * @param type Attribute typecode.
+ * @return ssize_t Position of the attribute, or -1 if no such attribute.
+ */
+ssize_t BgpUpdateMessage::findAttrib(uint8_t type) const {
+    if (indexValid()) {
+        uint16_t slot = attrib_slots[type];
+        if (slot == 0) return -1;
+        if (path_attribute[slot - 1]->type_code == type) return slot - 1;
+    }
+
+    // index out of date: path_attribute was modified directly.
+    for (size_t i = 0; i < path_attribute.size(); i++) {
+        if (path_attribute[i]->type_code == type) return i;
+    }
+
+    return -1;
+}
+
+/**
+ * @brief Get position of an attribute in the attribute list, rebuild the 
+ * index first if it is out of date.
+ * 
+ * @param type Attribute typecode.
+ * @return ssize_t Position of the attribute, or -1 if no such attribute.
+ */
+ssize_t BgpUpdateMessage::findAttrib(uint8_t type) {
+    if (!indexValid()) reindexAttribs();
+    return ((const BgpUpdateMessage *) this)->findAttrib(type);
+}
+
+/**
+ * @brief Get attribute of the given class by typecode.
+ * 
+ * @tparam T Class of the attribute.
+ * @param type Attribute typecode.
+ * @return T* The attribute, or NULL if no such attribute or the attribute is
+ * not of the class.
+ */
+template <typename T>
+T *BgpUpdateMessage::findTypedAttrib(uint8_t type) const {
+    ssize_t pos = findAttrib(type);
+    if (pos < 0) return NULL;
+
+    BgpPathAttrib *attrib = path_attribute[pos].get();
+
+    // typed flag is only valid if the index is.
+    if (indexValid()) {
+        if (((attrib_typed[type / 32] >> (type % 32)) & 1U) == 0) return NULL;
+        return static_cast<T *>(attrib);
+    }
+
+    return dynamic_cast<T *>(attrib);
 }
 
 /**
@@ -35,11 +196,10 @@ BgpUpdateMessage::BgpUpdateMessage(BgpLogHandler *logger, bool use_4b_asn) : Bgp
  * @throws "no such attribute" if attribute does not exist.
  */
 BgpPathAttrib& BgpUpdateMessage::getAttrib(uint8_t type) {
-    for (std::shared_ptr<BgpPathAttrib> attrib : path_attribute) {
-        if (attrib->type_code == type) return *attrib;
-    }
+    ssize_t pos = findAttrib(type);
+    if (pos < 0) throw "no such attribute";
 
-    throw "no such attribute";
+    return *path_attribute[pos];
 }
 
 /**
@@ -50,11 +210,10 @@ BgpPathAttrib& BgpUpdateMessage::getAttrib(uint8_t type) {
  * @throws "no such attribute" if attribute does not exist.
  */
 const BgpPathAttrib& BgpUpdateMessage::getAttrib(uint8_t type) const {
-    for (const std::shared_ptr<BgpPathAttrib> &attrib : path_attribute) {
-        if (attrib->type_code == type) return *attrib;
-    }
+    ssize_t pos = findAttrib(type);
+    if (pos < 0) throw "no such attribute";
 
-    throw "no such attribute";
+    return *path_attribute[pos];
 }
 
 /**
@@ -65,13 +224,29 @@ const BgpPathAttrib& BgpUpdateMessage::getAttrib(uint8_t type) const {
  * @return false Attribute not avaliable.
  */
 bool BgpUpdateMessage::hasAttrib(uint8_t type) const {
-    for (const std::shared_ptr<BgpPathAttrib> &attrib : path_attribute) {
-        if (attrib->type_code == type) return true;
-    }
-
-    return false;
+    return findAttrib(type) >= 0;
 }
 
+#define TYPED_GETTER(cls, name, type) \
+    cls *BgpUpdateMessage::name() { if (!indexValid()) reindexAttribs(); return findTypedAttrib<cls>(type); } \
+    const cls *BgpUpdateMessage::name() const { return findTypedAttrib<const cls>(type); }
+
+TYPED_GETTER(BgpPathAttribOrigin, getOrigin, ORIGIN)
+TYPED_GETTER(BgpPathAttribAsPath, getAsPath, AS_PATH)
+TYPED_GETTER(BgpPathAttribNexthop, getNexthop, NEXT_HOP)
+TYPED_GETTER(BgpPathAttribMed, getMed, MULTI_EXIT_DISC)
+TYPED_GETTER(BgpPathAttribLocalPref, getLocalPref, LOCAL_PREF)
+TYPED_GETTER(BgpPathAttribAggregator, getAggregator, AGGREATOR)
+TYPED_GETTER(BgpPathAttribCommunity, getCommunity, COMMUNITY)
+TYPED_GETTER(BgpPathAttribAs4Path, getAs4Path, AS4_PATH)
+TYPED_GETTER(BgpPathAttribAs4Aggregator, getAs4Aggregator, AS4_AGGREGATOR)
+TYPED_GETTER(BgpPathAttribExtCommunity, getExtCommunity, EXTENDED_COMMUNITY)
+TYPED_GETTER(BgpPathAttribLargeCommunity, getLargeCommunity, LARGE_COMMUNITY)
+TYPED_GETTER(BgpPathAttribMpReachNlriIpv6, getMpReachNlri6, MP_REACH_NLRI)
+TYPED_GETTER(BgpPathAttribMpUnreachNlriIpv6, getMpUnreachNlri6, MP_UNREACH_NLRI)
+
+#undef TYPED_GETTER
+
 /**
  * @brief Add an attribute to the update message.
  * 
@@ -84,21 +259,60 @@ bool BgpUpdateMessage::addAttrib(const BgpPathAttrib &attrib) {
     if (hasAttrib(attrib.type_code)) return false;
 
     path_attribute.push_back(std::shared_ptr<BgpPathAttrib>(attrib.clone(logger)));
+    reindexAttribs();
     return true;
 }
 
 /**
  * @brief Replace the attributes list with another attribute list.
  * 
+ * Attributes are copied. In two octets ASN mode, a four octets AS_PATH is
+ * replaced with its two octets encoding (see 
+ * BgpPathAttribAsPath::getDowngraded): the two octets AS_PATH, and the 
+ * AS4_PATH at the end of the list, the same as downgradeAsPath() would do. The
+ * encoding is kept in the AS_PATH attribute of the list, so it is computed
+ * once for attributes sent many times. (e.g., the ones in RIB)
+ * 
  * @param attrs List of attributes.
  * @return true List replaced.
  * @return false Failed to replace list.
  */
 bool BgpUpdateMessage::setAttribs(const std::vector<std::shared_ptr<BgpPathAttrib>> &attrs) {
+    std::shared_ptr<const BgpPathAttribAsPath> downgraded_path;
+    std::shared_ptr<const BgpPathAttribAs4Path> downgraded_as4_path;
+
+    if (!use_4b_asn) {
+        for (const std::shared_ptr<BgpPathAttrib> &attrib : attrs) {
+            if (attrib->type_code != AS_PATH) continue;
+
+            // attributes in the arena go away with the message: downgrade the
+            // copy later instead.
+            const BgpPathAttribAsPath *path = dynamic_cast<const BgpPathAttribAsPath *>(attrib.get());
+            if (path != NULL && !attrib->in_arena.isSet()) path->getDowngraded(downgraded_path, downgraded_as4_path);
+            break;
+        }
+    }
+
     path_attribute.clear();
+    path_attribute.reserve(attrs.size() + (downgraded_as4_path != NULL ? 1 : 0));
+
     for (const std::shared_ptr<BgpPathAttrib> &attrib : attrs) {
+        if (downgraded_as4_path != NULL) {
+            if (attrib->type_code == AS4_PATH) continue;
+            if (attrib->type_code == AS_PATH) {
+                path_attribute.push_back(std::shared_ptr<BgpPathAttrib>(downgraded_path->BgpPathAttrib::clone(logger)));
+                continue;
+            }
+        }
+
         path_attribute.push_back(std::shared_ptr<BgpPathAttrib>(attrib->clone(logger)));
     }
+
+    if (downgraded_as4_path != NULL) {
+        path_attribute.push_back(std::shared_ptr<BgpPathAttrib>(downgraded_as4_path->BgpPathAttrib::clone(logger)));
+    }
+
+    reindexAttribs();
     return true;
 }
 
@@ -111,14 +325,12 @@ bool BgpUpdateMessage::setAttribs(const std::vector<std::shared_ptr<BgpPathAttri
  * not exist.
  */
 bool BgpUpdateMessage::dropAttrib(uint8_t type) {
-    for (auto attr = path_attribute.begin(); attr != path_attribute.end(); attr++) {
-        if ((*attr)->type_code == type) {
-            path_attribute.erase(attr);
-            return true;
-        }
-    }
+    ssize_t pos = findAttrib(type);
+    if (pos < 0) return false;
 
-    return false;
+    path_attribute.erase(path_attribute.begin() + pos);
+    reindexAttribs();
+    return true;
 }
 
 /**
@@ -137,6 +349,7 @@ bool BgpUpdateMessage::dropNonTransitive() {
         } else attr++;
     }
 
+    if (removed) reindexAttribs();
     return removed;
 }
 
@@ -192,10 +405,11 @@ bool BgpUpdateMessage::prepend(uint32_t asn) {
             BgpPathAttribAsPath *path = new BgpPathAttribAsPath(logger, use_4b_asn);
             path->prepend(asn);
             path_attribute.push_back(std::shared_ptr<BgpPathAttrib>(path));
+            reindexAttribs();
             return true;
         }
 
-        BgpPathAttribAsPath &path = dynamic_cast<BgpPathAttribAsPath &>(getAttrib(AS_PATH));
+        BgpPathAttribAsPath &path = *getAsPath();
         if (!path.is_4b) {
             logger->log(ERROR, "BgpUpdateMessage::prepend: existing AS_PATH is 2b but we are running in 4b mode. " 
                        "consider restoreAsPath().\n");
@@ -214,8 +428,9 @@ bool BgpUpdateMessage::prepend(uint32_t asn) {
             BgpPathAttribAsPath *path = new BgpPathAttribAsPath(logger, use_4b_asn);
             path->prepend(prep_asn);
             path_attribute.push_back(std::shared_ptr<BgpPathAttrib>(path));
+            reindexAttribs();
         } else {
-            BgpPathAttribAsPath &path = dynamic_cast<BgpPathAttribAsPath &>(getAttrib(AS_PATH));
+            BgpPathAttribAsPath &path = *getAsPath();
             if (path.is_4b) {
                 logger->log(ERROR, "BgpUpdateMessage::prepend: existing AS_PATH is 4b but we are running in 2b mode. " 
                            "consider downgradeAsPath().\n");
@@ -225,7 +440,7 @@ bool BgpUpdateMessage::prepend(uint32_t asn) {
         }
 
         if (hasAttrib(AS4_PATH)) {
-            BgpPathAttribAs4Path &path4 = dynamic_cast<BgpPathAttribAs4Path &>(getAttrib(AS4_PATH));
+            BgpPathAttribAs4Path &path4 = *getAs4Path();
             if(!path4.prepend(prep_asn)) return false;
         }
 
@@ -245,7 +460,7 @@ bool BgpUpdateMessage::prepend(uint32_t asn) {
 bool BgpUpdateMessage::restoreAsPath() {
     if (!hasAttrib(AS_PATH)) return true;
 
-    BgpPathAttribAsPath &path = dynamic_cast<BgpPathAttribAsPath &>(getAttrib(AS_PATH));
+    BgpPathAttribAsPath &path = *getAsPath();
     if (path.is_4b) return true;
 
     // no AS4_PATH, just make AS_PATH 4b
@@ -276,7 +491,7 @@ bool BgpUpdateMessage::restoreAsPath() {
 
     // we have AS4_PATH recorver AS_TRANS.
     std::vector<uint32_t> full_as_path;
-    const BgpPathAttribAs4Path &as4_path = dynamic_cast<const BgpPathAttribAs4Path &>(getAttrib(AS4_PATH));
+    const BgpPathAttribAs4Path &as4_path = *getAs4Path();
     for (const BgpAsPathSegment &seg4 : as4_path.as4_paths) {
         if (!seg4.is_4b) {
             logger->log(ERROR, "BgpUpdateMessage::restoreAsPath: bad as4_path: found 2b seg.\n");
@@ -359,31 +574,13 @@ bool BgpUpdateMessage::restoreAsPath() {
 bool BgpUpdateMessage::downgradeAsPath() {
     if (!hasAttrib(AS_PATH)) return true;
 
-    BgpPathAttribAsPath &path = dynamic_cast<BgpPathAttribAsPath &>(getAttrib(AS_PATH));
+    BgpPathAttribAsPath &path = *getAsPath();
     if (!path.is_4b) return true;
 
-    std::vector<BgpAsPathSegment> new_segs;
     BgpPathAttribAs4Path path4 = BgpPathAttribAs4Path(logger);
+    if (!path.downgrade(path, path4)) return false;
 
-    for (const BgpAsPathSegment &seg4 : path.as_paths) {
-        if (!seg4.is_4b) {
-            logger->log(ERROR, "BgpUpdateMessage::downgradeAsPath: 2b seg found in 4b attrib.\n");
-            return false;
-        }
-
-        BgpAsPathSegment new_seg (false, seg4.type);
-        for (uint32_t asn : seg4.value) {
-            uint16_t new_as = asn >= 0xffff ? 23456 : asn;
-            new_seg.value.push_back(new_as);
-        }
-
-        path4.as4_paths.push_back(seg4);
-        new_segs.push_back(new_seg);
-    }
-    
     updateAttribute(path4);
-    path.is_4b = false;
-    path.as_paths = new_segs;
     return true;
 }
 
@@ -396,12 +593,12 @@ bool BgpUpdateMessage::downgradeAsPath() {
 bool BgpUpdateMessage::restoreAggregator() {
     if (!hasAttrib(AGGREATOR)) return true;
 
-    BgpPathAttribAggregator &aggr = dynamic_cast<BgpPathAttribAggregator &>(getAttrib(AGGREATOR));
+    BgpPathAttribAggregator &aggr = *getAggregator();
     aggr.is_4b = true;
 
     if (!hasAttrib(AS4_AGGREGATOR)) return true;
     
-    const BgpPathAttribAs4Aggregator &aggr4 = dynamic_cast<const BgpPathAttribAs4Aggregator &>(getAttrib(AS4_AGGREGATOR));
+    const BgpPathAttribAs4Aggregator &aggr4 = *getAs4Aggregator();
     aggr.aggregator = aggr4.aggregator;
     aggr.aggregator_asn = aggr4.aggregator_asn4;
 
@@ -417,7 +614,7 @@ bool BgpUpdateMessage::restoreAggregator() {
 bool BgpUpdateMessage::downgradeAggregator() {
     if (!hasAttrib(AGGREATOR)) return true;
     
-    BgpPathAttribAggregator &aggr = dynamic_cast<BgpPathAttribAggregator &>(getAttrib(AGGREATOR));
+    BgpPathAttribAggregator &aggr = *getAggregator();
     aggr.is_4b = false;
 
     BgpPathAttribAs4Aggregator aggr4 = BgpPathAttribAs4Aggregator(logger);
@@ -511,7 +708,7 @@ bool BgpUpdateMessage::validateAttribs() {
     bool has_nexthop = false;
     bool has_as_path = false;
 
-    uint32_t typecode_bitsmap = 0;
+    uint32_t typecode_bitsmap[8] = {0};
 
     for (std::vector<std::shared_ptr<BgpPathAttrib>>::const_iterator attr_iter = path_attribute.begin(); 
         attr_iter != path_attribute.end(); attr_iter++) {
@@ -521,13 +718,13 @@ bool BgpUpdateMessage::validateAttribs() {
         else if (type_code == NEXT_HOP) has_nexthop = true;
         else if (type_code == ORIGIN) has_origin = true;
 
-        if ((typecode_bitsmap >> type_code) & 1U) {
+        if ((typecode_bitsmap[type_code / 32] >> (type_code % 32)) & 1U) {
             logger->log(ERROR, "BgpUpdateMessage::validateAttribs:: duplicated attribute type in list: %d\n", type_code);
             setError(E_UPDATE, E_ATTR_LIST, NULL, 0);
             return false;
         }
 
-        typecode_bitsmap &= ~(1UL << type_code);
+        typecode_bitsmap[type_code / 32] |= 1U << (type_code % 32);
     }
 
     if (!(has_as_path && has_nexthop && has_origin)) {
@@ -579,29 +776,14 @@ ssize_t BgpUpdateMessage::parse(const uint8_t *from, size_t msg_sz) {
         return -1;
     }
 
-    uint16_t parsed_withdrawn_len = 0;
-    
-    while (parsed_withdrawn_len < withdrawn_len) {
-        if (withdrawn_len - parsed_withdrawn_len < 1) {
-            logger->log(ERROR, "BgpUpdateMessage::parse: unexpected end of withdrawn routes list.\n");
-            setError(E_UPDATE, E_UNSPEC, NULL, 0);
-            return -1;
-        }
-
-        Prefix4 route = Prefix4();
-        ssize_t route_read_ret = route.parse(buffer, withdrawn_len - parsed_withdrawn_len);
-        if (route_read_ret < 0) {
-            logger->log(ERROR, "BgpUpdateMessage::parse: error parsing route len in withdrawn routes.\n");
-            setError(E_UPDATE, E_UNSPEC, NULL, 0);
-            return -1;
-        }
-        parsed_withdrawn_len += route_read_ret;
-        buffer += route_read_ret;
-
-        withdrawn_routes.push_back(route);
+    if (Prefix4::ParseList(buffer, withdrawn_len, withdrawn_routes) < 0) {
+        logger->log(ERROR, "BgpUpdateMessage::parse: error parsing withdrawn routes.\n");
+        setError(E_UPDATE, E_UNSPEC, NULL, 0);
+        return -1;
     }
 
-    if (parsed_withdrawn_len != withdrawn_len) throw "bad_parse";
+    // ParseList consumes the entire list or fails.
+    buffer += withdrawn_len;
 
     uint16_t attribute_len = ntohs(getValue<uint16_t>(&buffer)); // len: 2
     if ((size_t) (attribute_len + withdrawn_len + 4) > msg_sz) {
@@ -627,19 +809,21 @@ ssize_t BgpUpdateMessage::parse(const uint8_t *from, size_t msg_sz) {
             return -1;
         }
 
-        BgpPathAttrib *attrib = NULL;
+        std::shared_ptr<BgpPathAttrib> attrib;
 
         switch(attr_type) {
-            case ORIGIN: attrib = new BgpPathAttribOrigin(logger); break;
-            case AS_PATH: attrib = new BgpPathAttribAsPath(logger, use_4b_asn); break;
-            case NEXT_HOP: attrib = new BgpPathAttribNexthop(logger); break;
-            case MULTI_EXIT_DISC: attrib = new BgpPathAttribMed(logger); break;
-            case LOCAL_PREF: attrib = new BgpPathAttribLocalPref(logger); break;
-            case ATOMIC_AGGREGATE: attrib =  new BgpPathAttribAtomicAggregate(logger); break;
-            case AGGREATOR: attrib = new BgpPathAttribAggregator(logger, use_4b_asn); break;
-            case COMMUNITY: attrib = new BgpPathAttribCommunity(logger); break;
-            case AS4_PATH: attrib = new BgpPathAttribAs4Path(logger); break;
-            case AS4_AGGREGATOR: attrib = new BgpPathAttribAs4Aggregator(logger); break;
+            case ORIGIN: attrib = newAttrib<BgpPathAttribOrigin>(arena, logger); break;
+            case AS_PATH: attrib = newAttrib<BgpPathAttribAsPath>(arena, logger, use_4b_asn); break;
+            case NEXT_HOP: attrib = newAttrib<BgpPathAttribNexthop>(arena, logger); break;
+            case MULTI_EXIT_DISC: attrib = newAttrib<BgpPathAttribMed>(arena, logger); break;
+            case LOCAL_PREF: attrib = newAttrib<BgpPathAttribLocalPref>(arena, logger); break;
+            case ATOMIC_AGGREGATE: attrib = newAttrib<BgpPathAttribAtomicAggregate>(arena, logger); break;
+            case AGGREATOR: attrib = newAttrib<BgpPathAttribAggregator>(arena, logger, use_4b_asn); break;
+            case COMMUNITY: attrib = newAttrib<BgpPathAttribCommunity>(arena, logger); break;
+            case AS4_PATH: attrib = newAttrib<BgpPathAttribAs4Path>(arena, logger); break;
+            case AS4_AGGREGATOR: attrib = newAttrib<BgpPathAttribAs4Aggregator>(arena, logger); break;
+            case EXTENDED_COMMUNITY: attrib = newAttrib<BgpPathAttribExtCommunity>(arena, logger); break;
+            case LARGE_COMMUNITY: attrib = newAttrib<BgpPathAttribLargeCommunity>(arena, logger); break;
             case MP_REACH_NLRI: 
             case MP_UNREACH_NLRI: {
                 int16_t afi = BgpPathAttribMpNlriBase::GetAfiFromBuffer(buffer, attribute_len - parsed_attribute_len);
@@ -650,21 +834,21 @@ ssize_t BgpUpdateMessage::parse(const uint8_t *from, size_t msg_sz) {
                 }
 
                 if (afi == IPV6 && attr_type == MP_REACH_NLRI) {
-                    attrib = new BgpPathAttribMpReachNlriIpv6(logger);
+                    attrib = newAttrib<BgpPathAttribMpReachNlriIpv6>(arena, logger);
                     break;
                 }
                 
                 if (afi == IPV6 && attr_type == MP_UNREACH_NLRI) {
-                    attrib = new BgpPathAttribMpUnreachNlriIpv6(logger);
+                    attrib = newAttrib<BgpPathAttribMpUnreachNlriIpv6>(arena, logger);
                     break;
                 }
 
-                if (attr_type == MP_REACH_NLRI) attrib = new BgpPathAttribMpReachNlriUnknow(logger);
-                else attrib = new BgpPathAttribMpUnreachNlriUnknow(logger);
+                if (attr_type == MP_REACH_NLRI) attrib = newAttrib<BgpPathAttribMpReachNlriUnknow>(arena, logger);
+                else attrib = newAttrib<BgpPathAttribMpUnreachNlriUnknow>(arena, logger);
                 
                 break;
             }
-            default: attrib = new BgpPathAttrib(logger); break;
+            default: attrib = newAttrib<BgpPathAttrib>(arena, logger); break;
         }
 
         if (attrib == NULL) throw "bad_parse";
@@ -673,43 +857,24 @@ ssize_t BgpUpdateMessage::parse(const uint8_t *from, size_t msg_sz) {
 
         if (attrib_parsed < 0) {
             forwardParseError(*attrib);
-            delete attrib;
             return -1;
         }
 
         buffer += attrib_parsed;
         parsed_attribute_len += attrib_parsed;
-        path_attribute.push_back(std::shared_ptr<BgpPathAttrib>(attrib));
+        path_attribute.push_back(attrib);
     }
 
     if (parsed_attribute_len != attribute_len) throw "bad_parse";
 
-    // 4: len fields (withdrawn len & attrib len)
-    size_t nlri_len = msg_sz - 4 - parsed_attribute_len - parsed_withdrawn_len;
-    size_t parsed_nlri_len = 0;
-
-    while (parsed_nlri_len < nlri_len) {
-        if (nlri_len - parsed_nlri_len < 1) {
-            logger->log(ERROR, "BgpOpenMessage::parse: unexpected end of nlri.\n");
-            setError(E_UPDATE, E_UNSPEC, NULL, 0);
-            return -1;
-        }
-
-        Prefix4 route = Prefix4();
-        ssize_t route_read_ret = route.parse(buffer, nlri_len - parsed_nlri_len);
-        if (route_read_ret < 0) {
-            logger->log(ERROR, "BgpUpdateMessage::parse: error parsing route len in nlri routes.\n");
-            setError(E_UPDATE, E_UNSPEC, NULL, 0);
-            return -1;
-        }
-        parsed_nlri_len += route_read_ret;
-        buffer += route_read_ret;
+    reindexAttribs();
 
-        nlri.push_back(route);
-    }
-
-    if (parsed_nlri_len + parsed_attribute_len + parsed_withdrawn_len + 4 != msg_sz) {
-        throw "bad_parse";
+    // 4: len fields (withdrawn len & attrib len)
+    size_t nlri_len = msg_sz - 4 - parsed_attribute_len - withdrawn_len;
+    if (Prefix4::ParseList(buffer, nlri_len, nlri) < 0) {
+        logger->log(ERROR, "BgpUpdateMessage::parse: error parsing nlri routes.\n");
+        setError(E_UPDATE, E_UNSPEC, NULL, 0);
+        return -1;
     }
 
     if (nlri.size() > 0 && !validateAttribs()) return -1;
@@ -730,21 +895,15 @@ ssize_t BgpUpdateMessage::write(uint8_t *to, size_t buf_sz) const {
     uint8_t *withdrawn_routes_len_ptr = buffer; 
     buffer += 2; // skip the length field for now
 
-    size_t written_withdrawn_length = 0;
-
-    for (const Prefix4 &route : withdrawn_routes) {
-        size_t buf_avali = buf_sz - (written_withdrawn_length + tot_written);
-        ssize_t route_write_ret = route.write(buffer, buf_avali);
-
-        if (route_write_ret < 0) {
-            logger->log(ERROR, "BgpUpdateMessage::write: failed to write withdraw entry.\n");
-            return -1;
-        }
+    ssize_t written_withdrawn_length = Prefix4::WriteList(withdrawn_routes, buffer, buf_sz - 2);
 
-        buffer += route_write_ret;
-        written_withdrawn_length += route_write_ret;
+    if (written_withdrawn_length < 0) {
+        logger->log(ERROR, "BgpUpdateMessage::write: failed to write withdrawn routes.\n");
+        return -1;
     }
 
+    buffer += written_withdrawn_length;
+
     // now, put the length
     putValue<uint16_t>(&withdrawn_routes_len_ptr, htons(written_withdrawn_length));
 
@@ -775,19 +934,11 @@ ssize_t BgpUpdateMessage::write(uint8_t *to, size_t buf_sz) const {
 
     tot_written += written_attrib_length + 2;
 
-    size_t written_nlri_len = 0;
-
-    for (const Prefix4 &route : nlri) {
-        size_t buf_avali = buf_sz - (written_nlri_len + tot_written);
-        ssize_t route_write_ret = route.write(buffer, buf_avali);
+    ssize_t written_nlri_len = Prefix4::WriteList(nlri, buffer, buf_sz - tot_written);
 
-        if (route_write_ret < 0) {
-            logger->log(ERROR, "BgpUpdateMessage::write: failed to write nlri entry.\n");
-            return -1;
-        }
-
-        buffer += route_write_ret;
-        written_nlri_len += route_write_ret;
+    if (written_nlri_len < 0) {
+        logger->log(ERROR, "BgpUpdateMessage::write: failed to write nlri.\n");
+        return -1;
     }
 
     tot_written += written_nlri_len;
@@ -16,6 +16,7 @@
 #include "prefix4.h"
 #include "bgp-message.h"
 #include "bgp-path-attrib.h"
+#include "bgp-arena.h"
 
 namespace libbgp {
 
@@ -32,6 +33,7 @@ public:
     std::vector<Prefix4> nlri;
 
     BgpUpdateMessage(BgpLogHandler *logger, bool use_4b_asn);
+    BgpUpdateMessage(BgpLogHandler *logger, bool use_4b_asn, BgpArena *arena);
 
     // get attribute by type, if attrib of that type does not exist, exception
     // will be thrown
@@ -44,6 +46,38 @@ public:
     // return true if this type of attribute is in the message
     bool hasAttrib(uint8_t type) const;
 
+    // typed attribute getters, return NULL if the attribute does not exist
+    BgpPathAttribOrigin *getOrigin();
+    const BgpPathAttribOrigin *getOrigin() const;
+    BgpPathAttribAsPath *getAsPath();
+    const BgpPathAttribAsPath *getAsPath() const;
+    BgpPathAttribNexthop *getNexthop();
+    const BgpPathAttribNexthop *getNexthop() const;
+    BgpPathAttribMed *getMed();
+    const BgpPathAttribMed *getMed() const;
+    BgpPathAttribLocalPref *getLocalPref();
+    const BgpPathAttribLocalPref *getLocalPref() const;
+    BgpPathAttribAggregator *getAggregator();
+    const BgpPathAttribAggregator *getAggregator() const;
+    BgpPathAttribCommunity *getCommunity();
+    const BgpPathAttribCommunity *getCommunity() const;
+    BgpPathAttribAs4Path *getAs4Path();
+    const BgpPathAttribAs4Path *getAs4Path() const;
+    BgpPathAttribAs4Aggregator *getAs4Aggregator();
+    const BgpPathAttribAs4Aggregator *getAs4Aggregator() const;
+    BgpPathAttribExtCommunity *getExtCommunity();
+    const BgpPathAttribExtCommunity *getExtCommunity() const;
+    BgpPathAttribLargeCommunity *getLargeCommunity();
+    const BgpPathAttribLargeCommunity *getLargeCommunity() const;
+    BgpPathAttribMpReachNlriIpv6 *getMpReachNlri6();
+    const BgpPathAttribMpReachNlriIpv6 *getMpReachNlri6() const;
+    BgpPathAttribMpUnreachNlriIpv6 *getMpUnreachNlri6();
+    const BgpPathAttribMpUnreachNlriIpv6 *getMpUnreachNlri6() const;
+
+    // rebuild the attribute index. call this after modifying path_attribute
+    // directly.
+    void reindexAttribs();
+
     // copy and add an attribute, return false if attrib of same type already exists
     bool addAttrib(const BgpPathAttrib &attrib);
 
@@ -112,7 +146,31 @@ private:
     // no missing well-known)
     bool validateAttribs();
 
+    // test if the attribute index is up to date.
+    bool indexValid() const;
+
+    // get index of attribute in path_attribute, -1 if no such attribute.
+    ssize_t findAttrib(uint8_t type) const;
+    ssize_t findAttrib(uint8_t type);
+
+    // get attribute of the given class by type, NULL if no such attribute.
+    template <typename T> T *findTypedAttrib(uint8_t type) const;
+
     bool use_4b_asn;
+
+    // arena to create parsed attributes in. (NULL: use heap)
+    BgpArena *arena;
+
+    // index of attributes by type code: position in path_attribute plus one,
+    // or 0 if no attribute of the type.
+    uint16_t attrib_slots[256];
+
+    // bitmap of type codes whose attribute is of the typed getter's class.
+    uint32_t attrib_typed[8];
+
+    // storage and size of path_attribute when the index was built.
+    const std::shared_ptr<BgpPathAttrib> *indexed_data;
+    size_t indexed_size;
 };
 
 }
@@ -0,0 +1,573 @@
+/**
+ * @file bgp-update-scanner.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief The BGP update message scanner.
+ * @version 0.1
+ * @date 2019-08-04
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <string.h>
+#include <stdlib.h>
+#include <arpa/inet.h>
+#include "bgp-update-scanner.h"
+#include "bgp-path-attrib.h"
+#include "bgp-message.h"
+#include "bgp-errcode.h"
+#include "bgp-afi.h"
+#include "prefix4.h"
+#include "value-op.h"
+
+namespace libbgp {
+
+/**
+ * @brief Read a 16 bits length / afi field.
+ * 
+ * @param buffer Pointer to the field.
+ * @return uint16_t The value in host byte order.
+ */
+static inline uint16_t getLength(const uint8_t *buffer) {
+    return ntohs(getValue<uint16_t>(&buffer));
+}
+
+/**
+ * @brief Check if a packed prefix list is well-formed.
+ * 
+ * @param buffer The list.
+ * @param len Length of the list.
+ * @param max_len Max prefix length. (32 for IPv4, 128 for IPv6)
+ * @return true List is good.
+ * @return false List is bad.
+ */
+static bool validatePrefixList(const uint8_t *buffer, size_t len, uint8_t max_len) {
+    size_t offset = 0;
+
+    while (offset < len) {
+        uint8_t length = buffer[offset];
+        if (length > max_len) return false;
+        offset += 1 + (length + 7) / 8;
+    }
+
+    return offset == len;
+}
+
+/**
+ * @brief Check if AS_PATH / AS4_PATH segments are well-formed.
+ * 
+ * @param buffer The attribute value.
+ * @param len Length of the attribute value.
+ * @param asn_sz Size of an ASN. (2 or 4)
+ * @return true Segments are good.
+ * @return false Segments are bad.
+ */
+static bool validateAsPath(const uint8_t *buffer, size_t len, size_t asn_sz) {
+    size_t offset = 0;
+
+    while (offset < len) {
+        if (len - offset < 3) return false;
+        uint8_t n_asn = buffer[offset + 1];
+        offset += 2 + n_asn * asn_sz;
+    }
+
+    return offset == len;
+}
+
+/**
+ * @brief Construct a new BgpUpdateScanner object.
+ * 
+ * @param logger Pointer to logger object for error logging.
+ * @param use_4b_asn Use four octets ASN.
+ * @param visitor The visitor. (NULL: validate only)
+ */
+BgpUpdateScanner::BgpUpdateScanner(BgpLogHandler *logger, bool use_4b_asn, BgpUpdateVisitor *visitor) : Serializable(logger) {
+    this->use_4b_asn = use_4b_asn;
+    this->visitor = visitor;
+}
+
+/**
+ * @brief Scan a full BGP message.
+ * 
+ * The message header is validated the same way BgpSink does. Messages other
+ * than update are skipped. This is useful for scanning packets from sources
+ * other than a BGP session, like MRT dumps.
+ * 
+ * @param from Pointer to the message.
+ * @param buf_sz Size of the buffer.
+ * @return ssize_t Bytes read.
+ * @retval -1 Malformed message.
+ * @retval 0 Incomplete message.
+ * @retval >0 Bytes read. (length of the message)
+ */
+ssize_t BgpUpdateScanner::scanPacket(const uint8_t *from, size_t buf_sz) {
+    clearError();
+
+    if (buf_sz < 19) return 0;
+
+    if (memcmp(from, "\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff\xff", 16) != 0) {
+        logger->log(ERROR, "BgpUpdateScanner::scanPacket: invalid BGP marker.\n");
+        setError(E_HEADER, E_SYNC, NULL, 0);
+        return -1;
+    }
+
+    const uint8_t *buffer = from + 16;
+    uint16_t pkt_len = ntohs(getValue<uint16_t>(&buffer));
+    uint8_t type = getValue<uint8_t>(&buffer);
+
+    if (pkt_len < 19 || pkt_len > 4096) {
+        logger->log(ERROR, "BgpUpdateScanner::scanPacket: invalid BGP packet length (%d).\n", pkt_len);
+        pkt_len = htons(pkt_len);
+        setError(E_HEADER, E_LENGTH, (const uint8_t *) &pkt_len, sizeof(uint16_t));
+        return -1;
+    }
+
+    if (pkt_len > buf_sz) return 0;
+    if (type != UPDATE) return pkt_len;
+
+    ssize_t parsed_len = parse(buffer, pkt_len - 19);
+    if (parsed_len < 0) return -1;
+
+    return pkt_len;
+}
+
+/**
+ * @brief Scan an update message.
+ * 
+ * The message is validated first, and the visitor is invoked only if the
+ * message is good.
+ * 
+ * @param from Pointer to the update message body.
+ * @param msg_sz Size of the message body.
+ * @return ssize_t Bytes read.
+ * @retval -1 Malformed message.
+ * @retval >=0 Bytes read.
+ */
+ssize_t BgpUpdateScanner::parse(const uint8_t *from, size_t msg_sz) {
+    clearError();
+
+    if (msg_sz < 4) {
+        uint8_t _err_data = msg_sz;
+        setError(E_HEADER, E_LENGTH, &_err_data, sizeof(uint8_t));
+        logger->log(ERROR, "BgpUpdateScanner::parse: invalid update message size: %d.\n", msg_sz);
+        return -1;
+    }
+
+    const uint8_t *buffer = from;
+
+    uint16_t withdrawn_len = ntohs(getValue<uint16_t>(&buffer));
+
+    if (withdrawn_len > msg_sz - 4) {
+        logger->log(ERROR, "BgpUpdateScanner::parse: withdrawn routes length overflows message.\n");
+        setError(E_UPDATE, E_UNSPEC, NULL, 0);
+        return -1;
+    }
+
+    const uint8_t *withdrawn = buffer;
+
+    if (!validatePrefixList(withdrawn, withdrawn_len, 32)) {
+        logger->log(ERROR, "BgpUpdateScanner::parse: error parsing withdrawn routes.\n");
+        setError(E_UPDATE, E_UNSPEC, NULL, 0);
+        return -1;
+    }
+
+    buffer += withdrawn_len;
+
+    uint16_t attribute_len = ntohs(getValue<uint16_t>(&buffer));
+    if ((size_t) (attribute_len + withdrawn_len + 4) > msg_sz) {
+        logger->log(ERROR, "BgpUpdateScanner::parse: attribute list length overflows message buffer.\n");
+        setError(E_UPDATE, E_ATTR_LIST, NULL, 0);
+        return -1;
+    }
+
+    const uint8_t *attribs = buffer;
+    uint32_t typecode_bitsmap[8] = {0};
+    bool has_dup = false;
+    uint8_t dup_type = 0;
+    size_t parsed_attribute_len = 0;
+
+    while (parsed_attribute_len < attribute_len) {
+        const uint8_t *attr = attribs + parsed_attribute_len;
+        size_t attr_buf_sz = attribute_len - parsed_attribute_len;
+
+        if (attr_buf_sz < 3) {
+            logger->log(ERROR, "BgpUpdateScanner::parse: unexpected end of attribute list.\n");
+            setError(E_UPDATE, E_UNSPEC, NULL, 0);
+            return -1;
+        }
+
+        uint8_t type_code = attr[1];
+
+        if (type_code == 0) {
+            logger->log(ERROR, "BgpUpdateScanner::parse: failed to parse attribute type.\n");
+            setError(E_UPDATE, E_UNSPEC, NULL, 0);
+            return -1;
+        }
+
+        ssize_t attr_len = validateAttrib(attr, attr_buf_sz);
+        if (attr_len < 0) return -1;
+
+        if ((typecode_bitsmap[type_code / 32] >> (type_code % 32)) & 1U) {
+            if (!has_dup) dup_type = type_code;
+            has_dup = true;
+        }
+
+        typecode_bitsmap[type_code / 32] |= 1U << (type_code % 32);
+        parsed_attribute_len += attr_len;
+    }
+
+    buffer += attribute_len;
+
+    size_t nlri_len = msg_sz - 4 - attribute_len - withdrawn_len;
+    const uint8_t *nlri = buffer;
+
+    if (!validatePrefixList(nlri, nlri_len, 32)) {
+        logger->log(ERROR, "BgpUpdateScanner::parse: error parsing nlri routes.\n");
+        setError(E_UPDATE, E_UNSPEC, NULL, 0);
+        return -1;
+    }
+
+    if (nlri_len > 0) {
+        if (has_dup) {
+            logger->log(ERROR, "BgpUpdateScanner::parse: duplicated attribute type in list: %d\n", dup_type);
+            setError(E_UPDATE, E_ATTR_LIST, NULL, 0);
+            return -1;
+        }
+
+        bool has_origin = (typecode_bitsmap[0] >> ORIGIN) & 1U;
+        bool has_as_path = (typecode_bitsmap[0] >> AS_PATH) & 1U;
+        bool has_nexthop = (typecode_bitsmap[0] >> NEXT_HOP) & 1U;
+
+        if (!(has_as_path && has_nexthop && has_origin)) {
+            logger->log(ERROR, "BgpUpdateScanner::parse: mandatory attribute(s) missing.\n");
+            setError(E_UPDATE, E_MISS_WELL_KNOWN, NULL, 0);
+            return -1;
+        }
+    }
+
+    if (visitor == NULL) return msg_sz;
+
+    // message is good, visit.
+    const uint8_t *ptr = withdrawn;
+    const uint8_t *end = withdrawn + withdrawn_len;
+
+    while (ptr < end) {
+        uint8_t length = *ptr++;
+        size_t prefix_buf_len = (length + 7) / 8;
+        uint32_t prefix = 0;
+        memcpy(&prefix, ptr, prefix_buf_len);
+        visitor->onWithdraw4(prefix, length);
+        ptr += prefix_buf_len;
+    }
+
+    ptr = attribs;
+    end = attribs + attribute_len;
+
+    while (ptr < end) {
+        uint8_t flags = ptr[0];
+        uint8_t type_code = ptr[1];
+        bool extended = (flags >> 4) & 0x1;
+        size_t value_len = extended ? getLength(ptr + 2) : ptr[2];
+        size_t hdr_len = extended ? 4 : 3;
+        visitor->onAttribute(flags, type_code, ptr + hdr_len, value_len);
+        ptr += hdr_len + value_len;
+    }
+
+    if (((typecode_bitsmap[0] >> MP_UNREACH_NLRI) & 1U) || ((typecode_bitsmap[0] >> MP_REACH_NLRI) & 1U)) {
+        const uint8_t mp_types[2] = { MP_UNREACH_NLRI, MP_REACH_NLRI };
+
+        for (uint8_t mp_type : mp_types) {
+            ptr = attribs;
+
+            while (ptr < end) {
+                bool extended = (ptr[0] >> 4) & 0x1;
+                size_t value_len = extended ? getLength(ptr + 2) : ptr[2];
+                size_t hdr_len = extended ? 4 : 3;
+                if (ptr[1] == mp_type) visitMpNlri(mp_type, ptr + hdr_len, value_len);
+                ptr += hdr_len + value_len;
+            }
+        }
+    }
+
+    ptr = nlri;
+    end = nlri + nlri_len;
+
+    while (ptr < end) {
+        uint8_t length = *ptr++;
+        size_t prefix_buf_len = (length + 7) / 8;
+        uint32_t prefix = 0;
+        memcpy(&prefix, ptr, prefix_buf_len);
+        visitor->onNlri4(prefix, length);
+        ptr += prefix_buf_len;
+    }
+
+    visitor->onUpdateEnd();
+
+    return msg_sz;
+}
+
+/**
+ * @brief Write is not supported by the scanner.
+ * 
+ * @return ssize_t Always -1.
+ */
+ssize_t BgpUpdateScanner::write(__attribute__((unused)) uint8_t *to, __attribute__((unused)) size_t buf_sz) const {
+    logger->log(ERROR, "BgpUpdateScanner::write: scanner can't be serialized.\n");
+    return -1;
+}
+
+/**
+ * @brief Replace the visitor.
+ * 
+ * @param visitor The new visitor. (NULL: validate only)
+ */
+void BgpUpdateScanner::setVisitor(BgpUpdateVisitor *visitor) {
+    this->visitor = visitor;
+}
+
+/**
+ * @brief Set the ASN size of the session.
+ * 
+ * @param use_4b_asn Use four octets ASN.
+ */
+void BgpUpdateScanner::setUse4bAsn(bool use_4b_asn) {
+    this->use_4b_asn = use_4b_asn;
+}
+
+ssize_t BgpUpdateScanner::doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const {
+    return _print(indent, to, buf_sz, "UpdateScanner { }\n");
+}
+
+void BgpUpdateScanner::clearError() {
+    if (err_len > 0 && err_data != NULL) free(err_data);
+    err_data = NULL;
+    err_len = 0;
+    err_code = 0;
+    err_subcode = 0;
+}
+
+ssize_t BgpUpdateScanner::validateAttrib(const uint8_t *from, size_t buf_sz) {
+    uint8_t flags = from[0];
+    uint8_t type_code = from[1];
+
+    bool optional = (flags >> 7) & 0x1;
+    bool transitive = (flags >> 6) & 0x1;
+    bool partial = (flags >> 5) & 0x1;
+    bool extended = (flags >> 4) & 0x1;
+
+    if (extended && buf_sz < 4) {
+        logger->log(ERROR, "BgpUpdateScanner::validateAttrib: invalid attribute header size (extended but size < 4).\n");
+        setError(E_UPDATE, E_UNSPEC_UPDATE, NULL, 0);
+        return -1;
+    }
+
+    size_t hdr_len = extended ? 4 : 3;
+    size_t value_len = extended ? getLength(from + 2) : from[2];
+
+    if (value_len > buf_sz - hdr_len) {
+        logger->log(ERROR, "BgpUpdateScanner::validateAttrib: value_length (%zu) < buffer left (%zu).\n", value_len, buf_sz - hdr_len);
+        setError(E_UPDATE, E_UNSPEC_UPDATE, NULL, 0);
+        return -1;
+    }
+
+    const uint8_t *value = from + hdr_len;
+    size_t attr_len = value_len + hdr_len;
+
+    // well-known or optional; transitive or not; (want_len, min_len): fixed
+    // length attributes.
+    bool want_optional = false;
+    bool want_transitive = true;
+    size_t min_len = 0;
+    ssize_t want_len = -1;
+
+    // optional transitive attributes that may be long, or partial.
+    bool allow_extended_partial = false;
+
+    switch (type_code) {
+        case ORIGIN: min_len = want_len = 1; break;
+        case NEXT_HOP: min_len = want_len = 4; break;
+        case LOCAL_PREF: min_len = want_len = 4; break;
+        case ATOMIC_AGGREGATE: want_len = 0; break;
+        case MULTI_EXIT_DISC:
+            min_len = want_len = 4;
+            want_optional = true;
+            want_transitive = false;
+            break;
+        case AGGREATOR:
+            min_len = want_len = use_4b_asn ? 8 : 6;
+            want_optional = true;
+            break;
+        case AS4_AGGREGATOR:
+            min_len = want_len = 8;
+            want_optional = true;
+            break;
+        case COMMUNITY:
+            min_len = 4;
+            want_optional = true;
+            if (value_len >= 4 && value_len % 4 != 0) {
+                logger->log(ERROR, "BgpUpdateScanner::validateAttrib: bad community length, want multiple of 4, saw %d.\n", value_len);
+                setError(E_UPDATE, E_ATTR_LEN, from, attr_len);
+                return -1;
+            }
+            break;
+        case EXTENDED_COMMUNITY:
+        case LARGE_COMMUNITY: {
+            size_t unit = type_code == LARGE_COMMUNITY ? 12 : 8;
+            min_len = unit;
+            want_optional = true;
+            allow_extended_partial = true;
+            if (value_len >= unit && value_len % unit != 0) {
+                logger->log(ERROR, "BgpUpdateScanner::validateAttrib: bad community length for attribute %d, want multiple of %zu, saw %d.\n", type_code, unit, value_len);
+                setError(E_UPDATE, E_ATTR_LEN, from, attr_len);
+                return -1;
+            }
+            break;
+        }
+        case AS_PATH: break;
+        case AS4_PATH: want_optional = true; break;
+        case MP_REACH_NLRI:
+        case MP_UNREACH_NLRI:
+            if (!optional || transitive || extended) {
+                logger->log(ERROR, "BgpUpdateScanner::validateAttrib: bad flag bits for mp-bgp attribute, must be optional, !extended, !transitive.\n");
+                setError(E_UPDATE, E_ATTR_FLAG, from, attr_len);
+                return -1;
+            }
+
+            if (!validateMpNlri(type_code, value, value_len)) return -1;
+            return attr_len;
+        default:
+            if (!optional && transitive) {
+                logger->log(ERROR, "BgpUpdateScanner::validateAttrib: flag indicates well-known, mandatory but attribute %d is unknown.\n", type_code);
+                setError(E_UPDATE, E_BAD_WELL_KNOWN, from, attr_len);
+                return -1;
+            }
+
+            if (optional && !transitive && partial) {
+                logger->log(ERROR, "BgpUpdateScanner::validateAttrib: optional non-transitive must not be partial.\n");
+                setError(E_UPDATE, E_ATTR_FLAG, from, attr_len);
+                return -1;
+            }
+
+            return attr_len;
+    }
+
+    bool is_as_path = type_code == AS_PATH || type_code == AS4_PATH;
+
+    // as_path checks flags first, others check length first.
+    if (!is_as_path) {
+        if (value_len < min_len) {
+            logger->log(ERROR, "BgpUpdateScanner::validateAttrib: incomplete attribute %d.\n", type_code);
+            setError(E_UPDATE, E_UNSPEC_UPDATE, NULL, 0);
+            return -1;
+        }
+
+        if (want_len >= 0 && value_len != (size_t) want_len) {
+            logger->log(ERROR, "BgpUpdateScanner::validateAttrib: bad length for attribute %d, want %d, saw %d.\n", type_code, want_len, value_len);
+            setError(E_UPDATE, E_ATTR_LEN, from, attr_len);
+            return -1;
+        }
+    }
+
+    if (optional != want_optional || transitive != want_transitive || ((extended || partial) && !allow_extended_partial)) {
+        logger->log(ERROR, "BgpUpdateScanner::validateAttrib: bad flag bits for attribute %d.\n", type_code);
+        setError(E_UPDATE, E_ATTR_FLAG, from, attr_len);
+        return -1;
+    }
+
+    if (type_code == ORIGIN && value[0] > 2) {
+        logger->log(ERROR, "BgpUpdateScanner::validateAttrib: Bad Origin Value: %d.\n", value[0]);
+        setError(E_UPDATE, E_ORIGIN, from, 4);
+        return -1;
+    }
+
+    if (is_as_path && !validateAsPath(value, value_len, (type_code == AS4_PATH || use_4b_asn) ? 4 : 2)) {
+        logger->log(ERROR, "BgpUpdateScanner::validateAttrib: malformed as_path segment.\n");
+        setError(E_UPDATE, E_AS_PATH, NULL, 0);
+        return -1;
+    }
+
+    return attr_len;
+}
+
+bool BgpUpdateScanner::validateMpNlri(uint8_t type, const uint8_t *value, size_t value_len) {
+    if (value_len < 5) {
+        logger->log(ERROR, "BgpUpdateScanner::validateMpNlri: incompete attribute.\n");
+        setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
+        return false;
+    }
+
+    uint16_t afi = getLength(value);
+
+    if (type == MP_UNREACH_NLRI) {
+        if (afi == IPV6 && !validatePrefixList(value + 3, value_len - 3, 128)) {
+            logger->log(ERROR, "BgpUpdateScanner::validateMpNlri: error parsing withdrawn entry.\n");
+            setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
+            return false;
+        }
+
+        return true;
+    }
+
+    uint8_t nexthop_len = value[3];
+
+    if (afi == IPV6 && nexthop_len != 16 && nexthop_len != 32) {
+        logger->log(ERROR, "BgpUpdateScanner::validateMpNlri: bad nexthop length %d (want 16 or 32).\n", nexthop_len);
+        setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
+        return false;
+    }
+
+    // 4: afi, safi, nexthop length. 1: reserved
+    if (value_len < 4 + (size_t) nexthop_len + 1) {
+        logger->log(ERROR, "BgpUpdateScanner::validateMpNlri: nexthop overflows attribute.\n");
+        setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
+        return false;
+    }
+
+    size_t nlri_offset = 4 + nexthop_len + 1;
+
+    if (afi == IPV6 && !validatePrefixList(value + nlri_offset, value_len - nlri_offset, 128)) {
+        logger->log(ERROR, "BgpUpdateScanner::validateMpNlri: error parsing nlri entry.\n");
+        setError(E_UPDATE, E_OPT_ATTR, NULL, 0);
+        return false;
+    }
+
+    return true;
+}
+
+void BgpUpdateScanner::visitMpNlri(uint8_t type, const uint8_t *value, size_t value_len) {
+    uint16_t afi = getLength(value);
+    uint8_t safi = value[2];
+
+    if (afi != IPV6) return;
+
+    const uint8_t *ptr = NULL;
+    const uint8_t *end = value + value_len;
+    bool reach = type == MP_REACH_NLRI;
+
+    if (reach) {
+        uint8_t nexthop_len = value[3];
+        uint8_t nexthop_linklocal[16];
+
+        if (nexthop_len == 32) memcpy(nexthop_linklocal, value + 4 + 16, 16);
+        else memset(nexthop_linklocal, 0, 16);
+
+        visitor->onMpReach6(safi, value + 4, nexthop_linklocal);
+        ptr = value + 4 + nexthop_len + 1;
+    } else {
+        visitor->onMpUnreach6(safi);
+        ptr = value + 3;
+    }
+
+    while (ptr < end) {
+        uint8_t length = *ptr++;
+        size_t prefix_buf_len = (length + 7) / 8;
+        uint8_t prefix[16] = {0};
+        memcpy(prefix, ptr, prefix_buf_len);
+
+        if (reach) visitor->onNlri6(prefix, length);
+        else visitor->onWithdraw6(prefix, length);
+
+        ptr += prefix_buf_len;
+    }
+}
+
+}
@@ -0,0 +1,82 @@
+/**
+ * @file bgp-update-scanner.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief The BGP update message scanner.
+ * @version 0.1
+ * @date 2019-08-04
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_UPDATE_SCANNER_H_
+#define BGP_UPDATE_SCANNER_H_
+#include <stdint.h>
+#include <unistd.h>
+#include "serializable.h"
+#include "bgp-update-visitor.h"
+
+namespace libbgp {
+
+/**
+ * @brief The BgpUpdateScanner class.
+ * 
+ * BgpUpdateScanner validates update messages and passes their content to a
+ * BgpUpdateVisitor, straight from the raw message buffer. Unlike
+ * BgpUpdateMessage::parse, no objects are created and no memory is allocated
+ * (except for the error payload, if the message is malformed).
+ * 
+ * Messages are validated the same way BgpUpdateMessage::parse does, and the
+ * same error codes are reported through getErrorCode(), getErrorSubCode() and
+ * getError(), so they can be used to build the NOTIFICATION message.
+ * 
+ * write() is not supported.
+ */
+class BgpUpdateScanner : public Serializable {
+public:
+    BgpUpdateScanner(BgpLogHandler *logger, bool use_4b_asn, BgpUpdateVisitor *visitor);
+
+    // scan a full BGP message (header included), skip if not an update
+    ssize_t scanPacket(const uint8_t *from, size_t buf_sz);
+
+    // scan an update message body
+    ssize_t parse(const uint8_t *from, size_t msg_sz);
+
+    ssize_t write(uint8_t *to, size_t buf_sz) const;
+
+    // replace the visitor (NULL: validate only)
+    void setVisitor(BgpUpdateVisitor *visitor);
+
+    // set the ASN size of the session
+    void setUse4bAsn(bool use_4b_asn);
+
+    virtual ~BgpUpdateScanner() {}
+
+protected:
+    ssize_t doPrint(size_t indent, uint8_t **to, size_t *buf_sz) const;
+
+private:
+    // clear error left by previous scan
+    void clearError();
+
+    // validate a path attribute, return attribute length (header included)
+    ssize_t validateAttrib(const uint8_t *from, size_t buf_sz);
+
+    // validate MP_REACH_NLRI / MP_UNREACH_NLRI value
+    bool validateMpNlri(uint8_t type, const uint8_t *value, size_t value_len);
+
+    // invoke visitor for MP_REACH_NLRI / MP_UNREACH_NLRI value
+    void visitMpNlri(uint8_t type, const uint8_t *value, size_t value_len);
+
+    bool use_4b_asn;
+    BgpUpdateVisitor *visitor;
+};
+
+/**
+ * @example update-scanner.cc
+ * Example of scanning update messages with BgpUpdateScanner. This example
+ * also compares the scanner with BgpPacket::parse.
+ */
+
+}
+
+#endif // BGP_UPDATE_SCANNER_H_
@@ -0,0 +1,114 @@
+/**
+ * @file bgp-update-visitor.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief The BGP update message visitor.
+ * @version 0.1
+ * @date 2019-08-04
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_UPDATE_VISITOR_H_
+#define BGP_UPDATE_VISITOR_H_
+#include <stdint.h>
+#include <unistd.h>
+
+namespace libbgp {
+
+/**
+ * @brief The BGP update message visitor.
+ * 
+ * BgpUpdateVisitor receives the content of update messages scanned by
+ * BgpUpdateScanner, directly from the raw message buffer. Implement the
+ * handlers you are interested in; all handlers do nothing by default.
+ * 
+ * The handlers are only invoked after the entire message has been validated,
+ * so a malformed message never reaches the visitor. For each message, the
+ * handlers are called in the following order:
+ * 
+ * 1. onWithdraw4() for every IPv4 withdrawn route.
+ * 2. onAttribute() for every path attribute, in the order they appear in the
+ * message. (MP_REACH_NLRI and MP_UNREACH_NLRI included)
+ * 3. onMpUnreach6() and then onWithdraw6() for every route in each IPv6
+ * MP_UNREACH_NLRI attribute.
+ * 4. onMpReach6() and then onNlri6() for every route in each IPv6
+ * MP_REACH_NLRI attribute.
+ * 5. onNlri4() for every IPv4 NLRI route.
+ * 6. onUpdateEnd().
+ * 
+ * Pointers passed to the handlers point into the message buffer and are only
+ * valid during the call.
+ */
+class BgpUpdateVisitor {
+public:
+
+    /**
+     * @brief Handle an IPv4 withdrawn route.
+     * 
+     * @param prefix Prefix in network byte order.
+     * @param length Netmask in CIDR notation.
+     */
+    virtual void onWithdraw4(__attribute__((unused)) uint32_t prefix, __attribute__((unused)) uint8_t length) {}
+
+    /**
+     * @brief Handle a path attribute.
+     * 
+     * @param flags Attribute flags. (optional, transitive, partial, extended)
+     * @param type Attribute type code.
+     * @param value Pointer to the attribute value.
+     * @param value_len Length of the attribute value.
+     */
+    virtual void onAttribute(__attribute__((unused)) uint8_t flags, __attribute__((unused)) uint8_t type, __attribute__((unused)) const uint8_t *value, __attribute__((unused)) size_t value_len) {}
+
+    /**
+     * @brief Handle the start of an IPv6 MP_UNREACH_NLRI attribute.
+     * 
+     * @param safi SAFI of the attribute.
+     */
+    virtual void onMpUnreach6(__attribute__((unused)) uint8_t safi) {}
+
+    /**
+     * @brief Handle an IPv6 withdrawn route.
+     * 
+     * @param prefix Prefix, zero-extended to 16 bytes.
+     * @param length Netmask in CIDR notation.
+     */
+    virtual void onWithdraw6(__attribute__((unused)) const uint8_t prefix[16], __attribute__((unused)) uint8_t length) {}
+
+    /**
+     * @brief Handle the start of an IPv6 MP_REACH_NLRI attribute.
+     * 
+     * @param safi SAFI of the attribute.
+     * @param nexthop_global Global nexthop.
+     * @param nexthop_linklocal Link-local nexthop. (all zero if not present)
+     */
+    virtual void onMpReach6(__attribute__((unused)) uint8_t safi, __attribute__((unused)) const uint8_t nexthop_global[16], __attribute__((unused)) const uint8_t nexthop_linklocal[16]) {}
+
+    /**
+     * @brief Handle an IPv6 NLRI route.
+     * 
+     * @param prefix Prefix, zero-extended to 16 bytes.
+     * @param length Netmask in CIDR notation.
+     */
+    virtual void onNlri6(__attribute__((unused)) const uint8_t prefix[16], __attribute__((unused)) uint8_t length) {}
+
+    /**
+     * @brief Handle an IPv4 NLRI route.
+     * 
+     * @param prefix Prefix in network byte order.
+     * @param length Netmask in CIDR notation.
+     */
+    virtual void onNlri4(__attribute__((unused)) uint32_t prefix, __attribute__((unused)) uint8_t length) {}
+
+    /**
+     * @brief Handle the end of an update message.
+     * 
+     */
+    virtual void onUpdateEnd() {}
+
+    virtual ~BgpUpdateVisitor() {}
+};
+
+}
+
+#endif // BGP_UPDATE_VISITOR_H_
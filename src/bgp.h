@@ -15,6 +15,7 @@
 #include "bgp-bad-message.h"
 #include "bgp-open-message.h"
 #include "bgp-update-message.h"
+#include "bgp-update-scanner.h"
 #include "bgp-keepalive-message.h"
 #include "bgp-notification-message.h"
 #include "bgp-path-attrib.h"
@@ -0,0 +1,449 @@
+/**
+ * @file prefix-set.cc
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Large shared prefix sets.
+ * @version 0.1
+ * @date 2019-08-06
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#include <stdio.h>
+#include <string.h>
+#include <arpa/inet.h>
+#include "prefix-set.h"
+#include "prefix-trie.h"
+
+namespace libbgp {
+
+/**
+ * @brief The path-compressed trie behind PrefixSet4 and PrefixSet6.
+ * 
+ * Only nodes where prefixes branch or end are stored. Each node that ends an
+ * entry keeps a bitmap of the route lengths it accepts, so entries with the
+ * same prefix but different ge/le ranges share a node.
+ * 
+ * @tparam N Size of the address in bytes.
+ */
+template <size_t N>
+class PrefixSetTrie {
+public:
+    PrefixSetTrie() : trie(BlankNode()) {
+        entries = 0;
+    }
+
+    void insert(const uint8_t *prefix, uint8_t length, uint8_t ge, uint8_t le) {
+        setMask(trie.insert(prefix, length), ge, le);
+        entries++;
+    }
+
+    bool includes(const uint8_t *prefix, uint8_t length) const {
+        return trie.walk(prefix, length, 0, [&](uint32_t cur) {
+            uint32_t mask = trie.nodes[cur].mask;
+            return mask != NO_MASK && ((masks[mask + (length >> 6)] >> (length & 63)) & 1);
+        });
+    }
+
+    size_t size() const {
+        return entries;
+    }
+
+    // visit the entries with visit(prefix, length, ge, le). entries on the same
+    // prefix are visited once per run of accepted route lengths.
+    template <typename F> void forEach(const F &visit) const {
+        for (const Node &node : trie.nodes) {
+            if (node.mask == NO_MASK) continue;
+
+            const uint64_t *mask = &masks[node.mask];
+            int ge = -1;
+
+            for (int len = 0; len <= (int) (N * 8) + 1; len++) {
+                bool set = len <= (int) (N * 8) && ((mask[len >> 6] >> (len & 63)) & 1);
+                if (set && ge < 0) ge = len;
+                if (set || ge < 0) continue;
+                visit(node.prefix, node.length, ge, len - 1);
+                ge = -1;
+            }
+        }
+    }
+
+    void shrink() {
+        trie.nodes.shrink_to_fit();
+        masks.shrink_to_fit();
+    }
+
+private:
+    static const uint32_t NO_MASK = 0xffffffff;
+    static const size_t MASK_WORDS = (N * 8) / 64 + 1;
+
+    struct Node {
+        uint8_t prefix[N];
+        uint8_t length;
+        uint32_t child[2];
+        uint32_t mask;
+    };
+
+    static Node BlankNode() {
+        Node node;
+        memset(&node, 0, sizeof(Node));
+        node.mask = NO_MASK;
+        return node;
+    }
+
+    void setMask(uint32_t node, uint8_t ge, uint8_t le) {
+        if (trie.nodes[node].mask == NO_MASK) {
+            trie.nodes[node].mask = masks.size();
+            masks.resize(masks.size() + MASK_WORDS, 0);
+        }
+
+        uint64_t *mask = &masks[trie.nodes[node].mask];
+        for (uint32_t len = ge; len <= le; len++) {
+            mask[len >> 6] |= (uint64_t) 1 << (len & 63);
+        }
+    }
+
+    PrefixTrie<N, Node> trie;
+    std::vector<uint64_t> masks;
+    size_t entries;
+};
+
+/**
+ * @brief Validate a prefix set entry.
+ * 
+ * @param logger Log handler.
+ * @param where Name of the caller, for logging.
+ * @param prefix Prefix.
+ * @param length Prefix length.
+ * @param ge Minimum route length.
+ * @param le Maximum route length.
+ * @param max_length Address length.
+ * @retval true Entry valid.
+ * @retval false Entry invalid.
+ */
+static bool ValidateEntry(BgpLogHandler *logger, const char *where, const uint8_t *prefix, uint8_t length, uint8_t ge, uint8_t le, uint8_t max_length) {
+    if (length > max_length || ge < length || le < ge || le > max_length) {
+        logger->log(ERROR, "%s: invalid entry (length %d, ge %d, le %d).\n", where, length, ge, le);
+        return false;
+    }
+
+    for (uint8_t bit = length; bit < max_length; bit++) {
+        if (getBit(prefix, bit)) {
+            logger->log(ERROR, "%s: entry has host bits set (length %d).\n", where, length);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+/**
+ * @brief Parse a line of prefix set file.
+ * 
+ * Lines are in the form of "prefix/length [ge n] [le n]". Without ge and le,
+ * the entry only matches the prefix itself. With ge only, the entry matches
+ * routes of length ge and longer. With le only, the entry matches routes of
+ * length "length" to le.
+ * 
+ * @param line The line.
+ * @param af Address family (AF_INET/AF_INET6).
+ * @param prefix Parsed prefix.
+ * @param length Parsed prefix length.
+ * @param ge Parsed minimum route length.
+ * @param le Parsed maximum route length.
+ * @retval 1 Line parsed.
+ * @retval 0 Line is empty or a comment.
+ * @retval -1 Line is invalid.
+ */
+static int ParseLine(const char *line, int af, uint8_t *prefix, uint8_t *length, uint8_t *ge, uint8_t *le) {
+    char addr[INET6_ADDRSTRLEN];
+    unsigned int len, ge_val = 0, le_val = 0;
+    bool has_ge = false, has_le = false;
+    int consumed;
+    uint8_t max_length = af == AF_INET ? 32 : 128;
+
+    while (*line == ' ' || *line == '\t') line++;
+    if (*line == '\0' || *line == '\n' || *line == '\r' || *line == '#') return 0;
+
+    if (sscanf(line, "%45[^/ \t]/%u%n", addr, &len, &consumed) != 2) return -1;
+    if (inet_pton(af, addr, prefix) != 1 || len > max_length) return -1;
+    line += consumed;
+
+    char keyword[3];
+    unsigned int value;
+    while (sscanf(line, " %2s %u%n", keyword, &value, &consumed) == 2) {
+        if (strcmp(keyword, "ge") == 0 && !has_ge) { has_ge = true; ge_val = value; }
+        else if (strcmp(keyword, "le") == 0 && !has_le) { has_le = true; le_val = value; }
+        else return -1;
+        if (value > max_length) return -1;
+        line += consumed;
+    }
+
+    while (*line == ' ' || *line == '\t' || *line == '\r' || *line == '\n') line++;
+    if (*line != '\0' && *line != '#') return -1;
+
+    *length = len;
+    *ge = has_ge ? ge_val : len;
+    *le = has_le ? le_val : (has_ge ? max_length : len);
+
+    return 1;
+}
+
+/**
+ * @brief Construct a new, empty IPv4 prefix set.
+ * 
+ * @param logger Log handler.
+ */
+PrefixSet4::PrefixSet4(BgpLogHandler *logger) {
+    this->logger = logger;
+    trie = std::make_shared<std::shared_ptr<const PrefixSetTrie<4>>>(std::make_shared<PrefixSetTrie<4>>());
+}
+
+/**
+ * @brief Replace the set with entries from an array.
+ * 
+ * The new set is built aside, and then swapped in. Filters using the set (or
+ * any copy of it) see the new set once this returns. The current set is kept
+ * if any entry is invalid.
+ * 
+ * @param entries The entries.
+ * @retval true Set loaded.
+ * @retval false Invalid entry.
+ */
+bool PrefixSet4::load(const std::vector<PrefixSetEntry4> &entries) {
+    std::shared_ptr<PrefixSetTrie<4>> new_trie = std::make_shared<PrefixSetTrie<4>>();
+
+    for (const PrefixSetEntry4 &entry : entries) {
+        const uint8_t *prefix = (const uint8_t *) &entry.prefix;
+        if (!ValidateEntry(logger, "PrefixSet4::load", prefix, entry.length, entry.ge, entry.le, 32)) return false;
+        new_trie->insert(prefix, entry.length, entry.ge, entry.le);
+    }
+
+    new_trie->shrink();
+    std::atomic_store(trie.get(), std::shared_ptr<const PrefixSetTrie<4>>(new_trie));
+
+    return true;
+}
+
+/**
+ * @brief Replace the set with entries from a text file.
+ * 
+ * The file has one entry per line, in the form of "prefix/length [ge n]
+ * [le n]". Empty lines and lines starting with "#" are ignored. The current
+ * set is kept if the file can't be read or has invalid lines.
+ * 
+ * @param filename Path to the file.
+ * @retval true Set loaded.
+ * @retval false Failed to load the file.
+ */
+bool PrefixSet4::load(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        logger->log(ERROR, "PrefixSet4::load: failed to open %s.\n", filename);
+        return false;
+    }
+
+    std::vector<PrefixSetEntry4> entries;
+    char line[256];
+    size_t line_no = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        PrefixSetEntry4 entry;
+        int ret = ParseLine(line, AF_INET, (uint8_t *) &entry.prefix, &entry.length, &entry.ge, &entry.le);
+        if (ret == 0) continue;
+        if (ret < 0) {
+            logger->log(ERROR, "PrefixSet4::load: %s:%zu: invalid line.\n", filename, line_no);
+            fclose(file);
+            return false;
+        }
+        entries.push_back(entry);
+    }
+
+    fclose(file);
+    return load(entries);
+}
+
+/**
+ * @brief Test if a route is in the set.
+ * 
+ * @param route The route.
+ * @retval true Route matches an entry.
+ * @retval false Route does not match any entry.
+ */
+bool PrefixSet4::includes(const Prefix4 &route) const {
+    return includes(route.getPrefix(), route.getLength());
+}
+
+/**
+ * @brief Test if a route is in the set.
+ * 
+ * @param prefix Route prefix, in network byte order.
+ * @param length Route length.
+ * @retval true Route matches an entry.
+ * @retval false Route does not match any entry.
+ */
+bool PrefixSet4::includes(uint32_t prefix, uint8_t length) const {
+    if (length > 32) return false;
+    return get()->includes((const uint8_t *) &prefix, length);
+}
+
+/**
+ * @brief Get number of entries in the set.
+ * 
+ * @return size_t Number of entries.
+ */
+size_t PrefixSet4::size() const {
+    return get()->size();
+}
+
+/**
+ * @brief Get the entries of the set.
+ * 
+ * Entries with the same prefix and overlapping or adjacent ranges of lengths
+ * are merged.
+ * 
+ * @param entries Vector to append the entries to.
+ */
+void PrefixSet4::getEntries(std::vector<PrefixSetEntry4> &entries) const {
+    get()->forEach([&](const uint8_t *prefix, uint8_t length, uint8_t ge, uint8_t le) {
+        PrefixSetEntry4 entry;
+        memcpy(&entry.prefix, prefix, 4);
+        entry.length = length;
+        entry.ge = ge;
+        entry.le = le;
+        entries.push_back(entry);
+    });
+}
+
+std::shared_ptr<const PrefixSetTrie<4>> PrefixSet4::get() const {
+    return std::atomic_load(trie.get());
+}
+
+/**
+ * @brief Construct a new, empty IPv6 prefix set.
+ * 
+ * @param logger Log handler.
+ */
+PrefixSet6::PrefixSet6(BgpLogHandler *logger) {
+    this->logger = logger;
+    trie = std::make_shared<std::shared_ptr<const PrefixSetTrie<16>>>(std::make_shared<PrefixSetTrie<16>>());
+}
+
+/**
+ * @brief Replace the set with entries from an array.
+ * 
+ * See PrefixSet4::load.
+ * 
+ * @param entries The entries.
+ * @retval true Set loaded.
+ * @retval false Invalid entry.
+ */
+bool PrefixSet6::load(const std::vector<PrefixSetEntry6> &entries) {
+    std::shared_ptr<PrefixSetTrie<16>> new_trie = std::make_shared<PrefixSetTrie<16>>();
+
+    for (const PrefixSetEntry6 &entry : entries) {
+        if (!ValidateEntry(logger, "PrefixSet6::load", entry.prefix, entry.length, entry.ge, entry.le, 128)) return false;
+        new_trie->insert(entry.prefix, entry.length, entry.ge, entry.le);
+    }
+
+    new_trie->shrink();
+    std::atomic_store(trie.get(), std::shared_ptr<const PrefixSetTrie<16>>(new_trie));
+
+    return true;
+}
+
+/**
+ * @brief Replace the set with entries from a text file.
+ * 
+ * See PrefixSet4::load.
+ * 
+ * @param filename Path to the file.
+ * @retval true Set loaded.
+ * @retval false Failed to load the file.
+ */
+bool PrefixSet6::load(const char *filename) {
+    FILE *file = fopen(filename, "r");
+    if (file == NULL) {
+        logger->log(ERROR, "PrefixSet6::load: failed to open %s.\n", filename);
+        return false;
+    }
+
+    std::vector<PrefixSetEntry6> entries;
+    char line[256];
+    size_t line_no = 0;
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        line_no++;
+        PrefixSetEntry6 entry;
+        int ret = ParseLine(line, AF_INET6, entry.prefix, &entry.length, &entry.ge, &entry.le);
+        if (ret == 0) continue;
+        if (ret < 0) {
+            logger->log(ERROR, "PrefixSet6::load: %s:%zu: invalid line.\n", filename, line_no);
+            fclose(file);
+            return false;
+        }
+        entries.push_back(entry);
+    }
+
+    fclose(file);
+    return load(entries);
+}
+
+/**
+ * @brief Test if a route is in the set.
+ * 
+ * @param route The route.
+ * @retval true Route matches an entry.
+ * @retval false Route does not match any entry.
+ */
+bool PrefixSet6::includes(const Prefix6 &route) const {
+    uint8_t prefix[16];
+    route.getPrefix(prefix);
+    return includes(prefix, route.getLength());
+}
+
+/**
+ * @brief Test if a route is in the set.
+ * 
+ * @param prefix Route prefix.
+ * @param length Route length.
+ * @retval true Route matches an entry.
+ * @retval false Route does not match any entry.
+ */
+bool PrefixSet6::includes(const uint8_t prefix[16], uint8_t length) const {
+    if (length > 128) return false;
+    return get()->includes(prefix, length);
+}
+
+/**
+ * @brief Get number of entries in the set.
+ * 
+ * @return size_t Number of entries.
+ */
+size_t PrefixSet6::size() const {
+    return get()->size();
+}
+
+/**
+ * @brief Get the entries of the set.
+ * 
+ * See PrefixSet4::getEntries.
+ * 
+ * @param entries Vector to append the entries to.
+ */
+void PrefixSet6::getEntries(std::vector<PrefixSetEntry6> &entries) const {
+    get()->forEach([&](const uint8_t *prefix, uint8_t length, uint8_t ge, uint8_t le) {
+        PrefixSetEntry6 entry;
+        memcpy(entry.prefix, prefix, 16);
+        entry.length = length;
+        entry.ge = ge;
+        entry.le = le;
+        entries.push_back(entry);
+    });
+}
+
+std::shared_ptr<const PrefixSetTrie<16>> PrefixSet6::get() const {
+    return std::atomic_load(trie.get());
+}
+
+}
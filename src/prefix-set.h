@@ -0,0 +1,131 @@
+/**
+ * @file prefix-set.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Large shared prefix sets.
+ * @version 0.1
+ * @date 2019-08-06
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef BGP_PREFIX_SET_H_
+#define BGP_PREFIX_SET_H_
+#include <stdint.h>
+#include <unistd.h>
+#include <vector>
+#include <memory>
+#include "prefix4.h"
+#include "prefix6.h"
+#include "bgp-log-handler.h"
+
+namespace libbgp {
+
+template <size_t N> class PrefixSetTrie;
+
+/**
+ * @brief An IPv4 prefix set entry.
+ * 
+ * The entry matches routes inside prefix/length, with a length between ge and
+ * le (inclusive).
+ */
+struct PrefixSetEntry4 {
+    uint32_t prefix; /*!< Prefix, in network byte order. */
+    uint8_t length; /*!< Prefix length. */
+    uint8_t ge; /*!< Minimum route length. */
+    uint8_t le; /*!< Maximum route length. */
+};
+
+/**
+ * @brief An IPv6 prefix set entry.
+ * 
+ * The entry matches routes inside prefix/length, with a length between ge and
+ * le (inclusive).
+ */
+struct PrefixSetEntry6 {
+    uint8_t prefix[16]; /*!< Prefix. */
+    uint8_t length; /*!< Prefix length. */
+    uint8_t ge; /*!< Minimum route length. */
+    uint8_t le; /*!< Maximum route length. */
+};
+
+/**
+ * @brief The IPv4 prefix set.
+ * 
+ * A PrefixSet4 holds a large number of prefix ranges (like the ones generated
+ * from IRR data) in a compact, path-compressed trie. Testing a route against
+ * the set walks the trie once, no matter how many entries are in it.
+ * 
+ * Copies of a PrefixSet4 refer to the same set: the set can be used in the
+ * filters of many sessions while keeping a single copy in memory. load()
+ * builds a new trie and swaps it in atomically, so loading new entries to one
+ * of the copies replaces the set for all copies. Routes being matched during
+ * the swap see either the old or the new set.
+ */
+class PrefixSet4 {
+public:
+    PrefixSet4(BgpLogHandler *logger);
+
+    // replace the set with entries from an array
+    bool load(const std::vector<PrefixSetEntry4> &entries);
+
+    // replace the set with entries from a text file
+    bool load(const char *filename);
+
+    // test if a route is in the set
+    bool includes(const Prefix4 &route) const;
+    bool includes(uint32_t prefix, uint8_t length) const;
+
+    // get number of entries in the set
+    size_t size() const;
+
+    // get the entries in the set
+    void getEntries(std::vector<PrefixSetEntry4> &entries) const;
+
+private:
+    std::shared_ptr<const PrefixSetTrie<4>> get() const;
+
+    BgpLogHandler *logger;
+    std::shared_ptr<std::shared_ptr<const PrefixSetTrie<4>>> trie;
+};
+
+/**
+ * @brief The IPv6 prefix set.
+ * 
+ * See PrefixSet4.
+ */
+class PrefixSet6 {
+public:
+    PrefixSet6(BgpLogHandler *logger);
+
+    // replace the set with entries from an array
+    bool load(const std::vector<PrefixSetEntry6> &entries);
+
+    // replace the set with entries from a text file
+    bool load(const char *filename);
+
+    // test if a route is in the set
+    bool includes(const Prefix6 &route) const;
+    bool includes(const uint8_t prefix[16], uint8_t length) const;
+
+    // get number of entries in the set
+    size_t size() const;
+
+    // get the entries in the set
+    void getEntries(std::vector<PrefixSetEntry6> &entries) const;
+
+private:
+    std::shared_ptr<const PrefixSetTrie<16>> get() const;
+
+    BgpLogHandler *logger;
+    std::shared_ptr<std::shared_ptr<const PrefixSetTrie<16>>> trie;
+};
+
+/**
+ * @example prefix-set.cc
+ * Example of filtering routes with a PrefixSet4 shared by multiple filter rules
+ * sets, and replacing the entries of the set.
+ */
+
+}
+
+#endif // BGP_PREFIX_SET_H_
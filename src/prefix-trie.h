@@ -0,0 +1,158 @@
+/**
+ * @file prefix-trie.h
+ * @author Nato Morichika <nat@nat.moe>
+ * @brief Path-compressed prefix trie shared by prefix sets and ROA tables.
+ * @version 0.1
+ * @date 2019-08-08
+ * 
+ * @copyright Copyright (c) 2019
+ * 
+ */
+#ifndef PREFIX_TRIE_H_
+#define PREFIX_TRIE_H_
+#include <stdint.h>
+#include <string.h>
+#include <vector>
+
+namespace libbgp {
+
+// get a bit of a prefix, bit 0 is the most significant bit of the first byte.
+static inline uint8_t getBit(const uint8_t *prefix, uint8_t bit) {
+    return (prefix[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+// length of the common part of two prefixes, up to max_length.
+static inline uint8_t commonLength(const uint8_t *a, const uint8_t *b, uint8_t max_length) {
+    uint8_t bytes = (max_length + 7) >> 3;
+
+    for (uint8_t i = 0; i < bytes; i++) {
+        uint8_t diff = a[i] ^ b[i];
+        if (diff == 0) continue;
+        uint8_t common = (i << 3) + __builtin_clz(diff) - 24;
+        return common < max_length ? common : max_length;
+    }
+
+    return max_length;
+}
+
+/**
+ * @brief Path-compressed binary trie of prefixes.
+ * 
+ * Only nodes where prefixes branch or end are stored, in a vector, and nodes
+ * refer to their children by index. Node 0 is the root (the zero-length
+ * prefix); a child index of 0 means no child. The data kept on the nodes is
+ * up to the user of the trie.
+ * 
+ * @tparam N Size of the address in bytes.
+ * @tparam Node Node type, with at least the members uint8_t prefix[N],
+ * uint8_t length and uint32_t child[2].
+ */
+template <size_t N, typename Node>
+class PrefixTrie {
+public:
+    /**
+     * @brief Construct a new trie with only the root node.
+     * 
+     * @param blank Node to copy new nodes from. Its prefix, length and
+     * children are ignored.
+     */
+    PrefixTrie(const Node &blank) : blank(blank) {
+        uint8_t root[N];
+        memset(root, 0, N);
+        newNode(root, 0);
+    }
+
+    /**
+     * @brief Find the node of a prefix, add it if not in the trie.
+     * 
+     * @param prefix Prefix, with bits after length unset.
+     * @param length Prefix length.
+     * @return uint32_t Index of the node.
+     */
+    uint32_t insert(const uint8_t *prefix, uint8_t length) {
+        uint32_t cur = 0;
+
+        for (;;) {
+            if (nodes[cur].length == length) return cur;
+
+            uint8_t bit = getBit(prefix, nodes[cur].length);
+            uint32_t next = nodes[cur].child[bit];
+
+            if (next == 0) {
+                uint32_t leaf = newNode(prefix, length);
+                nodes[cur].child[bit] = leaf;
+                return leaf;
+            }
+
+            uint8_t next_length = nodes[next].length;
+            uint8_t common = commonLength(prefix, nodes[next].prefix, next_length < length ? next_length : length);
+
+            if (common == next_length) {
+                cur = next;
+                continue;
+            }
+
+            // the new prefix branches off (or ends) in the middle of the edge
+            // to next: insert a node there.
+            uint32_t middle = newNode(prefix, common);
+            nodes[middle].child[getBit(nodes[next].prefix, common)] = next;
+            nodes[cur].child[bit] = middle;
+
+            if (common == length) return middle;
+
+            uint32_t leaf = newNode(prefix, length);
+            nodes[middle].child[getBit(prefix, common)] = leaf;
+            return leaf;
+        }
+    }
+
+    /**
+     * @brief Visit the nodes covering a route, shortest first.
+     * 
+     * @param prefix Route prefix.
+     * @param length Route length.
+     * @param start Node to start from. Must cover the route.
+     * @param visit Called with the index of each node covering the route.
+     * Return true to stop the walk.
+     * @retval true The walk was stopped by visit.
+     * @retval false No more nodes cover the route.
+     */
+    template <typename F> bool walk(const uint8_t *prefix, uint8_t length, uint32_t start, const F &visit) const {
+        uint32_t cur = start;
+
+        for (;;) {
+            const Node &node = nodes[cur];
+
+            if (node.length > length) return false;
+            if (commonLength(prefix, node.prefix, node.length) < node.length) return false;
+            if (visit(cur)) return true;
+            if (node.length == length) return false;
+
+            cur = node.child[getBit(prefix, node.length)];
+            if (cur == 0) return false;
+        }
+    }
+
+    /**
+     * @brief The nodes. Users may change the data on the nodes, but not the
+     * prefixes or the children.
+     * 
+     */
+    std::vector<Node> nodes;
+
+private:
+    uint32_t newNode(const uint8_t *prefix, uint8_t length) {
+        Node node = blank;
+        memcpy(node.prefix, prefix, N);
+        node.length = length;
+        node.child[0] = node.child[1] = 0;
+        nodes.push_back(node);
+        return nodes.size() - 1;
+    }
+
+    Node blank;
+};
+
+}
+
+#endif // PREFIX_TRIE_H_
@@ -11,9 +11,13 @@
 #include "prefix4.h"
 #include "value-op.h"
 #include <arpa/inet.h>
+#include <type_traits>
 
 namespace libbgp {
 
+static_assert(sizeof(Prefix4Value) == 8, "Prefix4Value should be packed into 8 bytes");
+static_assert(std::is_trivial<Prefix4Value>::value, "Prefix4Value should be trivially copyable");
+
 const uint32_t CIDR_MASK_MAP[33] = { 
     0x00000000, 0x00000080, 0x000000c0, 0x000000e0, 0x000000f0, 0x000000f8, 
     0x000000fc, 0x000000fe, 0x000000ff, 0x000080ff, 0x0000c0ff, 0x0000e0ff, 
@@ -72,6 +76,19 @@ Prefix4::Prefix4(const char* prefix, uint8_t length) {
     inet_pton(AF_INET, prefix, &(this->prefix));
 }
 
+/**
+ * @brief Construct a new Prefix4 object from a prefix value.
+ * 
+ * @param value The prefix value.
+ * @throws "bad_route_length" Netmask invalid.
+ */
+Prefix4::Prefix4(const Prefix4Value &value) {
+    if (value.length > 32) throw "bad_route_length";
+    afi = IPV4;
+    prefix = value.prefix;
+    length = value.length;
+}
+
 /**
  * @brief Parse a IPv4 NLRI prefix from buffer.
  * 
@@ -84,6 +101,7 @@ Prefix4::Prefix4(const char* prefix, uint8_t length) {
 ssize_t Prefix4::parse(const uint8_t *buffer, size_t buf_sz) {
     if (buf_sz < 1) return -1;
     length = getValue<uint8_t>(&buffer);
+    if (length > 32) return -1;
     size_t prefix_buf_len = (length + 7) / 8;
     if (prefix_buf_len + 1 > buf_sz) return -1;
     prefix = 0;
@@ -108,6 +126,153 @@ ssize_t Prefix4::write(uint8_t *buffer, size_t buf_sz) const {
     return prefix_buf_len + 1;
 }
 
+/**
+ * @brief Parse a packed list of IPv4 NLRI prefixes.
+ * 
+ * The list is validated in one pass before anything is decoded, so routes
+ * is left untouched on error. Prefixes are then decoded with a single 4 bytes
+ * load masked down to the prefix bytes, instead of a variable-length copy 
+ * per prefix.
+ * 
+ * @param buffer Buffer to parse from.
+ * @param buf_sz Size of the list. The entire buffer must be consumed.
+ * @param routes Vector to append parsed prefixes to.
+ * @return ssize_t Bytes read.
+ * @retval -1 Failed to parse the list.
+ * @retval >=0 Bytes read.
+ */
+ssize_t Prefix4::ParseList(const uint8_t *buffer, size_t buf_sz, std::vector<Prefix4> &routes) {
+    return DoParseList(buffer, buf_sz, routes);
+}
+
+/**
+ * @brief Parse a packed list of IPv4 NLRI prefixes into prefix values.
+ * 
+ * @param buffer Buffer to parse from.
+ * @param buf_sz Size of the list. The entire buffer must be consumed.
+ * @param routes Vector to append parsed prefixes to.
+ * @return ssize_t Bytes read.
+ * @retval -1 Failed to parse the list.
+ * @retval >=0 Bytes read.
+ */
+ssize_t Prefix4::ParseList(const uint8_t *buffer, size_t buf_sz, std::vector<Prefix4Value> &routes) {
+    return DoParseList(buffer, buf_sz, routes);
+}
+
+template <typename T>
+ssize_t Prefix4::DoParseList(const uint8_t *buffer, size_t buf_sz, std::vector<T> &routes) {
+    size_t offset = 0;
+    size_t count = 0;
+
+    while (offset < buf_sz) {
+        uint8_t length = buffer[offset];
+        if (length > 32) return -1;
+        offset += 1 + (length + 7) / 8;
+        count++;
+    }
+
+    if (offset != buf_sz) return -1;
+
+    routes.reserve(routes.size() + count);
+
+    const uint8_t *ptr = buffer;
+    const uint8_t *end = buffer + buf_sz;
+
+    while (ptr < end) {
+        uint8_t length = *ptr++;
+        size_t prefix_buf_len = (length + 7) / 8;
+
+        routes.emplace_back();
+        T &route = routes.back();
+        route.length = length;
+
+        if (end - ptr >= 4) {
+            memcpy(&route.prefix, ptr, 4);
+            route.prefix &= CIDR_MASK_MAP[prefix_buf_len * 8];
+        } else memcpy(&route.prefix, ptr, prefix_buf_len);
+
+        ptr += prefix_buf_len;
+    }
+
+    return buf_sz;
+}
+
+/**
+ * @brief Write a list of IPv4 prefixes to NLRI buffer.
+ * 
+ * Size of the list is computed and checked once upfront, then the prefixes 
+ * are written with fixed-size stores where the buffer allows.
+ * 
+ * @param routes Prefixes to write.
+ * @param buffer Buffer to write to.
+ * @param buf_sz Size of the buffer (max write size).
+ * @return ssize_t Bytes written.
+ * @retval -1 Failed to write.
+ * @retval >=0 Bytes written.
+ */
+ssize_t Prefix4::WriteList(const std::vector<Prefix4> &routes, uint8_t *buffer, size_t buf_sz) {
+    return DoWriteList(routes, buffer, buf_sz);
+}
+
+/**
+ * @brief Write a list of IPv4 prefix values to NLRI buffer.
+ * 
+ * @param routes Prefixes to write.
+ * @param buffer Buffer to write to.
+ * @param buf_sz Size of the buffer (max write size).
+ * @return ssize_t Bytes written.
+ * @retval -1 Failed to write.
+ * @retval >=0 Bytes written.
+ */
+ssize_t Prefix4::WriteList(const std::vector<Prefix4Value> &routes, uint8_t *buffer, size_t buf_sz) {
+    return DoWriteList(routes, buffer, buf_sz);
+}
+
+template <typename T>
+ssize_t Prefix4::DoWriteList(const std::vector<T> &routes, uint8_t *buffer, size_t buf_sz) {
+    size_t list_len = 0;
+    for (const T &route : routes) list_len += 1 + (route.length + 7) / 8;
+    if (list_len > buf_sz) return -1;
+
+    uint8_t *ptr = buffer;
+    uint8_t *end = buffer + list_len;
+
+    for (const T &route : routes) {
+        size_t prefix_buf_len = (route.length + 7) / 8;
+        *ptr++ = route.length;
+
+        if (end - ptr >= 4) memcpy(ptr, &route.prefix, 4);
+        else memcpy(ptr, &route.prefix, prefix_buf_len);
+
+        ptr += prefix_buf_len;
+    }
+
+    return list_len;
+}
+
+/**
+ * @brief Convert prefixes to prefix values.
+ * 
+ * @param routes Prefixes to convert.
+ * @param values Vector to append prefix values to.
+ */
+void Prefix4::ToValues(const std::vector<Prefix4> &routes, std::vector<Prefix4Value> &values) {
+    values.reserve(values.size() + routes.size());
+    for (const Prefix4 &route : routes) values.push_back(Prefix4Value(route.prefix, route.length));
+}
+
+/**
+ * @brief Convert prefix values to prefixes.
+ * 
+ * @param values Prefix values to convert.
+ * @param routes Vector to append prefixes to.
+ * @throws "bad_route_length" Netmask invalid.
+ */
+void Prefix4::FromValues(const std::vector<Prefix4Value> &values, std::vector<Prefix4> &routes) {
+    routes.reserve(routes.size() + values.size());
+    for (const Prefix4Value &value : values) routes.push_back(Prefix4(value));
+}
+
 /**
  * @brief Test if an address is inside a prefix.
  * 
@@ -185,7 +350,7 @@ bool Prefix4::includes (uint32_t prefix, uint8_t length) const {
  */
 bool Prefix4::includes (const Prefix &other) const {
     if (other.afi != IPV4) return false;
-    const Prefix4 &other_4 = dynamic_cast<const Prefix4 &>(other);
+    const Prefix4 &other_4 = static_cast<const Prefix4 &>(other);
     return includes (other_4.prefix, other_4.length);
 }
 
@@ -212,19 +377,30 @@ bool Prefix4::includes (const char* prefix, uint8_t length) const {
  */
 bool Prefix4::operator== (const Prefix &other) const {
     if (other.afi != IPV4) return false;
-    const Prefix4 &other_4 = dynamic_cast<const Prefix4 &>(other);
+    const Prefix4 &other_4 = static_cast<const Prefix4 &>(other);
     return other_4.prefix == prefix && other_4.length == length;
 }
 
+/**
+ * @brief Test if two routes are equals, without going through the vtable.
+ * 
+ * @param other The other route object.
+ * @return true The routes are equal.
+ * @return false The routes are different.
+ */
+bool Prefix4::operator== (const Prefix4 &other) const {
+    return other.prefix == prefix && other.length == length;
+}
+
 bool Prefix4::operator> (const Prefix &other) const {
     if (other.afi != IPV4) return false;
-    const Prefix4 &other_4 = dynamic_cast<const Prefix4 &>(other);
+    const Prefix4 &other_4 = static_cast<const Prefix4 &>(other);
     return length < other_4.length;
 }
 
 bool Prefix4::operator< (const Prefix &other) const {
     if (other.afi != IPV4) return false;
-    const Prefix4 &other_4 = dynamic_cast<const Prefix4 &>(other);
+    const Prefix4 &other_4 = static_cast<const Prefix4 &>(other);
     return length > other_4.length;
 }
 
@@ -309,4 +485,24 @@ uint32_t Prefix4::getMask() const {
     return CIDR_MASK_MAP[length];
 }
 
-}
\ No newline at end of file
+/**
+ * @brief Get the prefix as a prefix value.
+ * 
+ * @return Prefix4Value The prefix value.
+ */
+Prefix4Value Prefix4::toValue() const {
+    return Prefix4Value(prefix, length);
+}
+
+/**
+ * @brief Test if another prefix is inside this prefix.
+ * 
+ * @param other The other prefix.
+ * @return true The other prefix is in this prefix.
+ * @return false The other prefix is not in this prefix.
+ */
+bool Prefix4Value::includes (const Prefix4Value &other) const {
+    return Prefix4::Includes(prefix, length, other.prefix, other.length);
+}
+
+}
@@ -12,12 +12,65 @@
 #define BGP_PREFIX4_H_
 #include <stdint.h>
 #include <unistd.h>
+#include <vector>
 #include "prefix.h"
 
 namespace libbgp {
 
 uint32_t cidr_to_mask(uint8_t cidr);
 
+/**
+ * @brief An IPv4 prefix as a plain value.
+ * 
+ * Prefix4Value holds the same prefix as Prefix4, without the vtable and the
+ * address family of the Prefix base class. It is trivially copyable, 8 bytes
+ * instead of 24, and can be built in constant expressions, so it is what large
+ * tables of prefixes should be stored as: the RIB entries and the Adj-RIB-In
+ * hold it. Prefix4 converts from and to it, and is what the filters, NLRI and
+ * withdrawn routes lists take.
+ */
+struct Prefix4Value {
+    Prefix4Value() = default;
+    constexpr Prefix4Value(uint32_t prefix, uint8_t length) : prefix(prefix), length(length) {}
+
+    constexpr bool operator== (const Prefix4Value &other) const {
+        return prefix == other.prefix && length == other.length;
+    }
+
+    constexpr bool operator!= (const Prefix4Value &other) const {
+        return !(*this == other);
+    }
+
+    // test if route other is sub-prefix
+    bool includes (const Prefix4Value &other) const;
+
+    // same accessors as Prefix4
+    constexpr uint32_t getPrefix() const { return prefix; }
+    constexpr uint8_t getLength() const { return length; }
+
+    /**
+     * @brief The prefix in network byte order.
+     * 
+     */
+    uint32_t prefix;
+
+    /**
+     * @brief The netmask in CIDR notation.
+     * 
+     */
+    uint8_t length;
+};
+
+/**
+ * @brief Hasher for Prefix4Value.
+ * 
+ */
+struct Prefix4ValueHash {
+    std::size_t operator()(const Prefix4Value &value) const {
+        return ((uint64_t) value.length << 32) | value.prefix;
+    }
+};
+
 /**
  * @brief IPv4 Route/Prefix related utilities.
  * 
@@ -27,10 +80,21 @@ public:
     Prefix4();
     Prefix4(uint32_t prefix, uint8_t length);
     Prefix4(const char* prefix, uint8_t length);
+    Prefix4(const Prefix4Value &value);
 
     ssize_t parse(const uint8_t *buffer, size_t buf_sz);
     ssize_t write(uint8_t *buffer, size_t buf_sz) const;
 
+    // batch decode/encode packed prefix list (NLRI / withdrawn routes)
+    static ssize_t ParseList(const uint8_t *buffer, size_t buf_sz, std::vector<Prefix4> &routes);
+    static ssize_t WriteList(const std::vector<Prefix4> &routes, uint8_t *buffer, size_t buf_sz);
+    static ssize_t ParseList(const uint8_t *buffer, size_t buf_sz, std::vector<Prefix4Value> &routes);
+    static ssize_t WriteList(const std::vector<Prefix4Value> &routes, uint8_t *buffer, size_t buf_sz);
+
+    // convert between prefixes and prefix values
+    static void ToValues(const std::vector<Prefix4> &routes, std::vector<Prefix4Value> &values);
+    static void FromValues(const std::vector<Prefix4Value> &values, std::vector<Prefix4> &routes);
+
     // static utility functions for route include test
     static bool Includes (uint32_t prefix, uint8_t length, uint32_t address);
     static bool Includes (uint32_t prefix_a, uint8_t length_a, uint32_t prefix_b, uint8_t length_b);
@@ -46,6 +110,7 @@ public:
 
     // test if length & prefix equals to other
     bool operator== (const Prefix &other) const;
+    bool operator== (const Prefix4 &other) const;
 
     // test if length smaller (prefix size bigger) then other. prefix must be
     // same to do this.
@@ -65,12 +130,24 @@ public:
     uint32_t getPrefix() const;
     uint8_t getLength() const;
     uint32_t getMask() const;
+    Prefix4Value toValue() const;
 
 private:
+    template <typename T> static ssize_t DoParseList(const uint8_t *buffer, size_t buf_sz, std::vector<T> &routes);
+    template <typename T> static ssize_t DoWriteList(const std::vector<T> &routes, uint8_t *buffer, size_t buf_sz);
+
     uint8_t length;
     uint32_t prefix;
 };
 
+
+/**
+ * @example prefix-value.cc
+ * Example of storing large number of prefixes as Prefix4Value and
+ * Prefix6Value. This example also compares the memory used and the parsing
+ * speed with Prefix4 and Prefix6.
+ */
+
 }
 
 #endif // BGP_PREFIX4_H_
\ No newline at end of file
@@ -12,9 +12,17 @@
 #include <arpa/inet.h>
 #include "prefix6.h"
 #include "value-op.h"
+#include <endian.h>
+#include <type_traits>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 namespace libbgp {
 
+static_assert(sizeof(Prefix6Value) == 17, "Prefix6Value should be packed into 17 bytes");
+static_assert(std::is_trivial<Prefix6Value>::value, "Prefix6Value should be trivially copyable");
+
 const uint8_t CIDR_MASK_MAP6[129][16] = {
     {0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
     {0x80, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00},
@@ -147,6 +155,27 @@ const uint8_t CIDR_MASK_MAP6[129][16] = {
     {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff}
 };
 
+/**
+ * @brief Test if an address is inside a prefix, with the address, the prefix
+ * and the netmask loaded as 64 bits words.
+ * 
+ * The words are loaded in memory order: masks from CIDR_MASK_MAP6 apply to 
+ * them as they are, so no byte swapping is needed.
+ * 
+ * @param prefix The prefix.
+ * @param mask The netmask of the prefix, as bytes array.
+ * @param address The address to test against.
+ * @return true The address is in the prefix.
+ * @return false The address in not in the prefix.
+ */
+static inline bool IncludesWords(const uint8_t prefix[16], const uint8_t mask[16], const uint8_t address[16]) {
+    uint64_t prefix_words[2], mask_words[2], address_words[2];
+    memcpy(prefix_words, prefix, 16);
+    memcpy(mask_words, mask, 16);
+    memcpy(address_words, address, 16);
+    return ((address_words[0] & mask_words[0]) == prefix_words[0]) & ((address_words[1] & mask_words[1]) == prefix_words[1]);
+}
+
 /**
  * @brief Convert IPv6 mask in CIDR notation to bytes array.
  * 
@@ -172,19 +201,17 @@ bool cidr_to_mask6(uint8_t src, uint8_t dst[16]) {
  */
 bool mask_ipv6(const uint8_t prefix[16], uint8_t mask, uint8_t masked_addr[16]) {
     if (mask > 128) return false;
-    const uint8_t* mask_arr = CIDR_MASK_MAP6[mask];
 
-    for (int i = 0; i < 16; i++) {
-        masked_addr[i] = prefix[i] & mask_arr[i];
-    }
+    uint64_t words[2], masks[2];
+    memcpy(words, prefix, 16);
+    memcpy(masks, CIDR_MASK_MAP6[mask], 16);
+    words[0] &= masks[0];
+    words[1] &= masks[1];
+    memcpy(masked_addr, words, 16);
 
     return true;
 }
 
-const uint16_t zero_prefix[16] = {
-    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0
-};
-
 /**
  * @brief Test if a IPv6 addresss is all zero.
  * 
@@ -193,7 +220,9 @@ const uint16_t zero_prefix[16] = {
  * @return false Address is not all zero.
  */
 bool v6addr_is_zero(const uint8_t prefix[16]) {
-    return memcmp(zero_prefix, prefix, 16) == 0;
+    uint64_t words[2];
+    memcpy(words, prefix, 16);
+    return (words[0] | words[1]) == 0;
 }
 
 /**
@@ -230,6 +259,17 @@ Prefix6::Prefix6 (const char* prefix, uint8_t length) {
     inet_pton(AF_INET6, prefix, this->prefix);
 }
 
+/**
+ * @brief Construct a new Prefix6 object from a prefix value.
+ * 
+ * @param value The prefix value.
+ */
+Prefix6::Prefix6 (const Prefix6Value &value) {
+    afi = IPV6;
+    length = value.length;
+    memcpy(prefix, value.prefix, 16);
+}
+
 /**
  * @brief Parse a IPv6 NLRI prefix from buffer.
  * 
@@ -267,6 +307,161 @@ ssize_t Prefix6::write(uint8_t *buffer, size_t buf_sz) const {
     return prefix_buf_sz + 1;
 }
 
+/**
+ * @brief Parse a packed list of IPv6 NLRI prefixes.
+ * 
+ * The list is validated in one pass before anything is decoded, so routes
+ * is left untouched on error. Prefixes are then decoded with a single 16 bytes
+ * load masked down to the prefix bytes (two 64 bits words), instead of a 
+ * memset and a variable-length copy per prefix.
+ * 
+ * @param buffer Buffer to parse from.
+ * @param buf_sz Size of the list. The entire buffer must be consumed.
+ * @param routes Vector to append parsed prefixes to.
+ * @return ssize_t Bytes read.
+ * @retval -1 Failed to parse the list.
+ * @retval >=0 Bytes read.
+ */
+ssize_t Prefix6::ParseList(const uint8_t *buffer, size_t buf_sz, std::vector<Prefix6> &routes) {
+    return DoParseList(buffer, buf_sz, routes);
+}
+
+/**
+ * @brief Parse a packed list of IPv6 NLRI prefixes into prefix values.
+ * 
+ * @param buffer Buffer to parse from.
+ * @param buf_sz Size of the list. The entire buffer must be consumed.
+ * @param routes Vector to append parsed prefixes to.
+ * @return ssize_t Bytes read.
+ * @retval -1 Failed to parse the list.
+ * @retval >=0 Bytes read.
+ */
+ssize_t Prefix6::ParseList(const uint8_t *buffer, size_t buf_sz, std::vector<Prefix6Value> &routes) {
+    return DoParseList(buffer, buf_sz, routes);
+}
+
+template <typename T>
+ssize_t Prefix6::DoParseList(const uint8_t *buffer, size_t buf_sz, std::vector<T> &routes) {
+    size_t offset = 0;
+    size_t count = 0;
+
+    while (offset < buf_sz) {
+        uint8_t length = buffer[offset];
+        if (length > 128) return -1;
+        offset += 1 + (length + 7) / 8;
+        count++;
+    }
+
+    if (offset != buf_sz) return -1;
+
+    routes.reserve(routes.size() + count);
+
+    const uint8_t *ptr = buffer;
+    const uint8_t *end = buffer + buf_sz;
+
+    while (ptr < end) {
+        uint8_t length = *ptr++;
+        size_t prefix_buf_sz = (length + 7) / 8;
+
+        routes.emplace_back();
+        T &route = routes.back();
+        route.length = length;
+
+        if (end - ptr >= 16) {
+            uint64_t words[2], masks[2];
+            memcpy(words, ptr, 16);
+            memcpy(masks, CIDR_MASK_MAP6[prefix_buf_sz * 8], 16);
+            words[0] &= masks[0];
+            words[1] &= masks[1];
+            memcpy(route.prefix, words, 16);
+        } else memcpy(route.prefix, ptr, prefix_buf_sz);
+
+        ptr += prefix_buf_sz;
+    }
+
+    return buf_sz;
+}
+
+/**
+ * @brief Write a list of IPv6 prefixes to NLRI buffer.
+ * 
+ * Size of the list is computed and checked once upfront, then the prefixes 
+ * are written with fixed-size stores where the buffer allows.
+ * 
+ * @param routes Prefixes to write.
+ * @param buffer Buffer to write to.
+ * @param buf_sz Size of the buffer (max write size).
+ * @return ssize_t Bytes written.
+ * @retval -1 Failed to write.
+ * @retval >=0 Bytes written.
+ */
+ssize_t Prefix6::WriteList(const std::vector<Prefix6> &routes, uint8_t *buffer, size_t buf_sz) {
+    return DoWriteList(routes, buffer, buf_sz);
+}
+
+/**
+ * @brief Write a list of IPv6 prefix values to NLRI buffer.
+ * 
+ * @param routes Prefixes to write.
+ * @param buffer Buffer to write to.
+ * @param buf_sz Size of the buffer (max write size).
+ * @return ssize_t Bytes written.
+ * @retval -1 Failed to write.
+ * @retval >=0 Bytes written.
+ */
+ssize_t Prefix6::WriteList(const std::vector<Prefix6Value> &routes, uint8_t *buffer, size_t buf_sz) {
+    return DoWriteList(routes, buffer, buf_sz);
+}
+
+template <typename T>
+ssize_t Prefix6::DoWriteList(const std::vector<T> &routes, uint8_t *buffer, size_t buf_sz) {
+    size_t list_len = 0;
+
+    for (const T &route : routes) {
+        if (route.length > 128) return -1;
+        list_len += 1 + (route.length + 7) / 8;
+    }
+
+    if (list_len > buf_sz) return -1;
+
+    uint8_t *ptr = buffer;
+    uint8_t *end = buffer + list_len;
+
+    for (const T &route : routes) {
+        size_t prefix_buf_sz = (route.length + 7) / 8;
+        *ptr++ = route.length;
+
+        if (end - ptr >= 16) memcpy(ptr, route.prefix, 16);
+        else memcpy(ptr, route.prefix, prefix_buf_sz);
+
+        ptr += prefix_buf_sz;
+    }
+
+    return list_len;
+}
+
+/**
+ * @brief Convert prefixes to prefix values.
+ * 
+ * @param routes Prefixes to convert.
+ * @param values Vector to append prefix values to.
+ */
+void Prefix6::ToValues(const std::vector<Prefix6> &routes, std::vector<Prefix6Value> &values) {
+    values.reserve(values.size() + routes.size());
+    for (const Prefix6 &route : routes) values.push_back(Prefix6Value(route.prefix, route.length));
+}
+
+/**
+ * @brief Convert prefix values to prefixes.
+ * 
+ * @param values Prefix values to convert.
+ * @param routes Vector to append prefixes to.
+ */
+void Prefix6::FromValues(const std::vector<Prefix6Value> &values, std::vector<Prefix6> &routes) {
+    routes.reserve(routes.size() + values.size());
+    for (const Prefix6Value &value : values) routes.push_back(Prefix6(value));
+}
+
 /**
  * @brief Test if an address is inside a prefix.
  * 
@@ -278,11 +473,7 @@ ssize_t Prefix6::write(uint8_t *buffer, size_t buf_sz) const {
  */
 bool Prefix6::Includes (const uint8_t prefix[16], uint8_t length, const uint8_t address[16]) {
     if (length > 128) return false;
-
-    uint8_t masked_address[16];
-    if (!mask_ipv6(address, length, masked_address)) return false;
-
-    return memcmp(prefix, masked_address, 16) == 0;
+    return IncludesWords(prefix, CIDR_MASK_MAP6[length], address);
 }
 
 /**
@@ -298,11 +489,98 @@ bool Prefix6::Includes (const uint8_t prefix[16], uint8_t length, const uint8_t
 bool Prefix6::Includes (const uint8_t prefix_a[16], uint8_t length_a, const uint8_t prefix_b[16], uint8_t length_b) {
     if (length_a > 128 || length_b > 128) return false;
     if (length_b < length_a) return false;
+    return IncludesWords(prefix_a, CIDR_MASK_MAP6[length_a], prefix_b);
+}
 
-    uint8_t masked_prefix[16];
-    if (!mask_ipv6(prefix_b, length_a, masked_prefix)) return false;
+/**
+ * @brief Test if addresses are inside a prefix.
+ * 
+ * The addresses are tested in one loop with the prefix and the netmask kept in
+ * registers. With SSE2, an address is tested with one 128 bits AND and 
+ * compare.
+ * 
+ * @param prefix The prefix.
+ * @param length The netmask of the prefix in CIDR notation.
+ * @param addresses The addresses to test against.
+ * @param count Number of addresses.
+ * @param results Array of at least count elements. results[i] is set to true
+ * if addresses[i] is in the prefix, false otherwise.
+ * @return size_t Number of addresses in the prefix.
+ */
+size_t Prefix6::IncludesBatch (const uint8_t prefix[16], uint8_t length, const uint8_t addresses[][16], size_t count, bool results[]) {
+    if (length > 128) {
+        for (size_t i = 0; i < count; i++) results[i] = false;
+        return 0;
+    }
+
+    size_t n_included = 0;
+
+#ifdef __SSE2__
+    const __m128i prefix_v = _mm_loadu_si128((const __m128i *) prefix);
+    const __m128i mask_v = _mm_loadu_si128((const __m128i *) CIDR_MASK_MAP6[length]);
+
+    for (size_t i = 0; i < count; i++) {
+        __m128i address_v = _mm_loadu_si128((const __m128i *) addresses[i]);
+        bool included = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(address_v, mask_v), prefix_v)) == 0xffff;
+        results[i] = included;
+        n_included += included;
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        bool included = IncludesWords(prefix, CIDR_MASK_MAP6[length], addresses[i]);
+        results[i] = included;
+        n_included += included;
+    }
+#endif
 
-    return memcmp(prefix_a, masked_prefix, 16) == 0;
+    return n_included;
+}
+
+/**
+ * @brief Test if prefixes are inside a prefix.
+ * 
+ * See IncludesBatch(const uint8_t[16], uint8_t, const uint8_t[][16], size_t, bool[]).
+ * 
+ * @param prefix The prefix.
+ * @param length The netmask of the prefix in CIDR notation.
+ * @param routes The prefixes to test against.
+ * @param results Array of at least routes.size() elements. results[i] is set
+ * to true if routes[i] is in the prefix, false otherwise.
+ * @return size_t Number of prefixes in the prefix.
+ */
+size_t Prefix6::IncludesBatch (const uint8_t prefix[16], uint8_t length, const std::vector<Prefix6Value> &routes, bool results[]) {
+    size_t count = routes.size();
+
+    if (length > 128) {
+        for (size_t i = 0; i < count; i++) results[i] = false;
+        return 0;
+    }
+
+    size_t n_included = 0;
+
+#ifdef __SSE2__
+    const __m128i prefix_v = _mm_loadu_si128((const __m128i *) prefix);
+    const __m128i mask_v = _mm_loadu_si128((const __m128i *) CIDR_MASK_MAP6[length]);
+
+    for (size_t i = 0; i < count; i++) {
+        const Prefix6Value &route = routes[i];
+        __m128i route_v = _mm_loadu_si128((const __m128i *) route.prefix);
+        bool included = (_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_and_si128(route_v, mask_v), prefix_v)) == 0xffff) &
+            (route.length >= length) & (route.length <= 128);
+        results[i] = included;
+        n_included += included;
+    }
+#else
+    for (size_t i = 0; i < count; i++) {
+        const Prefix6Value &route = routes[i];
+        bool included = IncludesWords(prefix, CIDR_MASK_MAP6[length], route.prefix) &
+            (route.length >= length) & (route.length <= 128);
+        results[i] = included;
+        n_included += included;
+    }
+#endif
+
+    return n_included;
 }
 
 /**
@@ -338,7 +616,7 @@ bool Prefix6::includes (const char* address) const {
  */
 bool Prefix6::includes (const Prefix &other) const {
     if (other.afi != IPV6) return false;
-    const Prefix6 &other_6 = dynamic_cast<const Prefix6 &>(other);
+    const Prefix6 &other_6 = static_cast<const Prefix6 &>(other);
     return includes(other_6.prefix, other_6.length);
 }
 
@@ -377,19 +655,30 @@ bool Prefix6::includes (const char* prefix, uint8_t length) const {
  */
 bool Prefix6::operator== (const Prefix &other) const {
     if (other.afi != IPV6) return false;
-    const Prefix6 &other_6 = dynamic_cast<const Prefix6 &>(other);
+    const Prefix6 &other_6 = static_cast<const Prefix6 &>(other);
     return memcmp(prefix, other_6.prefix, 16) == 0 && other_6.length == length;
 }
 
+/**
+ * @brief Test if two routes are equals, without going through the vtable.
+ * 
+ * @param other The other route object.
+ * @return true The routes are equal.
+ * @return false The routes are different.
+ */
+bool Prefix6::operator== (const Prefix6 &other) const {
+    return memcmp(prefix, other.prefix, 16) == 0 && other.length == length;
+}
+
 bool Prefix6::operator> (const Prefix &other) const {
     if (other.afi != IPV6) return false;
-    const Prefix6 &other_6 = dynamic_cast<const Prefix6 &>(other);
+    const Prefix6 &other_6 = static_cast<const Prefix6 &>(other);
     return length < other_6.length;
 }
 
 bool Prefix6::operator< (const Prefix &other) const {
     if (other.afi != IPV6) return false;
-    const Prefix6 &other_6 = dynamic_cast<const Prefix6 &>(other);
+    const Prefix6 &other_6 = static_cast<const Prefix6 &>(other);
     return length > other_6.length;
 }
 
@@ -471,4 +760,113 @@ void Prefix6::getMask(uint8_t mask[16]) const {
     cidr_to_mask6(length, mask);
 }
 
-}
\ No newline at end of file
+
+/**
+ * @brief Get the prefix as a prefix value.
+ * 
+ * @return Prefix6Value The prefix value.
+ */
+Prefix6Value Prefix6::toValue() const {
+    return Prefix6Value(prefix, length);
+}
+
+/**
+ * @brief Construct a new Prefix6Value object.
+ * 
+ * @param prefix Prefix as bytes array.
+ * @param length Netmask of the prefix in CIDR notation.
+ */
+Prefix6Value::Prefix6Value(const uint8_t prefix[16], uint8_t length) {
+    memcpy(this->prefix, prefix, 16);
+    this->length = length;
+}
+
+/**
+ * @brief Test if two prefix values are equals.
+ * 
+ * @param other The other prefix value.
+ * @return true The prefixes are equal.
+ * @return false The prefixes are different.
+ */
+bool Prefix6Value::operator== (const Prefix6Value &other) const {
+    return memcmp(prefix, other.prefix, 16) == 0 && length == other.length;
+}
+
+bool Prefix6Value::operator!= (const Prefix6Value &other) const {
+    return !(*this == other);
+}
+
+/**
+ * @brief Test if another prefix is inside this prefix.
+ * 
+ * @param other The other prefix.
+ * @return true The other prefix is in this prefix.
+ * @return false The other prefix is not in this prefix.
+ */
+bool Prefix6Value::includes (const Prefix6Value &other) const {
+    return Prefix6::Includes(prefix, length, other.prefix, other.length);
+}
+
+/**
+ * @brief Get the prefix.
+ * 
+ * @param prefix Buffer to write the prefix to.
+ */
+void Prefix6Value::getPrefix(uint8_t prefix[16]) const {
+    memcpy(prefix, this->prefix, 16);
+}
+
+/**
+ * @brief Hash a prefix value.
+ * 
+ * @param value The prefix value.
+ * @return std::size_t The hash.
+ */
+std::size_t Prefix6ValueHash::operator()(const Prefix6Value &value) const {
+    uint64_t words[2];
+    memcpy(words, value.prefix, 16);
+    return (words[0] ^ (words[1] * 0x9e3779b97f4a7c15ULL)) ^ value.length;
+}
+
+
+/**
+ * @brief Get the prefix as 64 bits words.
+ * 
+ * @return Prefix6Words The prefix as words.
+ */
+Prefix6Words Prefix6::toWords() const {
+    return Prefix6Words(prefix, length);
+}
+
+/**
+ * @brief Construct a new Prefix6Words object.
+ * 
+ * @param prefix Prefix as bytes array.
+ * @param length Netmask of the prefix in CIDR notation.
+ */
+Prefix6Words::Prefix6Words(const uint8_t prefix[16], uint8_t length) {
+    uint64_t words[2];
+    memcpy(words, prefix, 16);
+    high = be64toh(words[0]);
+    low = be64toh(words[1]);
+    this->length = length;
+}
+
+/**
+ * @brief Construct a new Prefix6Words object from a prefix value.
+ * 
+ * @param value The prefix value.
+ */
+Prefix6Words::Prefix6Words(const Prefix6Value &value) : Prefix6Words(value.prefix, value.length) {}
+
+/**
+ * @brief Write the address to bytes array.
+ * 
+ * @param prefix Bytes array to store the prefix.
+ */
+void Prefix6Words::getPrefix(uint8_t prefix[16]) const {
+    uint64_t words[2] = { htobe64(high), htobe64(low) };
+    memcpy(prefix, words, 16);
+}
+
+}
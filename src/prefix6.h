@@ -12,6 +12,7 @@
 #define BGP_PREFIX6_H_
 #include <stdint.h>
 #include <unistd.h>
+#include <vector>
 #include "prefix.h"
 
 namespace libbgp {
@@ -20,6 +21,121 @@ bool cidr_to_mask6(uint8_t src, uint8_t dst[16]);
 bool mask_ipv6(const uint8_t prefix[16], uint8_t mask, uint8_t masked_addr[16]);
 bool v6addr_is_zero(const uint8_t prefix[16]);
 
+/**
+ * @brief An IPv6 prefix as a plain value.
+ * 
+ * Prefix6Value holds the same prefix as Prefix6, without the vtable and the
+ * address family of the Prefix base class. It is trivially copyable, 17 bytes
+ * instead of 32, and can be built in constant expressions from the two 64
+ * bits halves of the address, so it is what large tables of prefixes should be
+ * stored as: the RIB entries and the Adj-RIB-In hold it. Prefix6 converts from
+ * and to it, and is what the filters, NLRI and withdrawn routes lists take.
+ */
+struct Prefix6Value {
+    Prefix6Value() = default;
+    constexpr Prefix6Value(uint64_t high, uint64_t low, uint8_t length) : prefix {
+        (uint8_t) (high >> 56), (uint8_t) (high >> 48), (uint8_t) (high >> 40), (uint8_t) (high >> 32),
+        (uint8_t) (high >> 24), (uint8_t) (high >> 16), (uint8_t) (high >> 8), (uint8_t) high,
+        (uint8_t) (low >> 56), (uint8_t) (low >> 48), (uint8_t) (low >> 40), (uint8_t) (low >> 32),
+        (uint8_t) (low >> 24), (uint8_t) (low >> 16), (uint8_t) (low >> 8), (uint8_t) low
+    }, length(length) {}
+    Prefix6Value(const uint8_t prefix[16], uint8_t length);
+
+    bool operator== (const Prefix6Value &other) const;
+    bool operator!= (const Prefix6Value &other) const;
+
+    // test if route other is sub-prefix
+    bool includes (const Prefix6Value &other) const;
+
+    // same accessors as Prefix6
+    void getPrefix(uint8_t prefix[16]) const;
+    uint8_t getLength() const { return length; }
+
+    /**
+     * @brief The prefix.
+     * 
+     */
+    uint8_t prefix[16];
+
+    /**
+     * @brief The netmask in CIDR notation.
+     * 
+     */
+    uint8_t length;
+};
+
+/**
+ * @brief Hasher for Prefix6Value.
+ * 
+ */
+struct Prefix6ValueHash {
+    std::size_t operator()(const Prefix6Value &value) const;
+};
+
+/**
+ * @brief An IPv6 prefix as two 64 bits words.
+ * 
+ * Prefix6Words is the fast path for IPv6 prefix math. The address is held as
+ * two 64 bits words in host byte order (high is the first 8 bytes of the
+ * address), so masking, containment and equality are a few integer operations
+ * on registers, and comparing the words compares the addresses. Load it from
+ * bytes once, and test it against many prefixes.
+ */
+struct Prefix6Words {
+    Prefix6Words() = default;
+    constexpr Prefix6Words(uint64_t high, uint64_t low, uint8_t length) : high(high), low(low), length(length) {}
+    Prefix6Words(const uint8_t prefix[16], uint8_t length);
+    Prefix6Words(const Prefix6Value &value);
+
+    // get netmask of the high/low word. length must be <= 128.
+    static constexpr uint64_t MaskHigh(uint8_t length) {
+        return length == 0 ? 0 : length >= 64 ? ~0ULL : ~0ULL << (64 - length);
+    }
+
+    static constexpr uint64_t MaskLow(uint8_t length) {
+        return length <= 64 ? 0 : ~0ULL << (128 - length);
+    }
+
+    // test if address in prefix
+    constexpr bool includes (uint64_t high, uint64_t low) const {
+        return ((high & MaskHigh(length)) == this->high) & ((low & MaskLow(length)) == this->low);
+    }
+
+    // test if route other is sub-prefix
+    constexpr bool includes (const Prefix6Words &other) const {
+        return other.length >= length && includes(other.high, other.low);
+    }
+
+    constexpr bool operator== (const Prefix6Words &other) const {
+        return high == other.high && low == other.low && length == other.length;
+    }
+
+    constexpr bool operator!= (const Prefix6Words &other) const {
+        return !(*this == other);
+    }
+
+    // write the address to bytes array
+    void getPrefix(uint8_t prefix[16]) const;
+
+    /**
+     * @brief First 8 bytes of the address, in host byte order.
+     * 
+     */
+    uint64_t high;
+
+    /**
+     * @brief Last 8 bytes of the address, in host byte order.
+     * 
+     */
+    uint64_t low;
+
+    /**
+     * @brief The netmask in CIDR notation.
+     * 
+     */
+    uint8_t length;
+};
+
 /**
  * @brief IPv6 Route/Prefix related utilities.
  * 
@@ -29,14 +145,29 @@ public:
     Prefix6();
     Prefix6(const uint8_t prefix[16], uint8_t length);
     Prefix6(const char* prefix, uint8_t length);
+    Prefix6(const Prefix6Value &value);
 
     ssize_t parse(const uint8_t *buffer, size_t buf_sz);
     ssize_t write(uint8_t *buffer, size_t buf_sz) const;
 
+    // batch decode/encode packed prefix list (MP_REACH / MP_UNREACH)
+    static ssize_t ParseList(const uint8_t *buffer, size_t buf_sz, std::vector<Prefix6> &routes);
+    static ssize_t WriteList(const std::vector<Prefix6> &routes, uint8_t *buffer, size_t buf_sz);
+    static ssize_t ParseList(const uint8_t *buffer, size_t buf_sz, std::vector<Prefix6Value> &routes);
+    static ssize_t WriteList(const std::vector<Prefix6Value> &routes, uint8_t *buffer, size_t buf_sz);
+
+    // convert between prefixes and prefix values
+    static void ToValues(const std::vector<Prefix6> &routes, std::vector<Prefix6Value> &values);
+    static void FromValues(const std::vector<Prefix6Value> &values, std::vector<Prefix6> &routes);
+
     // static utility functions for route include test
     static bool Includes (const uint8_t prefix[16], uint8_t length, const uint8_t address[16]);
     static bool Includes (const uint8_t prefix_a[16], uint8_t length_a, const uint8_t prefix_b[16], uint8_t length_b);
 
+    // batch include test: test a prefix against an array of addresses/prefixes
+    static size_t IncludesBatch (const uint8_t prefix[16], uint8_t length, const uint8_t addresses[][16], size_t count, bool results[]);
+    static size_t IncludesBatch (const uint8_t prefix[16], uint8_t length, const std::vector<Prefix6Value> &routes, bool results[]);
+
     // test if address in prefix
     bool includes (const uint8_t address[16]) const;
     bool includes (const char* address) const;
@@ -48,6 +179,7 @@ public:
 
     // test if length & prefix equals to other
     bool operator== (const Prefix &other) const;
+    bool operator== (const Prefix6 &other) const;
 
     // test if length smaller (prefix size bigger) then other. prefix must be
     // same to do this.
@@ -67,12 +199,25 @@ public:
     void getPrefix(uint8_t prefix[16]) const;
     uint8_t getLength() const;
     void getMask(uint8_t mask[16]) const;
+    Prefix6Value toValue() const;
+    Prefix6Words toWords() const;
 
 private:
+    template <typename T> static ssize_t DoParseList(const uint8_t *buffer, size_t buf_sz, std::vector<T> &routes);
+    template <typename T> static ssize_t DoWriteList(const std::vector<T> &routes, uint8_t *buffer, size_t buf_sz);
+
     uint8_t length;
     uint8_t prefix[16];
 };
 
+
+/**
+ * @example prefix6-includes.cc
+ * Example of testing IPv6 addresses against prefixes with Prefix6::Includes,
+ * Prefix6Words and Prefix6::IncludesBatch. This example also benchmarks them
+ * against a byte-by-byte include test.
+ */
+
 }
 
 #endif // BGP_PREFIX6_H_
\ No newline at end of file
@@ -76,8 +76,12 @@ public:
     /**
      * @brief Pointer to the route replacement entries vector.
      * 
+     * The entries are copies of the RIB entries, taken when the change was
+     * made. The RIB is not locked while publishing, and may have changed
+     * again since. The copies stay valid until the handler returns. Do not
+     * keep the pointers after that.
      */
-    const std::vector<BgpRib4Entry> *replaced_entries;
+    const std::vector<const BgpRib4Entry*> *replaced_entries;
 
     /**
      * @brief ASN of the IBGP peer if the originating session is a IBGP session.
@@ -124,7 +128,7 @@ public:
      * @brief Path attribues of the route.
      * 
      */
-    std::vector<std::shared_ptr<BgpPathAttrib>> *shared_attribs;
+    const std::vector<std::shared_ptr<BgpPathAttrib>> *shared_attribs;
 
     /**
      * @brief Routes to add.
@@ -135,8 +139,12 @@ public:
     /**
      * @brief Pointer to the route replacement entries vector.
      * 
+     * The entries are copies of the RIB entries, taken when the change was
+     * made. The RIB is not locked while publishing, and may have changed
+     * again since. The copies stay valid until the handler returns. Do not
+     * keep the pointers after that.
      */
-    const std::vector<BgpRib6Entry> *replaced_entries;
+    const std::vector<const BgpRib6Entry*> *replaced_entries;
 
     /**
      * @brief Global IPv6 nexthop.